@@ -16,6 +16,7 @@ build () {
     make MQTTSNPacket
     make MQTT-SNGateway
     make MQTT-SNLogmonitor
+    make MQTT-SNTracedecoder
     popd
     cp *.conf ./$ODIR
 }
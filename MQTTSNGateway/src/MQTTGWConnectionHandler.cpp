@@ -75,10 +75,42 @@ void MQTTGWConnectionHandler::handleConnack(Client* client, MQTTGWPacket* packet
     ev1->setClientSendEvent(client, snPacket);
     client->connackSended(rc);  // update the client's status
     _gateway->getClientSendQue()->post(ev1);
+
+    /* topic filters shared by aggregated clients */
+    if (rc == MQTTSN_RC_ACCEPTED && client->isAggregater())
+    {
+        _gateway->getAdapterManager()->getAggregater()->resubscribe(client);
+    }
+
+    /* TopicIds of the persistent session are registered before saved PUBLISHes */
+    if (rc == MQTTSN_RC_ACCEPTED && !client->isCleanSession() && !client->isAdapter())
+    {
+        client->getWaitREGACKPacketList()->sendTopics(_gateway->getClientSendQue());
+        client->getInflightWindow()->resume(_gateway->getClientSendQue());
+    }
+
+    /* PUBLISHes saved in the session restored by the SessionStore */
+    if (rc == MQTTSN_RC_ACCEPTED)
+    {
+        MQTTGWPacket* msg = nullptr;
+        while ((msg = client->getClientSleepPacket()) != nullptr)
+        {
+            client->deleteFirstClientSleepPacket();
+            Event* ev = new Event();
+            ev->setBrokerRecvEvent(client, msg);
+            _gateway->getPacketEventQue()->post(ev);
+        }
+    }
 }
 
 void MQTTGWConnectionHandler::handlePingresp(Client* client, MQTTGWPacket* packet)
 {
+    /* the response of the PINGREQ sent by sendKeepAlive( ) */
+    if (!client->isPingrespForwardable())
+    {
+        return;
+    }
+
     MQTTSNPacket* snPacket = new MQTTSNPacket();
     snPacket->setPINGRESP();
     Event* ev1 = new Event();
@@ -96,3 +128,26 @@ void MQTTGWConnectionHandler::handleDisconnect(Client* client, MQTTGWPacket* pac
     Event* ev1 = new Event();
     ev1->setClientSendEvent(client, snPacket);
 }
+
+/*
+ *  Send a PINGREQ to the broker on each connection which has been idle for its keep alive interval.
+ *  PINGREQs of clients are answered by the gateway while the connection is alive.
+ */
+void MQTTGWConnectionHandler::sendKeepAlive(void)
+{
+    Client* client = _gateway->getClientList()->getClient(0);
+
+    while (client)
+    {
+        if (client->isBrokerPingreqRequired())
+        {
+            client->brokerPacketSended();
+            MQTTGWPacket* pingreq = new MQTTGWPacket();
+            pingreq->setHeader(PINGREQ);
+            Event* ev = new Event();
+            ev->setBrokerSendEvent(client, pingreq);
+            _gateway->getBrokerSendQue()->post(ev);
+        }
+        client = client->getNextClient();
+    }
+}
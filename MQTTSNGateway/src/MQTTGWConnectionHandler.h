@@ -31,6 +31,7 @@ public:
     void handleConnack(Client* client, MQTTGWPacket* packet);
     void handlePingresp(Client* client, MQTTGWPacket* packet);
     void handleDisconnect(Client* client, MQTTGWPacket* packet);
+    void sendKeepAlive(void);
 private:
     Gateway* _gateway;
 };
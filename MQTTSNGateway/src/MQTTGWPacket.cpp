@@ -16,8 +16,12 @@
  **************************************************************************************/
 
 #include "MQTTGWPacket.h"
+#include "MQTTSNGWProcess.h"
+#include "MQTTSNGWBufferPool.h"
 #include <string>
 #include <string.h>
+#include <atomic>
+#include <new>
 
 using namespace MQTTSNGW;
 
@@ -161,6 +165,52 @@ void writeUTF(unsigned char** pptr, const char* string)
     *pptr += len;
 }
 
+/**
+ * Data of MQTTGWPacket is preceded by a reference counter.
+ * Copies of a packet share one buffer which is treated as immutable.
+ */
+typedef struct
+{
+    std::atomic<int> refcnt;
+} PacketDataHeader;
+
+static unsigned char* allocData(int len)
+{
+    PacketDataHeader* hdr = (PacketDataHeader*) BufferPool::allocate(sizeof(PacketDataHeader) + len);
+    if (hdr == nullptr)
+    {
+        return nullptr;
+    }
+    new (&hdr->refcnt) std::atomic<int>(1);
+    return (unsigned char*) (hdr + 1);
+}
+
+static void retainData(unsigned char* data)
+{
+    if (data)
+    {
+        PacketDataHeader* hdr = (PacketDataHeader*) data - 1;
+        hdr->refcnt.fetch_add(1);
+    }
+}
+
+static void releaseData(unsigned char* data)
+{
+    if (data)
+    {
+        PacketDataHeader* hdr = (PacketDataHeader*) data - 1;
+        if (hdr->refcnt.fetch_sub(1) == 1)
+        {
+            BufferPool::release((unsigned char*) hdr);
+        }
+    }
+}
+
+static bool isSharedData(unsigned char* data)
+{
+    return data && ((PacketDataHeader*) data - 1)->refcnt.load() > 1;
+}
+
 /**
  * Lapper class of MQTTPacket
  *
@@ -174,10 +224,7 @@ MQTTGWPacket::MQTTGWPacket()
 
 MQTTGWPacket::~MQTTGWPacket()
 {
-    if (_data)
-    {
-        free(_data);
-    }
+    releaseData(_data);
 }
 
 int MQTTGWPacket::recv(Network* network)
@@ -211,7 +258,7 @@ int MQTTGWPacket::recv(Network* network)
     if (_remainingLength > 0)
     {
         /* allocate buffer */
-        _data = (unsigned char*) calloc(_remainingLength, 1);
+        _data = allocData(_remainingLength);
         if (!_data)
         {
             return -3;
@@ -323,7 +370,7 @@ int MQTTGWPacket::setCONNECT(Connect* connect, unsigned char* username, unsigned
         _remainingLength += (int) strlen((char*) password) + 2;
     }
 
-    _data = (unsigned char*) calloc(_remainingLength, 1);
+    _data = allocData(_remainingLength);
     unsigned char* ptr = _data;
 
     if (connect->version == 3)
@@ -368,7 +415,7 @@ int MQTTGWPacket::setSUBSCRIBE(const char* topic, unsigned char qos, unsigned sh
     _header.bits.type = SUBSCRIBE;
     _header.bits.qos = 1;          // Reserved
     _remainingLength = (int) strlen(topic) + 5;
-    _data = (unsigned char*) calloc(_remainingLength, 1);
+    _data = allocData(_remainingLength);
     if (_data)
     {
         unsigned char* ptr = _data;
@@ -388,7 +435,7 @@ int MQTTGWPacket::setUNSUBSCRIBE(const char* topic, unsigned short msgid)
     _header.bits.type = UNSUBSCRIBE;
     _header.bits.qos = 1;
     _remainingLength = (int) strlen(topic) + 4;
-    _data = (unsigned char*) calloc(_remainingLength, 1);
+    _data = allocData(_remainingLength);
     if (_data)
     {
         unsigned char* ptr = _data;
@@ -407,7 +454,7 @@ int MQTTGWPacket::setPUBLISH(Publish* pub)
     _header.byte = pub->header.byte;
     _header.bits.type = PUBLISH;
     _remainingLength = 4 + pub->topiclen + pub->payloadlen;
-    _data = (unsigned char*) calloc(_remainingLength, 1);
+    _data = allocData(_remainingLength);
     if (_data)
     {
         unsigned char* ptr = _data;
@@ -439,7 +486,7 @@ int MQTTGWPacket::setAck(unsigned char msgType, unsigned short msgid)
     _header.bits.type = msgType;
     _header.bits.qos = (msgType == PUBREL) ? 1 : 0;
 
-    _data = (unsigned char*) calloc(_remainingLength, 1);
+    _data = allocData(_remainingLength);
     if (_data)
     {
         unsigned char* data = _data;
@@ -467,7 +514,12 @@ int MQTTGWPacket::getType(void)
 
 const char* MQTTGWPacket::getName(void)
 {
-    return getType() > DISCONNECT ? "UNKNOWN" : mqtt_packet_names[getType()];
+    return getTypeName(getType());
+}
+
+const char* MQTTGWPacket::getTypeName(int type)
+{
+    return (type < 0 || type > DISCONNECT) ? "UNKNOWN" : mqtt_packet_names[type];
 }
 
 int MQTTGWPacket::getPacketData(unsigned char* buf)
@@ -488,14 +540,27 @@ int MQTTGWPacket::getPacketLength(void)
 
 void MQTTGWPacket::clearData(void)
 {
-    if (_data)
-    {
-        free(_data);
-    }
+    releaseData(_data);
+    _data = nullptr;
     _header.byte = 0;
     _remainingLength = 0;
 }
 
+void MQTTGWPacket::makeWritable(void)
+{
+    /* copy on write */
+    if (isSharedData(_data))
+    {
+        unsigned char* data = allocData(_remainingLength);
+        if (data)
+        {
+            memcpy(data, _data, _remainingLength);
+        }
+        releaseData(_data);
+        _data = data;
+    }
+}
+
 char* MQTTGWPacket::getMsgId(char* pbuf)
 {
     int type = getType();
@@ -570,6 +635,12 @@ void MQTTGWPacket::setMsgId(int msgId)
     int type = getType();
     unsigned char* ptr = 0;
 
+    makeWritable();
+    if (_data == nullptr)
+    {
+        return;
+    }
+
     switch (type)
     {
     case PUBLISH:
@@ -603,33 +674,51 @@ void MQTTGWPacket::setMsgId(int msgId)
 char* MQTTGWPacket::print(char* pbuf)
 {
     uint8_t packetData[MQTTSNGW_MAX_PACKET_SIZE];
-    char* ptr = pbuf;
-    char** pptr = &pbuf;
     int len = getPacketData(packetData);
     int size = len > SIZE_OF_LOG_PACKET ? SIZE_OF_LOG_PACKET : len;
-    for (int i = 0; i < size; i++)
+    return hexDump(pbuf, packetData, size);
+}
+
+int MQTTGWPacket::getLogCategory(void)
+{
+    switch (_header.bits.type)
     {
-        sprintf(*pptr, " %02X", packetData[i]);
-        *pptr += 3;
+    case CONNECT:
+    case CONNACK:
+    case DISCONNECT:
+        return LOG_CATEGORY_CONNECT;
+    case PUBLISH:
+    case SUBSCRIBE:
+    case UNSUBSCRIBE:
+        return LOG_CATEGORY_PUBLISH;
+    case PUBACK:
+    case PUBREC:
+    case PUBREL:
+    case PUBCOMP:
+    case SUBACK:
+    case UNSUBACK:
+        return LOG_CATEGORY_ACK;
+    case PINGREQ:
+    case PINGRESP:
+        return LOG_CATEGORY_PING;
+    default:
+        return LOG_CATEGORY_ALL;     // logged unless all categories are disabled
     }
-    **pptr = 0;
-    return ptr;
 }
 
 MQTTGWPacket& MQTTGWPacket::operator =(MQTTGWPacket& packet)
 {
+    if (this == &packet)
+    {
+        return *this;
+    }
+
+    /* share the data with the packet instead of copying it */
+    retainData(packet._data);
     clearData();
     this->_header.byte = packet._header.byte;
     this->_remainingLength = packet._remainingLength;
-    _data = (unsigned char*) calloc(_remainingLength, 1);
-    if (_data)
-    {
-        memcpy(this->_data, packet._data, _remainingLength);
-    }
-    else
-    {
-        clearData();
-    }
+    _data = packet._data;
     return *this;
 }
 
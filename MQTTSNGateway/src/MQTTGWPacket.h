@@ -216,6 +216,7 @@ public:
     int getPacketData(unsigned char* buf);
     int getPacketLength(void);
     const char* getName(void);
+    static const char* getTypeName(int type);
 
     int getAck(Ack* ack);
     int getCONNACK(Connack* resp);
@@ -236,10 +237,12 @@ public:
     int getMsgId(void);
     void setMsgId(int msgId);
     char* print(char* buf);
+    int getLogCategory(void);
     MQTTGWPacket& operator =(MQTTGWPacket& packet);
 
 private:
     void clearData(void);
+    void makeWritable(void);
     Header _header;
     int _remainingLength;
     unsigned char* _data;
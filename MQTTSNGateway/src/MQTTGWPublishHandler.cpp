@@ -37,21 +37,36 @@ MQTTGWPublishHandler::~MQTTGWPublishHandler()
 
 void MQTTGWPublishHandler::handlePublish(Client* client, MQTTGWPacket* packet)
 {
-    if (!client->isActive() && !client->isSleep() && !client->isAwake())
+    if (!client->isActive() && !client->isSleep() && !client->isAwake() && !client->isSessionKept())
     {
         WRITELOG("%s     The client is neither active nor sleep %s%s\n",
         ERRMSG_HEADER, client->getStatus(), ERRMSG_FOOTER);
         return;
     }
 
-    /* client is sleeping. save PUBLISH */
-    if (client->isSleep())
+    Publish pub;
+    packet->getPUBLISH(&pub);
+
+    /* the retained message has been sent from the RetainedCache. a saved one is checked when it is sent */
+    if (!client->isSleep() && !client->isSessionKept() && _gateway->getRetainedCache()->isDelivered(client, &pub))
     {
-        Publish pub;
-        packet->getPUBLISH(&pub);
+        if (pub.header.bits.qos == 1)
+        {
+            replyACK(client, &pub, PUBACK);
+        }
+        else if (pub.header.bits.qos == 2)
+        {
+            replyACK(client, &pub, PUBREC);
+        }
+        return;
+    }
 
+    /* client is sleeping or lost while its session is kept. save PUBLISH */
+    if (client->isSleep() || client->isSessionKept())
+    {
         WRITELOG(FORMAT_Y_G_G, currentDateTime(), packet->getName(),
-        RIGHTARROW, client->getClientId(), "is sleeping. a message was saved.");
+        RIGHTARROW, client->getClientId(),
+                client->isSleep() ? "is sleeping. a message was saved." : "is lost. a message was saved.");
 
         if (pub.header.bits.qos == 1)
         {
@@ -62,22 +77,11 @@ void MQTTGWPublishHandler::handlePublish(Client* client, MQTTGWPacket* packet)
             replyACK(client, &pub, PUBREC);
         }
 
-        MQTTGWPacket* msg = new MQTTGWPacket();
-        *msg = *packet;
-        if (msg->getType() == 0)
-        {
-            WRITELOG("%s MQTTGWPublishHandler::handlePublish can't allocate memories for Packet.%s\n",
-            ERRMSG_HEADER, ERRMSG_FOOTER);
-            delete msg;
-            return;
-        }
-        client->setClientSleepPacket(msg);
+        /* the store keeps a copy within the budget */
+        client->setClientSleepPacket(packet);
         return;
     }
 
-    Publish pub;
-    packet->getPUBLISH(&pub);
-
     MQTTSNPacket* snPacket = new MQTTSNPacket();
 
     /* create MQTTSN_topicid */
@@ -147,26 +151,14 @@ void MQTTGWPublishHandler::handlePublish(Client* client, MQTTGWPacket* packet)
             id = topic->getTopicId();
             if (id > 0)
             {
-                /* create REGISTER */
-                MQTTSNPacket* regPacket = new MQTTSNPacket();
-
-                MQTTSNString topicName = MQTTSNString_initializer;
-                topicName.lenstring.len = topicId.data.long_.len;
-                topicName.lenstring.data = topicId.data.long_.name;
+                /* send REGISTER without waiting REGACKs of other topics */
+                client->getWaitREGACKPacketList()->send(topic, _gateway->getClientSendQue());
 
-                uint16_t regackMsgId = client->getNextSnMsgId();
-                regPacket->setREGISTER(id, regackMsgId, &topicName);
-
-                /* send REGISTER */
-                Event* evrg = new Event();
-                evrg->setClientSendEvent(client, regPacket);
-                _gateway->getClientSendQue()->post(evrg);
-
-                /* send PUBLISH */
+                /* PUBLISH waits for the REGACK */
                 topicId.data.id = id;
                 snPacket->setPUBLISH((uint8_t) pub.header.bits.dup, (int) pub.header.bits.qos, (uint8_t) pub.header.bits.retain,
                         (uint16_t) pub.msgId, topicId, (uint8_t*) pub.payload, pub.payloadlen);
-                client->getWaitREGACKPacketList()->setPacket(snPacket, regackMsgId);
+                client->getWaitREGACKPacketList()->setPacket(snPacket, id);
                 return;
             }
             else
@@ -181,14 +173,26 @@ void MQTTGWPublishHandler::handlePublish(Client* client, MQTTGWPacket* packet)
 
     snPacket->setPUBLISH((uint8_t) pub.header.bits.dup, (int) pub.header.bits.qos, (uint8_t) pub.header.bits.retain,
             (uint16_t) pub.msgId, topicId, (uint8_t*) pub.payload, pub.payloadlen);
-    Event* ev1 = new Event();
-    ev1->setClientSendEvent(client, snPacket);
-    _gateway->getClientSendQue()->post(ev1);
 
+    /* the REGISTER of the topic is not acknowledged yet */
+    if (topicId.type == MQTTSN_TOPIC_TYPE_NORMAL
+            && client->getWaitREGACKPacketList()->setPacket(snPacket, topicId.data.id))
+    {
+        return;
+    }
+
+    /* QoS1 and QoS2 PUBLISHes are retransmitted until they are acknowledged */
+    client->getInflightWindow()->send(snPacket, _gateway->getClientSendQue());
 }
 
 void MQTTGWPublishHandler::replyACK(Client* client, Publish* pub, int type)
 {
+    /* PUBLISHes of shared subscriptions are acknowledged once by handleAggregatePublish( ) */
+    if (client->isAggregated() || _gateway->getAdapterManager()->isSharedSubscriber(client))
+    {
+        return;
+    }
+
     MQTTGWPacket* pubAck = new MQTTGWPacket();
     pubAck->setAck(type, (uint16_t) pub->msgId);
     Event* ev1 = new Event();
@@ -200,6 +204,7 @@ void MQTTGWPublishHandler::handlePuback(Client* client, MQTTGWPacket* packet)
 {
     Ack ack;
     packet->getAck(&ack);
+    client->getUplinkWindow()->acknowledge((uint16_t) ack.msgId, _gateway->getBrokerSendQue());
     TopicIdMapElement* topicId = client->getWaitedPubTopicId((uint16_t) ack.msgId);
     if (topicId)
     {
@@ -221,8 +226,18 @@ void MQTTGWPublishHandler::handleAck(Client* client, MQTTGWPacket* packet, int t
     Ack ack;
     packet->getAck(&ack);
 
+    if (type == PUBCOMP)
+    {
+        client->getUplinkWindow()->acknowledge((uint16_t) ack.msgId, _gateway->getBrokerSendQue());
+    }
+
     if (client->isActive() || client->isAwake())
     {
+        if (type == PUBREL && client->getInflightWindow()->sendPubrel((uint16_t) ack.msgId, _gateway->getClientSendQue()))
+        {
+            return;
+        }
+
         MQTTSNPacket* mqttsnPacket = new MQTTSNPacket();
         if (type == PUBREC)
         {
@@ -241,7 +256,7 @@ void MQTTGWPublishHandler::handleAck(Client* client, MQTTGWPacket* packet, int t
         ev1->setClientSendEvent(client, mqttsnPacket);
         _gateway->getClientSendQue()->post(ev1);
     }
-    else if (client->isSleep())
+    else if (client->isSleep() || client->isSessionKept())
     {
         if (type == PUBREL)
         {
@@ -259,7 +274,9 @@ void MQTTGWPublishHandler::handleAggregatePuback(Client* client, MQTTGWPacket* p
     uint16_t msgId = packet->getMsgId();
     uint16_t clientMsgId = 0;
     Client* newClient = _gateway->getAdapterManager()->convertClient(msgId, &clientMsgId);
-    if (newClient != nullptr)
+
+    /* clientMsgId is 0 for a PUBLISH which the gateway made, like a will */
+    if (newClient != nullptr && clientMsgId > 0)
     {
         packet->setMsgId((int) clientMsgId);
         handlePuback(newClient, packet);
@@ -290,31 +307,32 @@ void MQTTGWPublishHandler::handleAggregatePublish(Client* client, MQTTGWPacket*
     Publish pub;
     packet->getPUBLISH(&pub);
 
-    string* topicName = new string(pub.topic, pub.topiclen); // topic deletes topicName when the topic is deleted
-    Topic topic = Topic(topicName, MQTTSN_TOPIC_TYPE_NORMAL);
-
-    // ToDo: need to refactor
-    ClientTopicElement* elm = _gateway->getAdapterManager()->getAggregater()->getClientElement(&topic);
+    Aggregater* aggregater = _gateway->getAdapterManager()->getAggregater();
+    ClientVector clients;
+    aggregater->getClients(pub.topic, pub.topiclen, &clients);
 
-    while (elm != nullptr)
+    /*
+     * Expand the fan-out here instead of posting a copy of the packet per client.
+     * Packets saved for sleeping clients share the data of this packet.
+     */
+    for (size_t i = 0; i < clients.size(); i++)
     {
-        Client* devClient = elm->getClient();
-        MQTTGWPacket* msg = new MQTTGWPacket();
-        *msg = *packet;
-
-        if (msg->getType() == 0)
+        /* retained messages are for the clients of the last SUBSCRIBE. others have received them */
+        if (pub.header.bits.retain && !aggregater->isRetainedFor(clients[i], pub.topic, pub.topiclen))
         {
-            WRITELOG("%s MQTTGWPublishHandler::handleAggregatePublish can't allocate memories for Packet.%s\n",
-            ERRMSG_HEADER, ERRMSG_FOOTER);
-            delete msg;
-            break;
+            continue;
         }
+        handlePublish(clients[i], packet);
+    }
 
-        Event* ev = new Event();
-        ev->setBrokerRecvEvent(devClient, msg);
-        _gateway->getPacketEventQue()->post(ev);
-
-        elm = elm->getNextClientElement();
+    /* the gateway delivers it to clients by itself */
+    if (pub.header.bits.qos == 1)
+    {
+        replyACK(client, &pub, PUBACK);
+    }
+    else if (pub.header.bits.qos == 2)
+    {
+        replyACK(client, &pub, PUBREC);
     }
 }
 
@@ -34,10 +34,16 @@ void MQTTGWSubscribeHandler::handleSuback(Client* client, MQTTGWPacket* packet)
 {
     uint16_t msgId;
     uint8_t rc;
+
+    packet->getSUBACK(&msgId, &rc);
+    sendSuback(client, msgId, rc);
+}
+
+void MQTTGWSubscribeHandler::sendSuback(Client* client, uint16_t msgId, uint8_t rc)
+{
     uint8_t returnCode;
     int qos = 0;
 
-    packet->getSUBACK(&msgId, &rc);
     TopicIdMapElement* topicId = client->getWaitedSubTopicId(msgId);
 
     if (topicId)
@@ -57,6 +63,12 @@ void MQTTGWSubscribeHandler::handleSuback(Client* client, MQTTGWPacket* packet)
         Event* evt = new Event();
         evt->setClientSendEvent(client, snPacket);
         _gateway->getClientSendQue()->post(evt);
+
+        if (returnCode == MQTTSN_RC_ACCEPTED)
+        {
+            /* the broker has accepted it, so the client is allowed to receive the retained message */
+            _gateway->getRetainedCache()->answer(client, topicId, _gateway->getClientSendQue(), true);
+        }
         client->eraseWaitedSubTopicId(msgId);
     }
 }
@@ -74,14 +86,28 @@ void MQTTGWSubscribeHandler::handleUnsuback(Client* client, MQTTGWPacket* packet
 
 void MQTTGWSubscribeHandler::handleAggregateSuback(Client* client, MQTTGWPacket* packet)
 {
-    uint16_t msgId = packet->getMsgId();
+    uint16_t msgId;
+    uint8_t rc;
     uint16_t clientMsgId = 0;
+
+    std::vector<SubscribingClient> joined;
+
+    packet->getSUBACK(&msgId, &rc);
+    _gateway->getAdapterManager()->getAggregater()->subscribed(msgId, rc, &joined);
+
     Client* newClient = _gateway->getAdapterManager()->getAggregater()->convertClient(msgId, &clientMsgId);
     if (newClient != nullptr)
     {
         packet->setMsgId((int) clientMsgId);
         handleSuback(newClient, packet);
     }
+
+    /* clients which joined the SUBSCRIBE are granted their QoS at most */
+    for (size_t i = 0; i < joined.size(); i++)
+    {
+        uint8_t qos = (rc != 0x80 && joined[i].qos < rc) ? joined[i].qos : rc;
+        sendSuback(joined[i].client, joined[i].msgId, qos);
+    }
 }
 
 void MQTTGWSubscribeHandler::handleAggregateUnsuback(Client* client, MQTTGWPacket* packet)
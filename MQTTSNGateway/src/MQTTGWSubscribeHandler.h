@@ -35,6 +35,7 @@ public:
     void handleAggregateUnsuback(Client* client, MQTTGWPacket* packet);
 
 private:
+    void sendSuback(Client* client, uint16_t msgId, uint8_t rc);
     Gateway* _gateway;
 };
 
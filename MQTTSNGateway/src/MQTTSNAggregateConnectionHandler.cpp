@@ -64,6 +64,7 @@ void MQTTSNAggregateConnectionHandler::handleConnect(Client* client, MQTTSNPacke
     memset(connectData, 0, sizeof(Connect));
 
     client->disconnected();
+    client->setWillFlg(false);
 
     Topics* topics = client->getTopics();
 
@@ -75,24 +76,20 @@ void MQTTSNAggregateConnectionHandler::handleConnect(Client* client, MQTTSNPacke
         /* reset the table of msgNo and TopicId pare */
         client->clearWaitedPubTopicId();
         client->clearWaitedSubTopicId();
+        client->getWaitREGACKPacketList()->clear();
 
-        /* renew the TopicList */
+        /* renew the TopicList. topic filters which no client subscribes are unsubscribed */
         if (topics)
         {
-            Topic* tp = topics->getFirstTopic();
-            while (tp != nullptr)
-            {
-                if (tp->getType() == MQTTSN_TOPIC_TYPE_NORMAL)
-                {
-                    _gateway->getAdapterManager()->getAggregater()->removeAggregateTopic(tp, client);
-                }
-                tp = topics->getNextTopic(tp);
-            }
+            _gateway->getAdapterManager()->getAggregater()->removeClient(client);
             topics->eraseNormal();
         }
         client->setSessionStatus(true);
     }
 
+    /* the will is published by the gateway, not by the broker */
+    connectData->flags.bits.will = data.willFlag;
+
     if (data.willFlag)
     {
         /* create & send WILLTOPICREQ message to the client */
@@ -113,6 +110,12 @@ void MQTTSNAggregateConnectionHandler::handleConnect(Client* client, MQTTSNPacke
         ev->setClientSendEvent(client, packet);
         _gateway->getClientSendQue()->post(ev);
         client->connackSended(MQTTSN_RC_ACCEPTED);
+        if (!data.cleansession)
+        {
+            /* TopicIds of the persistent session are registered before saved PUBLISHes */
+            client->getWaitREGACKPacketList()->sendTopics(_gateway->getClientSendQue());
+            client->getInflightWindow()->resume(_gateway->getClientSendQue());
+        }
         sendStoredPublish(client);
         return;
     }
@@ -140,6 +143,7 @@ void MQTTSNAggregateConnectionHandler::handleWillmsg(Client* client, MQTTSNPacke
             return;
         }
         client->setWillMsg(willmsg);
+        client->setWillFlg(true);
 
         /* Send CONNACK to the client */
         MQTTSNPacket* packet = new MQTTSNPacket();
@@ -147,6 +151,7 @@ void MQTTSNAggregateConnectionHandler::handleWillmsg(Client* client, MQTTSNPacke
         Event* ev = new Event();
         ev->setClientSendEvent(client, packet);
         _gateway->getClientSendQue()->post(ev);
+        client->connackSended(MQTTSN_RC_ACCEPTED);
 
         sendStoredPublish(client);
         return;
@@ -158,6 +163,14 @@ void MQTTSNAggregateConnectionHandler::handleWillmsg(Client* client, MQTTSNPacke
  */
 void MQTTSNAggregateConnectionHandler::handleDisconnect(Client* client, MQTTSNPacket* packet)
 {
+    uint16_t duration = 0;
+
+    if (packet->getDISCONNECT(&duration) != 0 && duration == 0)
+    {
+        /* the will is discarded */
+        client->setWillFlg(false);
+    }
+
     MQTTSNPacket* snMsg = new MQTTSNPacket();
     snMsg->setDISCONNECT(0);
     Event* evt = new Event();
@@ -170,6 +183,9 @@ void MQTTSNAggregateConnectionHandler::handleDisconnect(Client* client, MQTTSNPa
  */
 void MQTTSNAggregateConnectionHandler::handlePingreq(Client* client, MQTTSNPacket* packet)
 {
+    /* REGISTERs which are not acknowledged are sent again */
+    client->getWaitREGACKPacketList()->retransmit(_gateway->getClientSendQue());
+
     if ((client->isSleep() || client->isAwake()) && client->getClientSleepPacket())
     {
         sendStoredPublish(client);
@@ -178,6 +194,7 @@ void MQTTSNAggregateConnectionHandler::handlePingreq(Client* client, MQTTSNPacke
 
     /* create and send PINGRESP to the PacketHandler */
     client->resetPingRequest();
+    client->pingreqForwarded();
 
     MQTTGWPacket* pingresp = new MQTTGWPacket();
 
@@ -39,11 +39,11 @@ AdapterManager::AdapterManager(Gateway* gw)
     _aggregater = new Aggregater(gw);
 }
 
-void AdapterManager::initialize(char* gwName, bool aggregate, bool forwarder, bool qosM1)
+void AdapterManager::initialize(char* gwName, bool aggregate, bool forwarder, bool qosM1, bool share)
 {
-    if (aggregate)
+    if (aggregate || share)
     {
-        _aggregater->initialize(gwName);
+        _aggregater->initialize(gwName, !aggregate);
     }
 
     if (qosM1)
@@ -100,6 +100,22 @@ bool AdapterManager::isAggregatedClient(Client* client)
     }
 }
 
+/**
+ *  A client of the transparent gateway which subscribes over the connection of the Aggregater.
+ *  Its PUBLISHes of the broker are acknowledged by the gateway.
+ */
+bool AdapterManager::isSharedSubscriber(Client* client)
+{
+    if (!_aggregater->isSharing() || client->isQoSm1() || client->isAdapter())
+    {
+        return false;
+    }
+    else
+    {
+        return true;
+    }
+}
+
 Client* AdapterManager::getClient(Client* client)
 {
     bool secure = client->isSecureNetwork();
@@ -138,7 +154,11 @@ int AdapterManager::unicastToClient(Client* client, MQTTSNPacket* packet, Client
         WirelessNodeId* wnId = fwd->getWirelessNodeId(client);
         encap.setWirelessNodeId(wnId);
         task->log(client, packet);
-        WRITELOG(FORMAT_Y_W_G, currentDateTime(), encap.getName(), RIGHTARROW, fwd->getId(), encap.print(pbuf));
+        if (CHK_PACKETLOG(packet->getLogCategory()))
+        {
+            WRITELOG(FORMAT_Y_W_G, currentDateTime(), encap.getName(), RIGHTARROW, fwd->getId(),
+                    CHK_PACKETDUMP ? encap.print(pbuf) : "");
+        }
         rc = encap.unicast(_gateway->getSensorNetwork(), fwd->getSensorNetAddr());
     }
     else
@@ -162,7 +182,7 @@ int AdapterManager::unicastToClient(Client* client, MQTTSNPacket* packet, Client
 
 void AdapterManager::checkConnection(void)
 {
-    if (_aggregater->isActive())
+    if (_aggregater->isActive() || _aggregater->isSharing())
     {
         _aggregater->checkConnection();
     }
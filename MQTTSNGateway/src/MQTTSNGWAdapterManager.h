@@ -40,13 +40,14 @@ class AdapterManager
 public:
     AdapterManager(Gateway* gw);
     ~AdapterManager(void);
-    void initialize(char* gwName, bool aggregater, bool fowarder, bool qosM1);
+    void initialize(char* gwName, bool aggregater, bool fowarder, bool qosM1, bool share);
     ForwarderList* getForwarderList(void);
     QoSm1Proxy* getQoSm1Proxy(void);
     Aggregater* getAggregater(void);
     void checkConnection(void);
 
     bool isAggregatedClient(Client* client);
+    bool isSharedSubscriber(Client* client);
     Client* getClient(Client* client);
     Client* convertClient(uint16_t msgId, uint16_t* clientMsgId);
     int unicastToClient(Client* client, MQTTSNPacket* packet,
@@ -13,308 +13,522 @@
  * Contributors:
  *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
  **************************************************************************************/
+
 #include "MQTTSNGWAggregateTopicTable.h"
 #include "MQTTSNGWClient.h"
+#include <string.h>
+#include <algorithm>
 
-/*=====================================
- Class ClientTopicElement
- =====================================*/
-ClientTopicElement::ClientTopicElement(Client* client)
+using namespace MQTTSNGW;
+
+static int compareLevel(const std::string& str, const char* level, int len)
 {
-    _client = client;
+    int slen = (int) str.size();
+    int rc = memcmp(str.data(), level, slen < len ? slen : len);
+    if (rc == 0)
+    {
+        rc = slen - len;
+    }
+    return rc;
 }
 
-ClientTopicElement::~ClientTopicElement()
+/*=====================================
+ Class AggregateTopicMatch
+ =====================================*/
+AggregateTopicMatch::AggregateTopicMatch(const char* topicName, int len) :
+        _topicName(topicName, len)
 {
 
 }
 
-Client* ClientTopicElement::getClient(void)
+AggregateTopicMatch::~AggregateTopicMatch(void)
 {
-    return _client;
-}
 
-ClientTopicElement* ClientTopicElement::getNextClientElement(void)
-{
-    return _next;
 }
 
 /*=====================================
  Class AggregateTopicElement
  =====================================*/
-AggregateTopicElement::AggregateTopicElement(void)
+AggregateTopicElement::AggregateTopicElement(const char* level, int len, AggregateTopicElement* parent) :
+        _level(level, len), _parent { parent }
 {
 
 }
 
-AggregateTopicElement::AggregateTopicElement(Topic* topic, Client* client)
+AggregateTopicElement::~AggregateTopicElement(void)
 {
-    _topic = topic;
-    ClientTopicElement* elm = new ClientTopicElement(client);
-    if (elm != nullptr)
+    for (size_t i = 0; i < _children.size(); i++)
+    {
+        delete _children[i];
+    }
+    if (_singleWildcard)
     {
-        _head = elm;
-        _tail = elm;
+        delete _singleWildcard;
+    }
+    if (_multiWildcard)
+    {
+        delete _multiWildcard;
+    }
+    if (_topic)
+    {
+        delete _topic;
     }
 }
 
-AggregateTopicElement::~AggregateTopicElement(void)
+Topic* AggregateTopicElement::getTopic(void)
 {
-    _mutex.lock();
-    if (_head != nullptr)
+    return _topic;
+}
+
+const ClientVector* AggregateTopicElement::getClients(void)
+{
+    return &_clients;
+}
+
+bool AggregateTopicElement::find(Client* client)
+{
+    return std::find(_clients.begin(), _clients.end(), client) != _clients.end();
+}
+
+int AggregateTopicElement::getGrantedQoS(void)
+{
+    return _grantedQoS;
+}
+
+void AggregateTopicElement::setGrantedQoS(int qos)
+{
+    _grantedQoS = qos;
+}
+
+uint8_t AggregateTopicElement::getRequestedQoS(void)
+{
+    return _requestedQoS;
+}
+
+void AggregateTopicElement::setRequestedQoS(uint8_t qos)
+{
+    _requestedQoS = qos;
+}
+
+bool AggregateTopicElement::isEmpty(void)
+{
+    return _clients.empty() && _children.empty() && _singleWildcard == nullptr && _multiWildcard == nullptr;
+}
+
+AggregateTopicElement* AggregateTopicElement::getChild(const char* level, int len)
+{
+    if (len == 1 && *level == MQTTSN_TOPIC_SINGLE_WILDCARD)
     {
-        ClientTopicElement* p = _tail;
-        while (p)
+        return _singleWildcard;
+    }
+    if (len == 1 && *level == MQTTSN_TOPIC_MULTI_WILDCARD)
+    {
+        return _multiWildcard;
+    }
+
+    int low = 0;
+    int high = (int) _children.size() - 1;
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        int rc = compareLevel(_children[mid]->_level, level, len);
+        if (rc == 0)
         {
-            ClientTopicElement* pPrev = p;
-            delete p;
-            p = pPrev->_prev;
+            return _children[mid];
+        }
+        else if (rc < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid - 1;
         }
-        _head = _tail = nullptr;
     }
-    _mutex.unlock();
+    return nullptr;
 }
 
-ClientTopicElement* AggregateTopicElement::add(Client* client)
+AggregateTopicElement* AggregateTopicElement::addChild(const char* level, int len)
 {
-    ClientTopicElement* elm = new ClientTopicElement(client);
-    if (elm == nullptr)
+    AggregateTopicElement* elm = getChild(level, len);
+    if (elm != nullptr)
     {
-        return nullptr;
+        return elm;
     }
 
-    _mutex.lock();
-
-    if (_head == nullptr)
+    elm = new AggregateTopicElement(level, len, this);
+    if (len == 1 && *level == MQTTSN_TOPIC_SINGLE_WILDCARD)
     {
-        _head = elm;
-        _tail = elm;
+        _singleWildcard = elm;
+    }
+    else if (len == 1 && *level == MQTTSN_TOPIC_MULTI_WILDCARD)
+    {
+        _multiWildcard = elm;
     }
     else
     {
-        ClientTopicElement* p = find(client);
-        if (p == nullptr)
+        std::vector<AggregateTopicElement*>::iterator it = _children.begin();
+        while (it != _children.end() && compareLevel((*it)->_level, level, len) < 0)
         {
-            p = _tail;
-            _tail = elm;
-            elm->_prev = p;
-            p->_next = elm;
-        }
-        else
-        {
-            delete elm;
-            elm = p;
+            ++it;
         }
+        _children.insert(it, elm);
     }
-    _mutex.unlock();
     return elm;
 }
 
-ClientTopicElement* AggregateTopicElement::find(Client* client)
+void AggregateTopicElement::removeChild(AggregateTopicElement* child)
 {
-    ClientTopicElement* p = _head;
-    while (p != nullptr)
+    if (child == _singleWildcard)
     {
-        if (p->_client == client)
+        _singleWildcard = nullptr;
+    }
+    else if (child == _multiWildcard)
+    {
+        _multiWildcard = nullptr;
+    }
+    else
+    {
+        std::vector<AggregateTopicElement*>::iterator it = std::find(_children.begin(), _children.end(), child);
+        if (it != _children.end())
         {
-            break;
+            _children.erase(it);
         }
-        p = p->_next;
     }
-    return p;
+    delete child;
 }
 
-ClientTopicElement* AggregateTopicElement::getFirstClientTopicElement(void)
+/*=====================================
+ Class AggregateTopicTable
+ ======================================*/
+
+AggregateTopicTable::AggregateTopicTable()
 {
-    return _head;
+    _root = new AggregateTopicElement("", 0, nullptr);
+    memset(_matches, 0, sizeof(_matches));
 }
 
-ClientTopicElement* AggregateTopicElement::getNextClientTopicElement(ClientTopicElement* elmClient)
+AggregateTopicTable::~AggregateTopicTable()
 {
-    return elmClient->_next;
+    clearMatches();
+    delete _root;
 }
 
-void AggregateTopicElement::eraseClient(Client* client)
+AggregateTopicElement* AggregateTopicTable::add(Topic* topic, Client* client)
 {
+    const char* name = topic->getTopicName()->c_str();
+    int len = (int) topic->getTopicName()->size();
+    int pos = 0;
+
     _mutex.lock();
+    AggregateTopicElement* elm = _root;
+    while (pos <= len)
+    {
+        const char* sep = (const char*) memchr(name + pos, '/', len - pos);
+        int end = sep ? (int) (sep - name) : len;
+        elm = elm->addChild(name + pos, end - pos);
+        pos = end + 1;
+    }
 
-    ClientTopicElement* p = find(client);
-    if (p != nullptr)
+    if (elm->_topic == nullptr)
     {
-        if (p->_prev == nullptr)    // head element
-        {
-            _head = p->_next;
-            if (p->_next == nullptr)   // head & only one
-            {
-                _tail = nullptr;
-            }
-            else
-            {
-                p->_next->_prev = nullptr;  // head & midle
-            }
-        }
-        else if (p->_next != nullptr)  // middle
-        {
-            p->_prev->_next = p->_next;
-        }
-        else    // tail
-        {
-            p->_prev->_next = nullptr;
-            _tail = p->_prev;
-        }
-        delete p;
+        elm->_topic = topic->duplicate();
+        _cnt++;
+    }
+    if (!elm->find(client))
+    {
+        elm->_clients.push_back(client);
+        clearMatches();
     }
     _mutex.unlock();
+    return elm;
 }
 
-/*=====================================
- Class AggregateTopicTable
- ======================================*/
-
-AggregateTopicTable::AggregateTopicTable()
+AggregateTopicElement* AggregateTopicTable::find(const char* topicName, int len)
 {
+    AggregateTopicElement* elm = _root;
+    int pos = 0;
 
+    while (elm != nullptr && pos <= len)
+    {
+        const char* sep = (const char*) memchr(topicName + pos, '/', len - pos);
+        int end = sep ? (int) (sep - topicName) : len;
+        elm = elm->getChild(topicName + pos, end - pos);
+        pos = end + 1;
+    }
+
+    if (elm != nullptr && elm->_topic == nullptr)
+    {
+        return nullptr;
+    }
+    return elm;
 }
 
-AggregateTopicTable::~AggregateTopicTable()
+AggregateTopicElement* AggregateTopicTable::getAggregateTopicElement(Topic* topic)
 {
-
+    _mutex.lock();
+    AggregateTopicElement* elm = find(topic->getTopicName()->c_str(), (int) topic->getTopicName()->size());
+    _mutex.unlock();
+    return elm;
 }
 
-AggregateTopicElement* AggregateTopicTable::add(Topic* topic, Client* client)
+void AggregateTopicTable::erase(Topic* topic, Client* client)
 {
-    AggregateTopicElement* elm = nullptr;
     _mutex.lock();
-    elm = getAggregateTopicElement(topic);
+    AggregateTopicElement* elm = find(topic->getTopicName()->c_str(), (int) topic->getTopicName()->size());
     if (elm != nullptr)
     {
-        if (elm->find(client) == nullptr)
-        {
-            elm->add(client);
-        }
+        erase(elm, client);
     }
-    else
+    _mutex.unlock();
+}
+
+void AggregateTopicTable::erase(Client* client)
+{
+    std::vector<AggregateTopicElement*> stack;
+
+    _mutex.lock();
+    stack.push_back(_root);
+    while (!stack.empty())
     {
-        Topic* newTopic = topic->duplicate();
-        elm = new AggregateTopicElement(newTopic, client);
-        if (_head == nullptr)
+        AggregateTopicElement* elm = stack.back();
+        stack.pop_back();
+
+        stack.insert(stack.end(), elm->_children.begin(), elm->_children.end());
+        if (elm->_singleWildcard)
         {
-            _head = elm;
-            _tail = elm;
+            stack.push_back(elm->_singleWildcard);
         }
-        else
+        if (elm->_multiWildcard)
         {
-            elm->_prev = _tail;
-            _tail->_next = elm;
-            _tail = elm;
+            stack.push_back(elm->_multiWildcard);
+        }
+
+        if (elm->find(client))
+        {
+            /* children are not deleted because elm still has them */
+            erase(elm, client);
         }
     }
     _mutex.unlock();
-    return elm;
 }
 
-void AggregateTopicTable::erase(Topic* topic, Client* client)
+void AggregateTopicTable::erase(AggregateTopicElement* elmTopic, Client* client)
 {
-    AggregateTopicElement* elm = nullptr;
-
-    _mutex.lock();
-    elm = getAggregateTopicElement(topic);
+    ClientVector::iterator it = std::find(elmTopic->_clients.begin(), elmTopic->_clients.end(), client);
+    if (it == elmTopic->_clients.end())
+    {
+        return;
+    }
+    elmTopic->_clients.erase(it);
+    clearMatches();
 
-    if (elm != nullptr)
+    if (elmTopic->_clients.empty())
     {
-        elm->eraseClient(client);
+        delete elmTopic->_topic;
+        elmTopic->_topic = nullptr;
+        _cnt--;
+        erase(elmTopic);
     }
-    if (elm->_head == nullptr)
+}
+
+void AggregateTopicTable::erase(AggregateTopicElement* elmTopic)
+{
+    /* remove levels which have no subscriber and no child */
+    while (elmTopic != _root && elmTopic->isEmpty())
     {
-        erase(elm);
+        AggregateTopicElement* parent = elmTopic->_parent;
+        parent->removeChild(elmTopic);
+        elmTopic = parent;
     }
+}
+
+void AggregateTopicTable::clear(void)
+{
+    _mutex.lock();
+    clearMatches();
+    delete _root;
+    _root = new AggregateTopicElement("", 0, nullptr);
+    _cnt = 0;
     _mutex.unlock();
-    return;
 }
 
-void AggregateTopicTable::erase(AggregateTopicElement* elmTopic)
+uint32_t AggregateTopicTable::hash(const char* topicName, int len)
 {
-    if (elmTopic != nullptr)
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++)
     {
-        if (elmTopic->_prev == nullptr)    // head element
-        {
-            _head = elmTopic->_next;
-            if (elmTopic->_next == nullptr)   // head & only one
-            {
-                _tail = nullptr;
-            }
-            else
-            {
-                elmTopic->_next->_prev = nullptr;  // head & midle
-            }
-        }
-        else if (elmTopic->_next != nullptr)  // middle
-        {
-            elmTopic->_prev->_next = elmTopic->_next;
-        }
-        else    // tail
+        h ^= (uint8_t) topicName[i];
+        h *= 16777619u;
+    }
+    return h & (AGGREGATE_MATCH_TABLE_SIZE - 1);
+}
+
+void AggregateTopicTable::clearMatches(void)
+{
+    if (_matchCnt == 0)
+    {
+        return;
+    }
+    for (int i = 0; i < AGGREGATE_MATCH_TABLE_SIZE; i++)
+    {
+        AggregateTopicMatch* p = _matches[i];
+        while (p)
         {
-            elmTopic->_prev->_next = nullptr;
-            _tail = elmTopic->_prev;
+            AggregateTopicMatch* q = p->_next;
+            delete p;
+            p = q;
         }
-        delete elmTopic;
+        _matches[i] = nullptr;
     }
+    _matchCnt = 0;
 }
 
-AggregateTopicElement* AggregateTopicTable::getAggregateTopicElement(Topic* topic)
+void AggregateTopicTable::match(AggregateTopicElement* elm, const char* topicName, int len, int pos,
+        ClientVector* clients, int* hits)
 {
-    AggregateTopicElement* elm = _head;
+    /* '#' matches the parent level and all remaining levels */
+    if (elm->_multiWildcard && !elm->_multiWildcard->_clients.empty())
+    {
+        ClientVector& cl = elm->_multiWildcard->_clients;
+        clients->insert(clients->end(), cl.begin(), cl.end());
+        (*hits)++;
+    }
 
-    while (elm != nullptr)
+    if (pos > len)
     {
-        if (elm->_topic->isMatch(topic->_topicName))
+        if (!elm->_clients.empty())
         {
-            break;
+            clients->insert(clients->end(), elm->_clients.begin(), elm->_clients.end());
+            (*hits)++;
         }
-        elm = elm->_next;
+        return;
+    }
+
+    const char* sep = (const char*) memchr(topicName + pos, '/', len - pos);
+    int end = sep ? (int) (sep - topicName) : len;
+
+    AggregateTopicElement* child = elm->getChild(topicName + pos, end - pos);
+    if (child)
+    {
+        match(child, topicName, len, end + 1, clients, hits);
+    }
+    if (elm->_singleWildcard)
+    {
+        match(elm->_singleWildcard, topicName, len, end + 1, clients, hits);
     }
-    return elm;
 }
 
-ClientTopicElement* AggregateTopicTable::getClientElement(Topic* topic)
+/**
+ *  Copy clients which subscribe the topic name into clients.
+ */
+void AggregateTopicTable::getClients(const char* topicName, int len, ClientVector* clients)
 {
-    AggregateTopicElement* elm = getAggregateTopicElement(topic);
-    if (elm != nullptr)
+    uint32_t h = hash(topicName, len);
+
+    _mutex.lock();
+    AggregateTopicMatch* p = _matches[h];
+    while (p)
     {
-        return elm->_head;
+        if ((int) p->_topicName.size() == len && memcmp(p->_topicName.data(), topicName, len) == 0)
+        {
+            *clients = p->_clients;
+            _mutex.unlock();
+            return;
+        }
+        p = p->_next;
     }
-    else
+
+    if (_matchCnt >= AGGREGATE_MATCH_TABLE_SIZE * 4)
     {
-        return nullptr;
+        clearMatches();
+    }
+
+    /* build a subscriber list of the topic */
+    p = new AggregateTopicMatch(topicName, len);
+    int hits = 0;
+    match(_root, topicName, len, 0, &p->_clients, &hits);
+    if (hits > 1)
+    {
+        std::sort(p->_clients.begin(), p->_clients.end());
+        p->_clients.erase(std::unique(p->_clients.begin(), p->_clients.end()), p->_clients.end());
     }
+    p->_clients.shrink_to_fit();
+
+    p->_next = _matches[h];
+    _matches[h] = p;
+    _matchCnt++;
+    *clients = p->_clients;
+    _mutex.unlock();
+}
+
+/**
+ *  Subscriptions of the broker are lost. Topic filters wait SUBACKs again.
+ *  @param filters  topic filters and QoS to subscribe again
+ */
+void AggregateTopicTable::resetSubscriptions(std::vector<AggregateTopicFilter>* filters)
+{
+    std::vector<AggregateTopicElement*> stack;
+
+    _mutex.lock();
+    stack.push_back(_root);
+    while (!stack.empty())
+    {
+        AggregateTopicElement* elm = stack.back();
+        stack.pop_back();
+
+        if (elm->_topic)
+        {
+            AggregateTopicFilter filter = { *elm->_topic->getTopicName(), elm->_requestedQoS };
+            filters->push_back(filter);
+            elm->_grantedQoS = -1;
+        }
+
+        stack.insert(stack.end(), elm->_children.begin(), elm->_children.end());
+        if (elm->_singleWildcard)
+        {
+            stack.push_back(elm->_singleWildcard);
+        }
+        if (elm->_multiWildcard)
+        {
+            stack.push_back(elm->_multiWildcard);
+        }
+    }
+    _mutex.unlock();
 }
 
 void AggregateTopicTable::print(void)
 {
-    AggregateTopicElement* elm = _head;
+    std::vector<AggregateTopicElement*> stack;
 
     printf("Beginning of AggregateTopicTable\n");
-    while (elm != nullptr)
+    _mutex.lock();
+    stack.push_back(_root);
+    while (!stack.empty())
     {
-        printf("%s\n", elm->_topic->getTopicName()->c_str());
+        AggregateTopicElement* elm = stack.back();
+        stack.pop_back();
 
-        ClientTopicElement* clElm = elm->getFirstClientTopicElement();
-        Client* client = clElm->getClient();
-
-        while (client != nullptr)
+        if (elm->_topic)
         {
-            printf("    %s\n", client->getClientId());
-            clElm = clElm->getNextClientElement();
-            if (clElm != nullptr)
-            {
-                client = clElm->getClient();
-            }
-            else
+            printf("%s\n", elm->_topic->getTopicName()->c_str());
+            for (size_t i = 0; i < elm->_clients.size(); i++)
             {
-                client = nullptr;
+                printf("    %s\n", elm->_clients[i]->getClientId());
             }
         }
-        elm = elm->_next;
+
+        stack.insert(stack.end(), elm->_children.rbegin(), elm->_children.rend());
+        if (elm->_singleWildcard)
+        {
+            stack.push_back(elm->_singleWildcard);
+        }
+        if (elm->_multiWildcard)
+        {
+            stack.push_back(elm->_multiWildcard);
+        }
     }
+    _mutex.unlock();
     printf("End of AggregateTopicTable\n");
 }
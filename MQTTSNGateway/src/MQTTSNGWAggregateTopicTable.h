@@ -20,17 +20,37 @@
 #include "MQTTSNGWDefines.h"
 #include "MQTTSNGWProcess.h"
 #include <stdint.h>
+#include <string>
+#include <vector>
 namespace MQTTSNGW
 {
 
 class Client;
 class Topic;
 class AggregateTopicElement;
-class ClientTopicElement;
+class AggregateTopicMatch;
 class Mutex;
 
+typedef std::vector<Client*> ClientVector;
+
+/*=====================================
+ Struct AggregateTopicFilter
+ =====================================*/
+struct AggregateTopicFilter
+{
+    std::string topicName;
+    uint8_t qos;            // max QoS requested by clients
+};
+
 /*=====================================
  Class AggregateTopicTable
+
+ Topic filters subscribed by aggregated clients are kept in a trie
+ of topic levels. The set of clients which match a topic name of
+ a PUBLISH is cached in a hash table until subscriptions change.
+ Clients of a topic filter share one subscription of the broker.
+ Results are copied under the lock, because other threads may change
+ subscriptions after it is released.
  ======================================*/
 class AggregateTopicTable
 {
@@ -40,19 +60,27 @@ public:
 
     AggregateTopicElement* add(Topic* topic, Client* client);
     AggregateTopicElement* getAggregateTopicElement(Topic* topic);
-    ClientTopicElement* getClientElement(Topic* topic);
+    void getClients(const char* topicName, int len, ClientVector* clients);
     void erase(Topic* topic, Client* client);
+    void erase(Client* client);
     void clear(void);
+    void resetSubscriptions(std::vector<AggregateTopicFilter>* filters);
 
     void print(void);
 
 private:
+    AggregateTopicElement* find(const char* topicName, int len);
     void erase(AggregateTopicElement* elmTopic);
+    void erase(AggregateTopicElement* elmTopic, Client* client);
+    void match(AggregateTopicElement* elm, const char* topicName, int len, int pos, ClientVector* clients, int* hits);
+    void clearMatches(void);
+    uint32_t hash(const char* topicName, int len);
+
     Mutex _mutex;
-    AggregateTopicElement* _head { nullptr };
-    AggregateTopicElement* _tail { nullptr };
+    AggregateTopicElement* _root { nullptr };
+    AggregateTopicMatch* _matches[AGGREGATE_MATCH_TABLE_SIZE];
+    int _matchCnt { 0 };
     int _cnt { 0 };
-    int _maxSize { MAX_MESSAGEID_TABLE_SIZE };
 };
 
 /*=====================================
@@ -62,44 +90,48 @@ class AggregateTopicElement
 {
     friend class AggregateTopicTable;
 public:
-    AggregateTopicElement(void);
-    AggregateTopicElement(Topic* topic, Client* client);
+    AggregateTopicElement(const char* level, int len, AggregateTopicElement* parent);
     ~AggregateTopicElement(void);
 
-    ClientTopicElement* add(Client* client);
-    ClientTopicElement* getFirstClientTopicElement(void);
-    ClientTopicElement* getNextClientTopicElement(
-            ClientTopicElement* elmClient);
-    void eraseClient(Client* client);
-    ClientTopicElement* find(Client* client);
+    Topic* getTopic(void);
+    const ClientVector* getClients(void);
+    bool find(Client* client);
+    int getGrantedQoS(void);
+    void setGrantedQoS(int qos);
+    uint8_t getRequestedQoS(void);
+    void setRequestedQoS(uint8_t qos);
 
 private:
-    Mutex _mutex;
-    Topic* _topic { nullptr };
-    AggregateTopicElement* _next { nullptr };
-    AggregateTopicElement* _prev { nullptr };
-    ClientTopicElement* _head { nullptr };
-    ClientTopicElement* _tail { nullptr };
+    AggregateTopicElement* getChild(const char* level, int len);
+    AggregateTopicElement* addChild(const char* level, int len);
+    void removeChild(AggregateTopicElement* child);
+    bool isEmpty(void);
+
+    std::string _level;
+    Topic* _topic { nullptr };          // Topic filter which ends at this level
+    ClientVector _clients;
+    int _grantedQoS { -1 };             // QoS of the subscription of the broker, -1 until it is accepted
+    uint8_t _requestedQoS { 0 };        // max QoS requested by clients
+    std::vector<AggregateTopicElement*> _children;   // sorted by _level
+    AggregateTopicElement* _singleWildcard { nullptr };
+    AggregateTopicElement* _multiWildcard { nullptr };
+    AggregateTopicElement* _parent { nullptr };
 };
 
 /*=====================================
- Class ClientTopicElement
+ Class AggregateTopicMatch
  =====================================*/
-class ClientTopicElement
+class AggregateTopicMatch
 {
     friend class AggregateTopicTable;
-    friend class AggregateTopicElement;
 public:
-    ClientTopicElement(Client* client);
-    ~ClientTopicElement(void);
-
-    ClientTopicElement* getNextClientElement(void);
-    Client* getClient(void);
+    AggregateTopicMatch(const char* topicName, int len);
+    ~AggregateTopicMatch(void);
 
 private:
-    Client* _client { nullptr };
-    ClientTopicElement* _next { nullptr };
-    ClientTopicElement* _prev { nullptr };
+    std::string _topicName;
+    ClientVector _clients;
+    AggregateTopicMatch* _next { nullptr };
 };
 
 }
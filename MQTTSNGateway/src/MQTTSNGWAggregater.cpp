@@ -23,9 +23,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <string>
+#include <algorithm>
 
 using namespace MQTTSNGW;
 
+char* currentDateTime(void);
+
 Aggregater::Aggregater(Gateway* gw) :
         Adapter(gw)
 {
@@ -37,12 +40,17 @@ Aggregater::~Aggregater(void)
 
 }
 
-void Aggregater::initialize(char* gwName)
+/**
+ *  @param sharing  true if transparent clients share only subscriptions of the broker
+ */
+void Aggregater::initialize(char* gwName, bool sharing)
 {
     /* Create Aggregater Client */
     string name = string(gwName) + string("_Aggregater");
     setup(name.c_str(), Atype_Aggregater);
-    _isActive = true;
+    _msgIdTable.initialize(_gateway->getGWParams()->msgIdTableSize);
+    _isActive = !sharing;
+    _isSharing = sharing;
 
     //testMessageIdTable();
 
@@ -53,6 +61,11 @@ bool Aggregater::isActive(void)
     return _isActive;
 }
 
+bool Aggregater::isSharing(void)
+{
+    return _isSharing;
+}
+
 uint16_t Aggregater::msgId(void)
 {
     // Only SecureClient generates msgId to avoid duplication of msgId. Client does not generate it.
@@ -84,6 +97,11 @@ uint16_t Aggregater::getMsgId(Client* client, uint16_t clientMsgId)
     return _msgIdTable.getMsgId(client, clientMsgId);
 }
 
+void Aggregater::eraseMessageIdTable(Client* client)
+{
+    _msgIdTable.erase(client);
+}
+
 AggregateTopicElement* Aggregater::addAggregateTopic(Topic* topic, Client* client)
 {
     return _topicTable.add(topic, client);
@@ -99,17 +117,253 @@ AggregateTopicElement* Aggregater::findTopic(Topic* topic)
     return _topicTable.getAggregateTopicElement(topic);
 }
 
-ClientTopicElement* Aggregater::getClientElement(Topic* topic)
+void Aggregater::removeAggregateAllTopic(Client* client)
+{
+    _topicTable.erase(client);
+}
+
+/**
+ *  Remove the client from all topic filters.
+ *  Topic filters which no client subscribes any more are unsubscribed.
+ */
+void Aggregater::removeClient(Client* client)
 {
-    AggregateTopicElement* elm = findTopic(topic);
-    if (elm != nullptr)
+    Topics* topics = client->getTopics();
+    Topic* tp = topics ? topics->getFirstTopic() : nullptr;
+
+    while (tp != nullptr)
     {
-        return elm->getFirstClientTopicElement();
+        AggregateTopicElement* elm = findTopic(tp);
+        if (tp->getType() == MQTTSN_TOPIC_TYPE_NORMAL && elm != nullptr && elm->find(client))
+        {
+            removeAggregateTopic(tp, client);
+            if (findTopic(tp) == nullptr)
+            {
+                unsubscribe(client, tp);
+            }
+        }
+        tp = topics->getNextTopic(tp);
     }
-    else
+    removeAggregateAllTopic(client);
+}
+
+/**
+ *  @return true if the broker has accepted the subscription of the topic filter with enough QoS.
+ *          The client shares it and a SUBSCRIBE is not sent.
+ */
+bool Aggregater::isSubscribed(Topic* topic, uint8_t qos, uint8_t* grantedQoS)
+{
+    AggregateTopicElement* elm = _topicTable.getAggregateTopicElement(topic);
+    if (elm == nullptr || elm->getGrantedQoS() < 0 || qos > elm->getRequestedQoS())
+    {
+        return false;
+    }
+    *grantedQoS = qos < elm->getGrantedQoS() ? qos : elm->getGrantedQoS();
+    return true;
+}
+
+/**
+ *  Called when a SUBSCRIBE of the topic filter is sent to the broker.
+ *  @return QoS of the SUBSCRIBE, which must not lower the subscription of other clients.
+ */
+uint8_t Aggregater::setSubscribing(uint16_t msgId, Topic* topic, uint8_t qos, Client* client)
+{
+    AggregateTopicElement* elm = _topicTable.getAggregateTopicElement(topic);
+    if (elm && qos > elm->getRequestedQoS())
+    {
+        elm->setRequestedQoS(qos);
+    }
+
+    AggregateSubscribing& subscribing = _subscribing[msgId];
+    subscribing.topicName = *topic->getTopicName();
+    subscribing.qos = elm ? elm->getRequestedQoS() : qos;
+    subscribing.client = client;
+    subscribing.joined.clear();
+    return subscribing.qos;
+}
+
+/**
+ *  A SUBSCRIBE of the topic filter which waits the SUBACK answers the client too.
+ *  @return true if the client waits it. The SUBSCRIBE of the client is not sent.
+ */
+bool Aggregater::joinSubscribing(Topic* topic, uint8_t qos, Client* client, uint16_t clientMsgId)
+{
+    for (auto it = _subscribing.begin(); it != _subscribing.end(); it++)
+    {
+        AggregateSubscribing& subscribing = it->second;
+        if (subscribing.topicName != *topic->getTopicName() || subscribing.qos < qos)
+        {
+            continue;
+        }
+
+        /* a SUBSCRIBE which the client sends again */
+        if (subscribing.client == client)
+        {
+            return true;
+        }
+        for (size_t i = 0; i < subscribing.joined.size(); i++)
+        {
+            if (subscribing.joined[i].client == client && subscribing.joined[i].msgId == clientMsgId)
+            {
+                return true;
+            }
+        }
+
+        SubscribingClient joined = { client, clientMsgId, qos };
+        subscribing.joined.push_back(joined);
+        return true;
+    }
+    return false;
+}
+
+/**
+ *  Called with a SUBACK of the broker.
+ *  Retained messages which the broker sends next are for the clients of the SUBSCRIBE.
+ *  @param joined  clients which have joined the SUBSCRIBE
+ */
+void Aggregater::subscribed(uint16_t msgId, uint8_t rc, std::vector<SubscribingClient>* joined)
+{
+    std::unordered_map<uint16_t, AggregateSubscribing>::iterator it = _subscribing.find(msgId);
+    if (it == _subscribing.end())
+    {
+        return;
+    }
+
+    Topic topic = Topic(new string(it->second.topicName), MQTTSN_TOPIC_TYPE_NORMAL);
+    AggregateTopicElement* elm = _topicTable.getAggregateTopicElement(&topic);
+    if (elm)
     {
-        return nullptr;
+        elm->setGrantedQoS(rc == 0x80 ? -1 : rc);
     }
+
+    _retainedTopic = it->second.topicName;
+    _retainedClients.clear();
+    if (rc != 0x80)
+    {
+        if (it->second.client)
+        {
+            _retainedClients.push_back(it->second.client);
+        }
+        for (size_t i = 0; i < it->second.joined.size(); i++)
+        {
+            _retainedClients.push_back(it->second.joined[i].client);
+        }
+    }
+    *joined = it->second.joined;
+    _subscribing.erase(it);
+}
+
+/**
+ *  The broker sets the retain flag only on PUBLISHes which it sends for a new subscription.
+ *  @return true if the client has subscribed the topic by the last SUBACK.
+ */
+bool Aggregater::isRetainedFor(Client* client, const char* topic, int topiclen)
+{
+    if (std::find(_retainedClients.begin(), _retainedClients.end(), client) == _retainedClients.end())
+    {
+        return false;
+    }
+
+    string topicName = string(topic, topiclen);
+    Topic filter = Topic(new string(_retainedTopic), MQTTSN_TOPIC_TYPE_NORMAL);
+    return filter.isMatch(&topicName);
+}
+
+/**
+ *  The removed client doesn't wait SUBACKs any more.
+ */
+void Aggregater::eraseSubscribing(Client* client)
+{
+    for (auto it = _subscribing.begin(); it != _subscribing.end(); it++)
+    {
+        AggregateSubscribing& subscribing = it->second;
+        if (subscribing.client == client)
+        {
+            subscribing.client = nullptr;
+        }
+        for (size_t i = 0; i < subscribing.joined.size();)
+        {
+            if (subscribing.joined[i].client == client)
+            {
+                subscribing.joined.erase(subscribing.joined.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+    _retainedClients.erase(std::remove(_retainedClients.begin(), _retainedClients.end(), client),
+            _retainedClients.end());
+}
+
+/**
+ *  Subscriptions of the broker are lost when the connection is made again.
+ *  Clients have received retained messages already, so they are not sent again.
+ */
+void Aggregater::resubscribe(Client* client)
+{
+    std::vector<AggregateTopicFilter> filters;
+
+    _subscribing.clear();
+    _retainedClients.clear();
+    _topicTable.resetSubscriptions(&filters);
+
+    for (size_t i = 0; i < filters.size(); i++)
+    {
+        uint16_t id = msgId();
+        _subscribing[id].topicName = filters[i].topicName;
+        _subscribing[id].qos = filters[i].qos;
+
+        MQTTGWPacket* subscribe = new MQTTGWPacket();
+        subscribe->setSUBSCRIBE(filters[i].topicName.c_str(), filters[i].qos, id);
+        Event* ev = new Event();
+        ev->setBrokerSendEvent(client, subscribe);
+        _gateway->getBrokerSendQue()->post(ev);
+    }
+
+    if (filters.size() > 0)
+    {
+        WRITELOG("%s %s subscribes %d topics again.\n", currentDateTime(), client->getClientId(), (int) filters.size());
+    }
+}
+
+/**
+ *  Send an UNSUBSCRIBE of the topic filter which no client subscribes.
+ */
+void Aggregater::unsubscribe(Client* client, Topic* topic)
+{
+    MQTTGWPacket* unsubscribe = new MQTTGWPacket();
+    unsubscribe->setUNSUBSCRIBE(topic->getTopicName()->c_str(), msgId());
+    Event* ev = new Event();
+    ev->setBrokerSendEvent(getAdapterClient(client), unsubscribe);
+    _gateway->getBrokerSendQue()->post(ev);
+}
+
+/**
+ *  Send a PUBLISH which the gateway makes for the client, like a will of the lost client.
+ *  The MsgId is kept with 0 of the client, and the PUBACK is not forwarded to the client.
+ */
+void Aggregater::publish(Client* client, Publish* pub)
+{
+    if (pub->header.bits.qos > 0)
+    {
+        pub->msgId = addMessageIdTable(client, 0);
+        if (pub->msgId == 0)
+        {
+            pub->header.bits.qos = 0;
+        }
+    }
+    MQTTGWPacket* publish = new MQTTGWPacket();
+    publish->setPUBLISH(pub);
+    Event* ev = new Event();
+    ev->setBrokerSendEvent(client, publish);
+    _gateway->getBrokerSendQue()->post(ev);
+}
+
+void Aggregater::getClients(const char* topicName, int len, ClientVector* clients)
+{
+    _topicTable.getClients(topicName, len, clients);
 }
 
 void Aggregater::printAggregateTopicTable(void)
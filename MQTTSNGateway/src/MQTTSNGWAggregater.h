@@ -20,6 +20,10 @@
 #include "MQTTSNGWAdapter.h"
 #include "MQTTSNGWMessageIdTable.h"
 #include "MQTTSNGWAggregateTopicTable.h"
+#include "MQTTGWPacket.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace MQTTSNGW
 {
@@ -31,8 +35,37 @@ class MessageIdTable;
 class AggregateTopicTable;
 class Topics;
 
+/*=====================================
+ Struct SubscribingClient
+ =====================================*/
+struct SubscribingClient
+{
+    Client* client;
+    uint16_t msgId;     // MsgId of the SUBSCRIBE of the client
+    uint8_t qos;        // QoS which the client requested
+};
+
+/*=====================================
+ Struct AggregateSubscribing
+ =====================================*/
+struct AggregateSubscribing
+{
+    std::string topicName;                  // topic filter of the SUBSCRIBE
+    uint8_t qos { 0 };                      // QoS of the SUBSCRIBE
+    Client* client { nullptr };             // client which sent it, nullptr if the gateway sent it again
+    std::vector<SubscribingClient> joined;  // clients whose SUBSCRIBEs wait the same SUBACK
+};
+
 /*=====================================
  Class Aggregater
+
+ Aggregated clients share a connection of the broker.
+ A topic filter is subscribed to the broker by the first client,
+ and unsubscribed by the last one. Others are answered by the gateway.
+ Retained messages which follow a SUBACK are sent only to the clients
+ of the SUBSCRIBE.
+ When it is sharing, transparent clients use the connection only
+ for their subscriptions.
  =====================================*/
 class Aggregater: public Adapter
 {
@@ -41,24 +74,35 @@ public:
     Aggregater(Gateway* gw);
     ~Aggregater(void);
 
-    void initialize(char* gwName);
+    void initialize(char* gwName, bool sharing);
 
     const char* getClientId(SensorNetAddress* addr);
     Client* getClient(SensorNetAddress* addr);
     Client* convertClient(uint16_t msgId, uint16_t* clientMsgId);
     uint16_t addMessageIdTable(Client* client, uint16_t msgId);
     uint16_t getMsgId(Client* client, uint16_t clientMsgId);
+    void eraseMessageIdTable(Client* client);
 
-    ClientTopicElement* getClientElement(Topic* topic);
-    ClientTopicElement* getNextClientElement(ClientTopicElement* clientElement);
-    Client* getClient(ClientTopicElement* clientElement);
+    void getClients(const char* topicName, int len, ClientVector* clients);
 
     AggregateTopicElement* findTopic(Topic* topic);
     AggregateTopicElement* addAggregateTopic(Topic* topic, Client* client);
 
     void removeAggregateTopic(Topic* topic, Client* client);
     void removeAggregateAllTopic(Client* client);
+    void removeClient(Client* client);
     bool isActive(void);
+    bool isSharing(void);
+
+    bool isSubscribed(Topic* topic, uint8_t qos, uint8_t* grantedQoS);
+    uint8_t setSubscribing(uint16_t msgId, Topic* topic, uint8_t qos, Client* client);
+    bool joinSubscribing(Topic* topic, uint8_t qos, Client* client, uint16_t clientMsgId);
+    void subscribed(uint16_t msgId, uint8_t rc, std::vector<SubscribingClient>* joined);
+    bool isRetainedFor(Client* client, const char* topic, int topiclen);
+    void eraseSubscribing(Client* client);
+    void resubscribe(Client* client);
+    void unsubscribe(Client* client, Topic* topic);
+    void publish(Client* client, Publish* pub);
 
     void printAggregateTopicTable(void);
     bool testMessageIdTable(void);
@@ -68,8 +112,12 @@ private:
     Gateway* _gateway { nullptr };
     MessageIdTable _msgIdTable;
     AggregateTopicTable _topicTable;
+    std::unordered_map<uint16_t, AggregateSubscribing> _subscribing;   // SUBSCRIBEs waiting SUBACKs
+    std::string _retainedTopic;                 // topic filter of the last SUBACK
+    std::vector<Client*> _retainedClients;      // clients which receive retained messages of the last SUBACK
 
     bool _isActive { false };
+    bool _isSharing { false };
     bool _isSecure { false };
 };
 
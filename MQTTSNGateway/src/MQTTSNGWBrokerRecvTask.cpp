@@ -18,6 +18,7 @@
 #include "MQTTSNGWClient.h"
 #include "MQTTSNGWClientList.h"
 #include "MQTTSNGateway.h"
+#include "MQTTSNGWTrace.h"
 #include <unistd.h>
 
 using namespace std;
@@ -62,7 +63,6 @@ void BrokerRecvTask::run(void)
 
     while (true)
     {
-        _light->blueLight(false);
         if (CHK_SIGINT)
         {
             WRITELOG("%s %s stopped.\n", currentDateTime(), getTaskName());
@@ -76,6 +76,7 @@ void BrokerRecvTask::run(void)
         int sockfd = 0;
 
         /* Prepare sockets list to read */
+        _gateway->getClientList()->scanned();
         Client* client = _gateway->getClientList()->getClient(0);
 
         while (client)
@@ -108,7 +109,6 @@ void BrokerRecvTask::run(void)
 
                 while (client)
                 {
-                    _light->blueLight(false);
                     if (client->getNetwork()->isValid())
                     {
                         int sockfd = client->getNetwork()->getSock();
@@ -121,12 +121,20 @@ void BrokerRecvTask::run(void)
                             rc = packet->recv(client->getNetwork());
                             if (rc > 0)
                             {
+                                client->brokerPacketReceived();
                                 if (log(client, packet) == -1)
                                 {
                                     delete packet;
                                     goto nextClient;
                                 }
 
+                                if (packet->getType() == PUBLISH)
+                                {
+                                    Publish pub;
+                                    packet->getPUBLISH(&pub);
+                                    _gateway->getRetainedCache()->update(&pub);
+                                }
+
                                 /* post a BrokerRecvEvent */
                                 ev = new Event();
                                 ev->setBrokerRecvEvent(client, packet);
@@ -164,7 +172,7 @@ void BrokerRecvTask::run(void)
 
                                 delete packet;
 
-                                if ((rc == -1 || rc == -2) && (client->isActive() || client->isSleep() || client->isAwake()))
+                                if ((rc == -1 || rc == -2) && (client->isActive() || client->isSleep() || client->isAwake() || client->isSessionKept()))
                                 {
                                     client->getNetwork()->close();
                                     client->disconnected();
@@ -186,36 +194,58 @@ int BrokerRecvTask::log(Client* client, MQTTGWPacket* packet)
 {
     char pbuf[(SIZE_OF_LOG_PACKET + 5) * 3];
     char msgId[6];
-    int rc = 0;
 
+    /* packets which a broker never sends are discarded */
     switch (packet->getType())
     {
     case CONNACK:
-        WRITELOG(FORMAT_Y_Y_W, currentDateTime(), packet->getName(), LEFTARROWB, client->getClientId(), packet->print(pbuf));
+    case PUBLISH:
+    case PUBACK:
+    case PUBREC:
+    case PUBREL:
+    case PUBCOMP:
+    case SUBACK:
+    case UNSUBACK:
+    case PINGRESP:
+        break;
+    default:
+        WRITELOG("Type=%x\n", packet->getType());
+        return -1;
+    }
+
+    PacketTrace::put(TRACE_BROKER_RECV, client, packet);
+    if (!CHK_PACKETLOG(packet->getLogCategory()))
+    {
+        return 0;
+    }
+    const char* dump = CHK_PACKETDUMP ? packet->print(pbuf) : "";
+
+    switch (packet->getType())
+    {
+    case CONNACK:
+        WRITELOG(FORMAT_Y_Y_W, currentDateTime(), packet->getName(), LEFTARROWB, client->getClientId(), dump);
         break;
     case PUBLISH:
         WRITELOG(FORMAT_W_MSGID_Y_W_NL, currentDateTime(), packet->getName(), packet->getMsgId(msgId), LEFTARROWB,
-                client->getClientId(), packet->print(pbuf));
+                client->getClientId(), dump);
         break;
     case PUBACK:
     case PUBREC:
     case PUBREL:
     case PUBCOMP:
         WRITELOG(FORMAT_W_MSGID_Y_W, currentDateTime(), packet->getName(), packet->getMsgId(msgId), LEFTARROWB,
-                client->getClientId(), packet->print(pbuf));
+                client->getClientId(), dump);
         break;
     case SUBACK:
     case UNSUBACK:
         WRITELOG(FORMAT_W_MSGID_Y_W, currentDateTime(), packet->getName(), packet->getMsgId(msgId), LEFTARROWB,
-                client->getClientId(), packet->print(pbuf));
+                client->getClientId(), dump);
         break;
     case PINGRESP:
-        WRITELOG(FORMAT_Y_Y_W, currentDateTime(), packet->getName(), LEFTARROWB, client->getClientId(), packet->print(pbuf));
+        WRITELOG(FORMAT_Y_Y_W, currentDateTime(), packet->getName(), LEFTARROWB, client->getClientId(), dump);
         break;
     default:
-        WRITELOG("Type=%x\n", packet->getType());
-        rc = -1;
         break;
     }
-    return rc;
+    return 0;
 }
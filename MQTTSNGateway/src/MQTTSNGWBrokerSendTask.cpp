@@ -20,6 +20,7 @@
 #include "MQTTSNGateway.h"
 #include "MQTTSNGWClient.h"
 #include "MQTTGWPacket.h"
+#include "MQTTSNGWTrace.h"
 #include <string.h>
 
 using namespace std;
@@ -42,6 +43,13 @@ BrokerSendTask::BrokerSendTask(Gateway* gateway)
 
 BrokerSendTask::~BrokerSendTask()
 {
+    for (auto it = _queues.begin(); it != _queues.end(); it++)
+    {
+        for (size_t i = 0; i < it->second.events.size(); i++)
+        {
+            delete it->second.events[i];
+        }
+    }
 }
 
 /**
@@ -55,101 +63,171 @@ void BrokerSendTask::initialize(int argc, char** argv)
 
 /**
  *  connect to the broker and send MQTT messges
+ *  Packets of each client are sent in order, and clients are served
+ *  by the deficit round robin so that a client can't monopolize this task.
+ *  Clients of an Adapter have their own queues and share the connection of the Adapter.
  */
 void BrokerSendTask::run()
 {
+    EventQue* que = _gateway->getBrokerSendQue();
     Event* ev = nullptr;
-    MQTTGWPacket* packet = nullptr;
-    Client* client = nullptr;
-    AdapterManager* adpMgr = _gateway->getAdapterManager();
-    int rc = 0;
 
     while (true)
     {
-        ev = _gateway->getBrokerSendQue()->wait();
-
-        if (ev->getEventType() == EtStop)
+        /* wait an event only when no packet is pending. otherwise take events without blocking */
+        if (_activeClients.empty())
         {
-            WRITELOG("%s %s stopped.\n", currentDateTime(), getTaskName());
-            delete ev;
-            return;
+            ev = que->wait();
         }
-
-        if (ev->getEventType() == EtBrokerSend)
+        else
         {
-            client = ev->getClient();
-            packet = ev->getMQTTGWPacket();
-
-            /* Check Client is managed by Adapters */
-            client = adpMgr->getClient(client);
-
-            if (packet->getType() == CONNECT && client->getNetwork()->isValid())
-            {
-                client->getNetwork()->close();
-            }
+            ev = que->size() > 0 ? que->timedwait(0) : nullptr;
+        }
 
-            if (!client->getNetwork()->isValid())
+        /* take all events posted */
+        while (ev)
+        {
+            if (ev->getEventType() == EtStop)
             {
-                /* connect to the broker and send a packet */
-
-                if (client->isSecureNetwork())
-                {
-                    rc = client->getNetwork()->connect((const char*) _gwparams->brokerName, (const char*) _gwparams->portSecure,
-                            (const char*) _gwparams->rootCApath, (const char*) _gwparams->rootCAfile,
-                            (const char*) _gwparams->certKey, (const char*) _gwparams->privateKey);
-                }
-                else
-                {
-                    rc = client->getNetwork()->connect((const char*) _gwparams->brokerName, (const char*) _gwparams->port);
-                }
-
-                if (!rc)
+                while (!_activeClients.empty())
                 {
-                    /* disconnect the broker and the client */
-                    WRITELOG("%s BrokerSendTask: %s can't connect to the broker. errno=%d %s %s\n",
-                    ERRMSG_HEADER, client->getClientId(), errno, strerror(errno), ERRMSG_FOOTER);
-                    delete ev;
-                    client->getNetwork()->close();
-                    continue;
+                    serve();
                 }
+                WRITELOG("%s %s stopped.\n", currentDateTime(), getTaskName());
+                delete ev;
+                return;
             }
 
-            /* send a packet */
-            _light->blueLight(true);
-            if ((rc = packet->send(client->getNetwork())) > 0)
+            if (ev->getEventType() == EtBrokerSend)
             {
-                if (packet->getType() == CONNECT)
+                Client* client = ev->getClient();
+                ClientSendQueue* queue = &_queues[client];
+                if (queue->events.empty())
                 {
-                    client->connectSended();
+                    _activeClients.push_back(client);
                 }
-                else if (packet->getType() == DISCONNECT)
-                {
-                    client->getNetwork()->close();
-                    client->disconnected();
-                }
-                log(client, packet);
+                queue->events.push_back(ev);
             }
             else
             {
-                WRITELOG("%s BrokerSendTask: %s can't send a packet to the broker. errno=%d %s %s\n",
-                ERRMSG_HEADER, client->getClientId(), rc == -1 ? errno : 0, strerror(errno), ERRMSG_FOOTER);
-                if ( errno != EBADF)
-                {
-                    client->getNetwork()->close();
-                }
-
-                /* Disconnect the client */
-                packet = new MQTTGWPacket();
-                packet->setHeader(DISCONNECT);
-                Event* ev1 = new Event();
-                ev1->setBrokerRecvEvent(client, packet);
-                _gateway->getPacketEventQue()->post(ev1);
+                delete ev;
             }
+            ev = que->size() > 0 ? que->timedwait(0) : nullptr;
+        }
 
-            _light->blueLight(false);
+        serve();
+    }
+}
+
+/**
+ *  Send packets of the first client within its deficit.
+ */
+void BrokerSendTask::serve(void)
+{
+    Client* client = _activeClients.front();
+    ClientSendQueue* queue = &_queues[client];
+    _activeClients.pop_front();
+
+    queue->deficit += BROKER_SEND_QUANTUM;
+    while (!queue->events.empty())
+    {
+        Event* ev = queue->events.front();
+        int len = ev->getMQTTGWPacket()->getPacketLength();
+        if (len > queue->deficit)
+        {
+            break;
         }
+        queue->deficit -= len;
+        queue->events.pop_front();
+
+        /* Check Client is managed by Adapters */
+        send(_gateway->getAdapterManager()->getClient(client), ev->getMQTTGWPacket());
         delete ev;
     }
+
+    /* the entry lives only while events refer to the client, so a recycled client starts with no deficit */
+    if (queue->events.empty())
+    {
+        _queues.erase(client);
+    }
+    else
+    {
+        _activeClients.push_back(client);
+    }
+}
+
+void BrokerSendTask::send(Client* client, MQTTGWPacket* packet)
+{
+    int rc = 0;
+
+    /* the connection has been closed already */
+    if (packet->getType() == DISCONNECT && !client->getNetwork()->isValid())
+    {
+        return;
+    }
+
+    if (packet->getType() == CONNECT && client->getNetwork()->isValid())
+    {
+        client->getNetwork()->close();
+    }
+
+    if (!client->getNetwork()->isValid())
+    {
+        /* connect to the broker and send a packet */
+
+        if (client->isSecureNetwork())
+        {
+            rc = client->getNetwork()->connect((const char*) _gwparams->brokerName, (const char*) _gwparams->portSecure,
+                    (const char*) _gwparams->rootCApath, (const char*) _gwparams->rootCAfile,
+                    (const char*) _gwparams->certKey, (const char*) _gwparams->privateKey);
+        }
+        else
+        {
+            rc = client->getNetwork()->connect((const char*) _gwparams->brokerName, (const char*) _gwparams->port);
+        }
+
+        if (!rc)
+        {
+            /* disconnect the broker and the client */
+            WRITELOG("%s BrokerSendTask: %s can't connect to the broker. errno=%d %s %s\n",
+            ERRMSG_HEADER, client->getClientId(), errno, strerror(errno), ERRMSG_FOOTER);
+            client->getNetwork()->close();
+            return;
+        }
+    }
+
+    /* send a packet */
+    _light->blueLight(true);
+    if ((rc = packet->send(client->getNetwork())) > 0)
+    {
+        client->brokerPacketSended();
+        if (packet->getType() == CONNECT)
+        {
+            client->connectSended();
+        }
+        else if (packet->getType() == DISCONNECT)
+        {
+            client->getNetwork()->close();
+            client->disconnected();
+        }
+        log(client, packet);
+    }
+    else
+    {
+        WRITELOG("%s BrokerSendTask: %s can't send a packet to the broker. errno=%d %s %s\n",
+        ERRMSG_HEADER, client->getClientId(), rc == -1 ? errno : 0, strerror(errno), ERRMSG_FOOTER);
+        if ( errno != EBADF)
+        {
+            client->getNetwork()->close();
+        }
+
+        /* Disconnect the client */
+        packet = new MQTTGWPacket();
+        packet->setHeader(DISCONNECT);
+        Event* ev1 = new Event();
+        ev1->setBrokerRecvEvent(client, packet);
+        _gateway->getPacketEventQue()->post(ev1);
+    }
 }
 
 /**
@@ -160,16 +238,23 @@ void BrokerSendTask::log(Client* client, MQTTGWPacket* packet)
     char pbuf[(SIZE_OF_LOG_PACKET + 5) * 3];
     char msgId[6];
 
+    PacketTrace::put(TRACE_BROKER_SEND, client, packet);
+    if (!CHK_PACKETLOG(packet->getLogCategory()))
+    {
+        return;
+    }
+    const char* dump = CHK_PACKETDUMP ? packet->print(pbuf) : "";
+
     switch (packet->getType())
     {
     case CONNECT:
     DEBUGLOG("XXX Duration3  = %d\n", 42);
         WRITELOG(FORMAT_Y_Y_W, currentDateTime(), packet->getName(),
-        RIGHTARROWB, client->getClientId(), packet->print(pbuf));
+        RIGHTARROWB, client->getClientId(), dump);
         break;
     case PUBLISH:
         WRITELOG(FORMAT_W_MSGID_Y_W, currentDateTime(), packet->getName(), packet->getMsgId(msgId), RIGHTARROWB,
-                client->getClientId(), packet->print(pbuf));
+                client->getClientId(), dump);
         break;
     case SUBSCRIBE:
     case UNSUBSCRIBE:
@@ -178,15 +263,15 @@ void BrokerSendTask::log(Client* client, MQTTGWPacket* packet)
     case PUBREL:
     case PUBCOMP:
         WRITELOG(FORMAT_W_MSGID_Y_W, currentDateTime(), packet->getName(), packet->getMsgId(msgId), RIGHTARROWB,
-                client->getClientId(), packet->print(pbuf));
+                client->getClientId(), dump);
         break;
     case PINGREQ:
         WRITELOG(FORMAT_Y_Y_W, currentDateTime(), packet->getName(),
-        RIGHTARROWB, client->getClientId(), packet->print(pbuf));
+        RIGHTARROWB, client->getClientId(), dump);
         break;
     case DISCONNECT:
         WRITELOG(FORMAT_Y_Y_W, currentDateTime(), packet->getName(),
-        RIGHTARROWB, client->getClientId(), packet->print(pbuf));
+        RIGHTARROWB, client->getClientId(), dump);
         break;
     default:
         break;
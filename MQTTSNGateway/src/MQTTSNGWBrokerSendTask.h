@@ -19,11 +19,22 @@
 #include "MQTTSNGWDefines.h"
 #include "MQTTSNGateway.h"
 #include "MQTTSNGWClient.h"
+#include <deque>
+#include <unordered_map>
 
 namespace MQTTSNGW
 {
 class Adapter;
 
+#define BROKER_SEND_QUANTUM  (1024)  // bytes added to the deficit of a client at each round
+
+/* packets of a client waiting to be sent */
+typedef struct
+{
+    std::deque<Event*> events;
+    int deficit;
+} ClientSendQueue;
+
 /*=====================================
  Class BrokerSendTask
  =====================================*/
@@ -37,10 +48,14 @@ public:
     void initialize(int argc, char** argv);
     void run();
 private:
+    void serve(void);
+    void send(Client* client, MQTTGWPacket* packet);
     void log(Client*, MQTTGWPacket*);
     Gateway* _gateway;
     GatewayParams* _gwparams;
     LightIndicator* _light;
+    std::unordered_map<Client*, ClientSendQueue> _queues;  // clients which have packets
+    std::deque<Client*> _activeClients;     // clients which have packets in the round robin order
 };
 
 }
@@ -0,0 +1,315 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#include "MQTTSNGWBufferPool.h"
+#include "MQTTSNGWProcess.h"
+#include "Threading.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+using namespace MQTTSNGW;
+
+static const int bufferPoolSize[BUFFERPOOL_CLASSES] = { 64, 256, 1024, 4096 };
+
+#define OVERSIZE_CLASS  (-1)
+
+/*
+ *  A buffer is preceded by a header which keeps the size class.
+ */
+typedef struct BufferHeader
+{
+    struct BufferHeader* next;
+    int sizeClass;
+    int capacity;
+} BufferHeader;
+
+typedef struct
+{
+    Mutex mutex;
+    BufferHeader* head { nullptr };
+    int count { 0 };
+    std::atomic<uint64_t> allocs { 0 };
+    std::atomic<uint64_t> inUse { 0 };
+    std::atomic<uint64_t> blocks { 0 };
+    std::atomic<uint64_t> refills { 0 };
+    std::atomic<uint64_t> spills { 0 };
+} CentralList;
+
+static std::atomic<uint64_t> oversizeCount { 0 };
+
+/*
+ *  Central lists are never destroyed because packets may be released
+ *  by destructors of static objects after the end of main().
+ */
+static CentralList* central(void)
+{
+    static CentralList* lists = new CentralList[BUFFERPOOL_CLASSES];
+    return lists;
+}
+
+/* Carve a slab into buffers. called with the central list locked. */
+static void carveSlab(int sizeClass, CentralList* list)
+{
+    int blockSize = sizeof(BufferHeader) + bufferPoolSize[sizeClass];
+    int cnt = BUFFERPOOL_SLAB_SIZE / blockSize;
+    if (cnt == 0)
+    {
+        cnt = 1;
+    }
+    unsigned char* slab = (unsigned char*) malloc(blockSize * cnt);
+    if (slab == nullptr)
+    {
+        return;
+    }
+    for (int i = 0; i < cnt; i++)
+    {
+        BufferHeader* hdr = (BufferHeader*) (slab + blockSize * i);
+        hdr->sizeClass = sizeClass;
+        hdr->capacity = bufferPoolSize[sizeClass];
+        hdr->next = list->head;
+        list->head = hdr;
+    }
+    list->count += cnt;
+    list->blocks += cnt;
+}
+
+/*
+ *  true after the cache of the thread is destroyed. Destructors of other thread_local
+ *  and static objects which run after it use the central lists directly.
+ */
+static thread_local bool cacheDestroyed = false;
+
+static BufferHeader* centralPop(int sizeClass)
+{
+    CentralList* list = &central()[sizeClass];
+    list->mutex.lock();
+    if (list->head == nullptr)
+    {
+        carveSlab(sizeClass, list);
+    }
+    BufferHeader* hdr = list->head;
+    if (hdr)
+    {
+        list->head = hdr->next;
+        list->count--;
+    }
+    list->mutex.unlock();
+    return hdr;
+}
+
+static void centralPush(BufferHeader* hdr)
+{
+    CentralList* list = &central()[hdr->sizeClass];
+    list->mutex.lock();
+    hdr->next = list->head;
+    list->head = hdr;
+    list->count++;
+    list->mutex.unlock();
+}
+
+/*=====================================
+ Class ThreadCache
+ =====================================*/
+class ThreadCache
+{
+public:
+    ThreadCache()
+    {
+        for (int i = 0; i < BUFFERPOOL_CLASSES; i++)
+        {
+            _head[i] = nullptr;
+            _count[i] = 0;
+        }
+    }
+
+    ~ThreadCache()
+    {
+        for (int i = 0; i < BUFFERPOOL_CLASSES; i++)
+        {
+            spill(i, _count[i]);
+        }
+        cacheDestroyed = true;
+    }
+
+    BufferHeader* pop(int sizeClass)
+    {
+        if (_head[sizeClass] == nullptr)
+        {
+            refill(sizeClass);
+        }
+        BufferHeader* hdr = _head[sizeClass];
+        if (hdr)
+        {
+            _head[sizeClass] = hdr->next;
+            _count[sizeClass]--;
+        }
+        return hdr;
+    }
+
+    void push(BufferHeader* hdr)
+    {
+        int sizeClass = hdr->sizeClass;
+        if (_count[sizeClass] >= BUFFERPOOL_CACHE_SIZE)
+        {
+            spill(sizeClass, BUFFERPOOL_CACHE_SIZE / 2);
+        }
+        hdr->next = _head[sizeClass];
+        _head[sizeClass] = hdr;
+        _count[sizeClass]++;
+    }
+
+private:
+    void refill(int sizeClass)
+    {
+        CentralList* list = &central()[sizeClass];
+        list->mutex.lock();
+        if (list->head == nullptr)
+        {
+            carveSlab(sizeClass, list);
+        }
+        int cnt = 0;
+        while (list->head && cnt < BUFFERPOOL_CACHE_SIZE / 2)
+        {
+            BufferHeader* hdr = list->head;
+            list->head = hdr->next;
+            hdr->next = _head[sizeClass];
+            _head[sizeClass] = hdr;
+            cnt++;
+        }
+        list->count -= cnt;
+        list->mutex.unlock();
+        _count[sizeClass] += cnt;
+        list->refills++;
+    }
+
+    void spill(int sizeClass, int cnt)
+    {
+        if (cnt == 0)
+        {
+            return;
+        }
+        CentralList* list = &central()[sizeClass];
+        list->mutex.lock();
+        for (int i = 0; i < cnt && _head[sizeClass]; i++)
+        {
+            BufferHeader* hdr = _head[sizeClass];
+            _head[sizeClass] = hdr->next;
+            hdr->next = list->head;
+            list->head = hdr;
+            list->count++;
+            _count[sizeClass]--;
+        }
+        list->mutex.unlock();
+        list->spills++;
+    }
+
+    BufferHeader* _head[BUFFERPOOL_CLASSES];
+    int _count[BUFFERPOOL_CLASSES];
+};
+
+static thread_local ThreadCache threadCache;
+
+/*=====================================
+ Class BufferPool
+ =====================================*/
+unsigned char* BufferPool::allocate(int size)
+{
+    BufferHeader* hdr = nullptr;
+    for (int i = 0; i < BUFFERPOOL_CLASSES; i++)
+    {
+        if (size <= bufferPoolSize[i])
+        {
+            hdr = cacheDestroyed ? centralPop(i) : threadCache.pop(i);
+            if (hdr == nullptr)
+            {
+                return nullptr;
+            }
+            CentralList* list = &central()[i];
+            list->allocs.fetch_add(1, std::memory_order_relaxed);
+            list->inUse.fetch_add(1, std::memory_order_relaxed);
+            return (unsigned char*) (hdr + 1);
+        }
+    }
+
+    hdr = (BufferHeader*) malloc(sizeof(BufferHeader) + size);
+    if (hdr == nullptr)
+    {
+        return nullptr;
+    }
+    hdr->next = nullptr;
+    hdr->sizeClass = OVERSIZE_CLASS;
+    hdr->capacity = size;
+    oversizeCount.fetch_add(1, std::memory_order_relaxed);
+    return (unsigned char*) (hdr + 1);
+}
+
+void BufferPool::release(unsigned char* buf)
+{
+    if (buf == nullptr)
+    {
+        return;
+    }
+    BufferHeader* hdr = (BufferHeader*) buf - 1;
+    if (hdr->sizeClass == OVERSIZE_CLASS)
+    {
+        free(hdr);
+        return;
+    }
+    central()[hdr->sizeClass].inUse.fetch_sub(1, std::memory_order_relaxed);
+    if (cacheDestroyed)
+    {
+        centralPush(hdr);
+    }
+    else
+    {
+        threadCache.push(hdr);
+    }
+}
+
+int BufferPool::getCapacity(unsigned char* buf)
+{
+    return buf ? ((BufferHeader*) buf - 1)->capacity : 0;
+}
+
+void BufferPool::getStat(int sizeClass, BufferPoolStat* stat)
+{
+    CentralList* list = &central()[sizeClass];
+    stat->size = bufferPoolSize[sizeClass];
+    stat->allocs = list->allocs.load();
+    stat->inUse = list->inUse.load();
+    stat->blocks = list->blocks.load();
+    stat->refills = list->refills.load();
+    stat->spills = list->spills.load();
+}
+
+uint64_t BufferPool::getOversizeCount(void)
+{
+    return oversizeCount.load();
+}
+
+void BufferPool::print(void)
+{
+    BufferPoolStat stat;
+    WRITELOG(" BufferPool   size     allocs      inUse     blocks    refills     spills\n");
+    for (int i = 0; i < BUFFERPOOL_CLASSES; i++)
+    {
+        getStat(i, &stat);
+        WRITELOG("            %6d %10llu %10llu %10llu %10llu %10llu\n", stat.size, (unsigned long long) stat.allocs,
+                (unsigned long long) stat.inUse, (unsigned long long) stat.blocks, (unsigned long long) stat.refills,
+                (unsigned long long) stat.spills);
+    }
+    WRITELOG("            oversize %llu\n", (unsigned long long) getOversizeCount());
+}
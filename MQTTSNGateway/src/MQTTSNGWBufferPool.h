@@ -0,0 +1,61 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#ifndef MQTTSNGATEWAY_SRC_MQTTSNGWBUFFERPOOL_H_
+#define MQTTSNGATEWAY_SRC_MQTTSNGWBUFFERPOOL_H_
+
+#include "MQTTSNGWDefines.h"
+#include <stdint.h>
+
+namespace MQTTSNGW
+{
+
+#define BUFFERPOOL_CLASSES     4    // number of size classes
+
+typedef struct
+{
+    int size;               // capacity of a buffer of the class
+    uint64_t allocs;        // number of allocations
+    uint64_t inUse;         // buffers held by packets
+    uint64_t blocks;        // buffers carved from slabs
+    uint64_t refills;       // thread caches refilled from the central list
+    uint64_t spills;        // thread caches returned to the central list
+} BufferPoolStat;
+
+/*=====================================
+ Class BufferPool
+
+ Packet buffers are taken from slabs of size classes.
+ Each thread keeps a cache of free buffers per class and
+ exchanges them with the central free list in batches,
+ so a buffer may be released by another thread than
+ the one which allocated it. Once the cache of a thread is
+ destroyed, the thread uses the central free list directly.
+ Requests larger than the largest class are malloc'd.
+ =====================================*/
+class BufferPool
+{
+public:
+    static unsigned char* allocate(int size);
+    static void release(unsigned char* buf);
+    static int getCapacity(unsigned char* buf);
+    static void getStat(int sizeClass, BufferPoolStat* stat);
+    static uint64_t getOversizeCount(void);
+    static void print(void);
+};
+
+}
+
+#endif /* MQTTSNGATEWAY_SRC_MQTTSNGWBUFFERPOOL_H_ */
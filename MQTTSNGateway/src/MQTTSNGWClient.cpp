@@ -22,6 +22,7 @@
 #include <string>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "MQTTSNGWForwarder.h"
 
@@ -31,6 +32,20 @@ char* currentDateTime(void);
 /*=====================================
  Class Client
  =====================================*/
+static uint32_t monotonicSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec;
+}
+
+static uint32_t monotonicMsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 static const char* theClientStatus[] = { "InPool", "Disconnected", "TryConnecting", "Connecting", "Active", "Asleep", "Awake",
         "Lost" };
 
@@ -49,15 +64,29 @@ Client::Client()
     _sensorNetype = true;
     _connAck = nullptr;
     _waitWillMsgFlg = false;
+    _willFlg = false;
+    _resumeLimit = 0;
     _sessionStatus = false;
     _prevClient = nullptr;
     _nextClient = nullptr;
-    _clientSleepPacketQue.setMaxSize(MAX_SAVED_PUBLISH);
     _proxyPacketQue.setMaxSize(MAX_SAVED_PUBLISH);
     _hasPredefTopic = false;
     _holdPingRequest = false;
+    _forwardedPingreq = 0;
+    _brokerSendTime = 0;
+    _brokerRecvTime = 0;
     _forwarder = nullptr;
     _clientType = Ctype_Normal;
+    _index = 0;
+    _listGeneration = 0;
+    _sessionOffset = 0;
+    _sessionLength = 0;
+    _sessionTopicGen = 0;
+    _sessionQueGen = 0;
+    _sessionClean = false;
+    _inflightWindow.setClient(this);
+    _uplinkWindow.setClient(this);
+    _waitREGACKList.setClient(this);
 }
 
 Client::~Client()
@@ -113,6 +142,11 @@ void Client::deleteFirstClientSleepPacket()
     _clientSleepPacketQue.pop();
 }
 
+void Client::clearClientSleepPacket()
+{
+    _clientSleepPacketQue.clear();
+}
+
 int Client::setClientSleepPacket(MQTTGWPacket* packet)
 {
     int rc = _clientSleepPacketQue.post(packet);
@@ -188,7 +222,7 @@ void Client::setWaitedSubTopicId(uint16_t msgId, uint16_t topicId, MQTTSN_topici
 
 bool Client::checkTimeover(void)
 {
-    return (_status == Cstat_Active && _keepAliveTimer.isTimeup());
+    return (_status == Cstat_Active && _keepAliveMsec > 0 && _keepAliveTimer.isTimeup());
 }
 
 void Client::setKeepAlive(MQTTSNPacket* packet)
@@ -268,6 +302,7 @@ void Client::updateStatus(MQTTSNPacket* packet)
         {
         case MQTTSN_CONNECT:
             _status = Cstat_Active;
+            setKeepAlive(packet);
             break;
         case MQTTSN_DISCONNECT:
             disconnected();
@@ -287,11 +322,14 @@ void Client::updateStatus(MQTTSNPacket* packet)
 void Client::updateStatus(ClientStatus stat)
 {
     _status = stat;
+    _resumeLimit = 0;
 }
 
 void Client::connectSended()
 {
     _status = Cstat_Connecting;
+    _brokerRecvTime = 0;
+    _forwardedPingreq = 0;
 }
 
 void Client::connackSended(int rc)
@@ -299,6 +337,7 @@ void Client::connackSended(int rc)
     if (rc == MQTTSN_RC_ACCEPTED)
     {
         _status = Cstat_Active;
+        _resumeLimit = 0;
     }
     else
     {
@@ -310,6 +349,27 @@ void Client::disconnected(void)
 {
     _status = Cstat_Disconnected;
     _waitWillMsgFlg = false;
+    _resumeLimit = 0;
+}
+
+/**
+ *  The client is lost, but its connection of the broker is kept alive for the seconds.
+ *  The client can resume the session by CONNECT without the round trip to the broker.
+ */
+void Client::keepSession(uint32_t sec)
+{
+    _status = Cstat_Lost;
+    _resumeLimit = monotonicSeconds() + sec;
+}
+
+bool Client::isSessionKept(void)
+{
+    return _status == Cstat_Lost && _resumeLimit != 0;
+}
+
+bool Client::isSessionExpired(void)
+{
+    return isSessionKept() && (int32_t) (monotonicSeconds() - _resumeLimit) >= 0;
 }
 
 void Client::tryConnect(void)
@@ -399,6 +459,16 @@ bool Client::isWaitWillMsg(void)
     return _waitWillMsgFlg;
 }
 
+void Client::setWillFlg(bool flg)
+{
+    _willFlg = flg;
+}
+
+bool Client::hasWill(void)
+{
+    return _willFlg && _willTopic && _willTopic[0] && _willMsg;
+}
+
 bool Client::isDisconnect(void)
 {
     return (_status == Cstat_Disconnected);
@@ -439,11 +509,26 @@ WaitREGACKPacketList* Client::getWaitREGACKPacketList()
     return &_waitREGACKList;
 }
 
+InflightWindow* Client::getInflightWindow()
+{
+    return &_inflightWindow;
+}
+
+UplinkWindow* Client::getUplinkWindow()
+{
+    return &_uplinkWindow;
+}
+
 Client* Client::getNextClient(void)
 {
     return _nextClient;
 }
 
+uint16_t Client::getIndex(void)
+{
+    return _index;
+}
+
 void Client::setClientId(MQTTSNString id)
 {
     if (_clientId)
@@ -582,20 +667,121 @@ bool Client::isHoldPingReqest(void)
     return _holdPingRequest;
 }
 
+/*
+ *  Called by the BrokerSendTask and the BrokerRecvTask
+ *  to know whether the connection of the broker is alive.
+ */
+void Client::brokerPacketSended(void)
+{
+    _brokerSendTime.store(monotonicSeconds(), std::memory_order_relaxed);
+}
+
+void Client::brokerPacketReceived(void)
+{
+    _brokerRecvTime.store(monotonicSeconds(), std::memory_order_relaxed);
+}
+
+/**
+ *  @return true if a packet has been received from the broker within 1.5 times the keep alive interval.
+ *  The gateway can answer a PINGREQ of the client by itself.
+ */
+bool Client::isBrokerAlive(void)
+{
+    uint32_t recvTime = _brokerRecvTime.load(std::memory_order_relaxed);
+
+    if (_connectData.keepAliveTimer == 0 || recvTime == 0 || !_network->isValid())
+    {
+        return false;
+    }
+    if (_status != Cstat_Active && _status != Cstat_Asleep && _status != Cstat_Awake && !isSessionKept())
+    {
+        return false;
+    }
+    /* the PINGRESP of the PINGREQ sent by the gateway at the keep alive interval is expected in this period */
+    return monotonicSeconds() - recvTime < (uint32_t) _connectData.keepAliveTimer * 3 / 2;
+}
+
+/**
+ *  @return true if no packet has been sent to the broker for the keep alive interval.
+ */
+bool Client::isBrokerPingreqRequired(void)
+{
+    if (_connectData.keepAliveTimer == 0 || !_network->isValid())
+    {
+        return false;
+    }
+    /* the broker detects the loss of the client which has a will by PINGREQs of the client */
+    if (_status == Cstat_Active && _connectData.flags.bits.will)
+    {
+        return false;
+    }
+    if (_status != Cstat_Active && _status != Cstat_Asleep && _status != Cstat_Awake && !isSessionKept())
+    {
+        return false;
+    }
+    return monotonicSeconds() - _brokerSendTime.load(std::memory_order_relaxed) >= (uint32_t) _connectData.keepAliveTimer;
+}
+
+void Client::pingreqForwarded(void)
+{
+    _forwardedPingreq++;
+}
+
+/**
+ *  Events of all tasks count the client, so a removed client is deleted after they are handled.
+ */
+void Client::addRef(void)
+{
+    _refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Client::releaseRef(void)
+{
+    _refCount.fetch_sub(1, std::memory_order_release);
+}
+
+int Client::getRefCount(void)
+{
+    return _refCount.load(std::memory_order_acquire);
+}
+
+/**
+ *  @return true if a PINGRESP is the response of the PINGREQ of the client.
+ *  false if it is the response of the PINGREQ which the gateway sent to keep the connection.
+ */
+bool Client::isPingrespForwardable(void)
+{
+    if (_forwardedPingreq == 0)
+    {
+        return false;
+    }
+    _forwardedPingreq--;
+    return true;
+}
+
 /*=====================================
  Class WaitREGACKPacket
  =====================================*/
-waitREGACKPacket::waitREGACKPacket(MQTTSNPacket* packet, uint16_t REGACKMsgId)
+waitREGACKPacket::waitREGACKPacket(WaitREGACKPacketList* list, uint16_t REGACKMsgId, uint16_t topicId)
 {
-    _packet = packet;
+    _list = list;
     _msgId = REGACKMsgId;
-    _next = nullptr;
-    _prev = nullptr;
+    _topicId = topicId;
+    _retry = 0;
+    _sendTime = 0;
 }
 
 waitREGACKPacket::~waitREGACKPacket()
 {
-    delete _packet;
+    for (size_t i = 0; i < _packets.size(); i++)
+    {
+        delete _packets[i];
+    }
+}
+
+void waitREGACKPacket::timeout(EventQue* que)
+{
+    _list->resend(this, que);
 }
 
 /*=====================================
@@ -604,93 +790,210 @@ waitREGACKPacket::~waitREGACKPacket()
 
 WaitREGACKPacketList::WaitREGACKPacketList()
 {
-    _first = nullptr;
-    _end = nullptr;
-    _cnt = 0;
+    _client = nullptr;
 }
 
 WaitREGACKPacketList::~WaitREGACKPacketList()
 {
-    waitREGACKPacket* p = _first;
-    while (p)
+    clear();
+}
+
+void WaitREGACKPacketList::setClient(Client* client)
+{
+    _client = client;
+}
+
+/**
+ *  Send a REGISTER of the topic to the client.
+ *  A REGISTER of the topic which is not acknowledged yet is sent again.
+ */
+void WaitREGACKPacketList::send(Topic* topic, EventQue* que)
+{
+    uint16_t topicId = topic->getTopicId();
+    auto it = _topicIds.find(topicId);
+    if (it != _topicIds.end())
     {
-        waitREGACKPacket* q = p->_next;
-        delete p;
-        p = q;
+        post(it->second, que);
+        return;
     }
+
+    uint16_t msgId = _client->getNextSnMsgId();
+    while (_msgIds.find(msgId) != _msgIds.end())
+    {
+        msgId = _client->getNextSnMsgId();
+    }
+
+    waitREGACKPacket* elm = new waitREGACKPacket(this, msgId, topicId);
+    _msgIds[msgId] = elm;
+    _topicIds[topicId] = elm;
+    post(elm, que);
 }
 
-int WaitREGACKPacketList::setPacket(MQTTSNPacket* packet, uint16_t REGACKMsgId)
+/**
+ *  Send REGISTERs of all topics of the session which the gateway can PUBLISH
+ *  before PUBLISHes saved in the session, because the client may have lost TopicIds.
+ */
+void WaitREGACKPacketList::sendTopics(EventQue* que)
 {
-    waitREGACKPacket* elm = new waitREGACKPacket(packet, REGACKMsgId);
-    if (elm == nullptr)
+    Topics* topics = _client->getTopics();
+    for (Topic* topic = topics->getFirstTopic(); topic; topic = topics->getNextTopic(topic))
     {
-        return 0;
+        string* name = topic->getTopicName();
+        if (topic->getType() == MQTTSN_TOPIC_TYPE_NORMAL && topic->getTopicId() > 0
+                && name->find_first_of("#+") == string::npos)
+        {
+            send(topic, que);
+        }
     }
+}
 
-    if (_first == nullptr)
+/**
+ *  Keep a PUBLISH until the REGACK of the topic arrives.
+ *  The oldest one is discarded when MAX_SAVED_PUBLISH PUBLISHes are kept.
+ *  @return false if the topic is not registering. The PUBLISH can be sent.
+ */
+bool WaitREGACKPacketList::setPacket(MQTTSNPacket* packet, uint16_t topicId)
+{
+    auto it = _topicIds.find(topicId);
+    if (it == _topicIds.end())
     {
-        _first = elm;
-        _end = elm;
+        return false;
     }
-    else
+    waitREGACKPacket* elm = it->second;
+    if (elm->_packets.size() >= MAX_SAVED_PUBLISH)
     {
-        _end->_next = elm;
-        elm->_prev = _end;
-        _end = elm;
+        delete elm->_packets.front();
+        elm->_packets.erase(elm->_packets.begin());
+        Retransmitter::count(RETRANSMIT_DROPPED);
     }
-    _cnt++;
-    return 1;
+    elm->_packets.push_back(packet);
+    return true;
 }
 
-MQTTSNPacket* WaitREGACKPacketList::getPacket(uint16_t REGACKMsgId)
+/**
+ *  Called with a REGACK. PUBLISHes of the topic are sent in the order of arrival.
+ */
+void WaitREGACKPacketList::acknowledge(uint16_t REGACKMsgId, EventQue* que)
 {
-    waitREGACKPacket* p = _first;
-    while (p)
+    auto it = _msgIds.find(REGACKMsgId);
+    if (it != _msgIds.end())
     {
-        if (p->_msgId == REGACKMsgId)
+        release(it->second, que);
+    }
+}
+
+/**
+ *  Send REGISTERs which are not acknowledged within the timeout again without waiting the Retransmitter.
+ *  Called when the client sends PINGREQ.
+ */
+void WaitREGACKPacketList::retransmit(EventQue* que)
+{
+    std::vector<waitREGACKPacket*> expired;
+    uint32_t now = monotonicMsec();
+    for (auto it = _msgIds.begin(); it != _msgIds.end(); it++)
+    {
+        if (now - it->second->_sendTime >= _client->getInflightWindow()->getTimeout())
         {
-            return p->_packet;
+            expired.push_back(it->second);
         }
-        p = p->_next;
     }
-    return nullptr;
+
+    for (size_t i = 0; i < expired.size(); i++)
+    {
+        resend(expired[i], que);
+    }
 }
 
-void WaitREGACKPacketList::erase(uint16_t REGACKMsgId)
+bool WaitREGACKPacketList::isRegistering(uint16_t topicId)
 {
-    waitREGACKPacket* p = _first;
-    while (p)
+    return _topicIds.find(topicId) != _topicIds.end();
+}
+
+int WaitREGACKPacketList::getCount(void)
+{
+    return (int) _msgIds.size();
+}
+
+void WaitREGACKPacketList::clear(void)
+{
+    for (auto it = _msgIds.begin(); it != _msgIds.end(); it++)
     {
-        if (p->_msgId == REGACKMsgId)
-        {
-            if (p->_prev == nullptr)
-            {
-                _first = p->_next;
+        delete it->second;
+    }
+    _msgIds.clear();
+    _topicIds.clear();
+}
 
-            }
-            else
-            {
-                p->_prev->_next = p->_next;
-            }
-            if (p->_next == nullptr)
-            {
-                _end = p->_prev;
-            }
-            else
-            {
-                p->_next->_prev = p->_prev;
-            }
-            _cnt--;
-            break;
-            // Do not delete element. Element is deleted after sending to Client.
-        }
-        p = p->_next;
+void WaitREGACKPacketList::post(waitREGACKPacket* elm, EventQue* que)
+{
+    MQTTSN_topicid topicId;
+    topicId.type = MQTTSN_TOPIC_TYPE_NORMAL;
+    topicId.data.id = elm->_topicId;
+    Topic* topic = _client->getTopics()->getTopicById(&topicId);
+    if (topic == nullptr)
+    {
+        release(elm, que);
+        return;
     }
+
+    MQTTSNString topicName = MQTTSNString_initializer;
+    topicName.lenstring.len = topic->getTopicName()->size();
+    topicName.lenstring.data = (char*) topic->getTopicName()->c_str();
+
+    if (elm->_sendTime)
+    {
+        elm->_retry++;
+    }
+    elm->_sendTime = monotonicMsec();
+    Retransmitter::schedule(elm, _client->getInflightWindow()->getTimeout());
+
+    MQTTSNPacket* regPacket = new MQTTSNPacket();
+    regPacket->setREGISTER(elm->_topicId, elm->_msgId, &topicName);
+    Event* ev = new Event();
+    ev->setClientSendEvent(_client, regPacket);
+    que->post(ev);
+}
+
+/**
+ *  Send the REGISTER which is not acknowledged within the timeout again.
+ *  PUBLISHes of a topic which the client never acknowledges are sent after RETRANSMIT_MAX_RETRY.
+ */
+void WaitREGACKPacketList::resend(waitREGACKPacket* elm, EventQue* que)
+{
+    /* wait until the client wakes up */
+    if (_client->isSleep())
+    {
+        Retransmitter::schedule(elm, _client->getInflightWindow()->getTimeout());
+        return;
+    }
+
+    /* REGISTERs are sent again when the client connects */
+    if (!_client->isActive() && !_client->isAwake())
+    {
+        Retransmitter::cancel(elm);
+        return;
+    }
+
+    if (elm->_retry >= RETRANSMIT_MAX_RETRY)
+    {
+        WRITELOG("%s REGISTER %04X of TopicId %d is not acknowledged by %s.%s\n", ERRMSG_HEADER,
+                elm->_msgId, elm->_topicId, _client->getClientId(), ERRMSG_FOOTER);
+        release(elm, que);
+        return;
+    }
+    post(elm, que);
 }
 
-uint8_t WaitREGACKPacketList::getCount(void)
+void WaitREGACKPacketList::release(waitREGACKPacket* elm, EventQue* que)
 {
-    return _cnt;
+    _msgIds.erase(elm->_msgId);
+    _topicIds.erase(elm->_topicId);
+
+    for (size_t i = 0; i < elm->_packets.size(); i++)
+    {
+        _client->getInflightWindow()->send(elm->_packets[i], que);
+    }
+    elm->_packets.clear();
+    delete elm;
 }
 
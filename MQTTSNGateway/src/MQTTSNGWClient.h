@@ -31,6 +31,11 @@
 #include "MQTTSNGWTopic.h"
 #include "MQTTSNGWClientList.h"
 #include "MQTTSNGWAdapter.h"
+#include "MQTTSNGWSleepStore.h"
+#include "MQTTSNGWInflight.h"
+#include <atomic>
+#include <unordered_map>
+#include <vector>
 
 namespace MQTTSNGW
 {
@@ -114,37 +119,59 @@ private:
 /*=====================================
  Class WaitREGACKPacket
  =====================================*/
-class waitREGACKPacket
+class WaitREGACKPacketList;
+class waitREGACKPacket: public RetransmitTimer
 {
     friend class WaitREGACKPacketList;
 public:
-    waitREGACKPacket(MQTTSNPacket* packet, uint16_t REGACKMsgId);
+    waitREGACKPacket(WaitREGACKPacketList* list, uint16_t REGACKMsgId, uint16_t topicId);
     ~waitREGACKPacket();
 
+protected:
+    void timeout(EventQue* que);
+
 private:
+    WaitREGACKPacketList* _list;
     uint16_t _msgId;
-    MQTTSNPacket* _packet;
-    waitREGACKPacket* _next;
-    waitREGACKPacket* _prev;
+    uint16_t _topicId;
+    uint8_t _retry;
+    uint32_t _sendTime;                     // msecs when the REGISTER was sent
+    std::vector<MQTTSNPacket*> _packets;    // PUBLISHes of the topic in the order of arrival, MAX_SAVED_PUBLISH at most
 };
 
 /*=====================================
  Class WaitREGACKPacketList
+
+ REGISTERs sent to a client which are not acknowledged, indexed by
+ the MsgId and by the TopicId. REGISTERs of different topics are sent
+ without waiting REGACKs, and PUBLISHes of a topic wait for its REGACK.
+ A REGISTER is sent again by the Retransmitter after the timeout of
+ the InflightWindow, or when the client sends PINGREQ.
  =====================================*/
 class WaitREGACKPacketList
 {
+    friend class waitREGACKPacket;
 public:
     WaitREGACKPacketList();
     ~WaitREGACKPacketList();
-    int setPacket(MQTTSNPacket* packet, uint16_t REGACKMsgId);
-    MQTTSNPacket* getPacket(uint16_t REGACKMsgId);
-    void erase(uint16_t REGACKMsgId);
-    uint8_t getCount(void);
+    void setClient(Client* client);
+    void send(Topic* topic, EventQue* que);
+    void sendTopics(EventQue* que);
+    bool setPacket(MQTTSNPacket* packet, uint16_t topicId);
+    void acknowledge(uint16_t REGACKMsgId, EventQue* que);
+    void retransmit(EventQue* que);
+    bool isRegistering(uint16_t topicId);
+    int getCount(void);
+    void clear(void);
 
 private:
-    uint8_t _cnt;
-    waitREGACKPacket* _first;
-    waitREGACKPacket* _end;
+    void post(waitREGACKPacket* elm, EventQue* que);
+    void resend(waitREGACKPacket* elm, EventQue* que);
+    void release(waitREGACKPacket* elm, EventQue* que);
+
+    Client* _client;
+    std::unordered_map<uint16_t, waitREGACKPacket*> _msgIds;
+    std::unordered_map<uint16_t, waitREGACKPacket*> _topicIds;
 };
 
 /*=====================================
@@ -178,6 +205,7 @@ class Client
 {
     friend class ClientList;
     friend class ClientsPool;
+    friend class SessionStore;
 public:
     Client();
     ~Client();
@@ -187,10 +215,13 @@ public:
     TopicIdMapElement* getWaitedSubTopicId(uint16_t msgId);
     MQTTGWPacket* getClientSleepPacket(void);
     void deleteFirstClientSleepPacket(void);
+    void clearClientSleepPacket(void);
 
     MQTTSNPacket* getProxyPacket(void);
     void deleteFirstProxyPacket(void);
     WaitREGACKPacketList* getWaitREGACKPacketList(void);
+    InflightWindow* getInflightWindow(void);
+    UplinkWindow* getUplinkWindow(void);
 
     void eraseWaitedPubTopicId(uint16_t msgId);
     void eraseWaitedSubTopicId(uint16_t msgId);
@@ -208,6 +239,7 @@ public:
     void connectSended(void);
     void connackSended(int rc);
     void disconnected(void);
+    void keepSession(uint32_t sec);
     bool isConnectSendable(void);
     void tryConnect(void);
     ClientStatus getClientStatus(void);
@@ -244,6 +276,7 @@ public:
     char* getWillMsg(void);
     const char* getStatus(void);
     void setWaitWillMsgFlg(bool);
+    void setWillFlg(bool);        // true: the will is published by the gateway when the client is lost
     void setSessionStatus(bool);  // true: clean session
     bool erasable(void);
 
@@ -255,19 +288,35 @@ public:
     bool isSecureNetwork(void);
     bool isSensorNetStable(void);
     bool isWaitWillMsg(void);
+    bool isSessionKept(void);
+    bool isSessionExpired(void);
+    bool hasWill(void);
 	bool isCleanSession(void);
 
     void holdPingRequest(void);
     void resetPingRequest(void);
     bool isHoldPingReqest(void);
 
+    void brokerPacketSended(void);
+    void brokerPacketReceived(void);
+    bool isBrokerAlive(void);
+    bool isBrokerPingreqRequired(void);
+    void pingreqForwarded(void);
+    void addRef(void);
+    void releaseRef(void);
+    int getRefCount(void);
+    bool isPingrespForwardable(void);
+
     Client* getNextClient(void);
+    uint16_t getIndex(void);
 
 private:
-    PacketQue<MQTTGWPacket> _clientSleepPacketQue;
+    SleepPacketQue _clientSleepPacketQue;
     PacketQue<MQTTSNPacket> _proxyPacketQue;
 
     WaitREGACKPacketList _waitREGACKList;
+    InflightWindow _inflightWindow;
+    UplinkWindow _uplinkWindow;
 
     Topics* _topics;
     TopicIdMap _waitedPubTopicIdMap;
@@ -281,12 +330,18 @@ private:
     char* _willMsg;
 
     bool _holdPingRequest;
+    uint16_t _forwardedPingreq;     // PINGREQs of the client which wait PINGRESPs from the broker
+    std::atomic<uint32_t> _brokerSendTime;  // seconds of the monotonic clock
+    std::atomic<uint32_t> _brokerRecvTime;
+    std::atomic<int> _refCount { 0 };       // Events which refer to the client
 
     Timer _keepAliveTimer;
     uint32_t _keepAliveMsec;
 
     ClientStatus _status;
     bool _waitWillMsgFlg;
+    bool _willFlg;
+    uint32_t _resumeLimit;  // seconds of the monotonic clock until the session of the lost client is kept, 0 if not kept
 
     uint16_t _packetId;
     uint8_t _snMsgId;
@@ -304,6 +359,14 @@ private:
 
     Client* _nextClient;
     Client* _prevClient;
+    uint16_t _index;        // position in the ClientsPool, 0 if not pooled
+    uint16_t _listGeneration;   // generation of clients.conf which has the client, 0 if not listed
+
+    uint32_t _sessionOffset;    // position of the record in the session file, 0 if not written
+    uint32_t _sessionLength;
+    uint32_t _sessionTopicGen;  // generations of topics and saved PUBLISHes written into the record
+    uint32_t _sessionQueGen;
+    bool _sessionClean;
 };
 
 }
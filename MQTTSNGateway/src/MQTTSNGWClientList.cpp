@@ -18,9 +18,18 @@
 #include "MQTTSNGateway.h"
 #include <string.h>
 #include <string>
+#include <time.h>
 
 using namespace MQTTSNGW;
 char* currentDateTime(void);
+
+static uint32_t monotonicSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec;
+}
+
 /*=====================================
  Class ClientList
  =====================================*/
@@ -49,6 +58,11 @@ ClientList::~ClientList()
         cl = ncl;
     };
 
+    for (size_t i = 0; i < _removedClients.size(); i++)
+    {
+        delete _removedClients[i].client;
+    }
+
     if (_clientsPool)
     {
         delete _clientsPool;
@@ -60,15 +74,16 @@ void ClientList::initialize(bool aggregate)
 {
     _maxClients = _gateway->getGWParams()->maxClients;
     _clientsPool->allocate(_gateway->getGWParams()->maxClients);
+    _aggregate = aggregate;
 
     if (_gateway->getGWParams()->clientAuthentication)
     {
-        int type = TRANSPEARENT_TYPE;
+        _listType = TRANSPEARENT_TYPE;
         if (aggregate)
         {
-            type = AGGREGATER_TYPE;
+            _listType = AGGREGATER_TYPE;
         }
-        setClientList(type);
+        setClientList(_listType);
         _authorize = true;
     }
 
@@ -78,6 +93,48 @@ void ClientList::initialize(bool aggregate)
     }
 }
 
+/**
+ *  Read clients.conf and predefinedTopic.conf again. Called by the PacketHandleTask.
+ *  Clients and topics which are not changed are kept as they are.
+ */
+void ClientList::reload(void)
+{
+    GatewayParams* params = _gateway->getGWParams();
+
+    if (_authorize)
+    {
+        if (++_listGeneration == 0)
+        {
+            _listGeneration = 1;
+        }
+
+        if (!createList(params->clientListName, _listType))
+        {
+            WRITELOG("%s ClientList can't reload %s.%s\n", ERRMSG_HEADER, params->clientListName, ERRMSG_FOOTER);
+        }
+        else
+        {
+            /* remove clients which are not in the file any more */
+            Client* client = _firstClient;
+            while (client)
+            {
+                Client* next = client->_nextClient;
+                if (client->_listGeneration && client->_listGeneration != _listGeneration)
+                {
+                    remove(client);
+                }
+                client = next;
+            }
+        }
+    }
+
+    if (params->predefinedTopic)
+    {
+        reloadPredefinedList(params->predefinedTopicFileName, _aggregate);
+    }
+    WRITELOG("%s Client lists are reloaded. %d clients.\n", currentDateTime(), _clientCnt);
+}
+
 void ClientList::setClientList(int type)
 {
     if (!createList(_gateway->getGWParams()->clientListName, type))
@@ -160,7 +217,7 @@ bool ClientList::createList(const char* fileName, int type)
                 stable = !(data.find("unstableLine") != string::npos);
                 if ((qos_1 && type == QOSM1PROXY_TYPE) || (!qos_1 && type == AGGREGATER_TYPE))
                 {
-                    createClient(&netAddr, &clientId, stable, secure, type);
+                    setListedClient(&netAddr, &clientId, stable, secure, type);
                 }
                 else if (forwarder && type == FORWARDER_TYPE)
                 {
@@ -168,7 +225,7 @@ bool ClientList::createList(const char* fileName, int type)
                 }
                 else if (type == TRANSPEARENT_TYPE)
                 {
-                    createClient(&netAddr, &clientId, stable, secure, type);
+                    setListedClient(&netAddr, &clientId, stable, secure, type);
                 }
             }
             else
@@ -184,51 +241,248 @@ bool ClientList::createList(const char* fileName, int type)
     return rc;
 }
 
+/*
+ *  Create a client of clients.conf. A client which is already in the list is kept
+ *  unless its address is given to another client by the file.
+ */
+void ClientList::setListedClient(SensorNetAddress* addr, MQTTSNString* clientId, bool stable, bool secure, int type)
+{
+    Client* client = getClient(addr);
+
+    if (client && client->_listGeneration != _listGeneration && strcmp(client->getClientId(), clientId->cstring) != 0)
+    {
+        remove(client);
+        client = nullptr;
+    }
+
+    if (client == nullptr)
+    {
+        client = createClient(addr, clientId, stable, secure, type);
+    }
+    else
+    {
+        client->setSensorNetType(stable);
+        client->getNetwork()->setSecure(secure);
+    }
+
+    if (client && type == _listType)
+    {
+        client->_listGeneration = _listGeneration;
+    }
+}
+
+/*
+ *  Unlink a client which is not in clients.conf any more.
+ *  The client is not deleted because other tasks may still refer to it. It is recycled later.
+ */
+void ClientList::remove(Client* client)
+{
+    _mutex.lock();
+    Client* prev = client->_prevClient;
+    Client* next = client->_nextClient;
+
+    if (prev)
+    {
+        prev->_nextClient = next;
+    }
+    else
+    {
+        _firstClient = next;
+    }
+    if (next)
+    {
+        next->_prevClient = prev;
+    }
+    else
+    {
+        _endClient = prev;
+    }
+    _clientCnt--;
+    _mutex.unlock();
+
+    Forwarder* fwd = client->getForwarder();
+    if (fwd)
+    {
+        fwd->eraseClient(client);
+    }
+
+    /* PUBLISHes from the broker are not delivered to the client any more */
+    if (_gateway->getAdapterManager()->isAggregatedClient(client)
+            || _gateway->getAdapterManager()->isSharedSubscriber(client))
+    {
+        _gateway->getAdapterManager()->getAggregater()->removeClient(client);
+    }
+    _gateway->getAdapterManager()->getAggregater()->eraseMessageIdTable(client);
+    _gateway->getAdapterManager()->getAggregater()->eraseSubscribing(client);
+    client->clearClientSleepPacket();
+    client->getInflightWindow()->clear();
+    client->getUplinkWindow()->clear();
+    client->getWaitREGACKPacketList()->clear();
+    client->clearWaitedPubTopicId();
+    client->clearWaitedSubTopicId();
+    _gateway->getRetainedCache()->forget(client);
+
+    /* the BrokerSendTask closes the connection, because the BrokerRecvTask may be reading it */
+    if (!client->isAdapter() && !_gateway->getAdapterManager()->isAggregatedClient(client)
+            && client->getNetwork()->isValid())
+    {
+        MQTTGWPacket* disconnect = new MQTTGWPacket();
+        disconnect->setHeader(DISCONNECT);
+        Event* ev = new Event();
+        ev->setBrokerSendEvent(client, disconnect);
+        _gateway->getBrokerSendQue()->post(ev);
+    }
+    client->disconnected();
+    client->_listGeneration = 0;
+
+    RemovedClient removed;
+    removed.client = client;
+    removed.scan = _scanCount.load();
+    _removedClients.push_back(removed);
+    WRITELOG("%s %s is removed from the client list.\n", currentDateTime(), client->getClientId());
+}
+
+/*
+ *  Return clients removed by reloads to the pool. Called by the PacketHandleTask.
+ *  A removed client is deleted when no Event refers to it, the BrokerSendTask has closed its connection
+ *  and the BrokerRecvTask has finished the scan of the list which may hold it. A new Client replaces it.
+ */
+void ClientList::recycle(void)
+{
+    uint32_t scan = _scanCount.load();
+
+    for (size_t i = 0; i < _removedClients.size();)
+    {
+        Client* client = _removedClients[i].client;
+        if (client->getRefCount() > 0 || client->getNetwork()->isValid() || scan == _removedClients[i].scan)
+        {
+            i++;
+            continue;
+        }
+        uint16_t index = client->_index;
+        delete client;
+        client = new Client();
+        client->_index = index;
+
+        _mutex.lock();
+        _clientsPool->setClient(client);
+        _mutex.unlock();
+        _removedClients.erase(_removedClients.begin() + i);
+    }
+}
+
 bool ClientList::readPredefinedList(const char* fileName, bool aggregate)
+{
+    std::vector<PredefinedTopicEntry> list;
+    MQTTSNString clientId = MQTTSNString_initializer;
+
+    if (!loadPredefinedList(fileName, &list))
+    {
+        WRITELOG("ClientList can not open the Predefined Topic List.     %s\n", fileName);
+        return false;
+    }
+
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        clientId.cstring = const_cast<char*>(list[i].clientId.c_str());
+        createPredefinedTopic(&clientId, list[i].topicName, list[i].topicId, aggregate);
+    }
+    return true;
+}
+
+bool ClientList::loadPredefinedList(const char* fileName, std::vector<PredefinedTopicEntry>* list)
 {
     FILE* fp;
     char buf[MAX_CLIENTID_LENGTH + 256];
     size_t pos0, pos1;
+    PredefinedTopicEntry entry;
+
+    if ((fp = fopen(fileName, "r")) == 0)
+    {
+        return false;
+    }
+
+    while (fgets(buf, MAX_CLIENTID_LENGTH + 254, fp) != 0)
+    {
+        if (*buf == '#')
+        {
+            continue;
+        }
+        string data = string(buf);
+        while ((pos0 = data.find_first_of(" 　\t\n")) != string::npos)
+        {
+            data.erase(pos0, 1);
+        }
+        if (data.empty())
+        {
+            continue;
+        }
+
+        pos0 = data.find_first_of(",");
+        pos1 = data.find(",", pos0 + 1);
+        entry.clientId = data.substr(0, pos0);
+        entry.topicName = data.substr(pos0 + 1, pos1 - pos0 - 1);
+        entry.topicId = stoul(data.substr(pos1 + 1));
+        list->push_back(entry);
+    }
+    fclose(fp);
+    return true;
+}
+
+/*
+ *  Predefined topics which are not in the file any more are erased.
+ *  A topic of which id is changed is erased and added again.
+ */
+void ClientList::reloadPredefinedList(const char* fileName, bool aggregate)
+{
+    std::vector<PredefinedTopicEntry> list;
     MQTTSNString clientId = MQTTSNString_initializer;
-    ;
-    bool rc = false;
 
-    if ((fp = fopen(fileName, "r")) != 0)
+    if (!loadPredefinedList(fileName, &list))
     {
-        while (fgets(buf, MAX_CLIENTID_LENGTH + 254, fp) != 0)
+        WRITELOG("%s ClientList can't reload %s.%s\n", ERRMSG_HEADER, fileName, ERRMSG_FOOTER);
+        return;
+    }
+
+    erasePredefinedTopics(_gateway->getTopics(), common_topic, &list);
+    for (Client* client = _firstClient; client; client = client->_nextClient)
+    {
+        if (client->_hasPredefTopic)
         {
-            if (*buf == '#')
-            {
-                continue;
-            }
-            string data = string(buf);
-            while ((pos0 = data.find_first_of(" 　\t\n")) != string::npos)
+            erasePredefinedTopics(client->getTopics(), client->getClientId(), &list);
+        }
+    }
+
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        clientId.cstring = const_cast<char*>(list[i].clientId.c_str());
+        createPredefinedTopic(&clientId, list[i].topicName, list[i].topicId, aggregate);
+    }
+}
+
+void ClientList::erasePredefinedTopics(Topics* topics, const char* clientId, std::vector<PredefinedTopicEntry>* list)
+{
+    Topic* topic = topics->getFirstTopic();
+
+    while (topic)
+    {
+        Topic* next = topics->getNextTopic(topic);
+        if (topic->getType() == MQTTSN_TOPIC_TYPE_PREDEFINED)
+        {
+            bool found = false;
+            for (size_t i = 0; i < list->size() && !found; i++)
             {
-                data.erase(pos0, 1);
+                PredefinedTopicEntry* entry = &(*list)[i];
+                found = entry->clientId == clientId && entry->topicId == topic->getTopicId()
+                        && entry->topicName == *topic->getTopicName();
             }
-            if (data.empty())
+            if (!found)
             {
-                continue;
+                topics->erase(topic);
             }
-
-            pos0 = data.find_first_of(",");
-            pos1 = data.find(",", pos0 + 1);
-            string id = data.substr(0, pos0);
-            clientId.cstring = strdup(id.c_str());
-            string topicName = data.substr(pos0 + 1, pos1 - pos0 - 1);
-            uint16_t topicID = stoul(data.substr(pos1 + 1));
-            createPredefinedTopic(&clientId, topicName, topicID, aggregate);
-            free(clientId.cstring);
         }
-        fclose(fp);
-        rc = true;
-    }
-    else
-    {
-        WRITELOG("ClientList can not open the Predefined Topic List.     %s\n", fileName);
-        return false;
+        topic = next;
     }
-    return rc;
 }
 
 void ClientList::erase(Client*& client)
@@ -289,6 +543,14 @@ Client* ClientList::getClient(SensorNetAddress* addr)
     return 0;
 }
 
+/**
+ *  The BrokerRecvTask starts a new scan of the list. Removed clients are not found by it any more.
+ */
+void ClientList::scanned(void)
+{
+    _scanCount++;
+}
+
 Client* ClientList::getClient(int index)
 {
     Client* client = _firstClient;
@@ -334,10 +596,10 @@ Client* ClientList::getClient(MQTTSNString* clientId)
 
 Client* ClientList::createClient(SensorNetAddress* addr, MQTTSNString* clientId, int type)
 {
-    return createClient(addr, clientId, false, false, type);
+    return createClient(addr, clientId, true, false, type);
 }
 
-Client* ClientList::createClient(SensorNetAddress* addr, MQTTSNString* clientId, bool unstableLine, bool secure, int type)
+Client* ClientList::createClient(SensorNetAddress* addr, MQTTSNString* clientId, bool stable, bool secure, int type)
 {
     Client* client = getClient(addr);
     if (client)
@@ -345,8 +607,10 @@ Client* ClientList::createClient(SensorNetAddress* addr, MQTTSNString* clientId,
         return client;
     }
 
-    /* acquire a free client */
+    /* acquire a free client. ClientRecvTasks may create clients concurrently. */
+    _mutex.lock();
     client = _clientsPool->getClient();
+    _mutex.unlock();
 
     if (!client)
     {
@@ -360,7 +624,7 @@ Client* ClientList::createClient(SensorNetAddress* addr, MQTTSNString* clientId,
     {
         client->setClientAddress(addr);
     }
-    client->setSensorNetType(unstableLine);
+    client->setSensorNetType(stable);
     if (MQTTSNstrlen(*clientId))
     {
         client->setClientId(*clientId);
@@ -424,7 +688,10 @@ Client* ClientList::createPredefinedTopic(MQTTSNString* clientId, string topicNa
             return nullptr;
         }
 
-        client = createClient(NULL, clientId, aggregate);
+        if (client == nullptr)
+        {
+            client = createClient(NULL, clientId, aggregate);
+        }
 
         if (client == nullptr)
         {
@@ -477,6 +744,7 @@ void ClientsPool::allocate(int maxClients)
     Client* cl = nullptr;
 
     _firstClient = new Client();
+    _firstClient->_index = 1;
 
     for (int i = 0; i < maxClients; i++)
     {
@@ -484,6 +752,7 @@ void ClientsPool::allocate(int maxClients)
         {
             throw Exception("ClientsPool::Can't allocate max number of clients\n", 0);
         }
+        cl->_index = i + 2;
         cl->_nextClient = _firstClient;
         _firstClient = cl;
         _clientCnt++;
@@ -20,6 +20,7 @@
 
 #include "MQTTSNGWClient.h"
 #include "MQTTSNGateway.h"
+#include <vector>
 
 namespace MQTTSNGW
 {
@@ -30,6 +31,21 @@ namespace MQTTSNGW
 
 class Client;
 
+/* a client removed by a reload, which waits for other tasks to release it */
+typedef struct
+{
+    Client* client;
+    uint32_t scan;      // scans of the BrokerRecvTask when it was removed
+} RemovedClient;
+
+/* a record of predefinedTopic.conf */
+typedef struct
+{
+    string clientId;
+    string topicName;
+    uint16_t topicId;
+} PredefinedTopicEntry;
+
 /*=====================================
  Class ClientsPool
  =====================================*/
@@ -58,13 +74,15 @@ public:
     ~ClientList();
 
     void initialize(bool aggregate);
+    void reload(void);
+    void recycle(void);
     void setClientList(int type);
     void setPredefinedTopics(bool aggregate);
     void erase(Client*&);
     Client* createClient(SensorNetAddress* addr, MQTTSNString* clientId,
             int type);
     Client* createClient(SensorNetAddress* addr, MQTTSNString* clientId,
-            bool unstableLine, bool secure, int type);
+            bool stable, bool secure, int type);
     bool createList(const char* fileName, int type);
     Client* getClient(SensorNetAddress* addr);
     Client* getClient(MQTTSNString* clientId);
@@ -72,9 +90,15 @@ public:
     uint16_t getClientCount(void);
     Client* getClient(void);
     bool isAuthorized();
+    void scanned(void);
 
 private:
     bool readPredefinedList(const char* fileName, bool _aggregate);
+    bool loadPredefinedList(const char* fileName, std::vector<PredefinedTopicEntry>* list);
+    void reloadPredefinedList(const char* fileName, bool aggregate);
+    void erasePredefinedTopics(Topics* topics, const char* clientId, std::vector<PredefinedTopicEntry>* list);
+    void remove(Client* client);
+    void setListedClient(SensorNetAddress* addr, MQTTSNString* clientId, bool stable, bool secure, int type);
 	ClientsPool* _clientsPool;
 	Gateway* _gateway;
     Client* createPredefinedTopic(MQTTSNString* clientId, string topicName,
@@ -85,6 +109,11 @@ private:
     uint16_t _clientCnt;
     uint16_t _maxClients;
     bool _authorize { false };
+    bool _aggregate { false };
+    int _listType { TRANSPEARENT_TYPE };       // type of clients read from clients.conf
+    uint16_t _listGeneration { 1 };             // incremented by each reload
+    std::vector<RemovedClient> _removedClients; // clients removed by reloads
+    std::atomic<uint32_t> _scanCount { 0 };     // scans of the list by the BrokerRecvTask
 };
 
 }
@@ -18,6 +18,7 @@
 #include "MQTTSNPacket.h"
 #include "MQTTSNGWQoSm1Proxy.h"
 #include "MQTTSNGWEncapsulatedPacket.h"
+#include "MQTTSNGWTrace.h"
 #include <cstring>
 
 using namespace MQTTSNGW;
@@ -25,12 +26,21 @@ char* currentDateTime(void);
 /*=====================================
  Class ClientRecvTask
  =====================================*/
-ClientRecvTask::ClientRecvTask(Gateway* gateway)
+ClientRecvTask::ClientRecvTask(Gateway* gateway, int index)
 {
     _gateway = gateway;
     _gateway->attach((Thread*) this);
     _sensorNetwork = _gateway->getSensorNetwork();
-    setTaskName("ClientRecvTask");
+    _index = index;
+    if (index == 0)
+    {
+        strcpy(_taskName, "ClientRecvTask");
+    }
+    else
+    {
+        snprintf(_taskName, sizeof(_taskName), "ClientRecvTask%d", index);
+    }
+    setTaskName(_taskName);
 }
 
 ClientRecvTask::~ClientRecvTask()
@@ -63,9 +73,10 @@ void ClientRecvTask::run()
         Client* client = nullptr;
         Forwarder* fwd = nullptr;
         WirelessNodeId nodeId;
+        SensorNetAddress senderAddr;
 
         MQTTSNPacket* packet = new MQTTSNPacket();
-        int packetLen = packet->recv(_sensorNetwork);
+        int packetLen = packet->recv(_sensorNetwork, &senderAddr, _index);
 
         if (CHK_SIGINT)
         {
@@ -96,8 +107,6 @@ void ClientRecvTask::run()
             continue;
         }
 
-        SensorNetAddress senderAddr = *_gateway->getSensorNetwork()->getSenderAddress();
-
         if (packet->getType() == MQTTSN_ENCAPSULATED)
         {
             fwd = _gateway->getAdapterManager()->getForwarderList()->getForwarder(&senderAddr);
@@ -110,7 +119,13 @@ void ClientRecvTask::run()
 
                 /* get the packet from the encapsulation message */
                 MQTTSNGWEncapsulatedPacket encap;
-                encap.desirialize(packet->getPacketData(), packet->getPacketLength());
+                if (encap.desirialize(packet->getPacketData(), packet->getPacketLength()) == 0)
+                {
+                    WRITELOG("%s MQTTSNGWClientRecvTask Forwarder(%s) sent an invalid WirelessNodeId. message has been discarded.%s\n",
+                            ERRMSG_HEADER, fwd->getName(), ERRMSG_FOOTER);
+                    delete packet;
+                    continue;
+                }
                 nodeId.setId(encap.getWirelessNodeId());
                 client = fwd->getClient(&nodeId);
                 packet = encap.getMQTTSNPacket();
@@ -149,7 +164,11 @@ void ClientRecvTask::run()
         {
             log(client, packet, 0);
 
-            if (client->isDisconnect()  && packet->getType() != MQTTSN_CONNECT)
+            /* WILLTOPIC and WILLMSG follow the CONNECT before the client is connected */
+            bool willPacket = (packet->getType() == MQTTSN_WILLTOPIC || packet->getType() == MQTTSN_WILLMSG)
+                    && client->getConnectData()->flags.bits.will;
+
+            if (client->isDisconnect() && packet->getType() != MQTTSN_CONNECT && !willPacket)
             {
                 WRITELOG("%s MQTTSNGWClientRecvTask %s is not connecting.%s\n",
                 ERRMSG_HEADER, client->getClientId(), ERRMSG_FOOTER);
@@ -239,7 +258,7 @@ void ClientRecvTask::run()
                 {
                     WRITELOG(
                             "%s MQTTSNGWClientRecvTask  Forwarder(%s) is not declared by ClientList file. message has been discarded.%s\n",
-                            ERRMSG_HEADER, _sensorNetwork->getSenderAddress()->sprint(buf),
+                            ERRMSG_HEADER, senderAddr.sprint(buf),
                             ERRMSG_FOOTER);
                 }
                 else
@@ -272,6 +291,12 @@ void ClientRecvTask::log(Client* client, MQTTSNPacket* packet, MQTTSNString* id)
     const char* clientId;
     char cstr[MAX_CLIENTID_LENGTH + 1];
 
+    PacketTrace::put(TRACE_CLIENT_RECV, client, packet);
+    if (!CHK_PACKETLOG(packet->getLogCategory()))
+    {
+        return;
+    }
+
     if (id)
     {
         if (id->cstring)
@@ -303,30 +328,36 @@ void ClientRecvTask::log(const char* clientId, MQTTSNPacket* packet)
     char pbuf[ SIZE_OF_LOG_PACKET * 3 + 1];
     char msgId[6];
 
+    if (!CHK_PACKETLOG(packet->getLogCategory()))
+    {
+        return;
+    }
+    const char* dump = CHK_PACKETDUMP ? packet->print(pbuf) : "";
+
     switch (packet->getType())
     {
     case MQTTSN_SEARCHGW:
         WRITELOG(FORMAT_Y_G_G_NL, currentDateTime(), packet->getName(),
-        LEFTARROW, CLIENT, packet->print(pbuf));
+        LEFTARROW, CLIENT, dump);
         break;
     case MQTTSN_CONNECT:
     case MQTTSN_PINGREQ:
         WRITELOG(FORMAT_Y_G_G_NL, currentDateTime(), packet->getName(),
-        LEFTARROW, clientId, packet->print(pbuf));
+        LEFTARROW, clientId, dump);
         break;
     case MQTTSN_DISCONNECT:
     case MQTTSN_WILLTOPICUPD:
     case MQTTSN_WILLMSGUPD:
     case MQTTSN_WILLTOPIC:
     case MQTTSN_WILLMSG:
-        WRITELOG(FORMAT_Y_G_G, currentDateTime(), packet->getName(), LEFTARROW, clientId, packet->print(pbuf));
+        WRITELOG(FORMAT_Y_G_G, currentDateTime(), packet->getName(), LEFTARROW, clientId, dump);
         break;
     case MQTTSN_PUBLISH:
     case MQTTSN_REGISTER:
     case MQTTSN_SUBSCRIBE:
     case MQTTSN_UNSUBSCRIBE:
         WRITELOG(FORMAT_G_MSGID_G_G_NL, currentDateTime(), packet->getName(), packet->getMsgId(msgId), LEFTARROW, clientId,
-                packet->print(pbuf));
+                dump);
         break;
     case MQTTSN_REGACK:
     case MQTTSN_PUBACK:
@@ -334,13 +365,13 @@ void ClientRecvTask::log(const char* clientId, MQTTSNPacket* packet)
     case MQTTSN_PUBREL:
     case MQTTSN_PUBCOMP:
         WRITELOG(FORMAT_G_MSGID_G_G, currentDateTime(), packet->getName(), packet->getMsgId(msgId), LEFTARROW, clientId,
-                packet->print(pbuf));
+                dump);
         break;
     case MQTTSN_ENCAPSULATED:
-        WRITELOG(FORMAT_Y_G_G, currentDateTime(), packet->getName(), LEFTARROW, clientId, packet->print(pbuf));
+        WRITELOG(FORMAT_Y_G_G, currentDateTime(), packet->getName(), LEFTARROW, clientId, dump);
         break;
     default:
-        WRITELOG(FORMAT_W_NL, currentDateTime(), packet->getName(), LEFTARROW, clientId, packet->print(pbuf));
+        WRITELOG(FORMAT_W_NL, currentDateTime(), packet->getName(), LEFTARROW, clientId, dump);
         break;
     }
 }
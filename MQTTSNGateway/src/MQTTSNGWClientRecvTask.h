@@ -31,7 +31,7 @@ class ClientRecvTask: public Thread
 MAGIC_WORD_FOR_THREAD;
     friend AdapterManager;
 public:
-    ClientRecvTask(Gateway*);
+    ClientRecvTask(Gateway*, int index = 0);
     ~ClientRecvTask(void);
     virtual void initialize(int argc, char** argv);
     void run(void);
@@ -42,6 +42,8 @@ private:
 
     Gateway* _gateway;
     SensorNetwork* _sensorNetwork;
+    int _index;                 // receiver of the SensorNetwork
+    char _taskName[32];
 };
 
 }
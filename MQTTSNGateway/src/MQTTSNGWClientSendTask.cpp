@@ -18,6 +18,7 @@
 #include "MQTTSNGateway.h"
 #include "MQTTSNGWEncapsulatedPacket.h"
 #include "MQTTSNGWQoSm1Proxy.h"
+#include "MQTTSNGWTrace.h"
 #include <errno.h>
 
 using namespace MQTTSNGW;
@@ -45,12 +46,15 @@ void ClientSendTask::run()
     AdapterManager* adpMgr = _gateway->getAdapterManager();
     int rc = 0;
 
+    EventQue* que = _gateway->getClientSendQue();
+
     while (true)
     {
-        Event* ev = _gateway->getClientSendQue()->wait();
+        Event* ev = que->wait();
 
         if (ev->getEventType() == EtStop || _gateway->IsStopping())
         {
+            flush();
             WRITELOG("%s %s stopped.\n", currentDateTime(), getTaskName());
             delete ev;
             break;
@@ -90,6 +94,20 @@ void ClientSendTask::run()
             }
         }
         delete ev;
+
+        /* datagrams batched by the SensorNetwork are sent when no more events are waiting */
+        if (que->size() == 0)
+        {
+            flush();
+        }
+    }
+}
+
+void ClientSendTask::flush(void)
+{
+    if (_sensorNetwork->flush() < 0)
+    {
+        WRITELOG("%s ClientSendTask can't send packets. Error=%d%s\n", ERRMSG_HEADER, errno, ERRMSG_FOOTER);
     }
 }
 
@@ -99,12 +117,19 @@ void ClientSendTask::log(Client* client, MQTTSNPacket* packet)
     char msgId[6];
     const char* clientId = client ? (const char*) client->getClientId() : UNKNOWNCL;
 
+    PacketTrace::put(TRACE_CLIENT_SEND, client, packet);
+    if (!CHK_PACKETLOG(packet->getLogCategory()))
+    {
+        return;
+    }
+    const char* dump = CHK_PACKETDUMP ? packet->print(pbuf) : "";
+
     switch (packet->getType())
     {
     case MQTTSN_ADVERTISE:
     case MQTTSN_GWINFO:
         WRITELOG(FORMAT_Y_W_G, currentDateTime(), packet->getName(), RIGHTARROW,
-        CLIENTS, packet->print(pbuf));
+        CLIENTS, dump);
         break;
     case MQTTSN_CONNACK:
     case MQTTSN_DISCONNECT:
@@ -113,12 +138,12 @@ void ClientSendTask::log(Client* client, MQTTSNPacket* packet)
     case MQTTSN_WILLTOPICRESP:
     case MQTTSN_WILLMSGRESP:
     case MQTTSN_PINGRESP:
-        WRITELOG(FORMAT_Y_W_G, currentDateTime(), packet->getName(), RIGHTARROW, clientId, packet->print(pbuf));
+        WRITELOG(FORMAT_Y_W_G, currentDateTime(), packet->getName(), RIGHTARROW, clientId, dump);
         break;
     case MQTTSN_REGISTER:
     case MQTTSN_PUBLISH:
         WRITELOG(FORMAT_W_MSGID_W_G, currentDateTime(), packet->getName(), packet->getMsgId(msgId), RIGHTARROW, clientId,
-                packet->print(pbuf));
+                dump);
         break;
     case MQTTSN_REGACK:
     case MQTTSN_PUBACK:
@@ -128,7 +153,7 @@ void ClientSendTask::log(Client* client, MQTTSNPacket* packet)
     case MQTTSN_SUBACK:
     case MQTTSN_UNSUBACK:
         WRITELOG(FORMAT_W_MSGID_W_G, currentDateTime(), packet->getName(), packet->getMsgId(msgId), RIGHTARROW, clientId,
-                packet->print(pbuf));
+                dump);
         break;
     default:
         break;
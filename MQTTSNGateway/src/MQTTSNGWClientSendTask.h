@@ -37,6 +37,7 @@ public:
 
 private:
     void log(Client* client, MQTTSNPacket* packet);
+    void flush(void);
 
     Gateway* _gateway;
     SensorNetwork* _sensorNetwork;
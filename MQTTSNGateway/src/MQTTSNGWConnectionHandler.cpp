@@ -23,6 +23,8 @@
 using namespace std;
 using namespace MQTTSNGW;
 
+char* currentDateTime(void);
+
 /*=====================================
  Class MQTTSNConnectionHandler
  =====================================*/
@@ -87,6 +89,12 @@ void MQTTSNConnectionHandler::handleConnect(Client* client, MQTTSNPacket* packet
         return;
     }
 
+    /* the session of the broker is still open */
+    if (resumeSession(client, packet, &data))
+    {
+        return;
+    }
+
     //* clear ConnectData of Client */
     Connect* connectData = client->getConnectData();
     memset(connectData, 0, sizeof(Connect));
@@ -94,9 +102,16 @@ void MQTTSNConnectionHandler::handleConnect(Client* client, MQTTSNPacket* packet
     {
         client->disconnected();
     }
+    client->setWillFlg(false);
 
     Topics* topics = client->getTopics();
 
+    /* PUBLISHes sent in the previous connection are never acknowledged */
+    client->getUplinkWindow()->clear();
+
+    /* retained messages are sent from the RetainedCache again */
+    _gateway->getRetainedCache()->forget(client);
+
     /* CONNECT was not sent yet. prepare Connect data */
     connectData->header.bits.type = CONNECT;
     connectData->clientID = client->getClientId();
@@ -128,16 +143,31 @@ void MQTTSNConnectionHandler::handleConnect(Client* client, MQTTSNPacket* packet
         /* reset the table of msgNo and TopicId pare */
         client->clearWaitedPubTopicId();
         client->clearWaitedSubTopicId();
+        client->getWaitREGACKPacketList()->clear();
 
         /* renew the TopicList */
         if (topics)
         {
+            if (_gateway->getAdapterManager()->isAggregatedClient(client)
+                    || _gateway->getAdapterManager()->isSharedSubscriber(client))
+            {
+                _gateway->getAdapterManager()->getAggregater()->removeClient(client);
+            }
             topics->eraseNormal();
             ;
         }
+        /* PUBLISHes saved or sent in the previous session */
+        client->clearClientSleepPacket();
+        client->getInflightWindow()->clear();
         client->setSessionStatus(true);
     }
 
+    /* the connection of the client never subscribes. subscriptions are kept by the Aggregater */
+    if (_gateway->getAdapterManager()->isSharedSubscriber(client))
+    {
+        connectData->flags.bits.cleanstart = 1;
+    }
+
     if (data.willFlag)
     {
         /* create & send WILLTOPICREQ message to the client */
@@ -257,6 +287,7 @@ void MQTTSNConnectionHandler::handleWillmsg(Client* client, MQTTSNPacket* packet
             return;
         }
         client->setWillMsg(willmsg);
+        client->setWillFlg(true);
 
         /* create CONNECT message */
         MQTTGWPacket* mqttPacket = new MQTTGWPacket();
@@ -283,6 +314,9 @@ void MQTTSNConnectionHandler::handleDisconnect(Client* client, MQTTSNPacket* pac
     {
         if (duration == 0)
         {
+            /* the will is discarded */
+            client->setWillFlg(false);
+            releaseSubscriptions(client);
             MQTTGWPacket* mqMsg = new MQTTGWPacket();
             mqMsg->setHeader(DISCONNECT);
             Event* ev = new Event();
@@ -298,6 +332,164 @@ void MQTTSNConnectionHandler::handleDisconnect(Client* client, MQTTSNPacket* pac
     _gateway->getClientSendQue()->post(evt);
 }
 
+/*
+ *  Clients which send no packet within 1.5 times of the keep alive duration are lost.
+ *  The broker publishes wills of clients which have their own connections, and the gateway publishes others.
+ */
+void MQTTSNConnectionHandler::checkKeepAlive(void)
+{
+    Client* client = _gateway->getClientList()->getClient(0);
+
+    while (client)
+    {
+        if (client->isAdapter())
+        {
+            client = client->getNextClient();
+            continue;
+        }
+
+        if (client->checkTimeover())
+        {
+            uint32_t resumeTime = _gateway->getGWParams()->sessionResumeTime;
+            bool aggregated = _gateway->getAdapterManager()->isAggregatedClient(client);
+
+            if (!aggregated && client->getConnectData()->flags.bits.will)
+            {
+                /* the broker publishes the will when the keep alive of the connection expires */
+                WRITELOG("%s %s is lost.\n", currentDateTime(), client->getClientId());
+                client->updateStatus(Cstat_Lost);
+            }
+            else if (resumeTime > 0 && !client->isCleanSession() && !aggregated && client->getNetwork()->isValid())
+            {
+                /* the client has no will. the connection of the broker is kept for the resumption */
+                WRITELOG("%s %s is lost. The session is kept for %u seconds.\n", currentDateTime(),
+                        client->getClientId(), resumeTime);
+                client->keepSession(resumeTime);
+            }
+            else
+            {
+                WRITELOG("%s %s is lost.\n", currentDateTime(), client->getClientId());
+                client->updateStatus(Cstat_Lost);
+                closeSession(client);
+            }
+        }
+        else if (client->isSessionExpired())
+        {
+            WRITELOG("%s The session of %s is expired.\n", currentDateTime(), client->getClientId());
+            client->updateStatus(Cstat_Lost);
+            closeSession(client);
+        }
+        client = client->getNextClient();
+    }
+}
+
+/**
+ *  CONNECT with CleanSession=false of the client whose connection of the broker is open.
+ *  The gateway returns CONNACK without the round trip to the broker. TopicIds are not registered again,
+ *  and PUBLISHes saved while the client was lost are sent.
+ *  @return true if the session is resumed
+ */
+bool MQTTSNConnectionHandler::resumeSession(Client* client, MQTTSNPacket* packet, MQTTSNPacket_connectData* data)
+{
+    if (_gateway->getGWParams()->sessionResumeTime == 0 || data->cleansession || data->willFlag)
+    {
+        return false;
+    }
+
+    /* the broker has a will of the previous CONNECT */
+    if (client->isAdapter() || client->isCleanSession() || client->getConnectData()->flags.bits.will)
+    {
+        return false;
+    }
+
+    if ((!client->isActive() && !client->isSessionKept()) || !client->getNetwork()->isValid())
+    {
+        return false;
+    }
+
+    WRITELOG("%s %s resumes the session.\n", currentDateTime(), client->getClientId());
+    client->setKeepAlive(packet);
+    client->setWillFlg(false);
+    client->connackSended(MQTTSN_RC_ACCEPTED);
+
+    MQTTSNPacket* connack = new MQTTSNPacket();
+    connack->setCONNACK(MQTTSN_RC_ACCEPTED);
+    Event* ev = new Event();
+    ev->setClientSendEvent(client, connack);
+    _gateway->getClientSendQue()->post(ev);
+
+    client->getInflightWindow()->resume(_gateway->getClientSendQue());
+    sendStoredPublish(client);
+    return true;
+}
+
+/**
+ *  Publish the will of the lost aggregated client, or disconnect the connection of the broker.
+ */
+void MQTTSNConnectionHandler::closeSession(Client* client)
+{
+    publishWill(client);
+    releaseSubscriptions(client);
+
+    if (!_gateway->getAdapterManager()->isAggregatedClient(client))
+    {
+        MQTTGWPacket* mqMsg = new MQTTGWPacket();
+        mqMsg->setHeader(DISCONNECT);
+        Event* ev = new Event();
+        ev->setBrokerSendEvent(client, mqMsg);
+        _gateway->getBrokerSendQue()->post(ev);
+    }
+}
+
+/**
+ *  The clean session of the client which shares subscriptions ends. The broker doesn't know them.
+ *  Subscriptions of other sessions are kept for the next CONNECT with CleanSession=false.
+ */
+void MQTTSNConnectionHandler::releaseSubscriptions(Client* client)
+{
+    AdapterManager* adpMgr = _gateway->getAdapterManager();
+    if (client->isCleanSession() && (adpMgr->isAggregatedClient(client) || adpMgr->isSharedSubscriber(client)))
+    {
+        _gateway->getAdapterManager()->getAggregater()->removeClient(client);
+    }
+
+    /* PUBLISHes waiting acknowledgements are kept for the next CONNECT with CleanSession=false */
+    if (client->isCleanSession())
+    {
+        client->getInflightWindow()->clear();
+    }
+}
+
+/**
+ *  Publish the will of the lost aggregated client over the shared connection of the Aggregater.
+ *  The broker publishes wills of other clients, because their PINGREQs are not answered by the gateway.
+ *  A will of QoS2 is published with QoS1, because the PUBREC has no client to be forwarded to.
+ */
+void MQTTSNConnectionHandler::publishWill(Client* client)
+{
+    if (!client->hasWill() || !_gateway->getAdapterManager()->isAggregatedClient(client))
+    {
+        return;
+    }
+    client->setWillFlg(false);
+
+    Connect* connectData = client->getConnectData();
+    Publish pub = MQTTPacket_Publish_Initializer;
+    pub.header.bits.qos = connectData->flags.bits.willQoS > 0 ? 1 : 0;
+    pub.header.bits.retain = connectData->flags.bits.willRetain;
+    pub.topic = client->getWillTopic();
+    pub.topiclen = strlen(client->getWillTopic());
+    pub.payload = client->getWillMsg();
+    pub.payloadlen = strlen(client->getWillMsg());
+
+    /* the retained message of the broker will be replaced */
+    if (pub.header.bits.retain)
+    {
+        _gateway->getRetainedCache()->invalidate(pub.topic, pub.topiclen);
+    }
+    _gateway->getAdapterManager()->getAggregater()->publish(client, &pub);
+}
+
 /*
  *  WILLTOPICUPD
  */
@@ -329,15 +521,35 @@ void MQTTSNConnectionHandler::handleWillmsgupd(Client* client, MQTTSNPacket* pac
  */
 void MQTTSNConnectionHandler::handlePingreq(Client* client, MQTTSNPacket* packet)
 {
+    /* REGISTERs which are not acknowledged are sent again */
+    client->getWaitREGACKPacketList()->retransmit(_gateway->getClientSendQue());
+
     if ((client->isSleep() || client->isAwake()) && client->getClientSleepPacket())
     {
         sendStoredPublish(client);
         client->holdPingRequest();
     }
+    else if (client->isAwake() && client->getWaitREGACKPacketList()->getCount() > 0)
+    {
+        /* PINGRESP is sent when PUBLISHes waiting for REGACKs are sent */
+        client->holdPingRequest();
+    }
+    else if (client->isBrokerAlive() && !client->getConnectData()->flags.bits.will)
+    {
+        /* the gateway keeps the connection of the broker. answer PINGRESP locally */
+        client->resetPingRequest();
+        MQTTSNPacket* pingresp = new MQTTSNPacket();
+        pingresp->setPINGRESP();
+        client->updateStatus(pingresp);
+        Event* evt = new Event();
+        evt->setClientSendEvent(client, pingresp);
+        _gateway->getClientSendQue()->post(evt);
+    }
     else
     {
         /* send PINGREQ to the broker */
         client->resetPingRequest();
+        client->pingreqForwarded();
         MQTTGWPacket* pingreq = new MQTTGWPacket();
         pingreq->setHeader(PINGREQ);
         Event* evt = new Event();
@@ -352,7 +564,6 @@ void MQTTSNConnectionHandler::sendStoredPublish(Client* client)
 
     while ((msg = client->getClientSleepPacket()) != nullptr)
     {
-        // ToDo:  This version can't re-send PUBLISH when PUBACK is not returned.
         client->deleteFirstClientSleepPacket(); // pop the que to delete element.
 
         Event* ev = new Event();
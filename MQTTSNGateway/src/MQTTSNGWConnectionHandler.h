@@ -36,8 +36,13 @@ public:
     void handleWilltopicupd(Client* client, MQTTSNPacket* packet);
     void handleWillmsgupd(Client* client, MQTTSNPacket* packet);
     void handlePingreq(Client* client, MQTTSNPacket* packet);
+    void checkKeepAlive(void);
 private:
     void sendStoredPublish(Client* client);
+    bool resumeSession(Client* client, MQTTSNPacket* packet, MQTTSNPacket_connectData* data);
+    void closeSession(Client* client);
+    void releaseSubscriptions(Client* client);
+    void publishWill(Client* client);
 
     Gateway* _gateway;
 };
@@ -40,11 +40,27 @@ namespace MQTTSNGW
 #define MAX_CLIENTS                 (100)  // Default number of Clients can be handled.
 #define MAX_CLIENTID_LENGTH          (64)  // Max length of clientID
 #define MAX_INFLIGHTMESSAGES         (10)  // Number of inflight messages
-#define MAX_MESSAGEID_TABLE_SIZE    (500)  // Number of MessageIdTable size
+#define TOPICIDMAP_SIZE              (64)  // Slots of TopicIdMap. it should be a power of 2 and larger than MAX_INFLIGHTMESSAGES * 2 + 1
+#define MAX_MESSAGEID_TABLE_SIZE    (500)  // Default number of MessageIdTable size
+#define AGGREGATE_MATCH_TABLE_SIZE (1024)  // Buckets of the subscribers cache of the AggregateTopicTable. it should be a power of 2
+#define MAX_WIRELESS_NODEID_LENGTH   (16)  // Max length of Wireless Node Id of an Encapsulated message
+#define FORWARDER_TABLE_SIZE         (16)  // Buckets of the ForwarderList. it should be a power of 2
+#define FORWARDER_NODE_TABLE_SIZE   (256)  // Buckets of wireless nodes of a Forwarder. it should be a power of 2
 #define MAX_SAVED_PUBLISH            (20)  // Max number of PUBLISH message for Asleep state
+#define DEFAULT_SLEEPSTORE_SIZE (1048576)  // Default bytes of PUBLISH messages saved for all Asleep clients
+#define DEFAULT_SLEEPSTORE_QUOTA   (8192)  // Default bytes of PUBLISH messages saved for an Asleep client
+#define DEFAULT_SESSION_FILE_SIZE (4194304)  // Default bytes of the file of sessions kept over the restart
+#define DEFAULT_RETAINED_CACHE_TTL   (60)  // Default seconds while a cached retained message answers SUBSCRIBEs
 #define MAX_TOPIC_PAR_CLIENT         (50)  // Max Topic count for a client. it should be less than 256
 #define MQTTSNGW_MAX_PACKET_SIZE   (1024)  // Max Packet size  (5+2+TopicLen+PayloadLen + Foward Encapsulation)
+#define BUFFERPOOL_CACHE_SIZE        (64)  // Max free packet buffers cached by a thread per size class
+#define BUFFERPOOL_SLAB_SIZE      (65536)  // Bytes of a slab carved into packet buffers
+#define DEFAULT_DATAGRAM_BATCH_SIZE  (16)  // Default number of datagrams received by a recvmmsg and sent by a sendmmsg
+#define MAX_DATAGRAM_BATCH_SIZE      (64)  // Max number of DatagramBatchSize
+#define MAX_RECEIVE_SOCKETS          (16)  // Max number of unicast sockets and ClientRecvTasks
 #define SIZE_OF_LOG_PACKET          (500)  // Length of the packet log in bytes
+#define DEFAULT_TRACE_RECORDS     (65536)  // Default number of records in a packet trace file
+#define DEFAULT_TRACE_GENERATIONS     (4)  // Default number of packet trace files kept
 
 #define PROXY_KEEPALIVE_DURATION   (900)   // Seconds
 #define PROXY_RESPONSE_DURATION     (10)   // Seconds
@@ -15,6 +15,7 @@
  **************************************************************************************/
 #include "MQTTSNGWPacket.h"
 #include "MQTTSNGWEncapsulatedPacket.h"
+#include "MQTTSNGWProcess.h"
 #include "MQTTSNPacket.h"
 #include <string.h>
 
@@ -22,37 +23,26 @@ using namespace MQTTSNGW;
 using namespace std;
 
 WirelessNodeId::WirelessNodeId() :
-        _len { 0 }, _nodeId { 0 }
+        _len { 0 }
 {
 
 }
 
 WirelessNodeId::~WirelessNodeId()
 {
-    if (_nodeId)
-    {
-        free(_nodeId);
-    }
+
 }
 
 void WirelessNodeId::setId(uint8_t* id, uint8_t len)
 {
-    if (_nodeId)
-    {
-        free(_nodeId);
-    }
-    uint8_t* buf = (uint8_t*) malloc(len);
-    if (buf)
+    /* An id which exceeds the buffer is kept as an empty id. An empty id never matches a node. */
+    if (len > MAX_WIRELESS_NODEID_LENGTH)
     {
-        memcpy(buf, id, len);
-        _len = len;
-        _nodeId = buf;
-    }
-    else
-    {
-        _nodeId = nullptr;
         _len = 0;
+        return;
     }
+    memcpy(_nodeId, id, len);
+    _len = len;
 }
 
 void WirelessNodeId::setId(WirelessNodeId* id)
@@ -62,7 +52,7 @@ void WirelessNodeId::setId(WirelessNodeId* id)
 
 bool WirelessNodeId::operator ==(WirelessNodeId& id)
 {
-    if (_len == id._len)
+    if (_len > 0 && _len == id._len)
     {
         return memcmp(_nodeId, id._nodeId, _len) == 0;
     }
@@ -72,6 +62,17 @@ bool WirelessNodeId::operator ==(WirelessNodeId& id)
     }
 }
 
+uint32_t WirelessNodeId::hash(void)
+{
+    uint32_t h = 2166136261U;   // FNV-1a
+    for (int i = 0; i < _len; i++)
+    {
+        h ^= _nodeId[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
 /*
  *    Class MQTTSNGWEncapsulatedPacket
  */
@@ -122,6 +123,12 @@ int MQTTSNGWEncapsulatedPacket::desirialize(unsigned char* buf, unsigned short l
         _mqttsn = nullptr;
     }
 
+    /* the frame of a node whose id exceeds the buffer is dropped */
+    if (len < 3 || buf[0] < 4 || buf[0] > len || buf[0] - 3 > MAX_WIRELESS_NODEID_LENGTH)
+    {
+        return 0;
+    }
+
     _ctrl = buf[2];
     _id.setId(buf + 3, buf[0] - 3);
 
@@ -157,19 +164,9 @@ void MQTTSNGWEncapsulatedPacket::setWirelessNodeId(WirelessNodeId* id)
 
 char* MQTTSNGWEncapsulatedPacket::print(char* pbuf)
 {
-    char* ptr = pbuf;
-    char** pptr = &pbuf;
-
     uint8_t buf[MQTTSNGW_MAX_PACKET_SIZE];
     int len = serialize(buf);
     int size = len > SIZE_OF_LOG_PACKET ? SIZE_OF_LOG_PACKET : len;
-
-    for (int i = 1; i < size; i++)
-    {
-        sprintf(*pptr, " %02X", *(buf + i));
-        *pptr += 3;
-    }
-    **pptr = 0;
-    return ptr;
+    return hexDump(pbuf, buf + 1, size - 1);
 }
 
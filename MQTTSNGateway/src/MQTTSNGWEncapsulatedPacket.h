@@ -17,6 +17,9 @@
 #ifndef MQTTSNGATEWAY_SRC_MQTTSNGWENCAPSULATEDPACKET_H_
 #define MQTTSNGATEWAY_SRC_MQTTSNGWENCAPSULATEDPACKET_H_
 
+#include "MQTTSNGWDefines.h"
+#include <stdint.h>
+
 namespace MQTTSNGW
 {
 
@@ -29,9 +32,10 @@ public:
     void setId(uint8_t* id, uint8_t len);
     void setId(WirelessNodeId* id);
     bool operator ==(WirelessNodeId& id);
+    uint32_t hash(void);
 private:
     uint8_t _len;
-    uint8_t* _nodeId;
+    uint8_t _nodeId[MAX_WIRELESS_NODEID_LENGTH];
 };
 
 class MQTTSNGWEncapsulatedPacket
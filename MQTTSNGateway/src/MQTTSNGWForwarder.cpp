@@ -27,14 +27,17 @@ using namespace std;
 
 ForwarderList::ForwarderList()
 {
-    _head = nullptr;
+    for (int i = 0; i < FORWARDER_TABLE_SIZE; i++)
+    {
+        _forwarders[i] = nullptr;
+    }
 }
 
 ForwarderList::~ForwarderList()
 {
-    if (_head)
+    for (int i = 0; i < FORWARDER_TABLE_SIZE; i++)
     {
-        Forwarder* p = _head;
+        Forwarder* p = _forwarders[i];
         while (p)
         {
             Forwarder* next = p->_next;
@@ -52,7 +55,7 @@ void ForwarderList::initialize(Gateway* gw)
 
 Forwarder* ForwarderList::getForwarder(SensorNetAddress* addr)
 {
-    Forwarder* p = _head;
+    Forwarder* p = _forwarders[addr->hash() & (FORWARDER_TABLE_SIZE - 1)];
     while (p)
     {
         if (p->_sensorNetAddr.isMatch(addr))
@@ -67,55 +70,43 @@ Forwarder* ForwarderList::getForwarder(SensorNetAddress* addr)
 Forwarder* ForwarderList::addForwarder(SensorNetAddress* addr, MQTTSNString* forwarderId)
 {
     Forwarder* fdr = new Forwarder(addr, forwarderId);
-    if (_head == nullptr)
+    Forwarder** pp = &_forwarders[addr->hash() & (FORWARDER_TABLE_SIZE - 1)];
+    while (*pp)
     {
-        _head = fdr;
-    }
-    else
-    {
-        Forwarder* p = _head;
-        while (p)
-        {
-            if (p->_next == nullptr)
-            {
-                p->_next = fdr;
-                break;
-            }
-            else
-            {
-                p = p->_next;
-            }
-        }
+        pp = &(*pp)->_next;
     }
+    *pp = fdr;
     return fdr;
 }
 
+/*=====================================
+ Class Forwarder
+ =====================================*/
+
 Forwarder::Forwarder()
 {
-    _headClient = nullptr;
-    _next = nullptr;
+    for (int i = 0; i < FORWARDER_NODE_TABLE_SIZE; i++)
+    {
+        _nodes[i] = nullptr;
+        _clients[i] = nullptr;
+    }
 }
 
-/*=====================================
- Class ForwarderList
- =====================================*/
-
-Forwarder::Forwarder(SensorNetAddress* addr, MQTTSNString* forwarderId)
+Forwarder::Forwarder(SensorNetAddress* addr, MQTTSNString* forwarderId) :
+        Forwarder()
 {
     _forwarderName = string(forwarderId->cstring);
     _sensorNetAddr = *addr;
-    _headClient = nullptr;
-    _next = nullptr;
 }
 
 Forwarder::~Forwarder(void)
 {
-    if (_headClient)
+    for (int i = 0; i < FORWARDER_NODE_TABLE_SIZE; i++)
     {
-        ForwarderElement* p = _headClient;
+        ForwarderElement* p = _clients[i];
         while (p)
         {
-            ForwarderElement* next = p->_next;
+            ForwarderElement* next = p->_nextClient;
             delete p;
             p = next;
         }
@@ -127,59 +118,79 @@ const char* Forwarder::getId(void)
     return _forwarderName.c_str();
 }
 
-void Forwarder::addClient(Client* client, WirelessNodeId* id)
+uint32_t Forwarder::hashClient(Client* client)
 {
-    ForwarderElement* p = _headClient;
-    ForwarderElement* prev = nullptr;
+    uintptr_t h = (uintptr_t) client;
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return (uint32_t) h & (FORWARDER_NODE_TABLE_SIZE - 1);
+}
 
-    client->setForwarder(this);
+ForwarderElement* Forwarder::findClient(Client* client)
+{
+    ForwarderElement* p = _clients[hashClient(client)];
+    while (p && p->_client != client)
+    {
+        p = p->_nextClient;
+    }
+    return p;
+}
 
-    if (p != nullptr)
+void Forwarder::unlinkNode(ForwarderElement* elm)
+{
+    ForwarderElement** pp = &_nodes[elm->_wirelessNodeId.hash() & (FORWARDER_NODE_TABLE_SIZE - 1)];
+    while (*pp)
     {
-        while (p)
+        if (*pp == elm)
         {
-            if (p->_client == client)
-            {
-                client->setForwarder(this);
-                p->setWirelessNodeId(id);
-                return;
-            }
-            prev = p;
-            p = p->_next;
+            *pp = elm->_nextNode;
+            break;
         }
+        pp = &(*pp)->_nextNode;
     }
+    elm->_nextNode = nullptr;
+}
 
-    ForwarderElement* fclient = new ForwarderElement();
-
-    fclient->setClient(client);
-    fclient->setWirelessNodeId(id);
+void Forwarder::addClient(Client* client, WirelessNodeId* id)
+{
+    client->setForwarder(this);
 
-    if (prev)
+    _mutex.lock();
+    ForwarderElement* fclient = findClient(client);
+    if (fclient)
     {
-        prev->_next = fclient;
+        unlinkNode(fclient);
     }
     else
     {
-        _headClient = fclient;
+        fclient = new ForwarderElement();
+        fclient->setClient(client);
+        uint32_t cidx = hashClient(client);
+        fclient->_nextClient = _clients[cidx];
+        _clients[cidx] = fclient;
     }
+    fclient->setWirelessNodeId(id);
+
+    uint32_t idx = id->hash() & (FORWARDER_NODE_TABLE_SIZE - 1);
+    fclient->_nextNode = _nodes[idx];
+    _nodes[idx] = fclient;
+    _mutex.unlock();
 }
 
 Client* Forwarder::getClient(WirelessNodeId* id)
 {
     Client* cl = nullptr;
     _mutex.lock();
-    ForwarderElement* p = _headClient;
+    ForwarderElement* p = _nodes[id->hash() & (FORWARDER_NODE_TABLE_SIZE - 1)];
     while (p)
     {
-        if (*(p->_wirelessNodeId) == *id)
+        if (p->_wirelessNodeId == *id)
         {
             cl = p->_client;
             break;
         }
-        else
-        {
-            p = p->_next;
-        }
+        p = p->_nextNode;
     }
     _mutex.unlock();
     return cl;
@@ -194,18 +205,10 @@ WirelessNodeId* Forwarder::getWirelessNodeId(Client* client)
 {
     WirelessNodeId* nodeId = nullptr;
     _mutex.lock();
-    ForwarderElement* p = _headClient;
-    while (p)
+    ForwarderElement* p = findClient(client);
+    if (p)
     {
-        if (p->_client == client)
-        {
-            nodeId = p->_wirelessNodeId;
-            break;
-        }
-        else
-        {
-            p = p->_next;
-        }
+        nodeId = &p->_wirelessNodeId;
     }
     _mutex.unlock();
     return nodeId;
@@ -213,29 +216,19 @@ WirelessNodeId* Forwarder::getWirelessNodeId(Client* client)
 
 void Forwarder::eraseClient(Client* client)
 {
-    ForwarderElement* prev = nullptr;
     _mutex.lock();
-    ForwarderElement* p = _headClient;
-
-    while (p)
+    ForwarderElement** pp = &_clients[hashClient(client)];
+    while (*pp)
     {
+        ForwarderElement* p = *pp;
         if (p->_client == client)
         {
-            if (prev)
-            {
-                prev->_next = p->_next;
-            }
-            else
-            {
-                _headClient = p->_next;
-            }
+            *pp = p->_nextClient;
+            unlinkNode(p);
             delete p;
             break;
         }
-        else
-        {
-            p = p->_next;
-        }
+        pp = &p->_nextClient;
     }
     _mutex.unlock();
 }
@@ -250,16 +243,13 @@ SensorNetAddress* Forwarder::getSensorNetAddr(void)
  */
 
 ForwarderElement::ForwarderElement() :
-        _client { 0 }, _wirelessNodeId { 0 }, _next { 0 }
+        _client { 0 }, _nextNode { 0 }, _nextClient { 0 }
 {
 }
 
 ForwarderElement::~ForwarderElement()
 {
-    if (_wirelessNodeId)
-    {
-        delete _wirelessNodeId;
-    }
+
 }
 
 void ForwarderElement::setClient(Client* client)
@@ -269,9 +259,5 @@ void ForwarderElement::setClient(Client* client)
 
 void ForwarderElement::setWirelessNodeId(WirelessNodeId* id)
 {
-    if (_wirelessNodeId == nullptr)
-    {
-        _wirelessNodeId = new WirelessNodeId();
-    }
-    _wirelessNodeId->setId(id);
+    _wirelessNodeId.setId(id);
 }
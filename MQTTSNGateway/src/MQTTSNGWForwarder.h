@@ -42,12 +42,16 @@ public:
     void setWirelessNodeId(WirelessNodeId* id);
 private:
     Client* _client;
-    WirelessNodeId* _wirelessNodeId;
-    ForwarderElement* _next;
+    WirelessNodeId _wirelessNodeId;
+    ForwarderElement* _nextNode;      // chain of the WirelessNodeId index
+    ForwarderElement* _nextClient;    // chain of the Client index
 };
 
 /*=====================================
  Class Forwarder
+
+ Wireless nodes are indexed by WirelessNodeId and by Client
+ in hash tables of FORWARDER_NODE_TABLE_SIZE buckets.
  =====================================*/
 class Forwarder
 {
@@ -67,9 +71,14 @@ public:
     const char* getName(void);
 
 private:
+    ForwarderElement* findClient(Client* client);
+    void unlinkNode(ForwarderElement* elm);
+    uint32_t hashClient(Client* client);
+
     string _forwarderName;
     SensorNetAddress _sensorNetAddr;
-    ForwarderElement* _headClient { nullptr };
+    ForwarderElement* _nodes[FORWARDER_NODE_TABLE_SIZE];
+    ForwarderElement* _clients[FORWARDER_NODE_TABLE_SIZE];
     Forwarder* _next { nullptr };
     Mutex _mutex;
 };
@@ -88,7 +97,7 @@ public:
     Forwarder* addForwarder(SensorNetAddress* addr, MQTTSNString* forwarderId);
 
 private:
-    Forwarder* _head;
+    Forwarder* _forwarders[FORWARDER_TABLE_SIZE];
 };
 
 }
@@ -0,0 +1,689 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#include "MQTTSNGWInflight.h"
+#include "MQTTSNGWProcess.h"
+#include "MQTTSNGWClient.h"
+#include "MQTTSNGateway.h"
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+
+using namespace MQTTSNGW;
+
+char* currentDateTime(void);
+
+static int windowSize = MAX_INFLIGHTMESSAGES;
+static RetransmitTimer* wheel[RETRANSMIT_WHEEL_SIZE];
+static uint32_t wheelCursor = 0;
+static int wheelCount = 0;
+static std::atomic<uint64_t> retransmitEvents[8];
+
+static uint32_t monotonicMsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* tick 0 means not scheduled */
+static uint32_t currentTick(void)
+{
+    return monotonicMsec() / RETRANSMIT_TICK + 1;
+}
+
+/*=====================================
+ Class RetransmitTimer
+ =====================================*/
+RetransmitTimer::RetransmitTimer()
+{
+    _expire = 0;
+    _next = nullptr;
+    _prev = nullptr;
+}
+
+RetransmitTimer::~RetransmitTimer()
+{
+    Retransmitter::cancel(this);
+}
+
+/*=====================================
+ Class InflightMessage
+ =====================================*/
+InflightMessage::InflightMessage()
+{
+    _window = nullptr;
+    _packet = nullptr;
+    _msgId = 0;
+    _waitType = 0;
+    _retry = 0;
+    _sendTime = 0;
+}
+
+InflightMessage::~InflightMessage()
+{
+    if (_packet)
+    {
+        delete _packet;
+    }
+}
+
+void InflightMessage::timeout(EventQue* que)
+{
+    _window->retransmit(this, que);
+}
+
+/*=====================================
+ Class Retransmitter
+ =====================================*/
+/**
+ *  @param size  messages of a window, 0 means no retransmission
+ */
+void Retransmitter::setWindowSize(int size)
+{
+    windowSize = size;
+}
+
+int Retransmitter::getWindowSize(void)
+{
+    return windowSize;
+}
+
+void Retransmitter::schedule(RetransmitTimer* timer, uint32_t msec)
+{
+    uint32_t now = currentTick();
+    if (timer->_expire)
+    {
+        cancel(timer);
+    }
+    if (wheelCount == 0)
+    {
+        wheelCursor = now;
+    }
+
+    uint32_t ticks = (msec + RETRANSMIT_TICK - 1) / RETRANSMIT_TICK;
+    timer->_expire = now + (ticks ? ticks : 1);
+
+    RetransmitTimer** slot = &wheel[timer->_expire % RETRANSMIT_WHEEL_SIZE];
+    timer->_prev = nullptr;
+    timer->_next = *slot;
+    if (*slot)
+    {
+        (*slot)->_prev = timer;
+    }
+    *slot = timer;
+    wheelCount++;
+}
+
+void Retransmitter::cancel(RetransmitTimer* timer)
+{
+    if (timer->_expire == 0)
+    {
+        return;
+    }
+    if (timer->_prev)
+    {
+        timer->_prev->_next = timer->_next;
+    }
+    else
+    {
+        wheel[timer->_expire % RETRANSMIT_WHEEL_SIZE] = timer->_next;
+    }
+    if (timer->_next)
+    {
+        timer->_next->_prev = timer->_prev;
+    }
+    timer->_next = nullptr;
+    timer->_prev = nullptr;
+    timer->_expire = 0;
+    wheelCount--;
+}
+
+/**
+ *  Retransmit messages of which timers have expired.
+ *  Slots of the wheel are visited from the last visited one to the current tick.
+ */
+void Retransmitter::expire(EventQue* que)
+{
+    uint32_t now = currentTick();
+
+    if ((int32_t) (now - wheelCursor) >= RETRANSMIT_WHEEL_SIZE)
+    {
+        wheelCursor = now - RETRANSMIT_WHEEL_SIZE + 1;
+    }
+
+    while (wheelCount > 0)
+    {
+        RetransmitTimer* timer = wheel[wheelCursor % RETRANSMIT_WHEEL_SIZE];
+        while (timer && (int32_t) (timer->_expire - now) > 0)
+        {
+            timer = timer->_next;
+        }
+
+        if (timer)
+        {
+            cancel(timer);
+            timer->timeout(que);
+        }
+        else if (wheelCursor == now)
+        {
+            break;
+        }
+        else
+        {
+            wheelCursor++;
+        }
+    }
+}
+
+bool Retransmitter::isEmpty(void)
+{
+    return wheelCount == 0;
+}
+
+void Retransmitter::count(int event)
+{
+    retransmitEvents[event].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Retransmitter::getStat(RetransmitStat* stat)
+{
+    stat->sent = retransmitEvents[RETRANSMIT_SENT].load();
+    stat->acked = retransmitEvents[RETRANSMIT_ACKED].load();
+    stat->retransmitted = retransmitEvents[RETRANSMIT_RESENT].load();
+    stat->expired = retransmitEvents[RETRANSMIT_EXPIRED].load();
+    stat->queued = retransmitEvents[RETRANSMIT_QUEUED].load();
+    stat->dropped = retransmitEvents[RETRANSMIT_DROPPED].load();
+    stat->upQueued = retransmitEvents[RETRANSMIT_UP_QUEUED].load();
+    stat->upRejected = retransmitEvents[RETRANSMIT_UP_REJECTED].load();
+}
+
+void Retransmitter::print(void)
+{
+    RetransmitStat stat;
+    getStat(&stat);
+    WRITELOG(" Inflight    sent %llu  acked %llu  retransmitted %llu  expired %llu  queued %llu  dropped %llu\n",
+            (unsigned long long) stat.sent, (unsigned long long) stat.acked, (unsigned long long) stat.retransmitted,
+            (unsigned long long) stat.expired, (unsigned long long) stat.queued, (unsigned long long) stat.dropped);
+    WRITELOG(" Uplink      queued %llu  rejected %llu\n", (unsigned long long) stat.upQueued,
+            (unsigned long long) stat.upRejected);
+}
+
+/*=====================================
+ Class InflightWindow
+ =====================================*/
+InflightWindow::InflightWindow()
+{
+    _client = nullptr;
+    _slots = nullptr;
+    _size = 0;
+    _cnt = 0;
+    _queue = nullptr;
+    _queHead = 0;
+    _queCnt = 0;
+    _srtt = 0;
+    _rttvar = 0;
+    _rto = 0;
+}
+
+InflightWindow::~InflightWindow()
+{
+    clear();
+    if (_slots)
+    {
+        delete[] _slots;
+    }
+    if (_queue)
+    {
+        free(_queue);
+    }
+}
+
+void InflightWindow::setClient(Client* client)
+{
+    _client = client;
+}
+
+/**
+ *  Send a PUBLISH to the client. QoS1 and QoS2 PUBLISHes are kept
+ *  until they are acknowledged, or wait in the queue if the window is full.
+ */
+void InflightWindow::send(MQTTSNPacket* packet, EventQue* que)
+{
+    uint8_t dup;
+    int qos = 0;
+    uint8_t retained;
+    uint16_t msgId = 0;
+    MQTTSN_topicid topic;
+    uint8_t* payload;
+    int payloadLen;
+    packet->getPUBLISH(&dup, &qos, &retained, &msgId, &topic, &payload, &payloadLen);
+
+    if (qos <= 0 || windowSize <= 0)
+    {
+        Event* ev = new Event();
+        ev->setClientSendEvent(_client, packet);
+        que->post(ev);
+        return;
+    }
+
+    if (_slots == nullptr)
+    {
+        _size = windowSize;
+        _slots = new InflightMessage[_size];
+        _queue = (MQTTSNPacket**) calloc(MAX_SAVED_PUBLISH, sizeof(MQTTSNPacket*));
+        for (int i = 0; i < _size; i++)
+        {
+            _slots[i]._window = this;
+        }
+    }
+
+    /* the broker sends it again */
+    InflightMessage* msg = find(msgId);
+    if (msg && msg->_packet)
+    {
+        delete msg->_packet;
+        msg->_packet = packet;
+        post(msg, que);
+        return;
+    }
+
+    if (_cnt >= _size)
+    {
+        if (_queCnt < MAX_SAVED_PUBLISH)
+        {
+            _queue[(_queHead + _queCnt++) % MAX_SAVED_PUBLISH] = packet;
+            Retransmitter::count(RETRANSMIT_QUEUED);
+        }
+        else
+        {
+            WRITELOG("%s   %s has no room for a PUBLISH. the packet was discarded.\n", currentDateTime(),
+                    _client->getClientId());
+            delete packet;
+            Retransmitter::count(RETRANSMIT_DROPPED);
+        }
+        return;
+    }
+
+    for (msg = _slots; msg->_waitType; msg++)
+    {
+    }
+    msg->_packet = packet;
+    msg->_msgId = msgId;
+    msg->_waitType = qos == 1 ? MQTTSN_PUBACK : MQTTSN_PUBREC;
+    msg->_retry = 0;
+    msg->_sendTime = monotonicMsec();
+    _cnt++;
+    Retransmitter::count(RETRANSMIT_SENT);
+    post(msg, que);
+    Retransmitter::schedule(msg, getTimeout());
+}
+
+/**
+ *  Send a PUBREL of the broker to the client.
+ *  @return false if the PUBLISH is not kept by the window.
+ */
+bool InflightWindow::sendPubrel(uint16_t msgId, EventQue* que)
+{
+    InflightMessage* msg = find(msgId);
+    if (msg == nullptr || msg->_waitType != MQTTSN_PUBREL)
+    {
+        return false;
+    }
+    msg->_packet = new MQTTSNPacket();
+    msg->_packet->setPUBREL(msgId);
+    msg->_waitType = MQTTSN_PUBCOMP;
+    msg->_retry = 0;
+    msg->_sendTime = monotonicMsec();
+    Retransmitter::count(RETRANSMIT_SENT);
+    post(msg, que);
+    Retransmitter::schedule(msg, getTimeout());
+    return true;
+}
+
+/**
+ *  PUBACK, PUBREC or PUBCOMP of the client is received.
+ */
+void InflightWindow::acknowledge(uint8_t type, uint16_t msgId, EventQue* que)
+{
+    InflightMessage* msg = find(msgId);
+    if (msg == nullptr || msg->_waitType != type)
+    {
+        return;
+    }
+    Retransmitter::cancel(msg);
+
+    /* Karn's algorithm. a retransmitted message doesn't measure the round trip time */
+    if (msg->_retry == 0)
+    {
+        updateRTT(monotonicMsec() - msg->_sendTime);
+    }
+    Retransmitter::count(RETRANSMIT_ACKED);
+
+    if (type == MQTTSN_PUBREC)
+    {
+        /* the slot is kept until PUBCOMP */
+        delete msg->_packet;
+        msg->_packet = nullptr;
+        msg->_waitType = MQTTSN_PUBREL;
+        return;
+    }
+    release(msg);
+
+    while (_cnt < _size && _queCnt > 0)
+    {
+        MQTTSNPacket* packet = _queue[_queHead];
+        _queHead = (_queHead + 1) % MAX_SAVED_PUBLISH;
+        _queCnt--;
+        send(packet, que);
+    }
+}
+
+/**
+ *  Send messages again which have waited for the client to connect with CleanSession=false
+ *  or to resume the session.
+ */
+void InflightWindow::resume(EventQue* que)
+{
+    for (int i = 0; i < _size && _cnt > 0; i++)
+    {
+        InflightMessage* msg = &_slots[i];
+
+        /* a PUBREL of the broker is waited */
+        if (msg->_waitType == 0 || msg->_packet == nullptr)
+        {
+            continue;
+        }
+        Retransmitter::cancel(msg);
+        retransmit(msg, que);
+    }
+}
+
+/**
+ *  Discard all messages. Called when the session is cleaned.
+ */
+void InflightWindow::clear(void)
+{
+    for (int i = 0; i < _size && _cnt > 0; i++)
+    {
+        if (_slots[i]._waitType)
+        {
+            Retransmitter::count(RETRANSMIT_EXPIRED);
+            release(&_slots[i]);
+        }
+    }
+    while (_queCnt > 0)
+    {
+        delete _queue[_queHead];
+        _queHead = (_queHead + 1) % MAX_SAVED_PUBLISH;
+        _queCnt--;
+        Retransmitter::count(RETRANSMIT_EXPIRED);
+    }
+}
+
+int InflightWindow::getCount(void)
+{
+    return _cnt;
+}
+
+/**
+ *  @return msecs to wait an acknowledgement. it is measured by round trip times
+ *  once a message is acknowledged, otherwise it depends on the type of the sensor network.
+ */
+uint32_t InflightWindow::getTimeout(void)
+{
+    if (_rto)
+    {
+        return _rto;
+    }
+    return _client->isSensorNetStable() ? RETRANSMIT_RTO_STABLE : RETRANSMIT_RTO_UNSTABLE;
+}
+
+void InflightWindow::post(InflightMessage* msg, EventQue* que)
+{
+    MQTTSNPacket* packet = new MQTTSNPacket(*msg->_packet);
+    Event* ev = new Event();
+    ev->setClientSendEvent(_client, packet);
+    que->post(ev);
+}
+
+void InflightWindow::retransmit(InflightMessage* msg, EventQue* que)
+{
+    /* wait until the client wakes up or resumes the session */
+    if (_client->isSleep() || _client->isSessionKept())
+    {
+        Retransmitter::schedule(msg, getTimeout());
+        return;
+    }
+
+    /* the message is sent again by resume( ) when the client connects, or discarded with the session */
+    if (!_client->isActive() && !_client->isAwake())
+    {
+        return;
+    }
+
+    if (msg->_retry >= RETRANSMIT_MAX_RETRY)
+    {
+        WRITELOG("%s   %s didn't acknowledge a message %04X. the message was discarded.\n", currentDateTime(),
+                _client->getClientId(), msg->_msgId);
+        Retransmitter::count(RETRANSMIT_EXPIRED);
+        release(msg);
+        return;
+    }
+
+    msg->_retry++;
+    if (msg->_packet->getType() == MQTTSN_PUBLISH)
+    {
+        msg->_packet->setDUP();
+    }
+    Retransmitter::count(RETRANSMIT_RESENT);
+    post(msg, que);
+
+    /* exponential backoff */
+    uint32_t timeout = getTimeout() << msg->_retry;
+    Retransmitter::schedule(msg, timeout < RETRANSMIT_RTO_MAX ? timeout : RETRANSMIT_RTO_MAX);
+}
+
+void InflightWindow::release(InflightMessage* msg)
+{
+    Retransmitter::cancel(msg);
+    if (msg->_packet)
+    {
+        delete msg->_packet;
+        msg->_packet = nullptr;
+    }
+    msg->_waitType = 0;
+    _cnt--;
+}
+
+InflightMessage* InflightWindow::find(uint16_t msgId)
+{
+    for (int i = 0; i < _size; i++)
+    {
+        if (_slots[i]._waitType && _slots[i]._msgId == msgId)
+        {
+            return &_slots[i];
+        }
+    }
+    return nullptr;
+}
+
+/*
+ *  RFC 6298 estimator of the retransmission timeout.
+ */
+void InflightWindow::updateRTT(uint32_t rtt)
+{
+    if (_srtt == 0)
+    {
+        _srtt = rtt ? rtt : 1;
+        _rttvar = rtt / 2;
+    }
+    else
+    {
+        uint32_t delta = _srtt > rtt ? _srtt - rtt : rtt - _srtt;
+        _rttvar = (3 * _rttvar + delta) / 4;
+        _srtt = (7 * _srtt + rtt) / 8;
+    }
+
+    uint32_t min = _client->isSensorNetStable() ? RETRANSMIT_RTO_MIN_STABLE : RETRANSMIT_RTO_MIN_UNSTABLE;
+    _rto = _srtt + (4 * _rttvar > RETRANSMIT_TICK ? 4 * _rttvar : RETRANSMIT_TICK);
+    _rto = _rto < min ? min : (_rto > RETRANSMIT_RTO_MAX ? RETRANSMIT_RTO_MAX : _rto);
+}
+
+/*=====================================
+ Class UplinkWindow
+ =====================================*/
+UplinkWindow::UplinkWindow()
+{
+    _client = nullptr;
+    _msgIds = nullptr;
+    _size = 0;
+    _cnt = 0;
+    _queue = nullptr;
+    _queHead = 0;
+    _queCnt = 0;
+}
+
+UplinkWindow::~UplinkWindow()
+{
+    clear();
+    if (_msgIds)
+    {
+        free(_msgIds);
+    }
+    if (_queue)
+    {
+        free(_queue);
+    }
+}
+
+void UplinkWindow::setClient(Client* client)
+{
+    _client = client;
+}
+
+/**
+ *  Send a QoS1 or QoS2 PUBLISH of the client to the broker,
+ *  or keep it in the queue if the window is full.
+ *  @return false if the queue is also full. the packet is deleted.
+ */
+bool UplinkWindow::send(MQTTGWPacket* packet, uint16_t msgId, EventQue* que)
+{
+    if (windowSize <= 0)
+    {
+        post(packet, 0, que);
+        return true;
+    }
+
+    if (_msgIds == nullptr)
+    {
+        _size = windowSize;
+        _msgIds = (uint16_t*) calloc(_size, sizeof(uint16_t));
+        _queue = (MQTTGWPacket**) calloc(MAX_SAVED_PUBLISH, sizeof(MQTTGWPacket*));
+    }
+
+    /* the client sends it again */
+    for (int i = 0; i < _size; i++)
+    {
+        if (_msgIds[i] == msgId)
+        {
+            post(packet, 0, que);
+            return true;
+        }
+    }
+
+    if (_cnt < _size)
+    {
+        post(packet, msgId, que);
+    }
+    else if (_queCnt < MAX_SAVED_PUBLISH)
+    {
+        _queue[(_queHead + _queCnt++) % MAX_SAVED_PUBLISH] = packet;
+        Retransmitter::count(RETRANSMIT_UP_QUEUED);
+    }
+    else
+    {
+        delete packet;
+        Retransmitter::count(RETRANSMIT_UP_REJECTED);
+        return false;
+    }
+    return true;
+}
+
+/**
+ *  PUBACK or PUBCOMP of the broker is received.
+ */
+void UplinkWindow::acknowledge(uint16_t msgId, EventQue* que)
+{
+    for (int i = 0; i < _size; i++)
+    {
+        if (_msgIds[i] == msgId)
+        {
+            _msgIds[i] = 0;
+            _cnt--;
+            break;
+        }
+    }
+
+    while (_cnt < _size && _queCnt > 0)
+    {
+        MQTTGWPacket* packet = _queue[_queHead];
+        _queHead = (_queHead + 1) % MAX_SAVED_PUBLISH;
+        _queCnt--;
+        post(packet, packet->getMsgId(), que);
+    }
+}
+
+/**
+ *  Forget PUBLISHes in flight. Called when the client connects to the broker again.
+ */
+void UplinkWindow::clear(void)
+{
+    for (int i = 0; i < _size; i++)
+    {
+        _msgIds[i] = 0;
+    }
+    _cnt = 0;
+    while (_queCnt > 0)
+    {
+        delete _queue[_queHead];
+        _queHead = (_queHead + 1) % MAX_SAVED_PUBLISH;
+        _queCnt--;
+    }
+}
+
+int UplinkWindow::getCount(void)
+{
+    return _cnt + _queCnt;
+}
+
+void UplinkWindow::post(MQTTGWPacket* packet, uint16_t msgId, EventQue* que)
+{
+    if (msgId)
+    {
+        for (int i = 0; i < _size; i++)
+        {
+            if (_msgIds[i] == 0)
+            {
+                _msgIds[i] = msgId;
+                _cnt++;
+                break;
+            }
+        }
+    }
+    Event* ev = new Event();
+    ev->setBrokerSendEvent(_client, packet);
+    que->post(ev);
+}
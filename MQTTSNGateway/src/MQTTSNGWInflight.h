@@ -0,0 +1,200 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#ifndef MQTTSNGATEWAY_SRC_MQTTSNGWINFLIGHT_H_
+#define MQTTSNGATEWAY_SRC_MQTTSNGWINFLIGHT_H_
+
+#include "MQTTSNGWDefines.h"
+#include <stdint.h>
+
+namespace MQTTSNGW
+{
+class Client;
+class EventQue;
+class MQTTSNPacket;
+class MQTTGWPacket;
+class InflightWindow;
+
+#define RETRANSMIT_TICK               (100)  // msecs of a slot of the timer wheel
+#define RETRANSMIT_WHEEL_SIZE         (512)  // slots of the timer wheel
+#define RETRANSMIT_MAX_RETRY            (3)  // retransmissions before a message is discarded
+#define RETRANSMIT_RTO_STABLE       (10000)  // msecs of the first timeout for a stable sensor network
+#define RETRANSMIT_RTO_UNSTABLE     (20000)  // msecs of the first timeout for an unstable one like a LoRa or a XBee
+#define RETRANSMIT_RTO_MIN_STABLE    (1000)  // lower bounds of the timeout measured by round trip times
+#define RETRANSMIT_RTO_MIN_UNSTABLE  (5000)
+#define RETRANSMIT_RTO_MAX          (60000)  // upper bound of the timeout including the backoff
+
+typedef struct
+{
+    uint64_t sent;          // PUBLISHes and PUBRELs sent at the first time
+    uint64_t acked;         // acknowledged by clients
+    uint64_t retransmitted; // sent again with the DUP flag
+    uint64_t expired;       // discarded after RETRANSMIT_MAX_RETRY or by the lost client
+    uint64_t queued;        // waited for a room of the window
+    uint64_t dropped;       // discarded because the queue is full
+    uint64_t upQueued;      // PUBLISHes of clients waited for a room of the window toward the broker
+    uint64_t upRejected;    // PUBLISHes of clients rejected with the congestion because the queue is full
+} RetransmitStat;
+
+/* events counted by Retransmitter::count( ) */
+#define RETRANSMIT_SENT       (0)
+#define RETRANSMIT_ACKED      (1)
+#define RETRANSMIT_RESENT     (2)
+#define RETRANSMIT_EXPIRED    (3)
+#define RETRANSMIT_QUEUED     (4)
+#define RETRANSMIT_DROPPED    (5)
+#define RETRANSMIT_UP_QUEUED  (6)
+#define RETRANSMIT_UP_REJECTED (7)
+
+/*=====================================
+ Class RetransmitTimer
+
+ A timer of the Retransmitter. timeout( ) is called when it expires.
+ =====================================*/
+class RetransmitTimer
+{
+    friend class Retransmitter;
+public:
+    RetransmitTimer();
+    virtual ~RetransmitTimer();
+
+protected:
+    virtual void timeout(EventQue* que) = 0;
+
+private:
+    uint32_t _expire;       // tick of the timer wheel, 0 if not scheduled
+    RetransmitTimer* _next;
+    RetransmitTimer* _prev;
+};
+
+/*=====================================
+ Class InflightMessage
+ =====================================*/
+class InflightMessage: public RetransmitTimer
+{
+    friend class InflightWindow;
+public:
+    InflightMessage();
+    ~InflightMessage();
+
+protected:
+    void timeout(EventQue* que);
+
+private:
+    InflightWindow* _window;
+    MQTTSNPacket* _packet;  // copy for the retransmission, nullptr while PUBREL of the broker is waited
+    uint16_t _msgId;
+    uint8_t _waitType;      // MQTTSN_PUBACK, MQTTSN_PUBREC, MQTTSN_PUBREL or MQTTSN_PUBCOMP, 0 if free
+    uint8_t _retry;
+    uint32_t _sendTime;     // msecs when the packet was sent at the first time
+};
+
+/*=====================================
+ Class Retransmitter
+
+ A timer wheel shared by windows and REGISTERs of all clients.
+ A timer is scheduled in O(1) and cancelled in O(1).
+ Used only by the PacketHandleTask.
+ =====================================*/
+class Retransmitter
+{
+public:
+    static void setWindowSize(int size);
+    static int getWindowSize(void);
+    static void schedule(RetransmitTimer* timer, uint32_t msec);
+    static void cancel(RetransmitTimer* timer);
+    static void expire(EventQue* que);
+    static bool isEmpty(void);
+    static void count(int event);
+    static void getStat(RetransmitStat* stat);
+    static void print(void);
+};
+
+/*=====================================
+ Class InflightWindow
+
+ QoS1 and QoS2 PUBLISHes sent to a client which are not acknowledged.
+ PUBLISHes exceeding the window wait in the queue. They are kept while
+ the client is lost, and discarded when its session is cleaned.
+ =====================================*/
+class InflightWindow
+{
+    friend class InflightMessage;
+public:
+    InflightWindow();
+    ~InflightWindow();
+
+    void setClient(Client* client);
+    void send(MQTTSNPacket* packet, EventQue* que);
+    bool sendPubrel(uint16_t msgId, EventQue* que);
+    void acknowledge(uint8_t type, uint16_t msgId, EventQue* que);
+    void resume(EventQue* que);
+    void clear(void);
+    int getCount(void);
+    uint32_t getTimeout(void);
+
+private:
+    void post(InflightMessage* msg, EventQue* que);
+    void retransmit(InflightMessage* msg, EventQue* que);
+    void release(InflightMessage* msg);
+    InflightMessage* find(uint16_t msgId);
+    void updateRTT(uint32_t rtt);
+
+    Client* _client;
+    InflightMessage* _slots;
+    int _size;
+    int _cnt;
+    MQTTSNPacket** _queue;  // ring buffer of PUBLISHes waiting for a slot
+    int _queHead;
+    int _queCnt;
+    uint32_t _srtt;         // smoothed round trip time in msecs, 0 if not measured
+    uint32_t _rttvar;
+    uint32_t _rto;
+};
+
+/*=====================================
+ Class UplinkWindow
+
+ QoS1 and QoS2 PUBLISHes of a client sent to the broker
+ which are not acknowledged by PUBACK or PUBCOMP.
+ PUBLISHes exceeding the window wait in the queue.
+ =====================================*/
+class UplinkWindow
+{
+public:
+    UplinkWindow();
+    ~UplinkWindow();
+
+    void setClient(Client* client);
+    bool send(MQTTGWPacket* packet, uint16_t msgId, EventQue* que);
+    void acknowledge(uint16_t msgId, EventQue* que);
+    void clear(void);
+    int getCount(void);
+
+private:
+    void post(MQTTGWPacket* packet, uint16_t msgId, EventQue* que);
+
+    Client* _client;
+    uint16_t* _msgIds;      // 0 if the slot is free
+    int _size;
+    int _cnt;
+    MQTTGWPacket** _queue;  // ring buffer of PUBLISHes waiting for a slot
+    int _queHead;
+    int _queCnt;
+};
+
+}
+
+#endif /* MQTTSNGATEWAY_SRC_MQTTSNGWINFLIGHT_H_ */
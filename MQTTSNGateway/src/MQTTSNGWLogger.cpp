@@ -0,0 +1,252 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#include "MQTTSNGWLogger.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace MQTTSNGW;
+
+/* the ring of the calling thread. rings are registered to the Logger and never freed while it runs. */
+static thread_local LogRing* threadRing = nullptr;
+
+/*=====================================
+ Class LogRing
+ =====================================*/
+LogRing::LogRing()
+{
+}
+
+LogRing::~LogRing()
+{
+}
+
+void LogRing::put(const char* record, int len)
+{
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    uint32_t head = _head.load(std::memory_order_acquire);
+
+    if (PROCESS_LOG_RING_SIZE - (tail - head) < (uint32_t) len + 2)
+    {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint8_t hdr[2] = { (uint8_t) (len >> 8), (uint8_t) len };
+    for (int i = 0; i < 2; i++)
+    {
+        _buf[(tail + i) % PROCESS_LOG_RING_SIZE] = hdr[i];
+    }
+
+    uint32_t pos = (tail + 2) % PROCESS_LOG_RING_SIZE;
+    uint32_t first = PROCESS_LOG_RING_SIZE - pos;
+    if (first >= (uint32_t) len)
+    {
+        memcpy(_buf + pos, record, len);
+    }
+    else
+    {
+        memcpy(_buf + pos, record, first);
+        memcpy(_buf, record + first, len - first);
+    }
+    _tail.store(tail + 2 + len, std::memory_order_release);
+}
+
+/**
+ *  Copy a record into buf and terminate it by NUL.
+ *  @return length of the record, 0 if the ring is empty.
+ */
+int LogRing::get(char* buf)
+{
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    uint32_t tail = _tail.load(std::memory_order_acquire);
+
+    if (head == tail)
+    {
+        return 0;
+    }
+
+    int len = ((uint8_t) _buf[head % PROCESS_LOG_RING_SIZE] << 8) | (uint8_t) _buf[(head + 1) % PROCESS_LOG_RING_SIZE];
+    uint32_t pos = (head + 2) % PROCESS_LOG_RING_SIZE;
+    uint32_t first = PROCESS_LOG_RING_SIZE - pos;
+    if (first >= (uint32_t) len)
+    {
+        memcpy(buf, _buf + pos, len);
+    }
+    else
+    {
+        memcpy(buf, _buf + pos, first);
+        memcpy(buf + first, _buf, len - first);
+    }
+    buf[len] = 0;
+    _head.store(head + 2 + len, std::memory_order_release);
+    return len;
+}
+
+uint64_t LogRing::getDropped(void)
+{
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+/*=====================================
+ Class Logger
+ =====================================*/
+Logger::Logger(Process* process)
+{
+    _process = process;
+    setTaskName("Logger");
+}
+
+Logger::~Logger()
+{
+    close();
+    LogRing* ring = _rings.load();
+    while (ring)
+    {
+        LogRing* next = ring->_next;
+        delete ring;
+        ring = next;
+    }
+}
+
+void Logger::EXECRUN(void)
+{
+    run();
+}
+
+/**
+ *  Start the Logger thread. putLog( ) writes into rings after this.
+ */
+void Logger::open(void)
+{
+    if (_running)
+    {
+        return;
+    }
+    _stopReq = false;
+    _running = true;
+    start();
+}
+
+/**
+ *  Stop the Logger thread and write the remaining records.
+ *  putLog( ) writes synchronously after this.
+ */
+void Logger::close(void)
+{
+    if (!_running)
+    {
+        return;
+    }
+    _running = false;
+    _stopReq = true;
+    _sem.post();
+    stop();
+    drain();
+}
+
+/**
+ *  @return false if the Logger is not running. The caller writes the record by itself.
+ */
+bool Logger::put(const char* record, int len)
+{
+    if (!_running.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    LogRing* ring = threadRing;
+    if (ring == nullptr)
+    {
+        ring = new LogRing();
+        LogRing* head = _rings.load();
+        do
+        {
+            ring->_next = head;
+        } while (!_rings.compare_exchange_weak(head, ring));
+        threadRing = ring;
+    }
+
+    ring->put(record, len);
+
+    /* wake up the Logger only when it sleeps */
+    if (_sleeping.load() && _sleeping.exchange(false))
+    {
+        _sem.post();
+    }
+    return true;
+}
+
+uint64_t Logger::getDropped(void)
+{
+    uint64_t cnt = 0;
+    for (LogRing* ring = _rings.load(); ring; ring = ring->_next)
+    {
+        cnt += ring->getDropped();
+    }
+    return cnt;
+}
+
+void Logger::run(void)
+{
+    while (!_stopReq)
+    {
+        if (drain() == 0)
+        {
+            _sleeping = true;
+            if (drain() == 0)
+            {
+                _sem.timedwait(LOGGER_IDLE_TIME);
+            }
+            _sleeping = false;
+        }
+    }
+    drain();
+}
+
+/**
+ *  Write records of all rings.
+ *  @return number of records written
+ */
+int Logger::drain(void)
+{
+    int cnt = 0;
+
+    _process->_mt.lock();
+    for (LogRing* ring = _rings.load(); ring; ring = ring->_next)
+    {
+        while (ring->get(_record) > 0)
+        {
+            _process->writeLog(_record);
+            cnt++;
+        }
+    }
+
+    uint64_t dropped = getDropped();
+    if (dropped > _reported)
+    {
+        snprintf(_record, sizeof(_record), "%s %llu log records have been dropped.%s\n", RED_HDR,
+                (unsigned long long) (dropped - _reported), CLR_HDR);
+        _process->writeLog(_record);
+        _reported = dropped;
+    }
+
+    if (cnt)
+    {
+        fflush(stdout);
+    }
+    _process->_mt.unlock();
+    return cnt;
+}
@@ -0,0 +1,87 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#ifndef MQTTSNGATEWAY_SRC_MQTTSNGWLOGGER_H_
+#define MQTTSNGATEWAY_SRC_MQTTSNGWLOGGER_H_
+
+#include "MQTTSNGWProcess.h"
+#include <stdint.h>
+#include <atomic>
+
+namespace MQTTSNGW
+{
+
+/*=====================================
+ Class LogRing
+
+ Log records written by one thread and read by the Logger.
+ Each record is a 2 bytes length followed by the text.
+ =====================================*/
+class LogRing
+{
+    friend class Logger;
+public:
+    LogRing();
+    ~LogRing();
+
+    void put(const char* record, int len);
+    int get(char* buf);
+    uint64_t getDropped(void);
+
+private:
+    char _buf[PROCESS_LOG_RING_SIZE];
+    std::atomic<uint32_t> _head { 0 };         // read by the Logger
+    std::atomic<uint32_t> _tail { 0 };         // written by the thread
+    std::atomic<uint64_t> _dropped { 0 };      // records dropped by overflows
+    LogRing* _next { nullptr };
+};
+
+/*=====================================
+ Class Logger
+
+ putLog( ) of each thread writes records into its own LogRing
+ without a lock. The Logger thread drains the rings into
+ stdout or the RingBuffer of the Logmonitor.
+ A record which doesn't fit in a ring is dropped and counted.
+ =====================================*/
+class Logger: public Thread
+{
+public:
+    Logger(Process* process);
+    ~Logger();
+
+    void EXECRUN(void);
+    void open(void);
+    void close(void);
+    bool put(const char* record, int len);
+    uint64_t getDropped(void);
+
+private:
+    void run(void);
+    int drain(void);
+
+    Process* _process;
+    std::atomic<LogRing*> _rings { nullptr };
+    std::atomic<bool> _running { false };
+    std::atomic<bool> _stopReq { false };
+    std::atomic<bool> _sleeping { false };
+    Semaphore _sem;
+    uint64_t _reported { 0 };
+    char _record[PROCESS_LOG_BUFFER_SIZE + 1];
+};
+
+}
+
+#endif /* MQTTSNGATEWAY_SRC_MQTTSNGWLOGGER_H_ */
@@ -22,6 +22,8 @@ using namespace MQTTSNGW;
 /*===============================
  * Class MessageIdTable
  ===============================*/
+#define MESSAGEID_INDEX_SIZE  (0x10000)
+
 MessageIdTable::MessageIdTable()
 {
 
@@ -30,58 +32,98 @@ MessageIdTable::MessageIdTable()
 MessageIdTable::~MessageIdTable()
 {
     _mutex.lock();
-    if (_head != nullptr)
+    if (_elements)
     {
-        MessageIdElement* p = _tail;
-        while (p)
-        {
-            MessageIdElement* pPrev = p;
-            delete p;
-            _cnt--;
-            p = pPrev->_prev;
-        }
-        _head = _tail = nullptr;
+        delete[] _elements;
+    }
+    if (_msgIdIndex)
+    {
+        delete[] _msgIdIndex;
     }
+    if (_clientIndex)
+    {
+        delete[] _clientIndex;
+    }
+    _elements = _free = nullptr;
+    _msgIdIndex = _clientIndex = nullptr;
+    _cnt = 0;
     _mutex.unlock();
 }
 
-MessageIdElement* MessageIdTable::add(Aggregater* aggregater, Client* client, uint16_t clientMsgId)
+void MessageIdTable::initialize(int maxSize)
 {
-    if (_cnt > _maxSize)
+    if (_elements)
     {
-        return nullptr;
+        return;
     }
 
-    MessageIdElement* elm = new MessageIdElement(0, client, clientMsgId);
-    if (elm == nullptr)
+    /* msgId 0 and 0xffff are never used */
+    if (maxSize <= 0)
     {
-        return nullptr;
+        maxSize = MAX_MESSAGEID_TABLE_SIZE;
     }
+    else if (maxSize > MESSAGEID_INDEX_SIZE - 2)
+    {
+        maxSize = MESSAGEID_INDEX_SIZE - 2;
+    }
+    _maxSize = maxSize;
+
+    uint32_t size = 1;
+    while (size < (uint32_t) _maxSize)
+    {
+        size <<= 1;
+    }
+    _clientIndexMask = size - 1;
+
+    _elements = new MessageIdElement[_maxSize];
+    _msgIdIndex = new MessageIdElement*[MESSAGEID_INDEX_SIZE]();
+    _clientIndex = new MessageIdElement*[size]();
+
+    for (int i = 0; i < _maxSize - 1; i++)
+    {
+        _elements[i]._next = &_elements[i + 1];
+    }
+    _free = _elements;
+}
+
+uint32_t MessageIdTable::hash(Client* client, uint16_t clientMsgId)
+{
+    uintptr_t key = (uintptr_t) client;
+    key = (key >> 4) ^ (key >> 16) ^ ((uintptr_t) clientMsgId * 0x9E3779B1u);
+    return (uint32_t) key & _clientIndexMask;
+}
+
+MessageIdElement* MessageIdTable::add(Aggregater* aggregater, Client* client, uint16_t clientMsgId)
+{
+    MessageIdElement* elm = nullptr;
+
     _mutex.lock();
-    if (_head == nullptr)
+    if (_elements == nullptr)
     {
-        elm->_msgId = aggregater->msgId();
-        _head = elm;
-        _tail = elm;
-        _cnt++;
+        initialize(MAX_MESSAGEID_TABLE_SIZE);
     }
-    else
+
+    if (_free != nullptr && find(client, clientMsgId) == nullptr)
     {
-        MessageIdElement* p = find(client, clientMsgId);
-        if (p == nullptr)
-        {
-            elm->_msgId = aggregater->msgId();
-            p = _tail;
-            _tail = elm;
-            elm->_prev = p;
-            p->_next = elm;
-            _cnt++;
-        }
-        else
+        /* skip msgIds which are still in use after the msgId wraps around */
+        uint16_t msgId = aggregater->msgId();
+        while (_msgIdIndex[msgId] != nullptr)
         {
-            delete elm;
-            elm = nullptr;
+            msgId = aggregater->msgId();
         }
+
+        elm = _free;
+        _free = elm->_next;
+
+        elm->_msgId = msgId;
+        elm->_client = client;
+        elm->_clientMsgId = clientMsgId;
+
+        uint32_t h = hash(client, clientMsgId);
+        elm->_next = _clientIndex[h];
+        _clientIndex[h] = elm;
+        _msgIdIndex[msgId] = elm;
+        _cnt++;
     }
     _mutex.unlock();
     return elm;
@@ -89,21 +131,21 @@ MessageIdElement* MessageIdTable::add(Aggregater* aggregater, Client* client, ui
 
 MessageIdElement* MessageIdTable::find(uint16_t msgId)
 {
-    MessageIdElement* p = _head;
-    while (p)
+    if (_msgIdIndex == nullptr)
     {
-        if (p->_msgId == msgId)
-        {
-            break;
-        }
-        p = p->_next;
+        return nullptr;
     }
-    return p;
+    return _msgIdIndex[msgId];
 }
 
 MessageIdElement* MessageIdTable::find(Client* client, uint16_t clientMsgId)
 {
-    MessageIdElement* p = _head;
+    if (_clientIndex == nullptr)
+    {
+        return nullptr;
+    }
+
+    MessageIdElement* p = _clientIndex[hash(client, clientMsgId)];
     while (p)
     {
         if (p->_clientMsgId == clientMsgId && p->_client == client)
@@ -139,6 +181,22 @@ void MessageIdTable::erase(uint16_t msgId)
     _mutex.unlock();
 }
 
+/**
+ *  Release all msgIds of the client which is deleted. Late ACKs of them are discarded.
+ */
+void MessageIdTable::erase(Client* client)
+{
+    _mutex.lock();
+    for (int i = 0; _elements && i < _maxSize; i++)
+    {
+        if (_elements[i]._client == client)
+        {
+            clear(&_elements[i]);
+        }
+    }
+    _mutex.unlock();
+}
+
 void MessageIdTable::clear(MessageIdElement* elm)
 {
     if (elm == nullptr)
@@ -146,54 +204,46 @@ void MessageIdTable::clear(MessageIdElement* elm)
         return;
     }
 
-    if (elm->_prev == nullptr)
+    MessageIdElement** pp = &_clientIndex[hash(elm->_client, elm->_clientMsgId)];
+    while (*pp && *pp != elm)
     {
-        _head = elm->_next;
-        if (_head == nullptr)
-        {
-            _tail = nullptr;
-        }
-        else
-        {
-            _head->_prev = nullptr;
-        }
-        delete elm;
-        _cnt--;
-        return;
+        pp = &(*pp)->_next;
     }
-    else
+    if (*pp)
     {
-        elm->_prev->_next = elm->_next;
-        if (elm->_next == nullptr)
-        {
-            _tail = elm->_prev;
-        }
-        else
-        {
-            elm->_next->_prev = elm->_prev;
-        }
-        delete elm;
-        _cnt--;
-        return;
+        *pp = elm->_next;
     }
+    _msgIdIndex[elm->_msgId] = nullptr;
+
+    elm->_client = nullptr;
+    elm->_next = _free;
+    _free = elm;
+    _cnt--;
 }
 
 uint16_t MessageIdTable::getMsgId(Client* client, uint16_t clientMsgId)
 {
     uint16_t msgId = 0;
+    _mutex.lock();
     MessageIdElement* p = find(client, clientMsgId);
     if (p != nullptr)
     {
         msgId = p->_msgId;
     }
+    _mutex.unlock();
     return msgId;
 }
 
+int MessageIdTable::getCount(void)
+{
+    return _cnt;
+}
+
 /*===============================
  * Class MessageIdElement
  ===============================*/
 MessageIdElement::MessageIdElement(void) :
-        _msgId { 0 }, _clientMsgId { 0 }, _client { nullptr }, _next { nullptr }, _prev { nullptr }
+        _msgId { 0 }, _clientMsgId { 0 }, _client { nullptr }, _next { nullptr }
 {
 
 }
@@ -30,6 +30,9 @@ class Meutex;
 class Aggregater;
 /*=====================================
  Class MessageIdTable
+
+ Elements are indexed directly by the gateway msgId and
+ by a hash of (client, clientMsgId).
  ======================================*/
 class MessageIdTable
 {
@@ -37,19 +40,26 @@ public:
     MessageIdTable();
     ~MessageIdTable();
 
+    void initialize(int maxSize);
     MessageIdElement* add(Aggregater* aggregater, Client* client,
             uint16_t clientMsgId);
     Client* getClientMsgId(uint16_t msgId, uint16_t* clientMsgId);
     uint16_t getMsgId(Client* client, uint16_t clientMsgId);
     void erase(uint16_t msgId);
+    void erase(Client* client);
     void clear(MessageIdElement* elm);
+    int getCount(void);
 private:
     MessageIdElement* find(uint16_t msgId);
     MessageIdElement* find(Client* client, uint16_t clientMsgId);
-    MessageIdElement* _head { nullptr };
-    MessageIdElement* _tail{ nullptr };
+    uint32_t hash(Client* client, uint16_t clientMsgId);
+    MessageIdElement* _elements { nullptr };
+    MessageIdElement* _free { nullptr };
+    MessageIdElement** _msgIdIndex { nullptr };
+    MessageIdElement** _clientIndex { nullptr };
+    uint32_t _clientIndexMask { 0 };
     int _cnt { 0 };
-    int _maxSize { MAX_MESSAGEID_TABLE_SIZE };
+    int _maxSize { 0 };
     Mutex _mutex;
 };
 
@@ -69,8 +79,7 @@ private:
     uint16_t _msgId;
     uint16_t _clientMsgId;
     Client* _client;
-    MessageIdElement* _next;
-    MessageIdElement* _prev;
+    MessageIdElement* _next;    // next element of the same hash bucket or of the free list
 };
 
 }
@@ -18,6 +18,7 @@
 #include "MQTTSNGWPacket.h"
 #include "MQTTSNPacket.h"
 #include "SensorNetwork.h"
+#include "MQTTSNGWBufferPool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,7 +36,7 @@ MQTTSNPacket::MQTTSNPacket(void)
 
 MQTTSNPacket::MQTTSNPacket(MQTTSNPacket& packet)
 {
-    _buf = (unsigned char*) malloc(packet._bufLen);
+    _buf = BufferPool::allocate(packet._bufLen);
     if (_buf)
     {
         _bufLen = packet._bufLen;
@@ -50,10 +51,7 @@ MQTTSNPacket::MQTTSNPacket(MQTTSNPacket& packet)
 
 MQTTSNPacket::~MQTTSNPacket()
 {
-    if (_buf)
-    {
-        free(_buf);
-    }
+    BufferPool::release(_buf);
 }
 
 int MQTTSNPacket::unicast(SensorNetwork* network, SensorNetAddress* sendTo)
@@ -74,12 +72,12 @@ int MQTTSNPacket::serialize(uint8_t* buf)
 
 int MQTTSNPacket::desirialize(unsigned char* buf, unsigned short len)
 {
-    if (_buf)
+    /* reuse the buffer if it has enough capacity */
+    if (BufferPool::getCapacity(_buf) < len)
     {
-        free(_buf);
+        BufferPool::release(_buf);
+        _buf = BufferPool::allocate(len);
     }
-
-    _buf = (unsigned char*) calloc(len, sizeof(unsigned char));
     if (_buf)
     {
         memcpy(_buf, buf, len);
@@ -92,14 +90,22 @@ int MQTTSNPacket::desirialize(unsigned char* buf, unsigned short len)
     return _bufLen;
 }
 
-int MQTTSNPacket::recv(SensorNetwork* network)
+int MQTTSNPacket::recv(SensorNetwork* network, SensorNetAddress* sender, int index)
 {
-    uint8_t buf[MQTTSNGW_MAX_PACKET_SIZE];
-    int len = network->read((uint8_t*) buf, MQTTSNGW_MAX_PACKET_SIZE);
-    if (len > 1)
+    /* SensorNetwork::read( ) receives into the pooled buffer or exchanges it for one it has received into */
+    if (BufferPool::getCapacity(_buf) < MQTTSNGW_MAX_PACKET_SIZE)
     {
-        len = desirialize(buf, len);
+        BufferPool::release(_buf);
+        _buf = BufferPool::allocate(MQTTSNGW_MAX_PACKET_SIZE);
+        _bufLen = 0;
+        if (_buf == nullptr)
+        {
+            return -1;
+        }
     }
+
+    int len = network->read((uint8_t**) &_buf, sender, index);
+    _bufLen = (len > 1) ? len : 0;
     return len;
 
 }
@@ -413,17 +419,49 @@ int MQTTSNPacket::getWILLMSGUPD(MQTTSNString* willMsg)
 
 char* MQTTSNPacket::print(char* pbuf)
 {
-    char* ptr = pbuf;
-    char** pptr = &pbuf;
     int size = _bufLen > SIZE_OF_LOG_PACKET ? SIZE_OF_LOG_PACKET : _bufLen;
+    return hexDump(pbuf, _buf, size);
+}
 
-    for (int i = 0; i < size; i++)
+int MQTTSNPacket::getLogCategory(void)
+{
+    switch (getType())
     {
-        sprintf(*pptr, " %02X", *(_buf + i));
-        *pptr += 3;
+    case MQTTSN_ADVERTISE:
+    case MQTTSN_SEARCHGW:
+    case MQTTSN_GWINFO:
+    case MQTTSN_CONNECT:
+    case MQTTSN_CONNACK:
+    case MQTTSN_WILLTOPICREQ:
+    case MQTTSN_WILLTOPIC:
+    case MQTTSN_WILLMSGREQ:
+    case MQTTSN_WILLMSG:
+    case MQTTSN_WILLTOPICUPD:
+    case MQTTSN_WILLTOPICRESP:
+    case MQTTSN_WILLMSGUPD:
+    case MQTTSN_WILLMSGRESP:
+    case MQTTSN_DISCONNECT:
+    case MQTTSN_ENCAPSULATED:
+        return LOG_CATEGORY_CONNECT;
+    case MQTTSN_REGISTER:
+    case MQTTSN_PUBLISH:
+    case MQTTSN_SUBSCRIBE:
+    case MQTTSN_UNSUBSCRIBE:
+        return LOG_CATEGORY_PUBLISH;
+    case MQTTSN_REGACK:
+    case MQTTSN_PUBACK:
+    case MQTTSN_PUBREC:
+    case MQTTSN_PUBREL:
+    case MQTTSN_PUBCOMP:
+    case MQTTSN_SUBACK:
+    case MQTTSN_UNSUBACK:
+        return LOG_CATEGORY_ACK;
+    case MQTTSN_PINGREQ:
+    case MQTTSN_PINGRESP:
+        return LOG_CATEGORY_PING;
+    default:
+        return LOG_CATEGORY_ALL;     // logged unless all categories are disabled
     }
-    **pptr = 0;
-    return ptr;
 }
 
 char* MQTTSNPacket::getMsgId(char* pbuf)
@@ -517,6 +555,32 @@ int MQTTSNPacket::getMsgId(void)
     return msgId;
 }
 
+int MQTTSNPacket::getTopicId(void)
+{
+    int value = 0;
+    int p = 0;
+    char* ptr = 0;
+
+    switch (getType())
+    {
+    case MQTTSN_PUBLISH:
+        p = MQTTSNPacket_decode(_buf, _bufLen, &value);
+        ptr = (char*) _buf + p + 2;
+        break;
+    case MQTTSN_PUBACK:
+    case MQTTSN_REGISTER:
+    case MQTTSN_REGACK:
+        ptr = (char*) _buf + 2;
+        break;
+    case MQTTSN_SUBACK:
+        ptr = (char*) _buf + 3;
+        break;
+    default:
+        return 0;
+    }
+    return readInt((char**) &ptr);
+}
+
 void MQTTSNPacket::setMsgId(uint16_t msgId)
 {
     int value = 0;
@@ -574,3 +638,10 @@ bool MQTTSNPacket::isDuplicate(void)
     int p = MQTTSNPacket_decode(_buf, _bufLen, &value);
     return (_buf[p + 1] & 0x80);
 }
+
+void MQTTSNPacket::setDUP(void)
+{
+    int value = 0;
+    int p = MQTTSNPacket_decode(_buf, _bufLen, &value);
+    _buf[p + 1] |= 0x80;
+}
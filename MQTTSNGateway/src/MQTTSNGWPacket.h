@@ -32,7 +32,7 @@ public:
     ~MQTTSNPacket(void);
     int unicast(SensorNetwork* network, SensorNetAddress* sendTo);
     int broadcast(SensorNetwork* network);
-    int recv(SensorNetwork* network);
+    int recv(SensorNetwork* network, SensorNetAddress* sender, int index);
     int serialize(uint8_t* buf);
     int desirialize(unsigned char* buf, unsigned short len);
     int getType(void);
@@ -89,11 +89,14 @@ public:
 
     bool isAccepted(void);
     bool isDuplicate(void);
+    void setDUP(void);
     bool isQoSMinusPUBLISH(void);
     char* getMsgId(char* buf);
     int getMsgId(void);
     void setMsgId(uint16_t msgId);
+    int getTopicId(void);
     char* print(char* buf);
+    int getLogCategory(void);
 
 private:
     unsigned char* _buf;    // Ptr to a packet data
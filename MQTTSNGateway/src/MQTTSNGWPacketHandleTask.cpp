@@ -37,6 +37,8 @@ using namespace std;
 using namespace MQTTSNGW;
 
 #define EVENT_QUE_TIME_OUT  2000      // 2000 msecs
+#define BROKER_KEEPALIVE_CHECK_INTERVAL  1000      // msecs between scans of idle connections of the broker
+#define SESSION_SYNC_INTERVAL            1000      // msecs between writes of changed sessions into the SessionStore
 char* currentDateTime(void);
 
 /*=====================================
@@ -107,11 +109,32 @@ void PacketHandleTask::run()
     memset(msgId, 0, 6);
 
     _advertiseTimer.start(_gateway->getGWParams()->keepAlive * 1000UL);
+    _brokerKeepAliveTimer.start(BROKER_KEEPALIVE_CHECK_INTERVAL);
+    _sessionSyncTimer.start(SESSION_SYNC_INTERVAL);
 
     while (true)
     {
-        /* wait Event */
-        ev = eventQue->timedwait(EVENT_QUE_TIME_OUT);
+        /* wait Event. messages waiting acknowledgements are checked at every tick */
+        ev = eventQue->timedwait(Retransmitter::isEmpty() ? EVENT_QUE_TIME_OUT : RETRANSMIT_TICK);
+
+        /*------ Retransmit PUBLISHes which are not acknowledged ------*/
+        Retransmitter::expire(_gateway->getClientSendQue());
+
+        /*------ Keep connections of the broker alive even if events never time out ------*/
+        if (_brokerKeepAliveTimer.isTimeup())
+        {
+            _mqttsnConnection->checkKeepAlive();
+            _mqttConnection->sendKeepAlive();
+            _gateway->getClientList()->recycle();
+            _brokerKeepAliveTimer.start(BROKER_KEEPALIVE_CHECK_INTERVAL);
+        }
+
+        /*------ Write sessions changed by this task ------*/
+        if (_sessionSyncTimer.isTimeup())
+        {
+            _gateway->getSessionStore()->sync(_gateway->getClientList());
+            _sessionSyncTimer.start(SESSION_SYNC_INTERVAL);
+        }
 
         if (ev->getEventType() == EtStop)
         {
@@ -176,6 +199,11 @@ void PacketHandleTask::run()
                 transparentPacketHandler(client, brPacket);
             }
         }
+        /*------  Reload client lists      ---------*/
+        else if (ev->getEventType() == EtReload)
+        {
+            _gateway->getClientList()->reload();
+        }
         delete ev;
     }
 }
@@ -275,6 +303,9 @@ void PacketHandleTask::aggregatePacketHandler(Client*client, MQTTGWPacket* packe
 
 void PacketHandleTask::transparentPacketHandler(Client*client, MQTTSNPacket* packet)
 {
+    /* subscriptions and PUBLISHes of them are handled over the connection of the Aggregater */
+    bool shared = _gateway->getAdapterManager()->isSharedSubscriber(client);
+
     switch (packet->getType())
     {
     case MQTTSN_CONNECT:
@@ -302,16 +333,37 @@ void PacketHandleTask::transparentPacketHandler(Client*client, MQTTSNPacket* pac
         _mqttsnPublish->handlePublish(client, packet);
         break;
     case MQTTSN_PUBACK:
-        _mqttsnPublish->handlePuback(client, packet);
+        if (shared)
+        {
+            _mqttsnPublish->handleAggregateAck(client, packet, MQTTSN_PUBACK);
+        }
+        else
+        {
+            _mqttsnPublish->handlePuback(client, packet);
+        }
         break;
     case MQTTSN_PUBREC:
-        _mqttsnPublish->handleAck(client, packet, PUBREC);
+        if (shared)
+        {
+            _mqttsnPublish->handleAggregateAck(client, packet, MQTTSN_PUBREC);
+        }
+        else
+        {
+            _mqttsnPublish->handleAck(client, packet, PUBREC);
+        }
         break;
     case MQTTSN_PUBREL:
         _mqttsnPublish->handleAck(client, packet, PUBREL);
         break;
     case MQTTSN_PUBCOMP:
-        _mqttsnPublish->handleAck(client, packet, PUBCOMP);
+        if (shared)
+        {
+            _mqttsnPublish->handleAggregateAck(client, packet, MQTTSN_PUBCOMP);
+        }
+        else
+        {
+            _mqttsnPublish->handleAck(client, packet, PUBCOMP);
+        }
         break;
     case MQTTSN_REGISTER:
         _mqttsnPublish->handleRegister(client, packet);
@@ -320,10 +372,24 @@ void PacketHandleTask::transparentPacketHandler(Client*client, MQTTSNPacket* pac
         _mqttsnPublish->handleRegAck(client, packet);
         break;
     case MQTTSN_SUBSCRIBE:
-        _mqttsnSubscribe->handleSubscribe(client, packet);
+        if (shared)
+        {
+            _mqttsnSubscribe->handleAggregateSubscribe(client, packet);
+        }
+        else
+        {
+            _mqttsnSubscribe->handleSubscribe(client, packet);
+        }
         break;
     case MQTTSN_UNSUBSCRIBE:
-        _mqttsnSubscribe->handleUnsubscribe(client, packet);
+        if (shared)
+        {
+            _mqttsnSubscribe->handleAggregateUnsubscribe(client, packet);
+        }
+        else
+        {
+            _mqttsnSubscribe->handleUnsubscribe(client, packet);
+        }
         break;
     default:
         break;
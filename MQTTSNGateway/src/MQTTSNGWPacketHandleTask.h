@@ -64,6 +64,8 @@ private:
     { nullptr };
     Timer _advertiseTimer;
     Timer _sendUnixTimer;
+    Timer _brokerKeepAliveTimer;
+    Timer _sessionSyncTimer;
     MQTTGWConnectionHandler* _mqttConnection { nullptr };
     MQTTGWPublishHandler* _mqttPublish { nullptr };
     MQTTGWSubscribeHandler* _mqttSubscribe { nullptr };
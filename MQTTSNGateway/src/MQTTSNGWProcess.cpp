@@ -24,6 +24,7 @@
 #include <getopt.h>
 #include <unistd.h>
 #include "MQTTSNGWProcess.h"
+#include "MQTTSNGWLogger.h"
 #include "Threading.h"
 
 using namespace std;
@@ -42,8 +43,18 @@ MultiTaskProcess* MQTTSNGW::theMultiTaskProcess = nullptr;
  */
 volatile int theSignaled = 0;
 
+/*
+ *  SIGHUP requests to reload config files
+ */
+volatile sig_atomic_t theHangup = 0;
+
 static void signalHandler(int sig)
 {
+    if (sig == SIGHUP)
+    {
+        theHangup = 1;
+        return;
+    }
     theSignaled = sig;
 }
 
@@ -57,12 +68,17 @@ Process::Process()
     _configDir = CONFIG_DIRECTORY;
     _configFile = CONFIG_FILE;
     _log = 0;
+    _logLevel = LOG_LEVEL_DUMP;
+    _logCategories = LOG_CATEGORY_ALL;
     _rbsem = NULL;
     _rb = NULL;
+    _logger = new Logger(this);
 }
 
 Process::~Process()
 {
+    delete _params.load();
+    delete _logger;
     if (_rb)
     {
         delete _rb;
@@ -78,6 +94,25 @@ void Process::run()
 
 }
 
+/**
+ *  Load the config file again. Called by MultiTaskProcess::run( ) on SIGHUP.
+ *  The current parameters are kept if the file can't be read.
+ */
+void Process::reload(void)
+{
+    try
+    {
+        loadParams();
+    }
+    catch (Exception &ex)
+    {
+        WRITELOG("%s%s %s can't be reloaded.%s\n", currentDateTime(), RED_HDR, (_configDir + _configFile).c_str(), CLR_HDR);
+        return;
+    }
+    setLogParams();
+    WRITELOG("%s %s is reloaded.\n", currentDateTime(), (_configDir + _configFile).c_str());
+}
+
 void Process::initialize(int argc, char** argv)
 {
     char param[MQTTSNGW_PARAM_MAX];
@@ -105,6 +140,7 @@ void Process::initialize(int argc, char** argv)
             }
         }
     }
+    loadParams();
     _rbsem = new NamedSemaphore(MQTTSNGW_RB_SEMAPHOR_NAME, 0);
     _rb = new RingBuffer(_configDir.c_str());
 
@@ -119,30 +155,110 @@ void Process::initialize(int argc, char** argv)
             _log = 0;
         }
     }
+
+    setLogParams();
 }
 
-void Process::putLog(const char* format, ...)
+void Process::setLogParams(void)
 {
-    _mt.lock();
-    va_list arg;
-    va_start(arg, format);
-    vsprintf(_rbdata, format, arg);
-    va_end(arg);
-    if (strlen(_rbdata))
+    char param[MQTTSNGW_PARAM_MAX];
+
+    if (getParam("LogLevel", param) == 0)
     {
-        if (_log > 0)
+        _logLevel = atoi(param);
+    }
+    setLogCategory("LogConnect", LOG_CATEGORY_CONNECT);
+    setLogCategory("LogPublish", LOG_CATEGORY_PUBLISH);
+    setLogCategory("LogAck", LOG_CATEGORY_ACK);
+    setLogCategory("LogPing", LOG_CATEGORY_PING);
+}
+
+void Process::setLogCategory(const char* parameter, int category)
+{
+    char param[MQTTSNGW_PARAM_MAX];
+
+    if (getParam(parameter, param) == 0)
+    {
+        if (!strcasecmp(param, "YES"))
         {
-            _rb->put(_rbdata);
-            _rbsem->post();
+            _logCategories |= category;
         }
         else
         {
-            printf("%s", _rbdata);
+            _logCategories &= ~category;
         }
     }
+}
+
+/**
+ *  Packets are formatted only when this returns true.
+ */
+bool Process::isPacketLogged(int category)
+{
+    return _logLevel >= LOG_LEVEL_PACKET && (_logCategories & category);
+}
+
+int Process::getLogLevel(void)
+{
+    return _logLevel;
+}
+
+/**
+ *  While the Logger runs, a record is queued to the ring of the calling thread
+ *  and written by the Logger thread. Otherwise it is written by the caller.
+ */
+void Process::putLog(const char* format, ...)
+{
+    static thread_local char record[PROCESS_LOG_BUFFER_SIZE + 1];
+
+    va_list arg;
+    va_start(arg, format);
+    int len = vsnprintf(record, sizeof(record), format, arg);
+    va_end(arg);
+    if (len <= 0)
+    {
+        return;
+    }
+    if (len > PROCESS_LOG_BUFFER_SIZE)
+    {
+        len = PROCESS_LOG_BUFFER_SIZE;
+    }
+
+    if (_logger->put(record, len))
+    {
+        return;
+    }
+    _mt.lock();
+    writeLog(record);
     _mt.unlock();
 }
 
+/*
+ *  Write a record into the RingBuffer of the Logmonitor or stdout. called with _mt locked.
+ */
+void Process::writeLog(const char* record)
+{
+    if (_log > 0)
+    {
+        _rb->put((char*) record);
+        _rbsem->post();
+    }
+    else
+    {
+        printf("%s", record);
+    }
+}
+
+void Process::startLogger(void)
+{
+    _logger->open();
+}
+
+void Process::stopLogger(void)
+{
+    _logger->close();
+}
+
 int Process::getArgc()
 {
     return _argc;
@@ -153,75 +269,45 @@ char** Process::getArgv()
     return _argv;
 }
 
+/**
+ *  Copy the value of the parameter into value.
+ *  @return 0 if found, -3 if the parameter is not in the config file.
+ */
 int Process::getParam(const char* parameter, char* value)
 {
-    char str[MQTTSNGW_PARAM_MAX];
-    char param[MQTTSNGW_PARAM_MAX];
-    memset(str, 0, sizeof(str));
-    memset(param, 0, sizeof(param));
-    FILE *fp;
-
-    int i = 0, j = 0;
-    string configPath = _configDir + _configFile;
-
-    if ((fp = fopen(configPath.c_str(), "r")) == NULL)
+    ParamTable* table = _params.load(std::memory_order_acquire);
+    if (table == nullptr)
     {
-        throw Exception("Config file not found:\n\nUsage: Command -f path/config_file_name\n", 0);
+        table = loadParams();
     }
 
-    int paramlen = strlen(parameter);
-
-    while (true)
+    const char* param = table->get(parameter);
+    if (param == nullptr)
     {
-        int pos = 0;
-        int len = 0;
-        if (fgets(str, MQTTSNGW_PARAM_MAX - 1, fp) == NULL)
-        {
-            fclose(fp);
-            return -3;
-        }
-        if (str[0] == '#' || str[0] == '\n')
-        {
-            continue;
-        }
+        return -3;
+    }
+    strcpy(value, param);
+    return 0;
+}
 
-        len = strlen(str);
-        for (pos = 0; i < len; pos++)
-        {
-            if (str[pos] == '=')
-            {
-                break;
-            }
-        }
+/*
+ *  Load the config file into a new table and replace the current one.
+ *  A replaced table is kept until the Process is deleted because
+ *  another thread may be reading it.
+ */
+ParamTable* Process::loadParams(void)
+{
+    ParamTable* table = new ParamTable();
+    string configPath = _configDir + _configFile;
 
-        if (pos == paramlen)
-        {
-            if (strncmp(str, parameter, paramlen) == 0)
-            {
-                strcpy(param, str + pos + 1);
-                param[len - pos - 2] = '\0';
-
-
-                for (i = strlen(param) - 1; i >= 0 && isspace(param[i]); i--)
-                    ;
-                param[i + 1] = '\0';
-                for (i = 0; isspace(param[i]); i++)
-                    ;
-                if (i > 0)
-                {
-                    j = 0;
-                    while (param[i])
-                        param[j++] = param[i++];
-                    param[j] = '\0';
-                }
-                strcpy(value, param);
-                fclose(fp);
-                return 0;
-            }
-        }
+    if (table->load(configPath.c_str()) < 0)
+    {
+        delete table;
+        throw Exception("Config file not found:\n\nUsage: Command -f path/config_file_name\n", 0);
     }
-    fclose(fp);
-    return -2;
+    table->_prev = _params.load();
+    _params.store(table, std::memory_order_release);
+    return table;
 }
 
 const char* Process::getLog()
@@ -291,6 +377,7 @@ void MultiTaskProcess::initialize(int argc, char** argv)
 
 void MultiTaskProcess::run(void)
 {
+    startLogger();
     for (int i = 0; i < _threadCount; i++)
     {
         _threadList[i]->start();
@@ -302,6 +389,11 @@ void MultiTaskProcess::run(void)
         {
             return;
         }
+        if (theHangup)
+        {
+            theHangup = 0;
+            theProcess->reload();
+        }
         sleep(1);
     }
 }
@@ -312,6 +404,7 @@ void MultiTaskProcess::waitStop(void)
     {
         sleep(1);
     }
+    stopLogger();
 }
 
 void MultiTaskProcess::threadStopped(void)
@@ -343,12 +436,116 @@ void MultiTaskProcess::attach(Thread* thread)
     _mutex.unlock();
 }
 
-int MultiTaskProcess::getParam(const char* parameter, char* value)
+/*=====================================
+ Class ParamTable
+ ====================================*/
+ParamTable::ParamTable()
+{
+    for (int i = 0; i < PROCESS_PARAM_TABLE_SIZE; i++)
+    {
+        _entries[i] = nullptr;
+    }
+}
+
+ParamTable::~ParamTable()
 {
-    _mutex.lock();
-    int rc = Process::getParam(parameter, value);
-    _mutex.unlock();
-    return rc;
+    for (int i = 0; i < PROCESS_PARAM_TABLE_SIZE; i++)
+    {
+        ParamEntry* entry = _entries[i];
+        while (entry)
+        {
+            ParamEntry* next = entry->next;
+            free(entry->name);
+            free(entry->value);
+            free(entry);
+            entry = next;
+        }
+    }
+    if (_prev)
+    {
+        delete _prev;
+    }
+}
+
+/**
+ *  Read records of "name=value". Blank lines and lines beginning with # are skipped.
+ *  When a name appears twice, the first one is used.
+ *  @return -1 if the file can't be opened.
+ */
+int ParamTable::load(const char* fileName)
+{
+    char str[MQTTSNGW_PARAM_MAX];
+    FILE* fp;
+
+    if ((fp = fopen(fileName, "r")) == NULL)
+    {
+        return -1;
+    }
+
+    while (fgets(str, MQTTSNGW_PARAM_MAX - 1, fp) != NULL)
+    {
+        if (str[0] == '#' || str[0] == '\n')
+        {
+            continue;
+        }
+
+        char* value = strchr(str, '=');
+        if (value == nullptr)
+        {
+            continue;
+        }
+        *value++ = '\0';
+
+        int len = strlen(value);
+        while (len > 0 && isspace(value[len - 1]))
+        {
+            value[--len] = '\0';
+        }
+        while (isspace(*value))
+        {
+            value++;
+        }
+
+        if (get(str))
+        {
+            continue;
+        }
+        uint32_t idx = hash(str);
+        ParamEntry* entry = (ParamEntry*) malloc(sizeof(ParamEntry));
+        entry->name = strdup(str);
+        entry->value = strdup(value);
+        entry->next = _entries[idx];
+        _entries[idx] = entry;
+    }
+    fclose(fp);
+    return 0;
+}
+
+/**
+ *  @return the value of the parameter, nullptr if it doesn't exist.
+ */
+const char* ParamTable::get(const char* parameter)
+{
+    for (ParamEntry* entry = _entries[hash(parameter)]; entry; entry = entry->next)
+    {
+        if (strcmp(entry->name, parameter) == 0)
+        {
+            return entry->value;
+        }
+    }
+    return nullptr;
+}
+
+uint32_t ParamTable::hash(const char* name)
+{
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+    while (*name)
+    {
+        h ^= (uint8_t) *name++;
+        h *= 16777619u;
+    }
+    return h & (PROCESS_PARAM_TABLE_SIZE - 1);
 }
 
 /*=====================================
@@ -443,3 +640,20 @@ const char* Exception::getFileName(const char* file)
     return file;
 }
 
+/*=====================================
+ Global Functions
+ ======================================*/
+static const char hexDigits[] = "0123456789ABCDEF";
+
+char* MQTTSNGW::hexDump(char* buf, const uint8_t* data, int len)
+{
+    char* ptr = buf;
+    for (int i = 0; i < len; i++)
+    {
+        *ptr++ = ' ';
+        *ptr++ = hexDigits[data[i] >> 4];
+        *ptr++ = hexDigits[data[i] & 0x0F];
+    }
+    *ptr = 0;
+    return buf;
+}
@@ -20,6 +20,7 @@
 #include <exception>
 #include <string>
 #include <signal.h>
+#include <atomic>
 #include "MQTTSNGWDefines.h"
 #include "Threading.h"
 
@@ -27,13 +28,30 @@ using namespace std;
 
 namespace MQTTSNGW
 {
+class Logger;
 
 /*=================================
  *    Parameters
  ==================================*/
-#define MQTTSNGW_MAX_TASK           10  // number of Tasks
+#define MQTTSNGW_MAX_TASK           32  // number of Tasks
 #define PROCESS_LOG_BUFFER_SIZE  16384  // Ring buffer size for Logs
+#define PROCESS_LOG_RING_SIZE    65536  // Size of a log ring of a thread. must be a power of 2
+#define LOGGER_IDLE_TIME           100  // Max time in msecs the Logger sleeps when rings are empty
 #define MQTTSNGW_PARAM_MAX         128  // Max length of config records.
+#define PROCESS_PARAM_TABLE_SIZE    64  // Buckets of the table of config parameters. must be a power of 2
+
+/*=================================
+ *    Packet log levels and categories
+ ==================================*/
+#define LOG_LEVEL_NONE               0  // no packet is logged
+#define LOG_LEVEL_PACKET             1  // packet names and clients are logged
+#define LOG_LEVEL_DUMP               2  // packets are logged with hex dumps
+
+#define LOG_CATEGORY_CONNECT      0x01  // CONNECT, WILL, DISCONNECT, SEARCHGW and GWINFO
+#define LOG_CATEGORY_PUBLISH      0x02  // PUBLISH, REGISTER, SUBSCRIBE and UNSUBSCRIBE
+#define LOG_CATEGORY_ACK          0x04  // PUBACK, PUBREC, PUBREL, PUBCOMP, REGACK, SUBACK and UNSUBACK
+#define LOG_CATEGORY_PING         0x08  // PINGREQ and PINGRESP
+#define LOG_CATEGORY_ALL          0x0F
 
 /*=================================
  *    Macros
@@ -42,18 +60,55 @@ namespace MQTTSNGW
 #define CHK_SIGINT (theProcess->checkSignal() == SIGINT)
 #define UNUSED(x) ((void)(x))
 #define EXCEPTION(...)   Exception(__VA_ARGS__, __FILE__, __func__, __LINE__)
+#define CHK_PACKETLOG(category) (theProcess->isPacketLogged(category))
+#define CHK_PACKETDUMP (theProcess->getLogLevel() >= LOG_LEVEL_DUMP)
+
+/*=================================
+ Class ParamTable
+
+ Parameters of the config file indexed by their names.
+ A table is not modified after it is loaded, so it is
+ read without a lock. SIGHUP loads a new table which
+ replaces the current one.
+ ==================================*/
+typedef struct ParamEntry
+{
+    char* name;
+    char* value;
+    struct ParamEntry* next;
+} ParamEntry;
+
+class ParamTable
+{
+    friend class Process;
+public:
+    ParamTable();
+    ~ParamTable();
+    int load(const char* fileName);
+    const char* get(const char* parameter);
+
+private:
+    uint32_t hash(const char* name);
+
+    ParamEntry* _entries[PROCESS_PARAM_TABLE_SIZE];
+    ParamTable* _prev { nullptr };      // replaced table
+};
 
 /*=================================
  Class Process
  ==================================*/
 class Process
 {
+    friend class Logger;
 public:
     Process();
     virtual ~Process();
     virtual void initialize(int argc, char** argv);
     virtual void run(void);
+    virtual void reload(void);
     void putLog(const char* format, ...);
+    void startLogger(void);
+    void stopLogger(void);
     void resetRingBuffer(void);
     int getArgc(void);
     char** getArgv(void);
@@ -62,7 +117,14 @@ public:
     int checkSignal(void);
     const string* getConfigDirName(void);
     const string* getConfigFileName(void);
+    bool isPacketLogged(int category);
+    int getLogLevel(void);
 private:
+    void setLogCategory(const char* parameter, int category);
+    void setLogParams(void);
+    void writeLog(const char* record);
+    ParamTable* loadParams(void);
+
     int _argc;
     char** _argv;
     string _configDir;
@@ -70,7 +132,11 @@ private:
     RingBuffer* _rb;
     NamedSemaphore* _rbsem;
     Mutex _mt;
+    Logger* _logger;
+    std::atomic<ParamTable*> _params { nullptr };
     int _log;
+    int _logLevel;
+    int _logCategories;
     char _rbdata[PROCESS_LOG_BUFFER_SIZE + 1];
 };
 
@@ -83,7 +149,6 @@ public:
     MultiTaskProcess(void);
     ~MultiTaskProcess();
     void initialize(int argc, char** argv);
-    int getParam(const char* parameter, char* value);
     void run(void);
     void waitStop(void);
     void threadStopped(void);
@@ -1020,5 +1085,8 @@ private:
 extern Process* theProcess;
 extern MultiTaskProcess* theMultiTaskProcess;
 
+/* writes " XX" for each byte of data and returns buf */
+char* hexDump(char* buf, const uint8_t* data, int len);
+
 }
 #endif /* MQTTSNGWPROCESS_H_ */
@@ -129,6 +129,12 @@ MQTTGWPacket* MQTTSNPublishHandler::handlePublish(Client* client, MQTTSNPacket*
     pub.payload = (char*) payload;
     pub.payloadlen = payloadlen;
 
+    /* the retained message of the broker will be replaced */
+    if (retained && pub.topiclen > 0)
+    {
+        _gateway->getRetainedCache()->invalidate(pub.topic, pub.topiclen);
+    }
+
     MQTTGWPacket* publish = new MQTTGWPacket();
     publish->setPUBLISH(&pub);
 
@@ -136,6 +142,22 @@ MQTTGWPacket* MQTTSNPublishHandler::handlePublish(Client* client, MQTTSNPacket*
     {
         return publish;
     }
+    else if (msgId && qos > 0 && qos < 3)
+    {
+        /* the broker connection is shared with other clients by the window */
+        if (!client->getUplinkWindow()->send(publish, msgId, _gateway->getBrokerSendQue()))
+        {
+            WRITELOG("%s %s sends too many PUBLISHes. PUBLISH %04X is rejected.%s\n", ERRMSG_HEADER,
+                    client->getClientId(), msgId, ERRMSG_FOOTER);
+            client->eraseWaitedPubTopicId(msgId);
+            MQTTSNPacket* pubAck = new MQTTSNPacket();
+            pubAck->setPUBACK(tid, msgId, MQTTSN_RC_REJECTED_CONGESTED);
+            Event* ev1 = new Event();
+            ev1->setClientSendEvent(client, pubAck);
+            _gateway->getClientSendQue()->post(ev1);
+        }
+        return nullptr;
+    }
     else
     {
         Event* ev1 = new Event();
@@ -151,12 +173,14 @@ void MQTTSNPublishHandler::handlePuback(Client* client, MQTTSNPacket* packet)
     uint16_t msgId;
     uint8_t rc;
 
+    if (packet->getPUBACK(&topicId, &msgId, &rc) == 0)
+    {
+        return;
+    }
+    client->getInflightWindow()->acknowledge(MQTTSN_PUBACK, msgId, _gateway->getClientSendQue());
+
     if (client->isActive())
     {
-        if (packet->getPUBACK(&topicId, &msgId, &rc) == 0)
-        {
-            return;
-        }
 
         if (rc == MQTTSN_RC_ACCEPTED)
         {
@@ -180,12 +204,18 @@ void MQTTSNPublishHandler::handleAck(Client* client, MQTTSNPacket* packet, uint8
 {
     uint16_t msgId;
 
+    if (packet->getACK(&msgId) == 0)
+    {
+        return;
+    }
+    if (packetType == PUBREC || packetType == PUBCOMP)
+    {
+        client->getInflightWindow()->acknowledge(packetType == PUBREC ? MQTTSN_PUBREC : MQTTSN_PUBCOMP, msgId,
+                _gateway->getClientSendQue());
+    }
+
     if (client->isActive())
     {
-        if (packet->getACK(&msgId) == 0)
-        {
-            return;
-        }
         MQTTGWPacket* ackPacket = new MQTTGWPacket();
         ackPacket->setAck(packetType, msgId);
         Event* ev1 = new Event();
@@ -235,21 +265,14 @@ void MQTTSNPublishHandler::handleRegAck(Client* client, MQTTSNPacket* packet)
             return;
         }
 
-        /* get PUBLISH message */
-        MQTTSNPacket* regAck = client->getWaitREGACKPacketList()->getPacket(msgId);
-
-        if (regAck != nullptr)
-        {
-            client->getWaitREGACKPacketList()->erase(msgId);
-            Event* ev = new Event();
-            ev->setClientSendEvent(client, regAck);
-            _gateway->getClientSendQue()->post(ev);
-        }
+        /* send PUBLISHes which wait for the REGACK */
+        client->getWaitREGACKPacketList()->acknowledge(msgId, _gateway->getClientSendQue());
 
         if (client->isHoldPingReqest() && client->getWaitREGACKPacketList()->getCount() == 0)
         {
-            /* send PINGREQ to the broker */
+            /* send PINGREQ to the broker. its PINGRESP is forwarded to the client */
             client->resetPingRequest();
+            client->pingreqForwarded();
             MQTTGWPacket* pingreq = new MQTTGWPacket();
             pingreq->setHeader(PINGREQ);
             Event* evt = new Event();
@@ -286,14 +309,35 @@ void MQTTSNPublishHandler::handleAggregatePublish(Client* client, MQTTSNPacket*
 
 void MQTTSNPublishHandler::handleAggregateAck(Client* client, MQTTSNPacket* packet, int type)
 {
-    if (type == MQTTSN_PUBREC)
-    {
-        uint16_t msgId;
+    uint16_t topicId;
+    uint16_t msgId;
+    uint8_t rc;
 
+    if (type == MQTTSN_PUBACK)
+    {
+        if (packet->getPUBACK(&topicId, &msgId, &rc))
+        {
+            client->getInflightWindow()->acknowledge(MQTTSN_PUBACK, msgId, _gateway->getClientSendQue());
+        }
+    }
+    else if (type == MQTTSN_PUBCOMP)
+    {
+        if (packet->getACK(&msgId))
+        {
+            client->getInflightWindow()->acknowledge(MQTTSN_PUBCOMP, msgId, _gateway->getClientSendQue());
+        }
+    }
+    else if (type == MQTTSN_PUBREC)
+    {
         if (packet->getACK(&msgId) == 0)
         {
             return;
         }
+        client->getInflightWindow()->acknowledge(MQTTSN_PUBREC, msgId, _gateway->getClientSendQue());
+        if (client->getInflightWindow()->sendPubrel(msgId, _gateway->getClientSendQue()))
+        {
+            return;
+        }
         MQTTSNPacket* ackPacket = new MQTTSNPacket();
         ackPacket->setPUBREL(msgId);
         Event* ev = new Event();
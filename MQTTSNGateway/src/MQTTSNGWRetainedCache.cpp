@@ -0,0 +1,407 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#include "MQTTSNGWRetainedCache.h"
+#include "MQTTSNGWProcess.h"
+#include "MQTTSNGWClient.h"
+#include "MQTTSNGateway.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+using namespace std;
+using namespace MQTTSNGW;
+
+static uint32_t monotonicSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec;
+}
+
+/*=====================================
+ Class RetainedMessage
+ =====================================*/
+RetainedMessage::RetainedMessage()
+{
+    _payload = nullptr;
+    _payloadlen = 0;
+    _time = 0;
+    _prev = nullptr;
+    _next = nullptr;
+}
+
+RetainedMessage::~RetainedMessage()
+{
+    if (_payload)
+    {
+        free(_payload);
+    }
+}
+
+/*=====================================
+ Class RetainedCache
+ =====================================*/
+RetainedCache::RetainedCache()
+{
+    for (int i = 0; i < 6; i++)
+    {
+        _events[i] = 0;
+    }
+}
+
+RetainedCache::~RetainedCache()
+{
+    clear();
+}
+
+/**
+ *  @param size  bytes of the cache, 0 disables it
+ *  @param ttl   seconds while a cached message answers SUBSCRIBEs, 0 means no limit
+ */
+void RetainedCache::initialize(uint32_t size, uint32_t ttl)
+{
+    _size = size;
+    _ttl = ttl;
+}
+
+bool RetainedCache::isActive(void)
+{
+    return _size > 0;
+}
+
+/**
+ *  Called with a PUBLISH received from the broker.
+ *  A message with the retain flag is the retained one of the topic, and an empty one deletes it.
+ *  A message without the flag may have replaced the retained one, so the cached one is removed.
+ */
+void RetainedCache::update(Publish* pub)
+{
+    if (!isActive() || pub->topiclen <= 0)
+    {
+        return;
+    }
+
+    _mutex.lock();
+    RetainedMessage* msg = find(pub->topic, pub->topiclen);
+
+    if (!pub->header.bits.retain || pub->payloadlen == 0
+            || pub->topiclen + pub->payloadlen + 7 > MQTTSNGW_MAX_PACKET_SIZE)
+    {
+        if (msg)
+        {
+            erase(msg);
+            _events[RETAINED_INVALIDATED]++;
+        }
+        _mutex.unlock();
+        return;
+    }
+
+    if (msg)
+    {
+        if (msg->_payloadlen == pub->payloadlen && memcmp(msg->_payload, pub->payload, pub->payloadlen) == 0)
+        {
+            /* same value. clients which have it are kept */
+            msg->_time = monotonicSeconds();
+            unlink(msg);
+            link(msg);
+            _mutex.unlock();
+            return;
+        }
+        erase(msg);
+    }
+    _mutex.unlock();
+
+    msg = new RetainedMessage();
+    msg->_topic.assign(pub->topic, pub->topiclen);
+    msg->_payload = (uint8_t*) malloc(pub->payloadlen);
+    if (msg->_payload == nullptr)
+    {
+        delete msg;
+        return;
+    }
+    memcpy(msg->_payload, pub->payload, pub->payloadlen);
+    msg->_payloadlen = pub->payloadlen;
+    msg->_time = monotonicSeconds();
+
+    uint32_t bytes = getBytes(msg);
+    if (bytes > _size)
+    {
+        delete msg;
+        return;
+    }
+
+    _mutex.lock();
+    while (_last && _bytes + bytes > _size)
+    {
+        erase(_last);
+        _events[RETAINED_EVICTED]++;
+    }
+    _map[msg->_topic] = msg;
+    link(msg);
+    _bytes += bytes;
+    _entries++;
+    _events[RETAINED_STORED]++;
+    _mutex.unlock();
+}
+
+void RetainedCache::invalidate(const char* topic, int topiclen)
+{
+    _mutex.lock();
+    RetainedMessage* msg = find(topic, topiclen);
+    if (msg)
+    {
+        erase(msg);
+        _events[RETAINED_INVALIDATED]++;
+    }
+    _mutex.unlock();
+}
+
+/**
+ *  Called with a retained PUBLISH from the broker before it is sent to the client.
+ *  @return true if it is the copy of the value which answer( ) has sent. The message should be dropped.
+ */
+bool RetainedCache::isDelivered(Client* client, Publish* pub)
+{
+    if (!isActive() || !pub->header.bits.retain)
+    {
+        return false;
+    }
+
+    bool rc = false;
+    _mutex.lock();
+    RetainedMessage* msg = find(pub->topic, pub->topiclen);
+    if (msg && msg->_clients.erase(client) > 0)
+    {
+        _bytes -= RETAINED_CLIENT_OVERHEAD;
+        _events[RETAINED_SUPPRESSED]++;
+        rc = true;
+    }
+    _mutex.unlock();
+    return rc;
+}
+
+/**
+ *  Called when the SUBSCRIBE of the client is accepted.
+ *  @param topicId  the topic waiting the SUBACK
+ *  @param duplicated  true if the broker also sends the retained message for the SUBSCRIBE
+ *  @return true if the cached message is sent
+ */
+bool RetainedCache::answer(Client* client, TopicIdMapElement* topicId, EventQue* que, bool duplicated)
+{
+    MQTTSN_topicid id;
+    id.type = topicId->getTopicType();
+    id.data.id = topicId->getTopicId();
+
+    if (!isActive())
+    {
+        return false;
+    }
+
+    if (id.type == MQTTSN_TOPIC_TYPE_SHORT)
+    {
+        char shortTopic[2];
+        shortTopic[0] = id.data.id >> 8;
+        shortTopic[1] = id.data.id & 0xff;
+        id.data.short_name[0] = shortTopic[0];
+        id.data.short_name[1] = shortTopic[1];
+        return answer(client, shortTopic, 2, &id, que, duplicated);
+    }
+
+    Topic* topic = client->getTopics()->getTopicById(&id);
+    if (topic == nullptr || id.data.id == 0)
+    {
+        return false;
+    }
+    return answer(client, topic->getTopicName()->c_str(), topic->getTopicName()->size(), &id, que, duplicated);
+}
+
+/**
+ *  Called when the SUBSCRIBE of the client is accepted.
+ *  The cached message of the topic is sent to the client with QoS0.
+ *  The client is marked if the broker also sends it, so that isDelivered( ) drops the copy once.
+ *  @param topicId  id of the topic which the client knows
+ *  @param duplicated  true if the broker also sends the retained message for the SUBSCRIBE
+ *  @return true if the cached message is sent
+ */
+bool RetainedCache::answer(Client* client, const char* topic, int topiclen, MQTTSN_topicid* topicId, EventQue* que,
+        bool duplicated)
+{
+    if (!isActive() || memchr(topic, MQTTSN_TOPIC_MULTI_WILDCARD, topiclen)
+            || memchr(topic, MQTTSN_TOPIC_SINGLE_WILDCARD, topiclen))
+    {
+        return false;
+    }
+
+    _mutex.lock();
+    RetainedMessage* msg = find(topic, topiclen);
+    if (msg && isExpired(msg))
+    {
+        erase(msg);
+        msg = nullptr;
+    }
+
+    if (msg == nullptr)
+    {
+        _events[RETAINED_MISS]++;
+        _mutex.unlock();
+        return false;
+    }
+    _events[RETAINED_HIT]++;
+    unlink(msg);
+    link(msg);
+
+    /* marks are counted in the size. the copy is not dropped if no space is left for the mark */
+    if (duplicated && msg->_clients.insert(client).second)
+    {
+        _bytes += RETAINED_CLIENT_OVERHEAD;
+        while (_last != msg && _bytes > _size)
+        {
+            erase(_last);
+            _events[RETAINED_EVICTED]++;
+        }
+        if (_bytes > _size)
+        {
+            msg->_clients.erase(client);
+            _bytes -= RETAINED_CLIENT_OVERHEAD;
+        }
+    }
+
+    MQTTSNPacket* publish = new MQTTSNPacket();
+    publish->setPUBLISH(0, 0, 1, 0, *topicId, msg->_payload, msg->_payloadlen);
+    _mutex.unlock();
+
+    Event* ev = new Event();
+    ev->setClientSendEvent(client, publish);
+    que->post(ev);
+    return true;
+}
+
+/**
+ *  Called when the client connects. Cached messages are sent to it again.
+ */
+void RetainedCache::forget(Client* client)
+{
+    _mutex.lock();
+    for (RetainedMessage* msg = _first; msg; msg = msg->_next)
+    {
+        _bytes -= msg->_clients.erase(client) * RETAINED_CLIENT_OVERHEAD;
+    }
+    _mutex.unlock();
+}
+
+void RetainedCache::clear(void)
+{
+    _mutex.lock();
+    while (_first)
+    {
+        erase(_first);
+    }
+    _mutex.unlock();
+}
+
+void RetainedCache::getStat(RetainedCacheStat* stat)
+{
+    stat->hits = _events[RETAINED_HIT];
+    stat->misses = _events[RETAINED_MISS];
+    stat->stored = _events[RETAINED_STORED];
+    stat->invalidated = _events[RETAINED_INVALIDATED];
+    stat->evicted = _events[RETAINED_EVICTED];
+    stat->suppressed = _events[RETAINED_SUPPRESSED];
+    stat->entries = _entries;
+    stat->bytes = _bytes;
+}
+
+void RetainedCache::print(void)
+{
+    if (!isActive())
+    {
+        return;
+    }
+    RetainedCacheStat stat;
+    getStat(&stat);
+    uint64_t lookups = stat.hits + stat.misses;
+    WRITELOG(" Retained    entries %u  bytes %u / %u  hits %llu  misses %llu  hit rate %llu%%  stored %llu  invalidated %llu  evicted %llu  suppressed %llu\n",
+            stat.entries, stat.bytes, _size, (unsigned long long) stat.hits, (unsigned long long) stat.misses,
+            (unsigned long long) (lookups ? stat.hits * 100 / lookups : 0), (unsigned long long) stat.stored,
+            (unsigned long long) stat.invalidated, (unsigned long long) stat.evicted, (unsigned long long) stat.suppressed);
+}
+
+RetainedMessage* RetainedCache::find(const char* topic, int topiclen)
+{
+    if (_map.empty())
+    {
+        return nullptr;
+    }
+    auto it = _map.find(string(topic, topiclen));
+    return it == _map.end() ? nullptr : it->second;
+}
+
+bool RetainedCache::isExpired(RetainedMessage* msg)
+{
+    return _ttl > 0 && monotonicSeconds() - msg->_time >= _ttl;
+}
+
+void RetainedCache::link(RetainedMessage* msg)
+{
+    msg->_prev = nullptr;
+    msg->_next = _first;
+    if (_first)
+    {
+        _first->_prev = msg;
+    }
+    else
+    {
+        _last = msg;
+    }
+    _first = msg;
+}
+
+void RetainedCache::unlink(RetainedMessage* msg)
+{
+    if (msg->_prev)
+    {
+        msg->_prev->_next = msg->_next;
+    }
+    else
+    {
+        _first = msg->_next;
+    }
+    if (msg->_next)
+    {
+        msg->_next->_prev = msg->_prev;
+    }
+    else
+    {
+        _last = msg->_prev;
+    }
+    msg->_prev = nullptr;
+    msg->_next = nullptr;
+}
+
+void RetainedCache::erase(RetainedMessage* msg)
+{
+    unlink(msg);
+    _map.erase(msg->_topic);
+    _bytes -= getBytes(msg);
+    _entries--;
+    delete msg;
+}
+
+uint32_t RetainedCache::getBytes(RetainedMessage* msg)
+{
+    return msg->_topic.size() + msg->_payloadlen + RETAINED_ENTRY_OVERHEAD
+            + msg->_clients.size() * RETAINED_CLIENT_OVERHEAD;
+}
@@ -0,0 +1,129 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#ifndef MQTTSNGATEWAY_SRC_MQTTSNGWRETAINEDCACHE_H_
+#define MQTTSNGATEWAY_SRC_MQTTSNGWRETAINEDCACHE_H_
+
+#include "MQTTSNGWDefines.h"
+#include "MQTTGWPacket.h"
+#include "MQTTSNPacket.h"
+#include "Threading.h"
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace MQTTSNGW
+{
+class Client;
+class EventQue;
+class TopicIdMapElement;
+
+#define RETAINED_ENTRY_OVERHEAD   (64)  // bytes counted for an entry besides the topic and the payload
+#define RETAINED_CLIENT_OVERHEAD  (32)  // bytes counted for a client which waits the copy of the broker
+
+typedef struct
+{
+    uint64_t hits;          // SUBSCRIBEs answered by the cache
+    uint64_t misses;        // SUBSCRIBEs of topics which are not cached or expired
+    uint64_t stored;        // retained messages stored or replaced
+    uint64_t invalidated;   // removed by empty retained messages or by live messages
+    uint64_t evicted;       // removed to keep the size
+    uint64_t suppressed;    // retained messages of the broker which the client already has
+    uint32_t entries;
+    uint32_t bytes;
+} RetainedCacheStat;
+
+/* events counted by RetainedCache */
+#define RETAINED_HIT          (0)
+#define RETAINED_MISS         (1)
+#define RETAINED_STORED       (2)
+#define RETAINED_INVALIDATED  (3)
+#define RETAINED_EVICTED      (4)
+#define RETAINED_SUPPRESSED   (5)
+
+/*=====================================
+ Class RetainedMessage
+ =====================================*/
+class RetainedMessage
+{
+    friend class RetainedCache;
+public:
+    RetainedMessage();
+    ~RetainedMessage();
+
+private:
+    std::string _topic;
+    uint8_t* _payload;
+    int _payloadlen;
+    uint32_t _time;                         // seconds of the monotonic clock when it was received
+    std::unordered_set<Client*> _clients;   // clients which got it from the cache and wait the copy of the broker
+    RetainedMessage* _prev;                 // list of the least recently used
+    RetainedMessage* _next;
+};
+
+/*=====================================
+ Class RetainedCache
+
+ Retained messages which the broker sends with the retain flag.
+ When the broker accepts a SUBSCRIBE of a topic, the cached value is
+ sent to the client with QoS0, and the copy which the broker sends for
+ the SUBSCRIBE is dropped once.
+ Entries exceeding the size are evicted from the least recently used one.
+ update( ) is called by the BrokerRecvTask which sees a PUBLISH only once,
+ and others are called by the PacketHandleTask.
+ =====================================*/
+class RetainedCache
+{
+public:
+    RetainedCache();
+    ~RetainedCache();
+
+    void initialize(uint32_t size, uint32_t ttl);
+    bool isActive(void);
+    void update(Publish* pub);
+    void invalidate(const char* topic, int topiclen);
+    bool isDelivered(Client* client, Publish* pub);
+    bool answer(Client* client, TopicIdMapElement* topicId, EventQue* que, bool duplicated);
+    bool answer(Client* client, const char* topic, int topiclen, MQTTSN_topicid* topicId, EventQue* que,
+            bool duplicated);
+    void forget(Client* client);
+    void clear(void);
+    void getStat(RetainedCacheStat* stat);
+    void print(void);
+
+private:
+    RetainedMessage* find(const char* topic, int topiclen);
+    bool isExpired(RetainedMessage* msg);
+    void link(RetainedMessage* msg);
+    void unlink(RetainedMessage* msg);
+    void erase(RetainedMessage* msg);
+    uint32_t getBytes(RetainedMessage* msg);
+
+    std::unordered_map<std::string, RetainedMessage*> _map;
+    RetainedMessage* _first { nullptr };    // most recently used
+    RetainedMessage* _last { nullptr };
+    uint32_t _size { 0 };                   // bytes of the cache, 0 if disabled
+    uint32_t _ttl { 0 };                    // seconds, 0 means no limit
+    std::atomic<uint32_t> _bytes { 0 };
+    std::atomic<uint32_t> _entries { 0 };
+    std::atomic<uint64_t> _events[6];
+    Mutex _mutex;
+};
+
+}
+
+#endif /* MQTTSNGATEWAY_SRC_MQTTSNGWRETAINEDCACHE_H_ */
@@ -0,0 +1,619 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#include "MQTTSNGWSessionStore.h"
+#include "MQTTSNGWProcess.h"
+#include "MQTTSNGWClient.h"
+#include "MQTTSNGWClientList.h"
+#include "MQTTGWPacket.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace MQTTSNGW;
+
+#define RECORD_HEADER_SIZE  (8)   // length and hash of a record
+
+/*
+ *  Writer and reader of fields of a record.
+ */
+class RecordBuffer
+{
+public:
+    RecordBuffer(uint8_t* buf)
+    {
+        _ptr = buf;
+    }
+    void put8(uint8_t val)
+    {
+        *_ptr++ = val;
+    }
+    void put16(uint16_t val)
+    {
+        memcpy(_ptr, &val, 2);
+        _ptr += 2;
+    }
+    void put32(uint32_t val)
+    {
+        memcpy(_ptr, &val, 4);
+        _ptr += 4;
+    }
+    void put(const void* data, uint32_t len)
+    {
+        memcpy(_ptr, data, len);
+        _ptr += len;
+    }
+    uint8_t get8(void)
+    {
+        return *_ptr++;
+    }
+    uint16_t get16(void)
+    {
+        uint16_t val;
+        memcpy(&val, _ptr, 2);
+        _ptr += 2;
+        return val;
+    }
+    uint32_t get32(void)
+    {
+        uint32_t val;
+        memcpy(&val, _ptr, 4);
+        _ptr += 4;
+        return val;
+    }
+    uint8_t* get(uint32_t len)
+    {
+        uint8_t* data = _ptr;
+        _ptr += len;
+        return data;
+    }
+    uint8_t* getPtr(void)
+    {
+        return _ptr;
+    }
+private:
+    uint8_t* _ptr;
+};
+
+static uint32_t recordHash(uint8_t* data, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t recordLength(uint8_t* record)
+{
+    uint32_t len;
+    memcpy(&len, record, 4);
+    return len;
+}
+
+/*=====================================
+ Class SessionStore
+ =====================================*/
+SessionStore::SessionStore()
+{
+
+}
+
+SessionStore::~SessionStore()
+{
+    close();
+}
+
+/**
+ *  Map the file. Sessions in it are read by restore( ).
+ */
+void SessionStore::open(const char* fileName, uint32_t capacity)
+{
+    if (_base)
+    {
+        return;
+    }
+    _fileName = strdup(fileName);
+    _capacity = capacity;
+    _record = (uint8_t*) malloc(SESSION_RECORD_SIZE);
+
+    _base = map(_fileName, false, _capacity);
+    if (_base == nullptr)
+    {
+        _base = map(_fileName, true, _capacity);
+    }
+    if (_base == nullptr)
+    {
+        throw EXCEPTION("SessionStore can't create a session file.", errno);
+    }
+}
+
+void SessionStore::close(void)
+{
+    if (_base)
+    {
+        SessionFileHeader* header = (SessionFileHeader*) _base;
+        munmap(_base, header->capacity);
+        _base = nullptr;
+    }
+    if (_fileName)
+    {
+        free(_fileName);
+        _fileName = nullptr;
+    }
+    if (_record)
+    {
+        free(_record);
+        _record = nullptr;
+    }
+}
+
+bool SessionStore::isOpen(void)
+{
+    return _base != nullptr;
+}
+
+/**
+ *  Map an existing file, or create a new file of capacity bytes when create is true.
+ *  Blocks of a new file are allocated, so writing the mapped file never raises SIGBUS when the disk is full.
+ *  @return nullptr if the file doesn't exist or is not a session file.
+ */
+uint8_t* SessionStore::map(const char* fileName, bool create, uint32_t capacity)
+{
+    int fd = ::open(fileName, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0600);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    if (create)
+    {
+        int rc = posix_fallocate(fd, 0, capacity);
+        if (rc != 0)
+        {
+            WRITELOG("%s SessionStore: can't allocate %u bytes of %s. %s%s\n", ERRMSG_HEADER, capacity, fileName,
+                    strerror(rc), ERRMSG_FOOTER);
+            ::close(fd);
+            unlink(fileName);
+            return nullptr;
+        }
+    }
+    else
+    {
+        SessionFileHeader header;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || read(fd, &header, sizeof(header)) != sizeof(header)
+                || memcmp(header.magic, SESSION_MAGIC, sizeof(header.magic)) || header.version != SESSION_VERSION
+                || header.capacity != st.st_size || header.used > header.capacity)
+        {
+            ::close(fd);
+            return nullptr;
+        }
+        capacity = header.capacity;
+    }
+
+    void* addr = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    if (create)
+    {
+        SessionFileHeader* header = (SessionFileHeader*) addr;
+        memcpy(header->magic, SESSION_MAGIC, sizeof(header->magic));
+        header->version = SESSION_VERSION;
+        header->capacity = capacity;
+        header->used = sizeof(SessionFileHeader);
+    }
+    return (uint8_t*) addr;
+}
+
+/**
+ *  Restore sessions of the file into clients and compact the file.
+ *  Clients which are not in the ClientList are created unless authorize is true.
+ *  @return number of clients restored
+ */
+int SessionStore::restore(ClientList* clientList, bool authorize)
+{
+    SessionFileHeader* header = (SessionFileHeader*) _base;
+    std::map<std::string, uint32_t> sessions;
+    uint32_t pos = sizeof(SessionFileHeader);
+    uint32_t required = sizeof(SessionFileHeader);
+    int cnt = 0;
+
+    /* the last record of each client */
+    while (pos + RECORD_HEADER_SIZE + 4 <= header->used)
+    {
+        RecordBuffer rec(_base + pos);
+        uint32_t len = rec.get32();
+        uint32_t hash = rec.get32();
+        if (len < RECORD_HEADER_SIZE + 4 || pos + len > header->used
+                || recordHash(_base + pos + RECORD_HEADER_SIZE, len - RECORD_HEADER_SIZE) != hash)
+        {
+            WRITELOG("%s SessionStore: %s is broken at %u. Following records are discarded.%s\n", ERRMSG_HEADER, _fileName,
+                    pos, ERRMSG_FOOTER);
+            break;
+        }
+        uint8_t type = rec.get8();
+        rec.get8();
+        uint16_t idLen = rec.get16();
+        std::string clientId((char*) rec.get(idLen), idLen);
+
+        if (type == SESSION_RECORD_CLIENT)
+        {
+            sessions[clientId] = pos;
+        }
+        else
+        {
+            sessions.erase(clientId);
+        }
+        pos += len;
+    }
+
+    for (std::map<std::string, uint32_t>::iterator it = sessions.begin(); it != sessions.end(); it++)
+    {
+        MQTTSNString id = MQTTSNString_initializer;
+        id.cstring = (char*) it->first.c_str();
+
+        Client* client = clientList->getClient(&id);
+        if (client == nullptr && !authorize)
+        {
+            client = clientList->createClient(nullptr, &id, TRANSPEARENT_TYPE);
+        }
+        if (client == nullptr)
+        {
+            WRITELOG("%s SessionStore: the session of %s is discarded.%s\n", ERRMSG_HEADER, id.cstring, ERRMSG_FOOTER);
+            continue;
+        }
+        apply(client, _base + it->second);
+        client->_sessionOffset = it->second;
+        client->_sessionLength = recordLength(_base + it->second);
+        required += client->_sessionLength;
+        cnt++;
+    }
+
+    /* write live records into a new file, which is larger than SessionFileSize if they don't fit in it */
+    _clientList = clientList;
+    if (!compact(_capacity > required ? _capacity : required))
+    {
+        throw EXCEPTION("SessionStore can't compact the session file.", errno);
+    }
+    return cnt;
+}
+
+/**
+ *  Append records of clients of which sessions have been changed.
+ *  Called by the PacketHandleTask which owns topics and saved PUBLISHes of clients.
+ */
+void SessionStore::sync(ClientList* clientList)
+{
+    bool written = false;
+
+    if (_base == nullptr)
+    {
+        return;
+    }
+    _clientList = clientList;
+
+    for (Client* client = clientList->getClient(0); client; client = client->getNextClient())
+    {
+        if (isPersistent(client))
+        {
+            if (client->_sessionOffset == 0 || isChanged(client))
+            {
+                written |= append(client, SESSION_RECORD_CLIENT);
+            }
+        }
+        else if (client->_sessionOffset)
+        {
+            written |= append(client, SESSION_RECORD_DELETE);
+        }
+    }
+
+    if (written)
+    {
+        SessionFileHeader* header = (SessionFileHeader*) _base;
+        msync(_base, header->capacity, MS_ASYNC);
+    }
+}
+
+/**
+ *  Sessions of clients which don't clean sessions, or which are sleeping, are kept.
+ */
+bool SessionStore::isPersistent(Client* client)
+{
+    if (client->_clientId == nullptr || *client->_clientId == 0 || client->_status == Cstat_Free)
+    {
+        return false;
+    }
+    if (client->_clientType != Ctype_Normal && client->_clientType != Ctype_Forwarded)
+    {
+        return false;
+    }
+    return !client->_sessionStatus || client->_status == Cstat_Asleep || client->_status == Cstat_Awake;
+}
+
+bool SessionStore::isChanged(Client* client)
+{
+    return client->_topics->getGeneration() != client->_sessionTopicGen
+            || client->_clientSleepPacketQue.getGeneration() != client->_sessionQueGen
+            || client->_sessionStatus != client->_sessionClean;
+}
+
+/**
+ *  Build a record of the client into _record.
+ *  @return length of the record, 0 if it is too large.
+ */
+uint32_t SessionStore::build(Client* client, uint8_t type)
+{
+    MQTTGWPacket* packets[MAX_SAVED_PUBLISH];
+    uint16_t idLen = strlen(client->_clientId);
+    uint32_t len = RECORD_HEADER_SIZE + 4 + idLen + 4;
+    uint16_t topicCnt = 0;
+    uint16_t pubCnt = 0;
+    int cnt = 0;
+
+    if (type == SESSION_RECORD_CLIENT)
+    {
+        for (Topic* topic = client->_topics->getFirstTopic(); topic; topic = client->_topics->getNextTopic(topic))
+        {
+            if (topic->getType() == MQTTSN_TOPIC_TYPE_NORMAL)
+            {
+                len += 5 + topic->getTopicName()->size();
+                topicCnt++;
+            }
+        }
+        cnt = client->_clientSleepPacketQue.getPackets(packets, MAX_SAVED_PUBLISH);
+        for (int i = 0; i < cnt; i++)
+        {
+            Publish pub = MQTTPacket_Publish_Initializer;
+            packets[i]->getPUBLISH(&pub);
+            if (pub.header.bits.qos > 0)
+            {
+                len += 9 + pub.topiclen + pub.payloadlen;
+                pubCnt++;
+            }
+        }
+    }
+
+    if (len > SESSION_RECORD_SIZE)
+    {
+        WRITELOG("%s SessionStore: the session of %s is too large.%s\n", ERRMSG_HEADER, client->_clientId, ERRMSG_FOOTER);
+        return 0;
+    }
+
+    RecordBuffer rec(_record);
+    rec.put32(len);
+    rec.put32(0);
+    rec.put8(type);
+    rec.put8(client->_sessionStatus ? 1 : 0);
+    rec.put16(idLen);
+    rec.put(client->_clientId, idLen);
+    rec.put16(topicCnt);
+    if (topicCnt)
+    {
+        for (Topic* topic = client->_topics->getFirstTopic(); topic; topic = client->_topics->getNextTopic(topic))
+        {
+            if (topic->getType() == MQTTSN_TOPIC_TYPE_NORMAL)
+            {
+                rec.put16(topic->getTopicId());
+                rec.put8(topic->getType());
+                rec.put16(topic->getTopicName()->size());
+                rec.put(topic->getTopicName()->c_str(), topic->getTopicName()->size());
+            }
+        }
+    }
+    rec.put16(pubCnt);
+    for (int i = 0; i < cnt && pubCnt; i++)
+    {
+        Publish pub = MQTTPacket_Publish_Initializer;
+        packets[i]->getPUBLISH(&pub);
+        if (pub.header.bits.qos > 0)
+        {
+            rec.put8(pub.header.byte);
+            rec.put16(pub.msgId);
+            rec.put16(pub.topiclen);
+            rec.put(pub.topic, pub.topiclen);
+            rec.put32(pub.payloadlen);
+            rec.put(pub.payload, pub.payloadlen);
+        }
+    }
+
+    uint32_t hash = recordHash(_record + RECORD_HEADER_SIZE, len - RECORD_HEADER_SIZE);
+    memcpy(_record + 4, &hash, 4);
+    return len;
+}
+
+/**
+ *  Append a record of the client.
+ *  @return true if the record is written.
+ */
+bool SessionStore::append(Client* client, uint8_t type)
+{
+    SessionFileHeader* header = (SessionFileHeader*) _base;
+    uint32_t len = build(client, type);
+    if (len == 0)
+    {
+        return false;
+    }
+
+    /* the file is full. compact it, and grow it if live records don't leave room for the record */
+    if (header->used + len > header->capacity)
+    {
+        if (time(nullptr) < _retryTime)
+        {
+            return false;
+        }
+
+        uint32_t capacity = header->capacity;
+        uint32_t required = sizeof(SessionFileHeader) + _liveBytes + len;
+        if (required > capacity)
+        {
+            capacity = capacity <= UINT32_MAX / 2 ? capacity * 2 : UINT32_MAX;
+            capacity = capacity > required ? capacity : required;
+        }
+        bool compacted = compact(capacity);
+
+        /* compact( ) maps the new file */
+        header = (SessionFileHeader*) _base;
+        if (!compacted || header->used + len > header->capacity)
+        {
+            WRITELOG("%s SessionStore: %s is full. sessions are not written for %d secs.%s\n", ERRMSG_HEADER,
+                    _fileName, SESSION_RETRY_INTERVAL, ERRMSG_FOOTER);
+            _retryTime = time(nullptr) + SESSION_RETRY_INTERVAL;
+            return false;
+        }
+    }
+
+    uint32_t pos = header->used;
+    memcpy(_base + pos, _record, len);
+    __sync_synchronize();
+    header->used = pos + len;
+
+    if (client->_sessionOffset)
+    {
+        _liveBytes -= client->_sessionLength;
+    }
+    if (type == SESSION_RECORD_CLIENT)
+    {
+        client->_sessionOffset = pos;
+        client->_sessionLength = len;
+        _liveBytes += len;
+    }
+    else
+    {
+        client->_sessionOffset = 0;
+        client->_sessionLength = 0;
+    }
+    client->_sessionTopicGen = client->_topics->getGeneration();
+    client->_sessionQueGen = client->_clientSleepPacketQue.getGeneration();
+    client->_sessionClean = client->_sessionStatus;
+
+    /* dead records exceed live ones */
+    uint32_t dead = header->used - sizeof(SessionFileHeader) - _liveBytes;
+    if (dead > _liveBytes + SESSION_COMPACT_MIN && time(nullptr) >= _retryTime && !compact(header->capacity))
+    {
+        _retryTime = time(nullptr) + SESSION_RETRY_INTERVAL;
+    }
+    return true;
+}
+
+/**
+ *  Copy live records into a new file of capacity bytes and replace the old one by it.
+ *  Offsets of records in clients are updated only when the new file replaces the old one.
+ */
+bool SessionStore::compact(uint32_t capacity)
+{
+    char tmpName[PATH_MAX];
+    std::vector<uint32_t> offsets;
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", _fileName);
+
+    uint8_t* base = map(tmpName, true, capacity);
+    if (base == nullptr)
+    {
+        return false;
+    }
+    SessionFileHeader* header = (SessionFileHeader*) base;
+    uint32_t pos = header->used;
+
+    for (Client* client = _clientList->getClient(0); client; client = client->getNextClient())
+    {
+        if (client->_sessionOffset == 0)
+        {
+            continue;
+        }
+        if (pos + client->_sessionLength > header->capacity)
+        {
+            munmap(base, header->capacity);
+            unlink(tmpName);
+            return false;
+        }
+        memcpy(base + pos, _base + client->_sessionOffset, client->_sessionLength);
+        offsets.push_back(pos);
+        pos += client->_sessionLength;
+    }
+    header->used = pos;
+    msync(base, header->capacity, MS_SYNC);
+
+    if (rename(tmpName, _fileName) < 0)
+    {
+        munmap(base, header->capacity);
+        unlink(tmpName);
+        return false;
+    }
+    munmap(_base, ((SessionFileHeader*) _base)->capacity);
+    _base = base;
+    _liveBytes = pos - sizeof(SessionFileHeader);
+
+    std::vector<uint32_t>::iterator offset = offsets.begin();
+    for (Client* client = _clientList->getClient(0); client; client = client->getNextClient())
+    {
+        if (client->_sessionOffset)
+        {
+            client->_sessionOffset = *offset++;
+        }
+    }
+    return true;
+}
+
+/**
+ *  Restore topics and saved PUBLISHes of a record into the client.
+ *  The client must CONNECT again because the connection of the broker is lost.
+ */
+void SessionStore::apply(Client* client, uint8_t* record)
+{
+    RecordBuffer rec(record + RECORD_HEADER_SIZE);
+    rec.get8();
+    client->setSessionStatus(rec.get8() & 1);
+    rec.get(rec.get16());
+
+    uint16_t topicCnt = rec.get16();
+    for (int i = 0; i < topicCnt; i++)
+    {
+        uint16_t topicId = rec.get16();
+        MQTTSN_topicTypes type = (MQTTSN_topicTypes) rec.get8();
+        uint16_t nameLen = rec.get16();
+        std::string name((char*) rec.get(nameLen), nameLen);
+        client->_topics->add(name.c_str(), topicId, type);
+    }
+
+    uint16_t pubCnt = rec.get16();
+    for (int i = 0; i < pubCnt; i++)
+    {
+        Publish pub = MQTTPacket_Publish_Initializer;
+        pub.header.byte = rec.get8();
+        pub.msgId = rec.get16();
+        pub.topiclen = rec.get16();
+        pub.topic = (char*) rec.get(pub.topiclen);
+        pub.payloadlen = rec.get32();
+        pub.payload = (char*) rec.get(pub.payloadlen);
+
+        MQTTGWPacket packet;
+        packet.setPUBLISH(&pub);
+        client->_clientSleepPacketQue.post(&packet);
+    }
+}
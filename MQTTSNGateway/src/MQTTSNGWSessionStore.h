@@ -0,0 +1,98 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#ifndef MQTTSNGATEWAY_SRC_MQTTSNGWSESSIONSTORE_H_
+#define MQTTSNGATEWAY_SRC_MQTTSNGWSESSIONSTORE_H_
+
+#include "MQTTSNGWDefines.h"
+#include <stdint.h>
+#include <time.h>
+
+namespace MQTTSNGW
+{
+
+#define SESSION_MAGIC        "MQSNSES"  // magic of a session file
+#define SESSION_VERSION             (1)  // version of the file format
+#define SESSION_COMPACT_MIN     (65536)  // bytes of dead records which never start a compaction
+#define SESSION_RECORD_SIZE    (262144)  // max bytes of a record
+#define SESSION_RETRY_INTERVAL     (60)  // secs before the file is compacted or grown again after a failure
+
+/* types of a record */
+#define SESSION_RECORD_CLIENT       (1)  // the whole session of a client
+#define SESSION_RECORD_DELETE       (2)  // the session of a client has ended
+
+/*
+ *  A session file is a SessionFileHeader followed by records.
+ *  A record is written at the end of the file and the header is updated after it,
+ *  so a record which is not completed is never read. The last record of a client wins.
+ */
+typedef struct
+{
+    char magic[8];          // SESSION_MAGIC
+    uint32_t version;       // SESSION_VERSION
+    uint32_t capacity;      // bytes of the file
+    uint32_t used;          // bytes of the header and records
+    uint8_t reserved[12];
+} SessionFileHeader;
+
+#define SESSION_FILE_SIZE_MIN  (sizeof(SessionFileHeader) + SESSION_RECORD_SIZE)  // bytes of the smallest file
+
+class Client;
+class ClientList;
+
+/*=====================================
+ Class SessionStore
+
+ Sessions of clients which keep them over the restart of the gateway,
+ i.e. CleanSession is false or they are sleeping, are written into
+ a memory mapped file. sync( ) appends a record of each client of
+ which topics or saved QoS1 and QoS2 PUBLISHes have been changed.
+ When dead records exceed the live ones, live records are copied
+ into a new file which replaces the old one. The new file is larger
+ if live records don't leave room for the record.
+ =====================================*/
+class SessionStore
+{
+public:
+    SessionStore();
+    ~SessionStore();
+
+    void open(const char* fileName, uint32_t capacity);
+    void close(void);
+    bool isOpen(void);
+    int restore(ClientList* clientList, bool authorize);
+    void sync(ClientList* clientList);
+
+private:
+    bool isPersistent(Client* client);
+    bool isChanged(Client* client);
+    uint32_t build(Client* client, uint8_t type);
+    bool append(Client* client, uint8_t type);
+    bool compact(uint32_t capacity);
+    void apply(Client* client, uint8_t* record);
+    uint8_t* map(const char* fileName, bool create, uint32_t capacity);
+
+    char* _fileName { nullptr };
+    uint32_t _capacity { 0 };
+    uint8_t* _base { nullptr };
+    uint32_t _liveBytes { 0 };
+    uint8_t* _record { nullptr };
+    ClientList* _clientList { nullptr };
+    time_t _retryTime { 0 };    // the file is not compacted again before it after a failure
+};
+
+}
+
+#endif /* MQTTSNGATEWAY_SRC_MQTTSNGWSESSIONSTORE_H_ */
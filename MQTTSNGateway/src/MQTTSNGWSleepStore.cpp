@@ -0,0 +1,337 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#include "MQTTSNGWSleepStore.h"
+#include "MQTTSNGWProcess.h"
+#include "MQTTGWPacket.h"
+#include <string.h>
+#include <atomic>
+
+using namespace MQTTSNGW;
+
+static uint32_t storeBudget = DEFAULT_SLEEPSTORE_SIZE;
+static uint32_t clientQuota = DEFAULT_SLEEPSTORE_QUOTA;
+static std::atomic<uint64_t> storeBytes { 0 };
+static std::atomic<uint64_t> storeMaxBytes { 0 };
+static std::atomic<uint64_t> storePackets { 0 };
+static std::atomic<uint64_t> storeEvents[4];
+
+/*=====================================
+ Class SleepStore
+ =====================================*/
+/**
+ *  @param bytes  global budget, 0 means no limit
+ *  @param clientBytes  quota of a client, 0 means no limit
+ */
+void SleepStore::setBudget(uint32_t bytes, uint32_t clientBytes)
+{
+    storeBudget = bytes;
+    clientQuota = clientBytes;
+}
+
+uint32_t SleepStore::getClientQuota(void)
+{
+    return clientQuota;
+}
+
+/**
+ *  @return false if the budget has no room for the bytes.
+ */
+bool SleepStore::reserve(uint32_t bytes)
+{
+    uint64_t held = storeBytes.load();
+    do
+    {
+        if (storeBudget && held + bytes > storeBudget)
+        {
+            return false;
+        }
+    } while (!storeBytes.compare_exchange_weak(held, held + bytes));
+
+    storePackets++;
+    uint64_t max = storeMaxBytes.load();
+    while (held + bytes > max && !storeMaxBytes.compare_exchange_weak(max, held + bytes))
+    {
+    }
+    return true;
+}
+
+void SleepStore::release(uint32_t bytes)
+{
+    storeBytes -= bytes;
+    storePackets--;
+}
+
+void SleepStore::count(int event)
+{
+    storeEvents[event].fetch_add(1, std::memory_order_relaxed);
+}
+
+void SleepStore::getStat(SleepStoreStat* stat)
+{
+    stat->bytes = storeBytes.load();
+    stat->maxBytes = storeMaxBytes.load();
+    stat->packets = storePackets.load();
+    stat->stored = storeEvents[SLEEPSTORE_STORED].load();
+    stat->coalesced = storeEvents[SLEEPSTORE_COALESCED].load();
+    stat->dropped = storeEvents[SLEEPSTORE_DROPPED].load();
+    stat->rejected = storeEvents[SLEEPSTORE_REJECTED].load();
+}
+
+void SleepStore::print(void)
+{
+    SleepStoreStat stat;
+    getStat(&stat);
+    WRITELOG(" SleepStore  bytes %llu / %u (max %llu)  packets %llu  stored %llu  coalesced %llu  dropped %llu  rejected %llu\n",
+            (unsigned long long) stat.bytes, storeBudget, (unsigned long long) stat.maxBytes, (unsigned long long) stat.packets,
+            (unsigned long long) stat.stored, (unsigned long long) stat.coalesced, (unsigned long long) stat.dropped,
+            (unsigned long long) stat.rejected);
+}
+
+/*=====================================
+ Class SleepPacket
+ =====================================*/
+SleepPacket::SleepPacket(MQTTGWPacket* packet, uint32_t size)
+{
+    Publish pub = MQTTPacket_Publish_Initializer;
+    packet->getPUBLISH(&pub);
+
+    _packet = packet;
+    _size = size;
+    _qos = pub.header.bits.qos;
+    _topic = pub.topic;
+    _topicLen = pub.topiclen;
+    _next = nullptr;
+    _prev = nullptr;
+}
+
+/* the packet is not deleted. it is passed to the client or deleted by SleepPacketQue. */
+SleepPacket::~SleepPacket()
+{
+}
+
+/*=====================================
+ Class SleepPacketQue
+ =====================================*/
+SleepPacketQue::SleepPacketQue()
+{
+    _head = nullptr;
+    _tail = nullptr;
+    _cnt = 0;
+    _bytes = 0;
+    _generation = 0;
+}
+
+SleepPacketQue::~SleepPacketQue()
+{
+    clear();
+}
+
+/**
+ *  Save a copy of the PUBLISH.
+ *  @return 1 if it is saved, 0 if it is discarded.
+ */
+int SleepPacketQue::post(MQTTGWPacket* packet)
+{
+    Publish pub = MQTTPacket_Publish_Initializer;
+    if (packet->getPUBLISH(&pub) != 1)
+    {
+        return 0;
+    }
+    uint8_t qos = pub.header.bits.qos;
+    uint32_t size = sizeof(SleepPacket) + sizeof(MQTTGWPacket) + packet->getPacketLength();
+    uint32_t quota = SleepStore::getClientQuota();
+
+    if (quota && size > quota)
+    {
+        SleepStore::count(qos == 0 ? SLEEPSTORE_DROPPED : SLEEPSTORE_REJECTED);
+        return 0;
+    }
+
+    _mutex.lock();
+
+    /* keep only the latest value of a topic */
+    if (qos == 0)
+    {
+        SleepPacket* old = findQoS0(_head, pub.topic, pub.topiclen);
+        if (old)
+        {
+            remove(old);
+            SleepStore::count(SLEEPSTORE_COALESCED);
+        }
+    }
+
+    /* discard the oldest QoS0 PUBLISHes until the packet fits */
+    SleepPacket* victim = _head;
+    while (true)
+    {
+        bool fit = _cnt < MAX_SAVED_PUBLISH && (quota == 0 || _bytes + size <= quota);
+        if (fit && SleepStore::reserve(size))
+        {
+            break;
+        }
+        victim = findQoS0(victim, nullptr, 0);
+        if (victim == nullptr)
+        {
+            _mutex.unlock();
+            SleepStore::count(qos == 0 ? SLEEPSTORE_DROPPED : SLEEPSTORE_REJECTED);
+            return 0;
+        }
+        SleepPacket* next = victim->_next;
+        remove(victim);
+        SleepStore::count(SLEEPSTORE_DROPPED);
+        victim = next;
+    }
+
+    /* the copy shares the data with the packet */
+    MQTTGWPacket* msg = new MQTTGWPacket();
+    *msg = *packet;
+    SleepPacket* elm = new SleepPacket(msg, size);
+
+    if (_tail)
+    {
+        _tail->_next = elm;
+        elm->_prev = _tail;
+        _tail = elm;
+    }
+    else
+    {
+        _head = _tail = elm;
+    }
+    _cnt++;
+    _bytes += size;
+    _generation++;
+    _mutex.unlock();
+
+    SleepStore::count(SLEEPSTORE_STORED);
+    return 1;
+}
+
+MQTTGWPacket* SleepPacketQue::getPacket(void)
+{
+    MQTTGWPacket* packet = nullptr;
+    _mutex.lock();
+    if (_head)
+    {
+        packet = _head->_packet;
+    }
+    _mutex.unlock();
+    return packet;
+}
+
+/**
+ *  Remove the first packet. The caller owns the packet got by getPacket( ).
+ */
+void SleepPacketQue::pop(void)
+{
+    _mutex.lock();
+    SleepPacket* elm = _head;
+    if (elm)
+    {
+        elm->_packet = nullptr;
+        remove(elm);
+    }
+    _mutex.unlock();
+}
+
+void SleepPacketQue::clear(void)
+{
+    _mutex.lock();
+    while (_head)
+    {
+        remove(_head);
+    }
+    _mutex.unlock();
+}
+
+int SleepPacketQue::getCount(void)
+{
+    return _cnt;
+}
+
+uint32_t SleepPacketQue::getBytes(void)
+{
+    return _bytes;
+}
+
+/**
+ *  @return a number which is changed whenever a packet is saved or removed.
+ */
+uint32_t SleepPacketQue::getGeneration(void)
+{
+    return _generation;
+}
+
+/**
+ *  Copy pointers of saved packets from the oldest one.
+ *  @return number of packets
+ */
+int SleepPacketQue::getPackets(MQTTGWPacket** packets, int max)
+{
+    int cnt = 0;
+    _mutex.lock();
+    for (SleepPacket* elm = _head; elm && cnt < max; elm = elm->_next)
+    {
+        packets[cnt++] = elm->_packet;
+    }
+    _mutex.unlock();
+    return cnt;
+}
+
+/* called with the mutex locked */
+void SleepPacketQue::remove(SleepPacket* elm)
+{
+    if (elm->_prev)
+    {
+        elm->_prev->_next = elm->_next;
+    }
+    else
+    {
+        _head = elm->_next;
+    }
+    if (elm->_next)
+    {
+        elm->_next->_prev = elm->_prev;
+    }
+    else
+    {
+        _tail = elm->_prev;
+    }
+    _cnt--;
+    _bytes -= elm->_size;
+    _generation++;
+    SleepStore::release(elm->_size);
+    if (elm->_packet)
+    {
+        delete elm->_packet;
+    }
+    delete elm;
+}
+
+/**
+ *  @return the first QoS0 PUBLISH from the element. The topic matches if it is given.
+ */
+SleepPacket* SleepPacketQue::findQoS0(SleepPacket* from, char* topic, int topicLen)
+{
+    for (SleepPacket* elm = from; elm; elm = elm->_next)
+    {
+        if (elm->_qos == 0
+                && (topic == nullptr || (elm->_topicLen == topicLen && memcmp(elm->_topic, topic, topicLen) == 0)))
+        {
+            return elm;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,117 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#ifndef MQTTSNGATEWAY_SRC_MQTTSNGWSLEEPSTORE_H_
+#define MQTTSNGATEWAY_SRC_MQTTSNGWSLEEPSTORE_H_
+
+#include "MQTTSNGWDefines.h"
+#include "Threading.h"
+#include <stdint.h>
+
+namespace MQTTSNGW
+{
+class MQTTGWPacket;
+
+typedef struct
+{
+    uint64_t bytes;         // bytes held by all clients
+    uint64_t maxBytes;      // high water mark of bytes
+    uint64_t packets;       // packets held by all clients
+    uint64_t stored;        // packets saved
+    uint64_t coalesced;     // QoS0 packets replaced by a newer one of the same topic
+    uint64_t dropped;       // QoS0 packets discarded to make room or because no room
+    uint64_t rejected;      // QoS1 and QoS2 packets discarded because no room
+} SleepStoreStat;
+
+/*=====================================
+ Class SleepStore
+
+ Accounts bytes of PUBLISHes saved for sleeping clients
+ against the global budget. Each client is also limited
+ by its quota and MAX_SAVED_PUBLISH packets.
+ =====================================*/
+class SleepStore
+{
+public:
+    static void setBudget(uint32_t bytes, uint32_t clientBytes);
+    static uint32_t getClientQuota(void);
+    static bool reserve(uint32_t bytes);
+    static void release(uint32_t bytes);
+    static void count(int event);
+    static void getStat(SleepStoreStat* stat);
+    static void print(void);
+};
+
+/* events counted by SleepStore::count( ) */
+#define SLEEPSTORE_STORED     (0)
+#define SLEEPSTORE_COALESCED  (1)
+#define SLEEPSTORE_DROPPED    (2)
+#define SLEEPSTORE_REJECTED   (3)
+
+/*=====================================
+ Class SleepPacketQue
+
+ PUBLISHes saved for a sleeping client.
+ A QoS0 PUBLISH replaces the saved one of the same topic.
+ When a PUBLISH doesn't fit, the oldest QoS0 PUBLISHes
+ of the client are discarded to make room.
+ =====================================*/
+class SleepPacket
+{
+    friend class SleepPacketQue;
+public:
+    SleepPacket(MQTTGWPacket* packet, uint32_t size);
+    ~SleepPacket();
+
+private:
+    MQTTGWPacket* _packet;
+    uint32_t _size;
+    uint8_t _qos;
+    char* _topic;
+    int _topicLen;
+    SleepPacket* _next;
+    SleepPacket* _prev;
+};
+
+class SleepPacketQue
+{
+public:
+    SleepPacketQue();
+    ~SleepPacketQue();
+
+    int post(MQTTGWPacket* packet);
+    MQTTGWPacket* getPacket(void);
+    void pop(void);
+    void clear(void);
+    int getCount(void);
+    uint32_t getBytes(void);
+    uint32_t getGeneration(void);
+    int getPackets(MQTTGWPacket** packets, int max);
+
+private:
+    void remove(SleepPacket* elm);
+    SleepPacket* findQoS0(SleepPacket* from, char* topic, int topicLen);
+
+    SleepPacket* _head;
+    SleepPacket* _tail;
+    int _cnt;
+    uint32_t _bytes;
+    uint32_t _generation;
+    Mutex _mutex;
+};
+
+}
+
+#endif /* MQTTSNGATEWAY_SRC_MQTTSNGWSLEEPSTORE_H_ */
@@ -116,7 +116,7 @@ MQTTGWPacket* MQTTSNSubscribeHandler::handleSubscribe(Client* client, MQTTSNPack
 
     client->setWaitedSubTopicId(msgId, topicId, &topicFilter);
 
-    if (!client->isAggregated())
+    if (!client->isAggregated() && !_gateway->getAdapterManager()->isSharedSubscriber(client))
     {
         ev1 = new Event();
         ev1->setBrokerSendEvent(client, subscribe);
@@ -190,7 +190,7 @@ MQTTGWPacket* MQTTSNSubscribeHandler::handleUnsubscribe(Client* client, MQTTSNPa
         }
     }
 
-    if (!client->isAggregated())
+    if (!client->isAggregated() && !_gateway->getAdapterManager()->isSharedSubscriber(client))
     {
         Event* ev1 = new Event();
         ev1->setBrokerSendEvent(client, unsubscribe);
@@ -209,6 +209,36 @@ void MQTTSNSubscribeHandler::handleAggregateSubscribe(Client* client, MQTTSNPack
 
     if (subscribe != nullptr)
     {
+        Aggregater* aggregater = _gateway->getAdapterManager()->getAggregater();
+        UTF8String str = subscribe->getTopic();
+        string* topicName = new string(str.data, str.len); // topicName is delete by topic
+        Topic topic = Topic(topicName, MQTTSN_TOPIC_TYPE_NORMAL);
+
+        uint8_t dup;
+        int qos = 0;
+        uint16_t snMsgId;
+        MQTTSN_topicid topicFilter;
+        uint8_t grantedQoS;
+        packet->getSUBSCRIBE(&dup, &qos, &snMsgId, &topicFilter);
+
+        /* the subscription of the broker is shared with other clients.
+         * the RetainedCache sends the retained message of the topic */
+        if (aggregater->isSubscribed(&topic, (uint8_t) qos, &grantedQoS))
+        {
+            delete subscribe;
+            aggregater->addAggregateTopic(&topic, client);
+            sendSuback(client, snMsgId, grantedQoS);
+            return;
+        }
+
+        /* the SUBACK of the same SUBSCRIBE of another client answers it */
+        if (aggregater->joinSubscribing(&topic, (uint8_t) qos, client, snMsgId))
+        {
+            delete subscribe;
+            aggregater->addAggregateTopic(&topic, client);
+            return;
+        }
+
         int msgId = 0;
         if (packet->isDuplicate())
         {
@@ -223,18 +253,18 @@ void MQTTSNSubscribeHandler::handleAggregateSubscribe(Client* client, MQTTSNPack
         {
             WRITELOG("%s MQTTSNSubscribeHandler can't create MessageIdTableElement  %s%s\n",
             ERRMSG_HEADER, client->getClientId(), ERRMSG_FOOTER);
+            delete subscribe;
             return;
         }
 
-        UTF8String str = subscribe->getTopic();
-        string* topicName = new string(str.data, str.len); // topicName is delete by topic
-        Topic topic = Topic(topicName, MQTTSN_TOPIC_TYPE_NORMAL);
-
-        _gateway->getAdapterManager()->getAggregater()->addAggregateTopic(&topic, client);
+        aggregater->addAggregateTopic(&topic, client);
+        qos = aggregater->setSubscribing(msgId, &topic, (uint8_t) qos, client);
 
-        subscribe->setMsgId(msgId);
+        delete subscribe;
+        subscribe = new MQTTGWPacket();
+        subscribe->setSUBSCRIBE(topic.getTopicName()->c_str(), (uint8_t) qos, (uint16_t) msgId);
         Event* ev = new Event();
-        ev->setBrokerSendEvent(client, subscribe);
+        ev->setBrokerSendEvent(aggregater->getAdapterClient(client), subscribe);
         _gateway->getBrokerSendQue()->post(ev);
     }
 }
@@ -244,6 +274,24 @@ void MQTTSNSubscribeHandler::handleAggregateUnsubscribe(Client* client, MQTTSNPa
     MQTTGWPacket* unsubscribe = handleUnsubscribe(client, packet);
     if (unsubscribe != nullptr)
     {
+        Aggregater* aggregater = _gateway->getAdapterManager()->getAggregater();
+        UTF8String str = unsubscribe->getTopic();
+        string* topicName = new string(str.data, str.len); // topicName is delete by topic
+        Topic topic = Topic(topicName, MQTTSN_TOPIC_TYPE_NORMAL);
+        aggregater->removeAggregateTopic(&topic, client);
+
+        /* other clients still subscribe the topic filter */
+        if (aggregater->findTopic(&topic) != nullptr)
+        {
+            delete unsubscribe;
+            MQTTSNPacket* sUnsuback = new MQTTSNPacket();
+            sUnsuback->setUNSUBACK(packet->getMsgId());
+            Event* evunsuback = new Event();
+            evunsuback->setClientSendEvent(client, sUnsuback);
+            _gateway->getClientSendQue()->post(evunsuback);
+            return;
+        }
+
         int msgId = 0;
         if (packet->isDuplicate())
         {
@@ -258,17 +306,35 @@ void MQTTSNSubscribeHandler::handleAggregateUnsubscribe(Client* client, MQTTSNPa
         {
             WRITELOG("%s MQTTSNUnsubscribeHandler can't create MessageIdTableElement  %s%s\n",
             ERRMSG_HEADER, client->getClientId(), ERRMSG_FOOTER);
+            delete unsubscribe;
             return;
         }
 
-        UTF8String str = unsubscribe->getTopic();
-        string* topicName = new string(str.data, str.len); // topicName is delete by topic
-        Topic topic = Topic(topicName, MQTTSN_TOPIC_TYPE_NORMAL);
-        _gateway->getAdapterManager()->getAggregater()->removeAggregateTopic(&topic, client);
-
         unsubscribe->setMsgId(msgId);
         Event* ev = new Event();
-        ev->setBrokerSendEvent(client, unsubscribe);
+        ev->setBrokerSendEvent(aggregater->getAdapterClient(client), unsubscribe);
         _gateway->getBrokerSendQue()->post(ev);
     }
 }
+
+/**
+ *  SUBACK of a SUBSCRIBE which shares the subscription of the broker.
+ */
+void MQTTSNSubscribeHandler::sendSuback(Client* client, uint16_t msgId, uint8_t qos)
+{
+    TopicIdMapElement* topicId = client->getWaitedSubTopicId(msgId);
+    if (topicId == nullptr)
+    {
+        return;
+    }
+
+    MQTTSNPacket* snPacket = new MQTTSNPacket();
+    snPacket->setSUBACK(qos, topicId->getTopicId(), msgId, MQTTSN_RC_ACCEPTED);
+    Event* evt = new Event();
+    evt->setClientSendEvent(client, snPacket);
+    _gateway->getClientSendQue()->post(evt);
+
+    /* the SUBSCRIBE was not sent to the broker */
+    _gateway->getRetainedCache()->answer(client, topicId, _gateway->getClientSendQue(), false);
+    client->eraseWaitedSubTopicId(msgId);
+}
@@ -37,6 +37,8 @@ public:
     void handleAggregateUnsubscribe(Client* client, MQTTSNPacket* packet);
 
 private:
+    void sendSuback(Client* client, uint16_t msgId, uint8_t qos);
+
     Gateway* _gateway;
 };
 
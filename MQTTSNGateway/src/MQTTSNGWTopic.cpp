@@ -177,6 +177,7 @@ Topics::Topics()
     _first = nullptr;
     _nextTopicId = 0;
     _cnt = 0;
+    _generation = 0;
 }
 
 Topics::~Topics()
@@ -241,6 +242,14 @@ Topic* Topics::add(const MQTTSN_topicid* topicid)
 }
 
 Topic* Topics::add(const char* topicName, uint16_t id)
+{
+    return add(topicName, id, id == 0 ? MQTTSN_TOPIC_TYPE_NORMAL : MQTTSN_TOPIC_TYPE_PREDEFINED);
+}
+
+/**
+ *  A normal topic of which id is not 0 keeps the id. It is used to restore a session.
+ */
+Topic* Topics::add(const char* topicName, uint16_t id, MQTTSN_topicTypes type)
 {
     MQTTSN_topicid topicId;
 
@@ -269,18 +278,22 @@ Topic* Topics::add(const char* topicName, uint16_t id)
     string* name = new string(topicName);
     topic->_topicName = name;
 
+    topic->_type = type;
     if (id == 0)
     {
-        topic->_type = MQTTSN_TOPIC_TYPE_NORMAL;
         topic->_topicId = getNextTopicId();
     }
     else
     {
-        topic->_type = MQTTSN_TOPIC_TYPE_PREDEFINED;
         topic->_topicId = id;
+        if (type == MQTTSN_TOPIC_TYPE_NORMAL && id > _nextTopicId)
+        {
+            _nextTopicId = id;
+        }
     }
 
     _cnt++;
+    _generation++;
 
     if (_first == nullptr)
     {
@@ -351,6 +364,7 @@ void Topics::eraseNormal(void)
             }
             delete topic;
             _cnt--;
+            _generation++;
             topic = next;
         }
         else
@@ -361,6 +375,39 @@ void Topics::eraseNormal(void)
     }
 }
 
+void Topics::erase(Topic* topic)
+{
+    Topic* prev = nullptr;
+
+    for (Topic* p = _first; p; p = p->_next)
+    {
+        if (p == topic)
+        {
+            if (prev)
+            {
+                prev->_next = p->_next;
+            }
+            else
+            {
+                _first = p->_next;
+            }
+            delete p;
+            _cnt--;
+            _generation++;
+            return;
+        }
+        prev = p;
+    }
+}
+
+/**
+ *  @return a number which is changed whenever a topic is added or erased.
+ */
+uint32_t Topics::getGeneration(void)
+{
+    return _generation;
+}
+
 Topic* Topics::getFirstTopic(void)
 {
     return _first;
@@ -396,14 +443,27 @@ uint8_t Topics::getCount(void)
 /*=====================================
  Class TopicIdMap
  =====================================*/
-TopicIdMapElement::TopicIdMapElement(uint16_t msgId, uint16_t topicId, MQTTSN_topicid* topic)
+TopicIdMapElement::TopicIdMapElement()
+{
+    _msgId = 0;
+    _topicId = 0;
+    _type = MQTTSN_TOPIC_TYPE_NORMAL;
+    _wildcard = 0;
+    _used = 0;
+}
+
+TopicIdMapElement::~TopicIdMapElement()
+{
+
+}
+
+void TopicIdMapElement::set(uint16_t msgId, uint16_t topicId, MQTTSN_topicid* topic)
 {
     _msgId = msgId;
     _topicId = topicId;
     _type = topic->type;
     _wildcard = 0;
-    _next = nullptr;
-    _prev = nullptr;
+    _used = 1;
 
     if (_type == MQTTSN_TOPIC_TYPE_NORMAL)
     {
@@ -414,11 +474,6 @@ TopicIdMapElement::TopicIdMapElement(uint16_t msgId, uint16_t topicId, MQTTSN_to
     }
 }
 
-TopicIdMapElement::~TopicIdMapElement()
-{
-
-}
-
 MQTTSN_topicTypes TopicIdMapElement::getTopicType(void)
 {
     return _type;
@@ -438,113 +493,102 @@ uint16_t TopicIdMapElement::getTopicId(void)
 
 TopicIdMap::TopicIdMap()
 {
+    static_assert((TOPICIDMAP_SIZE & (TOPICIDMAP_SIZE - 1)) == 0, "TOPICIDMAP_SIZE must be a power of 2");
+    static_assert(TOPICIDMAP_SIZE > MAX_INFLIGHTMESSAGES * 2 + 1, "TOPICIDMAP_SIZE is too small");
     _maxInflight = MAX_INFLIGHTMESSAGES;
-    _msgIds = 0;
-    _first = nullptr;
-    _end = nullptr;
     _cnt = 0;
 }
 
 TopicIdMap::~TopicIdMap()
 {
-    TopicIdMapElement* p = _first;
-    while (p)
-    {
-        TopicIdMapElement* q = p->_next;
-        delete p;
-        p = q;
-    }
+
 }
 
-TopicIdMapElement* TopicIdMap::getElement(uint16_t msgId)
+int TopicIdMap::getIndex(uint16_t msgId)
 {
-    TopicIdMapElement* p = _first;
-    while (p)
+    int idx = msgId & (TOPICIDMAP_SIZE - 1);
+    while (_elements[idx]._used)
     {
-        if (p->_msgId == msgId)
+        if (_elements[idx]._msgId == msgId)
         {
-            return p;
+            return idx;
         }
-        p = p->_next;
+        idx = (idx + 1) & (TOPICIDMAP_SIZE - 1);
     }
-    return 0;
+    return -1;
 }
 
-TopicIdMapElement* TopicIdMap::add(uint16_t msgId, uint16_t topicId, MQTTSN_topicid* topic)
+TopicIdMapElement* TopicIdMap::getElement(uint16_t msgId)
 {
-    if (_cnt > _maxInflight * 2 || (topicId == 0 && topic->type != MQTTSN_TOPIC_TYPE_SHORT))
+    int idx = getIndex(msgId);
+    if (idx < 0)
     {
         return 0;
     }
-    if (getElement(msgId))
-    {
-        erase(msgId);
-    }
+    return &_elements[idx];
+}
 
-    TopicIdMapElement* elm = new TopicIdMapElement(msgId, topicId, topic);
-    if (elm == 0)
+TopicIdMapElement* TopicIdMap::add(uint16_t msgId, uint16_t topicId, MQTTSN_topicid* topic)
+{
+    if (topicId == 0 && topic->type != MQTTSN_TOPIC_TYPE_SHORT)
     {
         return 0;
     }
-    if (_first == nullptr)
-    {
-        _first = elm;
-        _end = elm;
-    }
-    else
+
+    int idx = getIndex(msgId);
+    if (idx < 0)
     {
-        elm->_prev = _end;
-        _end->_next = elm;
-        _end = elm;
+        if (_cnt > _maxInflight * 2)
+        {
+            return 0;
+        }
+        idx = msgId & (TOPICIDMAP_SIZE - 1);
+        while (_elements[idx]._used)
+        {
+            idx = (idx + 1) & (TOPICIDMAP_SIZE - 1);
+        }
+        _cnt++;
     }
-    _cnt++;
-    return elm;
+    _elements[idx].set(msgId, topicId, topic);
+    return &_elements[idx];
 }
 
 void TopicIdMap::erase(uint16_t msgId)
 {
-    TopicIdMapElement* p = _first;
-    while (p)
+    int idx = getIndex(msgId);
+    if (idx < 0)
     {
-        if (p->_msgId == msgId)
-        {
-            if (p->_prev == nullptr)
-            {
-                _first = p->_next;
-            }
-            else
-            {
-                p->_prev->_next = p->_next;
-            }
-
-            if (p->_next == nullptr)
-            {
-                _end = p->_prev;
-            }
-            else
-            {
-                p->_next->_prev = p->_prev;
-            }
-            delete p;
-            break;
+        return;
+    }
 
+    /* Shift back following elements of the cluster instead of leaving a tombstone */
+    int hole = idx;
+    int next = (idx + 1) & (TOPICIDMAP_SIZE - 1);
+    while (_elements[next]._used)
+    {
+        int home = _elements[next]._msgId & (TOPICIDMAP_SIZE - 1);
+        if (((next - home) & (TOPICIDMAP_SIZE - 1)) >= ((next - hole) & (TOPICIDMAP_SIZE - 1)))
+        {
+            _elements[hole] = _elements[next];
+            hole = next;
         }
-        p = p->_next;
+        next = (next + 1) & (TOPICIDMAP_SIZE - 1);
     }
+    _elements[hole]._used = 0;
     _cnt--;
 }
 
 void TopicIdMap::clear(void)
 {
-    TopicIdMapElement* p = _first;
-    while (p)
+    for (int i = 0; i < TOPICIDMAP_SIZE; i++)
     {
-        TopicIdMapElement* q = p->_next;
-        delete p;
-        p = q;
+        _elements[i]._used = 0;
     }
-    _first = nullptr;
-    _end = nullptr;
     _cnt = 0;
 }
 
+int TopicIdMap::getCount(void)
+{
+    return _cnt;
+}
+
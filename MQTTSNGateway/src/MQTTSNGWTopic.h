@@ -59,19 +59,23 @@ public:
     ~Topics();
     Topic* add(const MQTTSN_topicid* topicid);
     Topic* add(const char* topicName, uint16_t id = 0);
+    Topic* add(const char* topicName, uint16_t id, MQTTSN_topicTypes type);
     Topic* getTopicByName(const MQTTSN_topicid* topic);
     Topic* getTopicById(const MQTTSN_topicid* topicid);
     Topic* getFirstTopic(void);
     Topic* getNextTopic(Topic* topic);
     Topic* match(const MQTTSN_topicid* topicid);
     void eraseNormal(void);
+    void erase(Topic* topic);
     uint16_t getNextTopicId();
     void print(void);
     uint8_t getCount(void);
+    uint32_t getGeneration(void);
 private:
     uint16_t _nextTopicId;
     Topic* _first;
     uint8_t _cnt;
+    uint32_t _generation;
 };
 
 /*=====================================
@@ -81,20 +85,26 @@ class TopicIdMapElement
 {
     friend class TopicIdMap;
 public:
-    TopicIdMapElement(uint16_t msgId, uint16_t topicId, MQTTSN_topicid* topic);
+    TopicIdMapElement();
     ~TopicIdMapElement();
     MQTTSN_topicTypes getTopicType(void);
     uint16_t getTopicId(void);
 
 private:
+    void set(uint16_t msgId, uint16_t topicId, MQTTSN_topicid* topic);
     uint16_t _msgId;
     uint16_t _topicId;
     uint8_t _wildcard;
+    uint8_t _used;
     MQTTSN_topicTypes _type;
-    TopicIdMapElement* _next;
-    TopicIdMapElement* _prev;
 };
 
+/*=====================================
+ Class TopicIdMap
+
+ Open addressed table (linear probing) of TOPICIDMAP_SIZE slots
+ which is embedded in a Client. No allocation is required.
+ =====================================*/
 class TopicIdMap
 {
 public:
@@ -104,10 +114,10 @@ public:
     TopicIdMapElement* add(uint16_t msgId, uint16_t topicId, MQTTSN_topicid* topic);
     void erase(uint16_t msgId);
     void clear(void);
+    int getCount(void);
 private:
-    uint16_t* _msgIds;
-    TopicIdMapElement* _first;
-    TopicIdMapElement* _end;
+    int getIndex(uint16_t msgId);
+    TopicIdMapElement _elements[TOPICIDMAP_SIZE];
     int _cnt;
     int _maxInflight;
 };
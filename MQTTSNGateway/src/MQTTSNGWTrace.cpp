@@ -0,0 +1,307 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#include "MQTTSNGWTrace.h"
+#include "MQTTSNGWProcess.h"
+#include "MQTTSNGWPacket.h"
+#include "MQTTGWPacket.h"
+#include "MQTTSNGWClient.h"
+#include "Threading.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <atomic>
+
+using namespace MQTTSNGW;
+
+typedef struct
+{
+    TraceFileHeader* header;
+    TraceRecord* records;
+} TraceMap;
+
+/*
+ *  tracePos is the generation of the current file in the upper 32 bits
+ *  and the index of the next record in the lower 32 bits.
+ *  The file of the previous generation is kept mapped until the next rotation
+ *  because a writer may still be writing a record reserved in it.
+ */
+static std::atomic<uint64_t> tracePos { 0 };
+static std::atomic<bool> traceOpen { false };
+static TraceMap traceMaps[2] = { { nullptr, nullptr }, { nullptr, nullptr } };
+static Mutex traceMutex;
+static char* traceFileName = nullptr;
+static uint32_t traceCapacity = 0;
+static int traceGenerations = 0;
+static bool tracePayload = false;
+
+static uint64_t traceTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t traceFileSize(void)
+{
+    return sizeof(TraceFileHeader) + sizeof(TraceRecord) * traceCapacity;
+}
+
+static bool mapFile(TraceMap* map, uint32_t generation)
+{
+    int fd = ::open(traceFileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (ftruncate(fd, traceFileSize()) < 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* addr = mmap(nullptr, traceFileSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+        return false;
+    }
+
+    map->header = (TraceFileHeader*) addr;
+    map->records = (TraceRecord*) (map->header + 1);
+    memcpy(map->header->magic, TRACE_MAGIC, sizeof(map->header->magic));
+    map->header->version = TRACE_VERSION;
+    map->header->recordSize = sizeof(TraceRecord);
+    map->header->capacity = traceCapacity;
+    map->header->generation = generation;
+    map->header->startTime = traceTime();
+    return true;
+}
+
+static void unmapFile(TraceMap* map)
+{
+    if (map->header)
+    {
+        munmap(map->header, traceFileSize());
+        map->header = nullptr;
+        map->records = nullptr;
+    }
+}
+
+/* <file>.1 .. <file>.<generations - 2> are shifted up and <file> becomes <file>.1 */
+static void shiftFiles(void)
+{
+    char from[PATH_MAX];
+    char to[PATH_MAX];
+
+    if (traceGenerations < 2)
+    {
+        unlink(traceFileName);
+        return;
+    }
+    for (int i = traceGenerations - 1; i > 1; i--)
+    {
+        snprintf(from, sizeof(from), "%s.%d", traceFileName, i - 1);
+        snprintf(to, sizeof(to), "%s.%d", traceFileName, i);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", traceFileName);
+    rename(traceFileName, to);
+}
+
+/* Switch to a new file unless another thread has already done it. */
+static void rotate(uint32_t generation)
+{
+    traceMutex.lock();
+    if ((uint32_t) (tracePos.load() >> 32) == generation)
+    {
+        TraceMap* map = &traceMaps[(generation + 1) % 2];
+        unmapFile(map);
+        shiftFiles();
+        if (mapFile(map, generation + 1))
+        {
+            tracePos.store((uint64_t) (generation + 1) << 32);
+        }
+        else
+        {
+            traceOpen = false;
+            WRITELOG("%s PacketTrace can't create %s. Trace is stopped.%s\n", ERRMSG_HEADER, traceFileName, ERRMSG_FOOTER);
+        }
+    }
+    traceMutex.unlock();
+}
+
+static TraceRecord* reserve(void)
+{
+    while (traceOpen.load(std::memory_order_acquire))
+    {
+        uint64_t pos = tracePos.fetch_add(1);
+        uint32_t generation = (uint32_t) (pos >> 32);
+        uint32_t index = (uint32_t) pos;
+
+        if (index < traceCapacity)
+        {
+            return &traceMaps[generation % 2].records[index];
+        }
+        rotate(generation);
+    }
+    return nullptr;
+}
+
+static void setPrefix(TraceRecord* rec, const void* payload, int len)
+{
+    if (tracePayload && payload && len > 0)
+    {
+        rec->prefixLen = len > TRACE_PREFIX_SIZE ? TRACE_PREFIX_SIZE : len;
+        memcpy(rec->prefix, payload, rec->prefixLen);
+    }
+}
+
+/*=====================================
+ Class PacketTrace
+ =====================================*/
+void PacketTrace::open(const char* fileName, int records, int generations, bool payload)
+{
+    if (traceOpen || records <= 0)
+    {
+        return;
+    }
+    traceFileName = strdup(fileName);
+    traceCapacity = records;
+    traceGenerations = generations;
+    tracePayload = payload;
+
+    if (!mapFile(&traceMaps[0], 0))
+    {
+        throw EXCEPTION("PacketTrace can't create a trace file.", errno);
+    }
+    tracePos = 0;
+    traceOpen = true;
+}
+
+/**
+ *  Called after all tasks have stopped.
+ */
+void PacketTrace::close(void)
+{
+    if (!traceOpen.exchange(false))
+    {
+        return;
+    }
+    traceMutex.lock();
+    unmapFile(&traceMaps[0]);
+    unmapFile(&traceMaps[1]);
+    free(traceFileName);
+    traceFileName = nullptr;
+    traceMutex.unlock();
+}
+
+bool PacketTrace::isOpen(void)
+{
+    return traceOpen.load(std::memory_order_relaxed);
+}
+
+void PacketTrace::put(int direction, Client* client, MQTTSNPacket* packet)
+{
+    TraceRecord* rec = reserve();
+    if (rec == nullptr)
+    {
+        return;
+    }
+
+    memset(rec, 0, sizeof(TraceRecord));
+    rec->clientIndex = client ? client->getIndex() : 0;
+    rec->direction = direction;
+    rec->type = packet->getType();
+    rec->length = packet->getPacketLength();
+    rec->msgId = packet->getMsgId();
+    rec->topicId = packet->getTopicId();
+
+    if (tracePayload && packet->getType() == MQTTSN_PUBLISH)
+    {
+        uint8_t dup;
+        int qos;
+        uint8_t retained;
+        uint16_t msgId;
+        MQTTSN_topicid topic;
+        uint8_t* payload;
+        int payloadLen;
+        if (packet->getPUBLISH(&dup, &qos, &retained, &msgId, &topic, &payload, &payloadLen) == 1)
+        {
+            setPrefix(rec, payload, payloadLen);
+        }
+    }
+    /* time is written at last. a record of which time is 0 is not completed. */
+    rec->time = traceTime();
+}
+
+void PacketTrace::put(int direction, Client* client, MQTTGWPacket* packet)
+{
+    TraceRecord* rec = reserve();
+    if (rec == nullptr)
+    {
+        return;
+    }
+
+    memset(rec, 0, sizeof(TraceRecord));
+    rec->clientIndex = client ? client->getIndex() : 0;
+    rec->direction = direction;
+    rec->type = packet->getType();
+    rec->length = packet->getPacketLength();
+
+    if (packet->getType() == PUBLISH)
+    {
+        Publish pub = MQTTPacket_Publish_Initializer;
+        packet->getPUBLISH(&pub);
+        rec->msgId = pub.msgId;
+        setPrefix(rec, pub.payload, pub.payloadlen);
+    }
+    else
+    {
+        rec->msgId = packet->getMsgId();
+    }
+    rec->time = traceTime();
+}
+
+const char* PacketTrace::getTypeName(int direction, int type)
+{
+    if (direction == TRACE_BROKER_RECV || direction == TRACE_BROKER_SEND)
+    {
+        return MQTTGWPacket::getTypeName(type);
+    }
+    return MQTTSNPacket_name(type);
+}
+
+const char* PacketTrace::getDirectionName(int direction)
+{
+    switch (direction)
+    {
+    case TRACE_CLIENT_RECV:
+        return "CLIENT_RECV";
+    case TRACE_CLIENT_SEND:
+        return "CLIENT_SEND";
+    case TRACE_BROKER_RECV:
+        return "BROKER_RECV";
+    case TRACE_BROKER_SEND:
+        return "BROKER_SEND";
+    default:
+        return "UNKNOWN";
+    }
+}
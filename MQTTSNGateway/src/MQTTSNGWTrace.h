@@ -0,0 +1,92 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#ifndef MQTTSNGATEWAY_SRC_MQTTSNGWTRACE_H_
+#define MQTTSNGATEWAY_SRC_MQTTSNGWTRACE_H_
+
+#include "MQTTSNGWDefines.h"
+#include <stdint.h>
+
+namespace MQTTSNGW
+{
+
+#define TRACE_MAGIC          "MQSNTRC"  // magic of a trace file
+#define TRACE_VERSION               (1)  // version of the file format
+#define TRACE_PREFIX_SIZE          (12)  // bytes of the payload kept in a record
+
+/* directions of a traced packet */
+#define TRACE_CLIENT_RECV           (0)  // MQTT-SN packet from a client
+#define TRACE_CLIENT_SEND           (1)  // MQTT-SN packet to a client
+#define TRACE_BROKER_RECV           (2)  // MQTT packet from the broker
+#define TRACE_BROKER_SEND           (3)  // MQTT packet to the broker
+
+/*
+ *  A trace file is a TraceFileHeader followed by fixed size records.
+ *  Records are written in native byte order. A record of which time is 0 is unused.
+ */
+typedef struct
+{
+    char magic[8];          // TRACE_MAGIC
+    uint32_t version;       // TRACE_VERSION
+    uint32_t recordSize;    // sizeof(TraceRecord)
+    uint32_t capacity;      // number of records in the file
+    uint32_t generation;    // sequence number of the file since the gateway started
+    uint64_t startTime;     // micro seconds since the Epoch when the file was created
+    uint8_t reserved[32];
+} TraceFileHeader;
+
+typedef struct
+{
+    uint64_t time;          // micro seconds since the Epoch
+    uint16_t clientIndex;   // Client::getIndex( ), 0 if the client is unknown
+    uint16_t msgId;
+    uint16_t topicId;
+    uint16_t length;        // length of the packet
+    uint8_t direction;      // TRACE_CLIENT_RECV etc.
+    uint8_t type;           // MQTT-SN or MQTT packet type
+    uint8_t prefixLen;      // valid bytes of prefix
+    uint8_t reserved;
+    uint8_t prefix[TRACE_PREFIX_SIZE];  // head of the payload of a PUBLISH
+} TraceRecord;
+
+class Client;
+class MQTTSNPacket;
+class MQTTGWPacket;
+
+/*=====================================
+ Class PacketTrace
+
+ Packets are recorded as fixed size binary records into
+ a memory mapped file. A thread reserves a slot by an atomic
+ counter, so writers never wait each other. When the file is
+ full, it is renamed to <file>.1, older files are shifted up to
+ <file>.<generations - 1>, and a new file is created.
+ MQTT-SNTracedecoder converts files into text or CSV.
+ =====================================*/
+class PacketTrace
+{
+public:
+    static void open(const char* fileName, int records, int generations, bool payload);
+    static void close(void);
+    static bool isOpen(void);
+    static void put(int direction, Client* client, MQTTSNPacket* packet);
+    static void put(int direction, Client* client, MQTTGWPacket* packet);
+    static const char* getTypeName(int direction, int type);
+    static const char* getDirectionName(int direction);
+};
+
+}
+
+#endif /* MQTTSNGATEWAY_SRC_MQTTSNGWTRACE_H_ */
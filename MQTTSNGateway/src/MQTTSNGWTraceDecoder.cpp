@@ -0,0 +1,148 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#include "MQTTSNGWTraceDecoder.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace MQTTSNGW;
+
+/*=====================================
+ Class TraceDecoder
+ =====================================*/
+TraceDecoder::TraceDecoder()
+{
+
+}
+
+TraceDecoder::~TraceDecoder()
+{
+
+}
+
+/**
+ *  MQTT-SNTracedecoder [-c] file ...
+ *  -c : CSV format
+ *  @return -1 if no file is specified.
+ */
+int TraceDecoder::initialize(int argc, char** argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "ch")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            _csv = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c] tracefile ...\n  -c : CSV format\n", argv[0]);
+            return -1;
+        }
+    }
+    _files = argv + optind;
+    _fileCnt = argc - optind;
+    if (_fileCnt == 0)
+    {
+        fprintf(stderr, "Usage: %s [-c] tracefile ...\n  -c : CSV format\n", argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+int TraceDecoder::run(void)
+{
+    int rc = 0;
+
+    if (_csv)
+    {
+        printf("time,direction,client,type,msgId,topicId,length,payload\n");
+    }
+    for (int i = 0; i < _fileCnt; i++)
+    {
+        if (decode(_files[i]) < 0)
+        {
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+int TraceDecoder::decode(const char* fileName)
+{
+    TraceFileHeader hdr;
+    TraceRecord rec;
+
+    FILE* fp = fopen(fileName, "rb");
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "%s can't be opened.\n", fileName);
+        return -1;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0
+            || hdr.version != TRACE_VERSION || hdr.recordSize != sizeof(TraceRecord))
+    {
+        fprintf(stderr, "%s is not a trace file.\n", fileName);
+        fclose(fp);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < hdr.capacity && fread(&rec, sizeof(rec), 1, fp) == 1; i++)
+    {
+        /* unused or incomplete record */
+        if (rec.time == 0)
+        {
+            continue;
+        }
+        print(&rec);
+    }
+    fclose(fp);
+    return 0;
+}
+
+void TraceDecoder::print(TraceRecord* rec)
+{
+    char tbuf[32];
+    char payload[TRACE_PREFIX_SIZE * 2 + 1];
+    struct tm tm;
+
+    time_t sec = rec->time / 1000000;
+    localtime_r(&sec, &tm);
+    strftime(tbuf, sizeof(tbuf), "%Y%m%d %H%M%S", &tm);
+
+    int len = rec->prefixLen > TRACE_PREFIX_SIZE ? TRACE_PREFIX_SIZE : rec->prefixLen;
+    for (int i = 0; i < len; i++)
+    {
+        sprintf(payload + i * 2, "%02X", rec->prefix[i]);
+    }
+    payload[len * 2] = 0;
+
+    if (_csv)
+    {
+        printf("%s.%06u,%s,%u,%s,%u,%u,%u,%s\n", tbuf, (unsigned int) (rec->time % 1000000),
+                PacketTrace::getDirectionName(rec->direction), rec->clientIndex,
+                PacketTrace::getTypeName(rec->direction, rec->type), rec->msgId, rec->topicId, rec->length, payload);
+    }
+    else
+    {
+        printf("%s.%06u %-11s client=%-5u %-12s msgId=%04X topicId=%04X len=%-5u %s\n", tbuf,
+                (unsigned int) (rec->time % 1000000), PacketTrace::getDirectionName(rec->direction), rec->clientIndex,
+                PacketTrace::getTypeName(rec->direction, rec->type), rec->msgId, rec->topicId, rec->length, payload);
+    }
+}
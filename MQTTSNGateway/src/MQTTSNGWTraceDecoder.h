@@ -0,0 +1,49 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+#ifndef MQTTSNGWTRACEDECODER_H_
+#define MQTTSNGWTRACEDECODER_H_
+
+#include "MQTTSNGWTrace.h"
+#include <stdio.h>
+
+namespace MQTTSNGW
+{
+/*=====================================
+ Class TraceDecoder
+
+ Converts packet trace files written by PacketTrace
+ into text or CSV lines on stdout.
+ =====================================*/
+class TraceDecoder
+{
+public:
+    TraceDecoder();
+    ~TraceDecoder();
+    int initialize(int argc, char** argv);
+    int run(void);
+
+private:
+    int decode(const char* fileName);
+    void print(TraceRecord* rec);
+
+    bool _csv { false };
+    char** _files { nullptr };
+    int _fileCnt { 0 };
+};
+
+}
+
+#endif /* MQTTSNGWTRACEDECODER_H_ */
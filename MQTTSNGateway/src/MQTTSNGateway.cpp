@@ -20,6 +20,9 @@
 #include "MQTTSNGWVersion.h"
 #include "MQTTSNGWQoSm1Proxy.h"
 #include "MQTTSNGWClient.h"
+#include "MQTTSNGWBufferPool.h"
+#include "MQTTSNGWTrace.h"
+#include "MQTTSNGWSleepStore.h"
 #include <string.h>
 using namespace MQTTSNGW;
 
@@ -111,6 +114,19 @@ Gateway::~Gateway()
     {
         free(_params.gwPrivatekey);
     }
+    if (_params.traceFileName)
+    {
+        free(_params.traceFileName);
+    }
+    if (_params.sessionFileName)
+    {
+        free(_params.sessionFileName);
+    }
+
+    /* Events refer to clients */
+    _packetEventQue.clear();
+    _brokerSendQue.clear();
+    _clientSendQue.clear();
 
     if (_adapterManager)
     {
@@ -128,7 +144,7 @@ Gateway::~Gateway()
 
 int Gateway::getParam(const char* parameter, char* value)
 {
-    return MultiTaskProcess::getParam(parameter, value);
+    return Process::getParam(parameter, value);
 }
 
 char* Gateway::getClientListFileName(void)
@@ -273,6 +289,20 @@ void Gateway::initialize(int argc, char** argv)
         }
     }
 
+    if (getParam("SharedSubscription", param) == 0)
+    {
+        if (!strcasecmp(param, "YES"))
+        {
+            _params.sharedSubscription = true;
+        }
+    }
+
+    _params.msgIdTableSize = MAX_MESSAGEID_TABLE_SIZE;
+    if (getParam("MessageIdTableSize", param) == 0)
+    {
+        _params.msgIdTableSize = atoi(param);
+    }
+
     if (getParam("Forwarder", param) == 0)
     {
         if (!strcasecmp(param, "YES"))
@@ -300,17 +330,115 @@ void Gateway::initialize(int argc, char** argv)
         _params.rfcommAddr = strdup(param);
     }
 
+    if (getParam("TraceFile", param) == 0)
+    {
+        _params.traceFileName = strdup(param);
+    }
+
+    _params.traceRecords = DEFAULT_TRACE_RECORDS;
+    if (getParam("TraceRecords", param) == 0)
+    {
+        _params.traceRecords = atoi(param);
+    }
+
+    _params.traceGenerations = DEFAULT_TRACE_GENERATIONS;
+    if (getParam("TraceGenerations", param) == 0)
+    {
+        _params.traceGenerations = atoi(param);
+    }
+
+    if (getParam("TracePayload", param) == 0)
+    {
+        if (!strcasecmp(param, "YES"))
+        {
+            _params.tracePayload = true;
+        }
+    }
+
+    _params.sleepStoreSize = DEFAULT_SLEEPSTORE_SIZE;
+    if (getParam("SleepStoreSize", param) == 0)
+    {
+        _params.sleepStoreSize = atoi(param);
+    }
+
+    _params.sleepStoreQuota = DEFAULT_SLEEPSTORE_QUOTA;
+    if (getParam("SleepStoreClientSize", param) == 0)
+    {
+        _params.sleepStoreQuota = atoi(param);
+    }
+    SleepStore::setBudget(_params.sleepStoreSize, _params.sleepStoreQuota);
+
+    if (getParam("SessionFile", param) == 0)
+    {
+        _params.sessionFileName = strdup(param);
+    }
+
+    _params.sessionFileSize = DEFAULT_SESSION_FILE_SIZE;
+    if (getParam("SessionFileSize", param) == 0)
+    {
+        long size = atol(param);
+        if (size <= 0)
+        {
+            WRITELOG("%s SessionFileSize %s is invalid. %d bytes are used.%s\n", ERRMSG_HEADER, param,
+                    DEFAULT_SESSION_FILE_SIZE, ERRMSG_FOOTER);
+        }
+        else if (size < (long) SESSION_FILE_SIZE_MIN)
+        {
+            WRITELOG("%s SessionFileSize %s is too small. %d bytes are used.%s\n", ERRMSG_HEADER, param,
+                    (int) SESSION_FILE_SIZE_MIN, ERRMSG_FOOTER);
+            _params.sessionFileSize = SESSION_FILE_SIZE_MIN;
+        }
+        else
+        {
+            _params.sessionFileSize = size < (long) UINT32_MAX ? (uint32_t) size : UINT32_MAX;
+        }
+    }
+
+    if (getParam("RetainedCacheSize", param) == 0)
+    {
+        _params.retainedCacheSize = atoi(param);
+    }
+
+    _params.retainedCacheTTL = DEFAULT_RETAINED_CACHE_TTL;
+    if (getParam("RetainedCacheTTL", param) == 0)
+    {
+        _params.retainedCacheTTL = atoi(param);
+    }
+    _retainedCache.initialize(_params.retainedCacheSize, _params.retainedCacheTTL);
+
+    if (getParam("SessionResumeTime", param) == 0)
+    {
+        _params.sessionResumeTime = atoi(param);
+    }
+
+    Retransmitter::setWindowSize(_params.maxInflightMsgs);
+
     /*  Setup max PacketEventQue size  */
     _packetEventQue.setMaxSize(_params.maxInflightMsgs * _params.maxClients);
 
+    /*  Setup ClientList and Predefined topics. Adapters take their clients from the pool */
+    _clientList->initialize(_params.aggregatingGw);
+
     /*  Initialize adapters */
-    _adapterManager->initialize(_params.gatewayName, _params.aggregatingGw, _params.forwarder, _params.qosMinus1);
+    _adapterManager->initialize(_params.gatewayName, _params.aggregatingGw, _params.forwarder, _params.qosMinus1,
+            _params.sharedSubscription);
 
-    /*  Setup ClientList and Predefined topics  */
-    _clientList->initialize(_params.aggregatingGw);
+    /*  Restore sessions kept over the restart */
+    if (_params.sessionFileName)
+    {
+        _sessionStore.open(_params.sessionFileName, _params.sessionFileSize);
+        int cnt = _sessionStore.restore(_clientList, _params.clientAuthentication);
+        WRITELOG("%s %d sessions are restored from %s\n", currentDateTime(), cnt, _params.sessionFileName);
+    }
 
     /*  SensorNetwork initialize */
     _sensorNetwork.initialize();
+
+    /*  Open the packet trace */
+    if (_params.traceFileName)
+    {
+        PacketTrace::open(_params.traceFileName, _params.traceRecords, _params.traceGenerations, _params.tracePayload);
+    }
 }
 
 void Gateway::run(void)
@@ -346,10 +474,19 @@ void Gateway::run(void)
     WRITELOG(" DtlsCertsKey: %s\n", _params.gwCertskey);
     WRITELOG(" DtlsPrivKey : %s\n", _params.gwPrivatekey);
 #endif
+    if (_params.traceFileName)
+    {
+        WRITELOG(" TraceFile   : %s\n", _params.traceFileName);
+    }
+    if (_params.sessionFileName)
+    {
+        WRITELOG(" SessionFile : %s\n", _params.sessionFileName);
+    }
     WRITELOG(" Max Clients : %d\n\n", _params.maxClients);
     WRITELOG("%s %s starts running.\n\n", currentDateTime(), _params.gatewayName);
 
     _stopFlg = false;
+    _lightIndicator.open();
 
     /* Run Tasks until CTRL+C entered or Exception occurred */
     MultiTaskProcess::run();
@@ -369,11 +506,37 @@ void Gateway::run(void)
 
     /* wait until all Task stop */
     MultiTaskProcess::waitStop();
-
+    PacketTrace::close();
+    _sessionStore.sync(_clientList);
+    _sessionStore.close();
+    _lightIndicator.close();
+
+    BufferPool::print();
+    SleepStore::print();
+    Retransmitter::print();
+    _retainedCache.print();
     WRITELOG("\n%s MQTT-SN Gateway  stopped.\n\n", currentDateTime());
     _lightIndicator.allLightOff();
 }
 
+/**
+ *  Called on SIGHUP. Client lists are reloaded by the PacketHandleTask
+ *  which owns topics of clients. Gauges of the SleepStore, the Retransmitter and the RetainedCache are written into the log.
+ */
+void Gateway::reload(void)
+{
+    MultiTaskProcess::reload();
+    SleepStore::print();
+    Retransmitter::print();
+    _retainedCache.print();
+    if (_params.clientAuthentication || _params.predefinedTopic)
+    {
+        Event* ev = new Event();
+        ev->setReload();
+        _packetEventQue.post(ev);
+    }
+}
+
 bool Gateway::IsStopping(void)
 {
     return _stopFlg;
@@ -404,6 +567,16 @@ SensorNetwork* Gateway::getSensorNetwork()
     return &_sensorNetwork;
 }
 
+SessionStore* Gateway::getSessionStore()
+{
+    return &_sessionStore;
+}
+
+RetainedCache* Gateway::getRetainedCache()
+{
+    return &_retainedCache;
+}
+
 LightIndicator* Gateway::getLightIndicator()
 {
     return &_lightIndicator;
@@ -437,6 +610,11 @@ EventQue::EventQue()
 }
 
 EventQue::~EventQue()
+{
+    clear();
+}
+
+void EventQue::clear(void)
 {
     _mutex.lock();
     while (_que.size() > 0)
@@ -528,6 +706,11 @@ Event::Event()
 
 Event::~Event()
 {
+    if (_client)
+    {
+        _client->releaseRef();
+    }
+
     if (_sensorNetAddr)
     {
         delete _sensorNetAddr;
@@ -551,28 +734,28 @@ EventType Event::getEventType()
 
 void Event::setClientSendEvent(Client* client, MQTTSNPacket* packet)
 {
-    _client = client;
+    setClient(client);
     _eventType = EtClientSend;
     _mqttSNPacket = packet;
 }
 
 void Event::setBrokerSendEvent(Client* client, MQTTGWPacket* packet)
 {
-    _client = client;
+    setClient(client);
     _eventType = EtBrokerSend;
     _mqttGWPacket = packet;
 }
 
 void Event::setClientRecvEvent(Client* client, MQTTSNPacket* packet)
 {
-    _client = client;
+    setClient(client);
     _eventType = EtClientRecv;
     _mqttSNPacket = packet;
 }
 
 void Event::setBrokerRecvEvent(Client* client, MQTTGWPacket* packet)
 {
-    _client = client;
+    setClient(client);
     _eventType = EtBrokerRecv;
     _mqttGWPacket = packet;
 }
@@ -587,6 +770,11 @@ void Event::setStop(void)
     _eventType = EtStop;
 }
 
+void Event::setReload(void)
+{
+    _eventType = EtReload;
+}
+
 void Event::setBrodcastEvent(MQTTSNPacket* msg)
 {
     _mqttSNPacket = msg;
@@ -605,6 +793,19 @@ Client* Event::getClient(void)
     return _client;
 }
 
+void Event::setClient(Client* client)
+{
+    if (_client)
+    {
+        _client->releaseRef();
+    }
+    _client = client;
+    if (_client)
+    {
+        _client->addRef();
+    }
+}
+
 SensorNetAddress* Event::getSensorNetAddress(void)
 {
     return _sensorNetAddr;
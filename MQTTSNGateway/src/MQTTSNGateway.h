@@ -20,6 +20,8 @@
 #include "MQTTSNGWProcess.h"
 #include "MQTTSNPacket.h"
 #include "MQTTSNGWClient.h"
+#include "MQTTSNGWSessionStore.h"
+#include "MQTTSNGWRetainedCache.h"
 #include "MQTTSNGWProcess.h"
 
 namespace MQTTSNGW
@@ -87,7 +89,8 @@ enum EventType
     EtClientRecv,
     EtClientSend,
     EtBroadcast,
-    EtSensornetSend
+    EtSensornetSend,
+    EtReload
 };
 
 class Event
@@ -103,6 +106,7 @@ public:
     void setBrodcastEvent(MQTTSNPacket*);  // ADVERTISE and GWINFO
     void setTimeout(void);                // Required by EventQue<Event>.timedwait()
     void setStop(void);
+    void setReload(void);                 // clients.conf and predefinedTopic.conf are read again
     void setClientSendEvent(SensorNetAddress*, MQTTSNPacket*);
     Client* getClient(void);
     SensorNetAddress* getSensorNetAddress(void);
@@ -110,6 +114,7 @@ public:
     MQTTGWPacket* getMQTTGWPacket(void);
 
 private:
+    void setClient(Client* client);
     EventType _eventType { Et_NA };
     Client* _client { nullptr };
     SensorNetAddress* _sensorNetAddr { nullptr };
@@ -129,6 +134,7 @@ public:
     Event* timedwait(uint16_t millsec);
     void setMaxSize(uint16_t maxSize);
     void post(Event*);
+    void clear(void);
     int size();
 
 private:
@@ -152,6 +158,7 @@ public:
     uint8_t gatewayId { 0 };
     uint8_t mqttVersion { 0 };
     uint16_t maxInflightMsgs { 0 };
+    int msgIdTableSize { 0 };
     char* gatewayName { nullptr };
     char* brokerName { nullptr };
     char* port { nullptr };
@@ -165,12 +172,24 @@ public:
     bool clientAuthentication { false };
     bool predefinedTopic { false };
     bool aggregatingGw { false };
+    bool sharedSubscription { false };
     bool qosMinus1 { false };
     bool forwarder { false };
     int maxClients {0};
     char* rfcommAddr { nullptr };
     char* gwCertskey { nullptr };
     char* gwPrivatekey { nullptr };
+    char* traceFileName { nullptr };
+    int traceRecords { 0 };
+    int traceGenerations { 0 };
+    bool tracePayload { false };
+    uint32_t sleepStoreSize { 0 };
+    uint32_t sleepStoreQuota { 0 };
+    char* sessionFileName { nullptr };
+    uint32_t sessionFileSize { 0 };
+    uint32_t retainedCacheSize { 0 };
+    uint32_t retainedCacheTTL { 0 };
+    uint32_t sessionResumeTime { 0 };
 };
 
 /*=====================================
@@ -187,6 +206,7 @@ public:
     ~Gateway();
     virtual void initialize(int argc, char** argv);
     void run(void);
+    void reload(void);
 
     EventQue* getPacketEventQue(void);
     EventQue* getClientSendQue(void);
@@ -194,6 +214,8 @@ public:
     ClientList* getClientList(void);
     SensorNetwork* getSensorNetwork(void);
     LightIndicator* getLightIndicator(void);
+    SessionStore* getSessionStore(void);
+    RetainedCache* getRetainedCache(void);
     GatewayParams* getGWParams(void);
     AdapterManager* getAdapterManager(void);
     int getParam(const char* parameter, char* value);
@@ -212,6 +234,8 @@ private:
     EventQue _clientSendQue;
     LightIndicator _lightIndicator;
     SensorNetwork _sensorNetwork;
+    SessionStore _sessionStore;
+    RetainedCache _retainedCache;
 	AdapterManager* _adapterManager;
     Topics* _topics;
     bool _stopFlg;
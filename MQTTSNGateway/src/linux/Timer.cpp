@@ -96,24 +96,80 @@ Class LightIndicator
 LightIndicator::LightIndicator()
 {
 	_greenStatus = false;
+	_blueStatus = false;
+	_enabled = false;
 	for ( int i = 0; i <= MAX_GPIO; i++)
 	{
 		_gpio[i] = 0;
 	}
 	init();
+	setTaskName("LightIndicator");
 }
 
 LightIndicator::~LightIndicator()
 {
+	close();
 	for ( int i = 0; i <= MAX_GPIO; i++)
 	{
 		if ( _gpio[i] )
 		{
-			close( _gpio[i]);
+			::close( _gpio[i]);
 		}
 	}
 }
 
+void LightIndicator::EXECRUN(void)
+{
+	run();
+}
+
+/**
+ *  Start the ticker. The lights are written only by the ticker after this.
+ */
+void LightIndicator::open(void)
+{
+	if ( _enabled && !_running )
+	{
+		_running = true;
+		start();
+	}
+}
+
+void LightIndicator::close(void)
+{
+	if ( _running )
+	{
+		_running = false;
+		stop();
+	}
+}
+
+void LightIndicator::run(void)
+{
+	while ( _running )
+	{
+		usleep(LIGHT_INDICATOR_INTERVAL * 1000);
+		update();
+	}
+	_activity = false;
+	update();
+}
+
+void LightIndicator::update(void)
+{
+	bool active = _activity.exchange(false);
+
+	if ( active != _blueStatus )
+	{
+		_blueStatus = active;
+		lit(LIGHT_INDICATOR_BLUE, active ? "1" : "0");
+	}
+	if ( active && !_greenStatus )
+	{
+		greenLight(true);
+	}
+}
+
 void LightIndicator::greenLight(bool on)
 {
 	if (on)
@@ -137,19 +193,16 @@ void LightIndicator::greenLight(bool on)
 		}
 	}
 }
+
+/**
+ *  Called by tasks for each packet. The blue light is on while packets
+ *  are sent or received and goes off after an interval without them.
+ */
 void LightIndicator::blueLight(bool on)
 {
-	if (on)
-	{
-		lit(LIGHT_INDICATOR_BLUE, "1");
-		if ( !_greenStatus )
-		{
-			greenLight(true);
-		}
-	}
-	else
+	if ( on && _enabled && !_activity.load(std::memory_order_relaxed) )
 	{
-		lit(LIGHT_INDICATOR_BLUE, "0");
+		_activity.store(true, std::memory_order_relaxed);
 	}
 }
 
@@ -171,6 +224,7 @@ void LightIndicator::allLightOff(void)
 	lit(LIGHT_INDICATOR_BLUE, "0");
 	lit(LIGHT_INDICATOR_GREEN, "0");
 	_greenStatus = false;
+	_blueStatus = false;
 }
 
 void LightIndicator::init()
@@ -195,7 +249,7 @@ void LightIndicator::pinMode(int gpioNo)
 	int rc = 0;
 	int fd = rc; // eliminate unused warnning of compiler
 
-	fd = open("/sys/class/gpio/export", O_WRONLY);
+	fd = ::open("/sys/class/gpio/export", O_WRONLY);
 	if ( fd < 0 )
 	{
 		return;
@@ -204,23 +258,24 @@ void LightIndicator::pinMode(int gpioNo)
 
 	sprintf(no,"%d", gpioNo);
 	rc = write(fd, no, strlen(no));
-	close(fd);
+	::close(fd);
 
 	char fileName[64];
 	sprintf( fileName, "/sys/class/gpio/gpio%d/direction", gpioNo);
 
-	fd = open(fileName, O_WRONLY);
+	fd = ::open(fileName, O_WRONLY);
 	if ( fd < 0 )
 	{
 		return;
 	}
 	rc = write(fd,"out", 3);
-	close(fd);
+	::close(fd);
 	sprintf( fileName, "/sys/class/gpio/gpio%d/value", gpioNo);
-	fd = open(fileName, O_WRONLY);
+	fd = ::open(fileName, O_WRONLY);
 	if ( fd > 0 )
 	{
 		_gpio[gpioNo] = fd;
+		_enabled = true;
 	}
 }
 
@@ -18,7 +18,9 @@
 
 #include <stdint.h>
 #include <sys/time.h>
+#include <atomic>
 #include "MQTTSNGWDefines.h"
+#include "Threading.h"
 
 namespace MQTTSNGW
 {
@@ -29,6 +31,7 @@ namespace MQTTSNGW
 #define LIGHT_INDICATOR_GREEN   23    // RPi connector 16
 #define LIGHT_INDICATOR_RED     24    // RPi connector 18
 #define LIGHT_INDICATOR_BLUE    25    // RPi connector 22
+#define LIGHT_INDICATOR_INTERVAL 50   // msecs between updates of the lights
 
 /*============================================
  Timer
@@ -50,12 +53,20 @@ private:
 
 /*=====================================
  Class LightIndicator
+
+ blueLight(true) only latches the activity of packets.
+ A ticker thread samples it every LIGHT_INDICATOR_INTERVAL
+ and writes GPIOs only when a light changes.
+ Nothing runs if no GPIO is available.
  =====================================*/
-class LightIndicator
+class LightIndicator: public Thread
 {
 public:
 	LightIndicator();
 	~LightIndicator();
+	void EXECRUN(void);
+	void open(void);
+	void close(void);
 	void greenLight(bool on);
 	void blueLight(bool on);
 	void redLight(bool on);
@@ -63,9 +74,15 @@ public:
 
 private:
 	void init();
+	void run(void);
+	void update(void);
 	int  lit(int gpioNo, const char* onoff);
 	void pinMode(int gpioNo);
 	bool _greenStatus;
+	bool _blueStatus;
+	bool _enabled;
+	std::atomic<bool> _activity { false };
+	std::atomic<bool> _running { false };
 	int _gpio[MAX_GPIO + 1];
 };
 
@@ -46,8 +46,9 @@ unsigned char cookie_secret[COOKIE_SECRET_LENGTH];
 /*===========================================
  Class  SensorNetAddreess
 
- These 4 methods are minimum requirements for the SensorNetAddress class.
+ These 5 methods are minimum requirements for the SensorNetAddress class.
  isMatch(SensorNetAddress* )
+ hash(void)
  operator =(SensorNetAddress& )
  setAddress(string* )
  sprint(char* )
@@ -211,6 +212,25 @@ bool SensorNetAddress::isMatch(SensorNetAddress *addr)
     return false;
 }
 
+uint32_t SensorNetAddress::hash(void)
+{
+    const uint8_t* p = (const uint8_t*) &_ipAddr.addr.ad4;
+    int len = sizeof(struct in_addr);
+    if (_ipAddr.af == AF_INET6)
+    {
+        p = (const uint8_t*) &_ipAddr.addr.ad6;
+        len = sizeof(struct in6_addr);
+    }
+
+    uint32_t h = 2166136261U;   // FNV-1a
+    for (int i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 16777619U;
+    }
+    return h ^ _portNo;
+}
+
 SensorNetAddress& SensorNetAddress::operator =(SensorNetAddress &addr)
 {
     this->_portNo = addr._portNo;
@@ -476,9 +496,11 @@ void Connections::print(void)
  getDescpription( )  is used by Gateway::initialize( )
  initialize( )       is used by Gateway::initialize( )
  getSenderAddress( ) is used by ClientRecvTask::run( )
+ getReceiverCount( ) is used by main( )
  broadcast( )        is used by MQTTSNPacket::broadcast( )
  unicast( )          is used by MQTTSNPacket::unicast( )
  read( )             is used by MQTTSNPacket::recv( )
+ flush( )            is used by ClientSendTask::run( )
 
  ================================================================*/
 #define DTLS_CLIENTHELLO  22
@@ -570,6 +592,24 @@ int SensorNetwork::broadcast(const uint8_t *payload, uint16_t payloadLength)
     return status;
 }
 
+/* the buffer is received into in place and never exchanged. there is only one receiver. */
+int SensorNetwork::read(uint8_t** buf, SensorNetAddress* sender, int index)
+{
+    int rc = read(*buf, MQTTSNGW_MAX_PACKET_SIZE);
+    *sender = _senderAddr;
+    return rc;
+}
+
+int SensorNetwork::getReceiverCount(void)
+{
+    return 1;
+}
+
+int SensorNetwork::flush(void)
+{
+    return 0;
+}
+
 int SensorNetwork::read(uint8_t *buf, uint16_t bufLen)
 {
     int optval;
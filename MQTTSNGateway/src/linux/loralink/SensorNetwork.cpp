@@ -79,6 +79,11 @@ bool SensorNetAddress::isMatch(SensorNetAddress* addr)
 	return _devAddr == addr->_devAddr;
 }
 
+uint32_t SensorNetAddress::hash(void)
+{
+	return _devAddr;
+}
+
 SensorNetAddress& SensorNetAddress::operator =(SensorNetAddress& addr)
 {
 	_devAddr =  addr._devAddr;
@@ -114,6 +119,24 @@ int SensorNetwork::broadcast(const uint8_t* payload, uint16_t payloadLength)
 	return LoRaLink::broadcast(payload, payloadLength);
 }
 
+/* the buffer is received into in place and never exchanged. there is only one receiver. */
+int SensorNetwork::read(uint8_t** buf, SensorNetAddress* sender, int index)
+{
+	int rc = read(*buf, MQTTSNGW_MAX_PACKET_SIZE);
+	*sender = _clientAddr;
+	return rc;
+}
+
+int SensorNetwork::getReceiverCount(void)
+{
+	return 1;
+}
+
+int SensorNetwork::flush(void)
+{
+	return 0;
+}
+
 int SensorNetwork::read(uint8_t* buf, uint16_t bufLen)
 {
 	return LoRaLink::recv(buf, bufLen, &_clientAddr);
@@ -32,8 +32,9 @@ using namespace MQTTSNGW;
 /*===========================================
  * Class  SensorNetAddreess
 
- * These 4 methods are minimum requirements for the SensorNetAddress class.
+ * These 5 methods are minimum requirements for the SensorNetAddress class.
  * isMatch(SensorNetAddress* )
+ * hash(void)
  * operator =(SensorNetAddress& )
  * setAddress(string* )
  * sprint(char* )
@@ -120,6 +121,17 @@ bool SensorNetAddress::isMatch(SensorNetAddress* addr)
     return ((this->_channel == addr->_channel) && bacmp(&this->_bdAddr, &addr->_bdAddr) == 0);
 }
 
+uint32_t SensorNetAddress::hash(void)
+{
+	uint32_t h = 2166136261U;   // FNV-1a
+	for (int i = 0; i < 6; i++)
+	{
+		h ^= _bdAddr.b[i];
+		h *= 16777619U;
+	}
+	return h ^ _channel;
+}
+
 SensorNetAddress& SensorNetAddress::operator =(SensorNetAddress& addr)
 {
     this->_channel = addr._channel;
@@ -140,9 +152,11 @@ char* SensorNetAddress::sprint(char* buf)
  getDescpription( )  is used by Gateway::initialize( )
  initialize( )       is used by Gateway::initialize( )
  getSenderAddress( ) is used by ClientRecvTask::run( )
+ getReceiverCount( ) is used by main( )
  broadcast( )        is used by MQTTSNPacket::broadcast( )
  unicast( )          is used by MQTTSNPacket::unicast( )
  read( )             is used by MQTTSNPacket::recv( )
+ flush( )            is used by ClientSendTask::run( )
 
  ================================================================*/
 
@@ -187,6 +201,24 @@ int SensorNetwork::broadcast(const uint8_t* payload, uint16_t payloadLength)
     return rc;
 }
 
+/* the buffer is received into in place and never exchanged. there is only one receiver. */
+int SensorNetwork::read(uint8_t** buf, SensorNetAddress* sender, int index)
+{
+    int rc = read(*buf, MQTTSNGW_MAX_PACKET_SIZE);
+    *sender = _senderAddr;
+    return rc;
+}
+
+int SensorNetwork::getReceiverCount(void)
+{
+    return 1;
+}
+
+int SensorNetwork::flush(void)
+{
+    return 0;
+}
+
 int SensorNetwork::read(uint8_t* buf, uint16_t bufLen)
 {
     struct timeval timeout;
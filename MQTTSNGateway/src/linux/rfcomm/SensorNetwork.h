@@ -41,6 +41,7 @@ public:
 	uint16_t getPortNo(void);
     bdaddr_t* getAddress(void);
 	bool isMatch(SensorNetAddress* addr);
+	uint32_t hash(void);
 	SensorNetAddress& operator =(SensorNetAddress& addr);
 	char* sprint(char* buf);
 private:
@@ -83,9 +84,12 @@ public:
     int unicast(const uint8_t* payload, uint16_t payloadLength, SensorNetAddress* sendto);
 	int broadcast(const uint8_t* payload, uint16_t payloadLength);
 	int read(uint8_t* buf, uint16_t bufLen);
+	int read(uint8_t** buf, SensorNetAddress* sender, int index);
+	int flush(void);
 	void initialize(void);
 	const char* getDescription(void);
 	SensorNetAddress* getSenderAddress(void);
+	int getReceiverCount(void);
 
 private:
     // sockets for RFCOMM
@@ -29,6 +29,7 @@
 #include <poll.h>
 #include "SensorNetwork.h"
 #include "MQTTSNGWProcess.h"
+#include "MQTTSNGWBufferPool.h"
 
 using namespace std;
 using namespace MQTTSNGW;
@@ -36,8 +37,9 @@ using namespace MQTTSNGW;
 /*===========================================
   Class  SensorNetAddreess
 
-  These 4 methods are minimum requirements for the SensorNetAddress class.
+  These 5 methods are minimum requirements for the SensorNetAddress class.
    isMatch(SensorNetAddress* )
+   hash(void)
    operator =(SensorNetAddress& )
    setAddress(string* )
    sprint(char* )
@@ -121,6 +123,12 @@ bool SensorNetAddress::isMatch(SensorNetAddress* addr)
 	return ((this->_portNo == addr->_portNo) && (this->_IpAddr == addr->_IpAddr));
 }
 
+uint32_t SensorNetAddress::hash(void)
+{
+	uint32_t h = (_IpAddr ^ _portNo) * 2654435761U;
+	return h ^ (h >> 16);
+}
+
 SensorNetAddress& SensorNetAddress::operator =(SensorNetAddress& addr)
 {
 	this->_portNo = addr._portNo;
@@ -146,10 +154,11 @@ char* SensorNetAddress::sprint(char* buf)
 
    getDescpription( )  is used by Gateway::initialize( )
  initialize( )       is used by Gateway::initialize( )
-   getSenderAddress( ) is used by ClientRecvTask::run( )
+   getReceiverCount( ) is used by main( )
    broadcast( )        is used by MQTTSNPacket::broadcast( )
    unicast( )          is used by MQTTSNPacket::unicast( )
    read( )             is used by MQTTSNPacket::recv( )
+   flush( )            is used by ClientSendTask::run( )
 
  ================================================================*/
 
@@ -171,9 +180,19 @@ int SensorNetwork::broadcast(const uint8_t* payload, uint16_t payloadLength)
 	return UDPPort::broadcast(payload, payloadLength);
 }
 
-int SensorNetwork::read(uint8_t* buf, uint16_t bufLen)
+/**
+ *  *buf is a BufferPool buffer of MQTTSNGW_MAX_PACKET_SIZE bytes.
+ *  It is exchanged for the buffer which a datagram was received into.
+ *  index is the receiver of the calling ClientRecvTask.
+ */
+int SensorNetwork::read(uint8_t** buf, SensorNetAddress* sender, int index)
+{
+	return UDPPort::recv(buf, sender, index);
+}
+
+int SensorNetwork::flush(void)
 {
-	return UDPPort::recv(buf, bufLen, &_senderAddr);
+	return UDPPort::flush();
 }
 
 /**
@@ -188,6 +207,8 @@ void SensorNetwork::initialize(void)
 	uint16_t unicastPortNo = 0;
 	string ip;
 	unsigned int ttl = 1;
+	int batchSize = DEFAULT_DATAGRAM_BATCH_SIZE;
+	int sockets = 1;
 	/*
 	 * theProcess->getParam( ) copies
 	 * a text specified by "Key" into param[] from the Gateway.conf
@@ -198,6 +219,8 @@ void SensorNetwork::initialize(void)
      *  GatewayPortNo=10000
      *  MulticastIP=225.1.1.1
      *  MulticastPortNo=1883
+     *  DatagramBatchSize=16
+     *  ReceiveSockets=1
      *
      */
     if (theProcess->getParam("MulticastIP", param) == 0)
@@ -224,10 +247,37 @@ void SensorNetwork::initialize(void)
         _description += ", TTL:";
         _description += param;
     }
+    if (theProcess->getParam("DatagramBatchSize", param) == 0)
+    {
+        batchSize = atoi(param);
+        if (batchSize < 1 || batchSize > MAX_DATAGRAM_BATCH_SIZE)
+        {
+            throw EXCEPTION("DatagramBatchSize is out of range", 0);
+        }
+    }
+    if (theProcess->getParam("ReceiveSockets", param) == 0)
+    {
+        /* 0 : a socket per online CPU */
+        sockets = atoi(param);
+        if (sockets == 0)
+        {
+            sockets = sysconf(_SC_NPROCESSORS_ONLN);
+            if (sockets > MAX_RECEIVE_SOCKETS)
+            {
+                sockets = MAX_RECEIVE_SOCKETS;
+            }
+        }
+        if (sockets < 1 || sockets > MAX_RECEIVE_SOCKETS)
+        {
+            throw EXCEPTION("ReceiveSockets is out of range", 0);
+        }
+        _description += ", Sockets:";
+        _description += to_string(sockets);
+    }
 
     /*  setup UDP sockets */
 	errno = 0;
-	if ( UDPPort::open(ip.c_str(), multicastPortNo, unicastPortNo, ttl) < 0 )
+	if ( UDPPort::open(ip.c_str(), multicastPortNo, unicastPortNo, ttl, batchSize, sockets) < 0 )
 	{
 		throw EXCEPTION("Can't open a UDP", errno);
 	}
@@ -238,9 +288,9 @@ const char* SensorNetwork::getDescription(void)
 	return _description.c_str();
 }
 
-SensorNetAddress* SensorNetwork::getSenderAddress(void)
+int SensorNetwork::getReceiverCount(void)
 {
-	return &_senderAddr;
+	return UDPPort::getReceiverCount();
 }
 
 /*=========================================
@@ -250,27 +300,36 @@ SensorNetAddress* SensorNetwork::getSenderAddress(void)
 UDPPort::UDPPort()
 {
 	_disconReq = false;
-    memset(_pollFds, 0, sizeof(_pollFds));
 }
 
 UDPPort::~UDPPort()
 {
 	close();
+	clearBatch();
 }
 
 void UDPPort::close(void)
 {
-    for (int i = 0; i < 2; i++)
+    for (int i = 0; i < _receiverCnt; i++)
     {
-        if (_pollFds[i].fd > 0)
+        for (int j = 0; j < 2; j++)
         {
-            ::close(_pollFds[i].fd);
-            _pollFds[i].fd = 0;
+            if (_receivers[i]._pollFds[j].fd > 0)
+            {
+                ::close(_receivers[i]._pollFds[j].fd);
+                _receivers[i]._pollFds[j].fd = 0;
+            }
         }
     }
 }
 
-int UDPPort::open(const char *multicastIP, uint16_t multiPortNo, uint16_t uniPortNo, unsigned int ttl)
+/**
+ *  Open unicast sockets and a multicast socket.
+ *  When sockets > 1, unicast sockets are bound to the same port with SO_REUSEPORT.
+ *  The kernel hashes the source address of a datagram to select a socket,
+ *  so datagrams of a client are always received by the same ClientRecvTask.
+ */
+int UDPPort::open(const char *multicastIP, uint16_t multiPortNo, uint16_t uniPortNo, unsigned int ttl, int batchSize, int sockets)
 {
     int optval = 0;
     int sock = 0;
@@ -281,27 +340,51 @@ int UDPPort::open(const char *multicastIP, uint16_t multiPortNo, uint16_t uniPor
         return -1;
     }
 
-    /*------ Create unicast socket --------*/
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0)
+    close();
+    clearBatch();
+    _receivers = new UDPReceiver[sockets];
+    _receiverCnt = sockets;
+
+    /*------ Create unicast sockets --------*/
+    for (int i = 0; i < sockets; i++)
     {
-        D_NWSTACK("error can't create unicast socket in UDPPort::open\n");
-        return -1;
-    }
+        sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock < 0)
+        {
+            D_NWSTACK("error can't create unicast socket in UDPPort::open\n");
+            close();
+            return -1;
+        }
+        _receivers[i]._pollFds[0].fd = sock;
+        _receivers[i]._pollFds[0].events = POLLIN;
+        _receivers[i]._pollCnt = 1;
 
-    sockaddr_in addru;
-    addru.sin_family = AF_INET;
-    addru.sin_port = htons(uniPortNo);
-    addru.sin_addr.s_addr = INADDR_ANY;
+        optval = 1;
+        if (sockets > 1 && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0)
+        {
+            D_NWSTACK("error SO_REUSEPORT in UDPPort::open\n");
+            close();
+            return -1;
+        }
 
-    if (::bind(sock, (sockaddr*) &addru, sizeof(addru)) < 0)
-	{
-		D_NWSTACK("error can't bind unicast socket in UDPPort::open\n");
-		return -1;
-	}
+        sockaddr_in addru;
+        addru.sin_family = AF_INET;
+        addru.sin_port = htons(uniPortNo);
+        addru.sin_addr.s_addr = INADDR_ANY;
+
+        if (::bind(sock, (sockaddr*) &addru, sizeof(addru)) < 0)
+        {
+            D_NWSTACK("error can't bind unicast socket in UDPPort::open\n");
+            close();
+            return -1;
+        }
 
-    _pollFds[0].fd = sock;
-    _pollFds[0].events = POLLIN;
+        if (_receivers[i].initialize(batchSize) < 0)
+        {
+            close();
+            return -1;
+        }
+    }
 
     /*------ Create Multicast socket --------*/
     sock = socket(AF_INET, SOCK_DGRAM, 0);
@@ -359,12 +442,55 @@ int UDPPort::open(const char *multicastIP, uint16_t multiPortNo, uint16_t uniPor
     }
 
     _multicastAddr.setAddress(inet_addr(multicastIP), htons(multiPortNo));
-    _pollFds[1].fd = sock;
-    _pollFds[1].events = POLLIN;
-
+    _receivers[0]._pollFds[1].fd = sock;
+    _receivers[0]._pollFds[1].events = POLLIN;
+    _receivers[0]._pollCnt = 2;
+
+    /*------ Prepare buffers for sendmmsg --------*/
+    _batchSize = batchSize;
+    _sendMsgs = new mmsghdr[batchSize];
+    _sendIov = new iovec[batchSize];
+    _sendAddrs = new sockaddr_in[batchSize];
+    _sendBufs = new uint8_t[batchSize * MQTTSNGW_MAX_PACKET_SIZE];
+    memset(_sendMsgs, 0, sizeof(mmsghdr) * batchSize);
+
+    for (int i = 0; i < batchSize; i++)
+    {
+        _sendIov[i].iov_base = _sendBufs + i * MQTTSNGW_MAX_PACKET_SIZE;
+        _sendMsgs[i].msg_hdr.msg_name = &_sendAddrs[i];
+        _sendMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        _sendMsgs[i].msg_hdr.msg_iov = &_sendIov[i];
+        _sendMsgs[i].msg_hdr.msg_iovlen = 1;
+    }
     return 0;
 }
 
+void UDPPort::clearBatch(void)
+{
+    delete[] _receivers;
+    delete[] _sendMsgs;
+    delete[] _sendIov;
+    delete[] _sendAddrs;
+    delete[] _sendBufs;
+    _receivers = nullptr;
+    _sendMsgs = nullptr;
+    _sendIov = nullptr;
+    _sendAddrs = nullptr;
+    _sendBufs = nullptr;
+    _receiverCnt = 0;
+    _batchSize = 0;
+    _sendCnt = 0;
+}
+
+int UDPPort::getReceiverCount(void)
+{
+    return _receiverCnt;
+}
+
+/*
+ *  Datagrams are sent from the first unicast socket.
+ *  A reply has the same source port as any other socket has.
+ */
 int UDPPort::unicast(const uint8_t* buf, uint32_t length, SensorNetAddress* addr)
 {
     sockaddr_in dest;
@@ -372,7 +498,26 @@ int UDPPort::unicast(const uint8_t* buf, uint32_t length, SensorNetAddress* addr
     dest.sin_port = addr->getPortNo();
     dest.sin_addr.s_addr = addr->getIpAddress();
 
-    int status = ::sendto(_pollFds[0].fd, buf, length, 0, (const sockaddr*) &dest, sizeof(dest));
+    if (_batchSize > 1 && length <= MQTTSNGW_MAX_PACKET_SIZE)
+    {
+        /* queued until flush( ) */
+        int i = _sendCnt++;
+        memcpy(_sendIov[i].iov_base, buf, length);
+        _sendIov[i].iov_len = length;
+        _sendAddrs[i] = dest;
+        D_NWSTACK("queue %s:%u length = %d\n", inet_ntoa(dest.sin_addr), ntohs(dest.sin_port), length);
+        if (_sendCnt == _batchSize)
+        {
+            return flush() < 0 ? -1 : length;
+        }
+        return length;
+    }
+
+    if (flush() < 0)
+    {
+        return -1;
+    }
+    int status = ::sendto(_receivers[0]._pollFds[0].fd, buf, length, 0, (const sockaddr*) &dest, sizeof(dest));
     if (status < 0)
     {
         D_NWSTACK("errno == %d in UDPPort::sendto\n", errno);
@@ -387,47 +532,157 @@ int UDPPort::broadcast(const uint8_t* buf, uint32_t length)
 	return unicast(buf, length, &_multicastAddr);
 }
 
-int UDPPort::recv(uint8_t* buf, uint16_t len, SensorNetAddress* addr)
+/**
+ *  Send datagrams queued by unicast( ) with sendmmsg( ).
+ *  A datagram which can't be sent is dropped and -1 is returned.
+ */
+int UDPPort::flush(void)
 {
     int rc = 0;
-    poll(_pollFds, 2, 2000);  // Timeout 2 seconds
+    int pos = 0;
+    while (pos < _sendCnt)
+    {
+        int cnt = ::sendmmsg(_receivers[0]._pollFds[0].fd, _sendMsgs + pos, _sendCnt - pos, 0);
+        if (cnt < 0)
+        {
+            D_NWSTACK("errno == %d in UDPPort::sendmmsg\n", errno);
+            cnt = 1;
+            rc = -1;
+        }
+        pos += cnt;
+    }
+    _sendCnt = 0;
+    return rc;
+}
+
+int UDPPort::recv(uint8_t** buf, SensorNetAddress* addr, int index)
+{
+    return _receivers[index].recv(buf, addr);
+}
 
-    if (_pollFds[0].revents == POLLIN)
+/*=========================================
+ Class UDPReceiver
+ =========================================*/
+UDPReceiver::UDPReceiver()
+{
+    memset(_pollFds, 0, sizeof(_pollFds));
+}
+
+UDPReceiver::~UDPReceiver()
+{
+    clear();
+}
+
+int UDPReceiver::initialize(int batchSize)
+{
+    clear();
+    _batchSize = batchSize;
+    _msgs = new mmsghdr[batchSize];
+    _iov = new iovec[batchSize];
+    _addrs = new sockaddr_in[batchSize];
+    _bufs = new uint8_t*[batchSize]();
+    memset(_msgs, 0, sizeof(mmsghdr) * batchSize);
+
+    for (int i = 0; i < batchSize; i++)
     {
-        rc = recvfrom(_pollFds[0].fd, buf, len, 0, addr);
+        _bufs[i] = BufferPool::allocate(MQTTSNGW_MAX_PACKET_SIZE);
+        if (_bufs[i] == nullptr)
+        {
+            return -1;
+        }
+        _msgs[i].msg_hdr.msg_name = &_addrs[i];
+        _msgs[i].msg_hdr.msg_iov = &_iov[i];
+        _msgs[i].msg_hdr.msg_iovlen = 1;
     }
-    else if (_pollFds[1].revents == POLLIN)
+    return 0;
+}
+
+void UDPReceiver::clear(void)
+{
+    for (int i = 0; i < _batchSize; i++)
     {
-        rc = recvfrom(_pollFds[1].fd, buf, len, 0, addr);
+        BufferPool::release(_bufs[i]);
     }
-    return rc;
+    delete[] _msgs;
+    delete[] _iov;
+    delete[] _addrs;
+    delete[] _bufs;
+    _msgs = nullptr;
+    _iov = nullptr;
+    _addrs = nullptr;
+    _bufs = nullptr;
+    _batchSize = 0;
+    _cnt = 0;
+    _pos = 0;
 }
 
-int UDPPort::recvfrom(int sockfd, uint8_t* buf, uint16_t len, uint8_t flags, SensorNetAddress* addr)
+int UDPReceiver::recv(uint8_t** buf, SensorNetAddress* addr)
 {
-    sockaddr_in sender;
-    socklen_t addrlen = sizeof(sender);
-    memset(&sender, 0, addrlen);
+    if (_pos == _cnt)
+    {
+        int rc = 0;
+        _pos = 0;
+        _cnt = 0;
+        poll(_pollFds, _pollCnt, 2000);  // Timeout 2 seconds
+
+        if (_pollFds[0].revents == POLLIN)
+        {
+            rc = recvBatch(_pollFds[0].fd);
+        }
+        else if (_pollCnt > 1 && _pollFds[1].revents == POLLIN)
+        {
+            rc = recvBatch(_pollFds[1].fd);
+        }
+        if (rc <= 0)
+        {
+            return rc;
+        }
+        _cnt = rc;
+    }
 
-    int status = ::recvfrom(sockfd, buf, len, flags, (sockaddr*) &sender, &addrlen);
+    /* hand over the received buffer and keep the caller's one for the next recvmmsg( ) */
+    int pos = _pos++;
+    uint8_t* data = _bufs[pos];
+    _bufs[pos] = *buf;
+    *buf = data;
+    addr->setAddress(_addrs[pos].sin_addr.s_addr, _addrs[pos].sin_port);
+    return _msgs[pos].msg_len;
+}
 
-    if (status < 0 && errno != EAGAIN)
+int UDPReceiver::recvBatch(int sockfd)
+{
+    for (int i = 0; i < _batchSize; i++)
     {
-        D_NWSTACK("errno == %d in UDPPort::recvfrom\n", errno);
+        _iov[i].iov_base = _bufs[i];
+        _iov[i].iov_len = MQTTSNGW_MAX_PACKET_SIZE;
+        _msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+
+    int cnt = ::recvmmsg(sockfd, _msgs, _batchSize, MSG_DONTWAIT, nullptr);
+    if (cnt < 0)
+    {
+        if (errno == EAGAIN)
+        {
+            return 0;
+        }
+        D_NWSTACK("errno == %d in UDPPort::recvmmsg\n", errno);
         return -1;
     }
-    addr->setAddress(sender.sin_addr.s_addr, sender.sin_port);
-    D_NWSTACK("recved from %s:%d length = %d\n", inet_ntoa(sender.sin_addr),ntohs(sender.sin_port), status);
-    
-    if (buf[1]==0x04)
+
+    for (int i = 0; i < cnt; i++)
     {
-		if (buf[5]==0) 
-		{
-		   buf[5]=120; // COT DEFAULT	
-		}
-        D_NWSTACK("XXX3 %02X %02X \n", buf[1],buf[5]);
+        uint8_t* buf = _bufs[i];
+        D_NWSTACK("recved from %s:%d length = %d\n", inet_ntoa(_addrs[i].sin_addr), ntohs(_addrs[i].sin_port),
+                _msgs[i].msg_len);
+
+        if (_msgs[i].msg_len > 5 && buf[1] == 0x04)
+        {
+            if (buf[5] == 0)
+            {
+                buf[5] = 120; // COT DEFAULT
+            }
+            D_NWSTACK("XXX3 %02X %02X \n", buf[1], buf[5]);
+        }
     }
-    D_NWSTACK("XXX2 %02X %02X \n", buf[1],buf[5]);
-    return status;
+    return cnt;
 }
-
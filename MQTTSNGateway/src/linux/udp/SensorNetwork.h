@@ -20,6 +20,8 @@
 #include "MQTTSNGWDefines.h"
 #include <string>
 #include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 using namespace std;
 
@@ -39,6 +41,7 @@ public:
 	uint16_t getPortNo(void);
 	uint32_t getIpAddress(void);
 	bool isMatch(SensorNetAddress* addr);
+	uint32_t hash(void);
 	SensorNetAddress& operator =(SensorNetAddress& addr);
 	char* sprint(char* buf);
 private:
@@ -46,6 +49,36 @@ private:
 	uint32_t _IpAddr;
 };
 
+/*========================================
+ Class UDPReceiver
+
+ A unicast socket and datagrams received from it by recvmmsg( ).
+ Each receiver is read by its own ClientRecvTask.
+ =======================================*/
+class UDPReceiver
+{
+	friend class UDPPort;
+public:
+	UDPReceiver();
+	~UDPReceiver();
+
+private:
+	int initialize(int batchSize);
+	void clear(void);
+	int recv(uint8_t** buf, SensorNetAddress* addr);
+	int recvBatch(int sockfd);
+
+	pollfd _pollFds[2];     // unicast socket and the multicast socket of the first receiver
+	int _pollCnt { 0 };
+	int _batchSize { 0 };
+	mmsghdr* _msgs { nullptr };
+	iovec* _iov { nullptr };
+	sockaddr_in* _addrs { nullptr };
+	uint8_t** _bufs { nullptr };
+	int _cnt { 0 };
+	int _pos { 0 };
+};
+
 /*========================================
  Class UpdPort
  =======================================*/
@@ -55,19 +88,32 @@ public:
 	UDPPort();
 	virtual ~UDPPort();
 
-	int open(const char* ipAddress, uint16_t multiPortNo,	uint16_t uniPortNo, unsigned int hops);
+	int open(const char* ipAddress, uint16_t multiPortNo,	uint16_t uniPortNo, unsigned int hops, int batchSize, int sockets);
 	void close(void);
 	int unicast(const uint8_t* buf, uint32_t length, SensorNetAddress* sendToAddr);
 	int broadcast(const uint8_t* buf, uint32_t length);
-	int recv(uint8_t* buf, uint16_t len, SensorNetAddress* addr);
+	int recv(uint8_t** buf, SensorNetAddress* addr, int index);
+	int flush(void);
+	int getReceiverCount(void);
 
 private:
 	void setNonBlocking(const bool);
-	int recvfrom(int sockfd, uint8_t* buf, uint16_t len, uint8_t flags,	SensorNetAddress* addr);
+	void clearBatch(void);
 
-    pollfd _pollFds[2];
 	bool _disconReq;
     SensorNetAddress _multicastAddr;
+
+    /* unicast sockets bound to the same port by SO_REUSEPORT */
+    UDPReceiver* _receivers { nullptr };
+    int _receiverCnt { 0 };
+
+    /* datagrams queued for sendmmsg( ) */
+    int _batchSize { 0 };
+    mmsghdr* _sendMsgs { nullptr };
+    iovec* _sendIov { nullptr };
+    sockaddr_in* _sendAddrs { nullptr };
+    uint8_t* _sendBufs { nullptr };
+    int _sendCnt { 0 };
 };
 
 /*===========================================
@@ -81,13 +127,13 @@ public:
 
 	int unicast(const uint8_t* payload, uint16_t payloadLength, SensorNetAddress* sendto);
 	int broadcast(const uint8_t* payload, uint16_t payloadLength);
-	int read(uint8_t* buf, uint16_t bufLen);
+	int read(uint8_t** buf, SensorNetAddress* sender, int index);
+	int flush(void);
 	void initialize(void);
 	const char* getDescription(void);
-	SensorNetAddress* getSenderAddress(void);
+	int getReceiverCount(void);
 
 private:
-	SensorNetAddress _senderAddr;
 	string _description;
 };
 
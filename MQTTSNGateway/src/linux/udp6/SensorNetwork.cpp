@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include "SensorNetwork.h"
 #include "MQTTSNGWProcess.h"
+#include "MQTTSNGWBufferPool.h"
 
 //using namespace std;
 using namespace MQTTSNGW;
@@ -126,6 +127,17 @@ bool SensorNetAddress::isMatch(SensorNetAddress* addr)
                     sizeof(this->_IpAddr.sin6_addr.s6_addr)) == 0);
 }
 
+uint32_t SensorNetAddress::hash(void)
+{
+    uint32_t h = 2166136261U;   // FNV-1a
+    for (int i = 0; i < (int) sizeof(_IpAddr.sin6_addr.s6_addr); i++)
+    {
+        h ^= _IpAddr.sin6_addr.s6_addr[i];
+        h *= 16777619U;
+    }
+    return h ^ _IpAddr.sin6_port;
+}
+
 SensorNetAddress& SensorNetAddress::operator =(SensorNetAddress& addr)
 {
     memcpy(&this->_IpAddr, &addr._IpAddr, sizeof(this->_IpAddr));
@@ -161,9 +173,19 @@ int SensorNetwork::broadcast(const uint8_t* payload, uint16_t payloadLength)
     return UDPPort6::broadcast(payload, payloadLength);
 }
 
-int SensorNetwork::read(uint8_t* buf, uint16_t bufLen)
+/**
+ *  *buf is a BufferPool buffer of MQTTSNGW_MAX_PACKET_SIZE bytes.
+ *  It is exchanged for the buffer which a datagram was received into.
+ *  index is the receiver of the calling ClientRecvTask.
+ */
+int SensorNetwork::read(uint8_t** buf, SensorNetAddress* sender, int index)
 {
-    return UDPPort6::recv(buf, bufLen, &_clientAddr);
+    return UDPPort6::recv(buf, sender, index);
+}
+
+int SensorNetwork::flush(void)
+{
+    return UDPPort6::flush();
 }
 
 void SensorNetwork::initialize(void)
@@ -175,6 +197,8 @@ void SensorNetwork::initialize(void)
     string multicast;
     string interface;
     uint32_t hops = 1;
+    int batchSize = DEFAULT_DATAGRAM_BATCH_SIZE;
+    int sockets = 1;
 
     if (theProcess->getParam("MulticastIPv6", param) == 0)
     {
@@ -206,8 +230,35 @@ void SensorNetwork::initialize(void)
         _description += ", Hops:";
         _description += param;
     }
+    if (theProcess->getParam("DatagramBatchSize", param) == 0)
+    {
+        batchSize = atoi(param);
+        if (batchSize < 1 || batchSize > MAX_DATAGRAM_BATCH_SIZE)
+        {
+            throw EXCEPTION("DatagramBatchSize is out of range", 0);
+        }
+    }
+    if (theProcess->getParam("ReceiveSockets", param) == 0)
+    {
+        /* 0 : a socket per online CPU */
+        sockets = atoi(param);
+        if (sockets == 0)
+        {
+            sockets = sysconf(_SC_NPROCESSORS_ONLN);
+            if (sockets > MAX_RECEIVE_SOCKETS)
+            {
+                sockets = MAX_RECEIVE_SOCKETS;
+            }
+        }
+        if (sockets < 1 || sockets > MAX_RECEIVE_SOCKETS)
+        {
+            throw EXCEPTION("ReceiveSockets is out of range", 0);
+        }
+        _description += ", Sockets:";
+        _description += to_string(sockets);
+    }
 
-    if (UDPPort6::open(unicastPortNo, multicastPortNo, multicast.c_str(), interface.c_str(), hops) < 0)
+    if (UDPPort6::open(unicastPortNo, multicastPortNo, multicast.c_str(), interface.c_str(), hops, batchSize, sockets) < 0)
     {
         throw EXCEPTION("Can't open a UDP6", errno);
     }
@@ -218,9 +269,9 @@ const char* SensorNetwork::getDescription(void)
     return _description.c_str();
 }
 
-SensorNetAddress* SensorNetwork::getSenderAddress(void)
+int SensorNetwork::getReceiverCount(void)
 {
-    return &_clientAddr;
+    return UDPPort6::getReceiverCount();
 }
 
 /*=========================================
@@ -236,22 +287,31 @@ UDPPort6::UDPPort6()
 UDPPort6::~UDPPort6()
 {
     close();
+    clearBatch();
 }
 
 void UDPPort6::close(void)
 {
-    for (int i = 0; i < 2; i++)
+    for (int i = 0; i < _receiverCnt; i++)
     {
-        if (_pollfds[i].fd > 0)
+        for (int j = 0; j < 2; j++)
         {
-            ::close(_pollfds[i].fd);
-            _pollfds[i].fd = 0;
+            if (_receivers[i]._pollfds[j].fd > 0)
+            {
+                ::close(_receivers[i]._pollfds[j].fd);
+                _receivers[i]._pollfds[j].fd = 0;
+            }
         }
     }
 }
 
+/**
+ *  When sockets > 1, unicast sockets are bound to the same port with SO_REUSEPORT.
+ *  The kernel hashes the source address of a datagram to select a socket,
+ *  so datagrams of a client are always received by the same ClientRecvTask.
+ */
 int UDPPort6::open(uint16_t uniPortNo, uint16_t multiPortNo, const char *multicastAddr, const char *interfaceName,
-        uint32_t hops)
+        uint32_t hops, int batchSize, int sockets)
 {
     int optval = 0;
     int sock = 0;
@@ -266,57 +326,80 @@ int UDPPort6::open(uint16_t uniPortNo, uint16_t multiPortNo, const char *multica
         return -1;
     }
 
-    // Create a unicast socket
-    sock = socket(AF_INET6, SOCK_DGRAM, 0);
-    if (sock < 0)
+    close();
+    clearBatch();
+    _receivers = new UDPReceiver6[sockets];
+    _receiverCnt = sockets;
+
+    // Create unicast sockets
+    for (int i = 0; i < sockets; i++)
     {
-        D_NWSTACK("UDP6::open - unicast socket: %s", strerror(errno));
-        return -1;
-    }
+        sock = socket(AF_INET6, SOCK_DGRAM, 0);
+        if (sock < 0)
+        {
+            D_NWSTACK("UDP6::open - unicast socket: %s", strerror(errno));
+            close();
+            return -1;
+        }
 
-    _pollfds[0].fd = sock;
-    _pollfds[0].events = POLLIN;
+        _receivers[i]._pollfds[0].fd = sock;
+        _receivers[i]._pollfds[0].events = POLLIN;
+        _receivers[i]._pollCnt = 1;
 
-    optval = 1;
-    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char*) &optval, sizeof(optval));
+        optval = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char*) &optval, sizeof(optval));
 
-    optval = 1;
-    if (setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (char*) &optval, sizeof(optval)) < 0)
-    {
-        D_NWSTACK("\033[0m\033[0;31m unicast socket error %s IPV6_V6ONLY\033[0m\033[0;37m\n", strerror(errno));
-        close();
-        return -1;
-    }
+        optval = 1;
+        if (sockets > 1 && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (char*) &optval, sizeof(optval)) < 0)
+        {
+            D_NWSTACK("\033[0m\033[0;31m unicast socket error %s SO_REUSEPORT\033[0m\033[0;37m\n", strerror(errno));
+            close();
+            return -1;
+        }
 
-    if (setsockopt(sock, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &hops, sizeof(hops)) < 0)
-    {
-        D_NWSTACK("\033[0m\033[0;31m error %s IPV6_UNICAST_HOPS\033[0m\033[0;37m\n", strerror(errno));
-        close();
-        return -1;
-    }
+        optval = 1;
+        if (setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (char*) &optval, sizeof(optval)) < 0)
+        {
+            D_NWSTACK("\033[0m\033[0;31m unicast socket error %s IPV6_V6ONLY\033[0m\033[0;37m\n", strerror(errno));
+            close();
+            return -1;
+        }
 
-    if (strlen(interfaceName) > 0)
-    {
-        ifindex = if_nametoindex(interfaceName);
+        if (setsockopt(sock, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &hops, sizeof(hops)) < 0)
+        {
+            D_NWSTACK("\033[0m\033[0;31m error %s IPV6_UNICAST_HOPS\033[0m\033[0;37m\n", strerror(errno));
+            close();
+            return -1;
+        }
+
+        if (strlen(interfaceName) > 0)
+        {
+            ifindex = if_nametoindex(interfaceName);
 #ifdef __APPLE__
-        setsockopt(sock, IPPROTO_IP, IP_BOUND_IF, &ifindex, sizeof(ifindex));
+            setsockopt(sock, IPPROTO_IP, IP_BOUND_IF, &ifindex, sizeof(ifindex));
 #else
-        setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, interfaceName, strlen(interfaceName));
+            setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, interfaceName, strlen(interfaceName));
 #endif
-    }
+        }
 
-    memset(&addr6, 0, sizeof(addr6));
-    addr6.sin6_family = AF_INET6;
-    addr6.sin6_port = htons(uniPortNo);
-    addr6.sin6_addr = in6addr_any;
+        memset(&addr6, 0, sizeof(addr6));
+        addr6.sin6_family = AF_INET6;
+        addr6.sin6_port = htons(uniPortNo);
+        addr6.sin6_addr = in6addr_any;
 
-    if (::bind(sock, (sockaddr*) &addr6, sizeof(addr6)) < 0)
-    {
-        D_NWSTACK("error can't bind unicast socket in UDPPort6::open: %s\n", strerror(errno));
-        close();
-        return -1;
-    }
+        if (::bind(sock, (sockaddr*) &addr6, sizeof(addr6)) < 0)
+        {
+            D_NWSTACK("error can't bind unicast socket in UDPPort6::open: %s\n", strerror(errno));
+            close();
+            return -1;
+        }
 
+        if (_receivers[i].initialize(batchSize) < 0)
+        {
+            close();
+            return -1;
+        }
+    }
 
     // create a MULTICAST socket
 
@@ -327,8 +410,9 @@ int UDPPort6::open(uint16_t uniPortNo, uint16_t multiPortNo, const char *multica
         close();
         return -1;
     }
-    _pollfds[1].fd = sock;
-    _pollfds[1].events = POLLIN;
+    _receivers[0]._pollfds[1].fd = sock;
+    _receivers[0]._pollfds[1].events = POLLIN;
+    _receivers[0]._pollCnt = 2;
 
     optval = 1;
     if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*) &optval, sizeof(optval)) < 0)
@@ -388,9 +472,48 @@ int UDPPort6::open(uint16_t uniPortNo, uint16_t multiPortNo, const char *multica
 
     memcpy(&addr6.sin6_addr, &addrm.ipv6mr_multiaddr, sizeof(addrm.ipv6mr_multiaddr));
     _grpAddr.setAddress(&addr6);
+
+    // Prepare buffers for sendmmsg
+    _batchSize = batchSize;
+    _sendMsgs = new mmsghdr[batchSize];
+    _sendIov = new iovec[batchSize];
+    _sendAddrs = new sockaddr_in6[batchSize];
+    _sendBufs = new uint8_t[batchSize * MQTTSNGW_MAX_PACKET_SIZE];
+    memset(_sendMsgs, 0, sizeof(mmsghdr) * batchSize);
+
+    for (int i = 0; i < batchSize; i++)
+    {
+        _sendIov[i].iov_base = _sendBufs + i * MQTTSNGW_MAX_PACKET_SIZE;
+        _sendMsgs[i].msg_hdr.msg_name = &_sendAddrs[i];
+        _sendMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in6);
+        _sendMsgs[i].msg_hdr.msg_iov = &_sendIov[i];
+        _sendMsgs[i].msg_hdr.msg_iovlen = 1;
+    }
     return 0;
 }
 
+void UDPPort6::clearBatch(void)
+{
+    delete[] _receivers;
+    delete[] _sendMsgs;
+    delete[] _sendIov;
+    delete[] _sendAddrs;
+    delete[] _sendBufs;
+    _receivers = nullptr;
+    _sendMsgs = nullptr;
+    _sendIov = nullptr;
+    _sendAddrs = nullptr;
+    _sendBufs = nullptr;
+    _receiverCnt = 0;
+    _batchSize = 0;
+    _sendCnt = 0;
+}
+
+int UDPPort6::getReceiverCount(void)
+{
+    return _receiverCnt;
+}
+
 int UDPPort6::unicast(const uint8_t* buf, uint32_t length, SensorNetAddress* addr)
 {
     sockaddr_in6 dest;
@@ -405,7 +528,25 @@ int UDPPort6::unicast(const uint8_t* buf, uint32_t length, SensorNetAddress* add
     D_NWSTACK("sendto %s\n", addrBuf);
 #endif
 
-    int status = ::sendto(_pollfds[0].fd, buf, length, 0, (const sockaddr*) &dest, sizeof(dest));
+    if (_batchSize > 1 && length <= MQTTSNGW_MAX_PACKET_SIZE)
+    {
+        // queued until flush()
+        int i = _sendCnt++;
+        memcpy(_sendIov[i].iov_base, buf, length);
+        _sendIov[i].iov_len = length;
+        _sendAddrs[i] = dest;
+        if (_sendCnt == _batchSize)
+        {
+            return flush() < 0 ? -1 : length;
+        }
+        return length;
+    }
+
+    if (flush() < 0)
+    {
+        return -1;
+    }
+    int status = ::sendto(_receivers[0]._pollfds[0].fd, buf, length, 0, (const sockaddr*) &dest, sizeof(dest));
 
     if (status < 0)
     {
@@ -428,7 +569,11 @@ int UDPPort6::broadcast(const uint8_t* buf, uint32_t length)
     D_NWSTACK("sendto %s\n", addrBuf);
 #endif
 
-    int status = ::sendto(_pollfds[1].fd, buf, length, 0, (const sockaddr*) &dest, sizeof(dest));
+    if (flush() < 0)
+    {
+        return -1;
+    }
+    int status = ::sendto(_receivers[0]._pollfds[1].fd, buf, length, 0, (const sockaddr*) &dest, sizeof(dest));
 
     if (status < 0)
     {
@@ -439,43 +584,154 @@ int UDPPort6::broadcast(const uint8_t* buf, uint32_t length)
     return 0;
 }
 
-int UDPPort6::recv(uint8_t* buf, uint16_t len, SensorNetAddress* addr)
+/**
+ *  Send datagrams queued by unicast() with sendmmsg().
+ *  A datagram which can't be sent is dropped and -1 is returned.
+ */
+int UDPPort6::flush(void)
 {
-    int rc = poll(_pollfds, 2, 2000);  // Timeout 2secs
-    if (rc == 0)
+    int rc = 0;
+    int pos = 0;
+    while (pos < _sendCnt)
     {
-        return rc;
+        int cnt = ::sendmmsg(_receivers[0]._pollfds[0].fd, _sendMsgs + pos, _sendCnt - pos, 0);
+        if (cnt < 0)
+        {
+            D_NWSTACK("%s in UDPPort6::sendmmsg\n", strerror(errno));
+            cnt = 1;
+            rc = -1;
+        }
+        pos += cnt;
     }
+    _sendCnt = 0;
+    return rc;
+}
+
+int UDPPort6::recv(uint8_t** buf, SensorNetAddress* addr, int index)
+{
+    return _receivers[index].recv(buf, addr);
+}
 
-    for (int i = 0; i < 2; i++)
+/*=========================================
+ Class UDPReceiver6
+ =========================================*/
+UDPReceiver6::UDPReceiver6()
+{
+    memset(_pollfds, 0, sizeof(_pollfds));
+}
+
+UDPReceiver6::~UDPReceiver6()
+{
+    clear();
+}
+
+int UDPReceiver6::initialize(int batchSize)
+{
+    clear();
+    _batchSize = batchSize;
+    _msgs = new mmsghdr[batchSize];
+    _iov = new iovec[batchSize];
+    _addrs = new sockaddr_in6[batchSize];
+    _bufs = new uint8_t*[batchSize]();
+    memset(_msgs, 0, sizeof(mmsghdr) * batchSize);
+
+    for (int i = 0; i < batchSize; i++)
     {
-        if (_pollfds[i].revents & POLLIN)
+        _bufs[i] = BufferPool::allocate(MQTTSNGW_MAX_PACKET_SIZE);
+        if (_bufs[i] == nullptr)
         {
-            return recvfrom(_pollfds[i].fd, buf, len, 0, addr);
+            return -1;
         }
+        _msgs[i].msg_hdr.msg_name = &_addrs[i];
+        _msgs[i].msg_hdr.msg_iov = &_iov[i];
+        _msgs[i].msg_hdr.msg_iovlen = 1;
     }
     return 0;
 }
 
-int UDPPort6::recvfrom(int sockfd, uint8_t* buf, uint16_t len, uint8_t flags, SensorNetAddress* addr)
+void UDPReceiver6::clear(void)
 {
-    sockaddr_in6 sender;
-    socklen_t addrlen = sizeof(sender);
-    memset(&sender, 0, addrlen);
+    for (int i = 0; i < _batchSize; i++)
+    {
+        BufferPool::release(_bufs[i]);
+    }
+    delete[] _msgs;
+    delete[] _iov;
+    delete[] _addrs;
+    delete[] _bufs;
+    _msgs = nullptr;
+    _iov = nullptr;
+    _addrs = nullptr;
+    _bufs = nullptr;
+    _batchSize = 0;
+    _cnt = 0;
+    _pos = 0;
+}
 
-    int status = ::recvfrom(sockfd, buf, len, flags, (sockaddr*) &sender, &addrlen);
+int UDPReceiver6::recv(uint8_t** buf, SensorNetAddress* addr)
+{
+    if (_pos == _cnt)
+    {
+        _pos = 0;
+        _cnt = 0;
+        int rc = poll(_pollfds, _pollCnt, 2000);  // Timeout 2secs
+        if (rc == 0)
+        {
+            return rc;
+        }
 
-    if (status < 0 && errno != EAGAIN)
+        rc = 0;
+        for (int i = 0; i < _pollCnt; i++)
+        {
+            if (_pollfds[i].revents & POLLIN)
+            {
+                rc = recvBatch(_pollfds[i].fd);
+                break;
+            }
+        }
+        if (rc <= 0)
+        {
+            return rc;
+        }
+        _cnt = rc;
+    }
+
+    // hand over the received buffer and keep the caller's one for the next recvmmsg()
+    int pos = _pos++;
+    uint8_t* data = _bufs[pos];
+    _bufs[pos] = *buf;
+    *buf = data;
+    addr->setAddress(&_addrs[pos]);
+    return _msgs[pos].msg_len;
+}
+
+int UDPReceiver6::recvBatch(int sockfd)
+{
+    for (int i = 0; i < _batchSize; i++)
+    {
+        _iov[i].iov_base = _bufs[i];
+        _iov[i].iov_len = MQTTSNGW_MAX_PACKET_SIZE;
+        _msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in6);
+    }
+
+    int cnt = ::recvmmsg(sockfd, _msgs, _batchSize, MSG_DONTWAIT, nullptr);
+    if (cnt < 0)
     {
-        D_NWSTACK("errno in UDPPort6::recvfrom: %s\n", strerror(errno));
+        if (errno == EAGAIN)
+        {
+            return 0;
+        }
+        D_NWSTACK("errno in UDPPort6::recvmmsg: %s\n", strerror(errno));
         return -1;
     }
-    addr->setAddress(&sender);
 
 #ifdef DEBUG_NW
     char addrBuf[INET6_ADDRSTRLEN];
-    addr->sprint(addrBuf);
-    D_NWSTACK("sendto %s length = %d\n", addrBuf, status);
+    for (int i = 0; i < cnt; i++)
+    {
+        D_NWSTACK("recvfrom %s length = %d\n", inet_ntop(AF_INET6, &_addrs[i].sin6_addr, addrBuf, sizeof(addrBuf)),
+                _msgs[i].msg_len);
+    }
 #endif
-    return status;
+    return cnt;
 }
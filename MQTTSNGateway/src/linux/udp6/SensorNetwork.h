@@ -23,6 +23,8 @@
 #include <arpa/inet.h>
 #include <string>
 #include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 using namespace std;
 
@@ -44,6 +46,7 @@ public:
     sockaddr_in6* getIpAddress(void);
     char* getAddress(void);
     bool isMatch(SensorNetAddress* addr);
+    uint32_t hash(void);
     SensorNetAddress& operator =(SensorNetAddress& addr);
     char* sprint(char* buf);
 private:
@@ -51,6 +54,36 @@ private:
     sockaddr_in6 _IpAddr;
 };
 
+/*========================================
+ Class UDPReceiver6
+
+ A unicast socket and datagrams received from it by recvmmsg( ).
+ Each receiver is read by its own ClientRecvTask.
+ =======================================*/
+class UDPReceiver6
+{
+    friend class UDPPort6;
+public:
+    UDPReceiver6();
+    ~UDPReceiver6();
+
+private:
+    int initialize(int batchSize);
+    void clear(void);
+    int recv(uint8_t** buf, SensorNetAddress* addr);
+    int recvBatch(int sockfd);
+
+    pollfd _pollfds[2];     // unicast socket and the multicast socket of the first receiver
+    int _pollCnt { 0 };
+    int _batchSize { 0 };
+    mmsghdr* _msgs { nullptr };
+    iovec* _iov { nullptr };
+    sockaddr_in6* _addrs { nullptr };
+    uint8_t** _bufs { nullptr };
+    int _cnt { 0 };
+    int _pos { 0 };
+};
+
 /*========================================
  Class UpdPort6
  =======================================*/
@@ -60,21 +93,34 @@ public:
     UDPPort6();
     virtual ~UDPPort6();
 
-    int open(uint16_t uniPortNo, uint16_t multiPortNo, const char *broadcastAddr, const char *interfaceName, uint32_t hops);
+    int open(uint16_t uniPortNo, uint16_t multiPortNo, const char *broadcastAddr, const char *interfaceName, uint32_t hops,
+            int batchSize, int sockets);
     void close(void);
     int unicast(const uint8_t* buf, uint32_t length, SensorNetAddress* sendToAddr);
     int broadcast(const uint8_t* buf, uint32_t length);
-    int recv(uint8_t* buf, uint16_t len, SensorNetAddress* addr);
+    int recv(uint8_t** buf, SensorNetAddress* addr, int index);
+    int flush(void);
+    int getReceiverCount(void);
 
 private:
     void setNonBlocking(const bool);
-    int recvfrom(int sockfd, uint8_t* buf, uint16_t len, uint8_t flags, SensorNetAddress* addr);
+    void clearBatch(void);
 
-    pollfd _pollfds[2];
     SensorNetAddress _grpAddr;
-    SensorNetAddress _clientAddr;
     bool _disconReq;
     uint32_t _hops;
+
+    /* unicast sockets bound to the same port by SO_REUSEPORT */
+    UDPReceiver6* _receivers { nullptr };
+    int _receiverCnt { 0 };
+
+    /* datagrams queued for sendmmsg( ) */
+    int _batchSize { 0 };
+    mmsghdr* _sendMsgs { nullptr };
+    iovec* _sendIov { nullptr };
+    sockaddr_in6* _sendAddrs { nullptr };
+    uint8_t* _sendBufs { nullptr };
+    int _sendCnt { 0 };
 };
 
 /*===========================================
@@ -88,13 +134,13 @@ public:
 
     int unicast(const uint8_t* payload, uint16_t payloadLength, SensorNetAddress* sendto);
     int broadcast(const uint8_t* payload, uint16_t payloadLength);
-    int read(uint8_t* buf, uint16_t bufLen);
+    int read(uint8_t** buf, SensorNetAddress* sender, int index);
+    int flush(void);
     void initialize(void);
     const char* getDescription(void);
-    SensorNetAddress* getSenderAddress(void);
+    int getReceiverCount(void);
 
 private:
-    SensorNetAddress _clientAddr;   // Sender's address. not gateway's one.
     string _description;
 };
 
@@ -73,6 +73,17 @@ bool SensorNetAddress::isMatch(SensorNetAddress* addr)
 	return (memcmp(this->_address64, addr->_address64, 8 ) == 0 &&  memcmp(this->_address16, addr->_address16, 2) == 0);
 }
 
+uint32_t SensorNetAddress::hash(void)
+{
+	uint32_t h = 2166136261U;   // FNV-1a
+	for (int i = 0; i < 8; i++)
+	{
+		h ^= _address64[i];
+		h *= 16777619U;
+	}
+	return h ^ (_address16[0] << 8) ^ _address16[1];
+}
+
 SensorNetAddress& SensorNetAddress::operator =(SensorNetAddress& addr)
 {
 	memcpy(_address64, addr._address64, 8);
@@ -114,6 +125,24 @@ int SensorNetwork::broadcast(const uint8_t* payload, uint16_t payloadLength)
 	return XBee::broadcast(payload, payloadLength);
 }
 
+/* the buffer is received into in place and never exchanged. there is only one receiver. */
+int SensorNetwork::read(uint8_t** buf, SensorNetAddress* sender, int index)
+{
+	int rc = read(*buf, MQTTSNGW_MAX_PACKET_SIZE);
+	*sender = _clientAddr;
+	return rc;
+}
+
+int SensorNetwork::getReceiverCount(void)
+{
+	return 1;
+}
+
+int SensorNetwork::flush(void)
+{
+	return 0;
+}
+
 int SensorNetwork::read(uint8_t* buf, uint16_t bufLen)
 {
 	return XBee::recv(buf, bufLen, &_clientAddr);
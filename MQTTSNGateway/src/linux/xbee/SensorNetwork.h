@@ -68,6 +68,7 @@ public:
 	int  setAddress(string* data);
 	void setBroadcastAddress(void);
 	bool isMatch(SensorNetAddress* addr);
+	uint32_t hash(void);
 	SensorNetAddress& operator =(SensorNetAddress& addr);
 	char* sprint(char*);
 private:
@@ -119,9 +120,12 @@ public:
 	int unicast(const uint8_t* payload, uint16_t payloadLength, SensorNetAddress* sendto);
 	int broadcast(const uint8_t* payload, uint16_t payloadLength);
 	int read(uint8_t* buf, uint16_t bufLen);
+	int read(uint8_t** buf, SensorNetAddress* sender, int index);
+	int flush(void);
 	void initialize(void);
 	const char* getDescription(void);
 	SensorNetAddress* getSenderAddress(void);
+	int getReceiverCount(void);
 
 private:
 	SensorNetAddress _clientAddr;   // Sender's address. not gateway's one.
@@ -36,6 +36,12 @@ int main(int argc, char** argv)
     try
     {
         gateway.initialize(argc, argv);
+
+        /* a ClientRecvTask for each receiver of the SensorNetwork */
+        for (int i = 1; i < gateway.getSensorNetwork()->getReceiverCount(); i++)
+        {
+            new ClientRecvTask(&gateway, i);
+        }
         gateway.run();
     }
     catch (Exception &ex)
@@ -24,7 +24,7 @@ using namespace MQTTSNGW;
  */
 int main(int argc, char** argv)
 {
-    Logmonitor monitor = Logmonitor();
+    Logmonitor monitor;
     monitor.initialize(argc, argv);
     monitor.run();
     return 0;
@@ -0,0 +1,32 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation and/or initial documentation
+ **************************************************************************************/
+
+#include "MQTTSNGWTraceDecoder.h"
+
+using namespace MQTTSNGW;
+
+/*
+ *   Tracedecoder process
+ */
+int main(int argc, char** argv)
+{
+    TraceDecoder decoder = TraceDecoder();
+    if (decoder.initialize(argc, argv) < 0)
+    {
+        return 1;
+    }
+    return decoder.run();
+}
@@ -0,0 +1,135 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation 
+ **************************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <cassert>
+#include <algorithm>
+#include "TestAggregateTopicTable.h"
+
+using namespace std;
+using namespace MQTTSNGW;
+
+TestAggregateTopicTable::TestAggregateTopicTable()
+{
+	_table = new AggregateTopicTable();
+}
+
+TestAggregateTopicTable::~TestAggregateTopicTable()
+{
+	delete _table;
+}
+
+void TestAggregateTopicTable::add(const char* topicFilter, Client* client)
+{
+	Topic topic(new string(topicFilter), MQTTSN_TOPIC_TYPE_NORMAL);
+	_table->add(&topic, client);
+}
+
+void TestAggregateTopicTable::erase(const char* topicFilter, Client* client)
+{
+	Topic topic(new string(topicFilter), MQTTSN_TOPIC_TYPE_NORMAL);
+	_table->erase(&topic, client);
+}
+
+bool TestAggregateTopicTable::hasClients(const char* topicName, int cnt, Client* c1, Client* c2)
+{
+	ClientVector clients;
+	_table->getClients(topicName, strlen(topicName), &clients);
+	if ((int)clients.size() != cnt)
+	{
+		return false;
+	}
+	if (c1 && find(clients.begin(), clients.end(), c1) == clients.end())
+	{
+		return false;
+	}
+	if (c2 && find(clients.begin(), clients.end(), c2) == clients.end())
+	{
+		return false;
+	}
+	return true;
+}
+
+void TestAggregateTopicTable::test(void)
+{
+	Client* c1 = new Client();
+	Client* c2 = new Client();
+	Client* c3 = new Client();
+
+	add("fleet/+/cmd", c1);
+	add("fleet/dev1/cmd", c2);
+	add("fleet/#", c3);
+	add("fleet/+/cmd", c2);
+	add("fleet/+/cmd", c2);
+
+	assert(hasClients("fleet/dev1/cmd", 3, c1, c2));
+	assert(hasClients("fleet/dev2/cmd", 3, c1, c2));
+	assert(hasClients("fleet/dev2/cmd", 3, c3));
+	assert(hasClients("fleet/dev2/status", 1, c3));
+	assert(hasClients("fleet", 1, c3));
+	assert(hasClients("fleet/dev2/cmd/x", 1, c3));
+	assert(hasClients("other/dev2/cmd", 0));
+	assert(hasClients("fleet//cmd", 3, c1, c2));
+
+	/* the cached result is invalidated by a change of subscriptions */
+	erase("fleet/#", c3);
+	assert(hasClients("fleet/dev2/cmd", 2, c1, c2));
+	assert(hasClients("fleet", 0));
+	erase("fleet/+/cmd", c1);
+	assert(hasClients("fleet/dev2/cmd", 1, c2));
+
+	Topic filter(new string("fleet/+/cmd"), MQTTSN_TOPIC_TYPE_NORMAL);
+	assert(_table->getAggregateTopicElement(&filter) != nullptr);
+	_table->erase(c2);
+	assert(_table->getAggregateTopicElement(&filter) == nullptr);
+	assert(hasClients("fleet/dev1/cmd", 0));
+
+	/* a filter shares one subscription of the broker */
+	add("fleet/+/cmd", c1);
+	add("fleet/+/cmd", c3);
+	AggregateTopicElement* elm = _table->getAggregateTopicElement(&filter);
+	assert(elm->getGrantedQoS() == -1);
+	elm->setRequestedQoS(1);
+	elm->setGrantedQoS(1);
+	std::vector<AggregateTopicFilter> filters;
+	_table->resetSubscriptions(&filters);
+	assert(filters.size() == 1 && filters[0].topicName == "fleet/+/cmd" && filters[0].qos == 1);
+	assert(elm->getGrantedQoS() == -1);
+
+	/* the result is a copy which doesn't change with subscriptions */
+	ClientVector clients;
+	_table->getClients("fleet/dev1/cmd", 14, &clients);
+	erase("fleet/+/cmd", c3);
+	assert(clients.size() == 2 && hasClients("fleet/dev1/cmd", 1, c1));
+	_table->erase(c1);
+	_table->erase(c3);
+
+	/* erase an unknown filter */
+	erase("unknown/topic", c1);
+
+	add("#", c1);
+	add("+", c2);
+	add("a/b", c3);
+	assert(hasClients("a", 2, c1, c2));
+	assert(hasClients("a/b", 2, c1, c3));
+	_table->clear();
+	assert(hasClients("a/b", 0));
+
+	delete c1;
+	delete c2;
+	delete c3;
+	printf("[ OK ]\n");
+}
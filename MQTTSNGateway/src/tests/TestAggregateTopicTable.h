@@ -0,0 +1,36 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation 
+ **************************************************************************************/
+#ifndef MQTTSNGATEWAY_SRC_TESTS_TESTAGGREGATETOPICTABLE_H_
+#define MQTTSNGATEWAY_SRC_TESTS_TESTAGGREGATETOPICTABLE_H_
+
+#include "MQTTSNGWClient.h"
+#include "MQTTSNGWAggregateTopicTable.h"
+
+class TestAggregateTopicTable
+{
+public:
+	TestAggregateTopicTable();
+	~TestAggregateTopicTable();
+	void test(void);
+
+private:
+	void add(const char* topicFilter, Client* client);
+	void erase(const char* topicFilter, Client* client);
+	bool hasClients(const char* topicName, int cnt, Client* c1 = nullptr, Client* c2 = nullptr);
+	AggregateTopicTable* _table;
+};
+
+#endif /* MQTTSNGATEWAY_SRC_TESTS_TESTAGGREGATETOPICTABLE_H_ */
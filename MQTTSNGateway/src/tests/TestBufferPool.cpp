@@ -0,0 +1,138 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation
+ **************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <cassert>
+#include "TestBufferPool.h"
+
+using namespace std;
+using namespace MQTTSNGW;
+
+#define BUFCNT  (BUFFERPOOL_CACHE_SIZE * 3)
+
+static unsigned char* buffers[BUFCNT];
+
+static void* releaseBuffers(void*)
+{
+	for ( int i = 0; i < BUFCNT; i++ )
+	{
+		BufferPool::release(buffers[i]);
+	}
+	return nullptr;
+}
+
+/*
+ *  A thread_local object which is destroyed after the cache of the thread.
+ */
+class LateRelease
+{
+public:
+	~LateRelease()
+	{
+		BufferPool::release(buf);
+		unsigned char* tmp = BufferPool::allocate(100);
+		assert(tmp);
+		BufferPool::release(tmp);
+	}
+	unsigned char* buf { nullptr };
+};
+
+static void* releaseLate(void*)
+{
+	static thread_local LateRelease late;
+	late.buf = nullptr;
+	late.buf = BufferPool::allocate(100);
+	return nullptr;
+}
+
+TestBufferPool::TestBufferPool()
+{
+
+}
+
+TestBufferPool::~TestBufferPool()
+{
+
+}
+
+void TestBufferPool::test(void)
+{
+	BufferPoolStat stat0;
+	BufferPoolStat stat1;
+
+	/* size classes */
+	unsigned char* buf = BufferPool::allocate(10);
+	assert(BufferPool::getCapacity(buf) == 64);
+	BufferPool::release(buf);
+	buf = BufferPool::allocate(MQTTSNGW_MAX_PACKET_SIZE);
+	assert(BufferPool::getCapacity(buf) >= MQTTSNGW_MAX_PACKET_SIZE);
+	memset(buf, 0xff, MQTTSNGW_MAX_PACKET_SIZE);
+	BufferPool::release(buf);
+
+	/* a released buffer is reused by the thread */
+	buf = BufferPool::allocate(200);
+	BufferPool::release(buf);
+	assert(BufferPool::allocate(200) == buf);
+	BufferPool::release(buf);
+
+	/* larger than the largest class */
+	uint64_t oversize = BufferPool::getOversizeCount();
+	buf = BufferPool::allocate(100000);
+	assert(BufferPool::getCapacity(buf) == 100000);
+	assert(BufferPool::getOversizeCount() == oversize + 1);
+	BufferPool::release(buf);
+
+	/* buffers released by another thread */
+	BufferPool::getStat(1, &stat0);
+	for ( int i = 0; i < BUFCNT; i++ )
+	{
+		buffers[i] = BufferPool::allocate(100);
+		assert(buffers[i]);
+	}
+	BufferPool::getStat(1, &stat1);
+	assert(stat1.inUse == stat0.inUse + BUFCNT);
+	assert(stat1.allocs == stat0.allocs + BUFCNT);
+
+	pthread_t th;
+	pthread_create(&th, nullptr, releaseBuffers, nullptr);
+	pthread_join(th, nullptr);
+
+	BufferPool::getStat(1, &stat1);
+	assert(stat1.inUse == stat0.inUse);
+	assert(stat1.spills > stat0.spills);
+
+	/* they are available again */
+	for ( int i = 0; i < BUFCNT; i++ )
+	{
+		buffers[i] = BufferPool::allocate(100);
+	}
+	BufferPool::getStat(1, &stat0);
+	for ( int i = 0; i < BUFCNT; i++ )
+	{
+		BufferPool::release(buffers[i]);
+	}
+	assert(stat0.blocks == stat1.blocks);
+
+	/* buffers released after the cache of the thread is destroyed */
+	BufferPool::getStat(1, &stat0);
+	pthread_create(&th, nullptr, releaseLate, nullptr);
+	pthread_join(th, nullptr);
+	BufferPool::getStat(1, &stat1);
+	assert(stat1.inUse == stat0.inUse && stat1.allocs == stat0.allocs + 2);
+
+	printf("[ OK ]\n");
+}
@@ -0,0 +1,195 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation
+ **************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <cassert>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "TestClientSession.h"
+#include "MQTTSNGWConnectionHandler.h"
+#include "MQTTSNGWClientList.h"
+#include "MQTTGWPacket.h"
+
+using namespace std;
+using namespace MQTTSNGW;
+
+/*
+ *  A socket which accepts connections of clients as the broker does.
+ *  @return the socket, and the port is written into port
+ */
+static int listenBroker(char* port, int len)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	assert(sock > 0);
+	assert(bind(sock, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+	assert(listen(sock, 5) == 0);
+	assert(getsockname(sock, (struct sockaddr*) &addr, &addrlen) == 0);
+	snprintf(port, len, "%d", ntohs(addr.sin_port));
+	return sock;
+}
+
+/*
+ *  A client which is connected and whose session is not cleaned.
+ */
+static Client* connect(Gateway* gw, const char* clientId, const char* port)
+{
+	MQTTSNString id = MQTTSNString_initializer;
+	id.cstring = (char*) clientId;
+	Client* client = gw->getClientList()->createClient(nullptr, &id, TRANSPEARENT_TYPE);
+	client->setSessionStatus(false);
+	client->connackSended(MQTTSN_RC_ACCEPTED);
+	assert(client->getNetwork()->connect("127.0.0.1", port));
+	return client;
+}
+
+static void sendConnect(MQTTSNConnectionHandler* handler, Client* client, bool will)
+{
+	MQTTSNPacket_connectData data = MQTTSNPacket_connectData_initializer;
+	data.clientID.cstring = (char*) client->getClientId();
+	data.duration = 60;
+	data.cleansession = 0;
+	data.willFlag = will;
+	MQTTSNPacket packet;
+	packet.setCONNECT(&data);
+	handler->handleConnect(client, &packet);
+}
+
+/*
+ *  Take all packets posted to clients.
+ *  @return the number of packets of the type
+ */
+static int takeClientPackets(Gateway* gw, int type)
+{
+	int cnt = 0;
+	while (gw->getClientSendQue()->size() > 0)
+	{
+		Event* ev = gw->getClientSendQue()->wait();
+		if (ev->getMQTTSNPacket()->getType() == type)
+		{
+			cnt++;
+		}
+		delete ev;
+	}
+	return cnt;
+}
+
+/*
+ *  Take all MQTT packets of the que.
+ *  @return the number of packets of the type
+ */
+static int takeBrokerPackets(EventQue* que, int type)
+{
+	int cnt = 0;
+	while (que->size() > 0)
+	{
+		Event* ev = que->wait();
+		if (ev->getMQTTGWPacket()->getType() == type)
+		{
+			cnt++;
+		}
+		delete ev;
+	}
+	return cnt;
+}
+
+TestClientSession::TestClientSession(Gateway* gw)
+{
+	_gateway = gw;
+}
+
+TestClientSession::~TestClientSession()
+{
+
+}
+
+void TestClientSession::test(void)
+{
+	char port[16];
+	int sock = listenBroker(port, sizeof(port));
+	MQTTSNConnectionHandler handler(_gateway);
+	_gateway->getGWParams()->sessionResumeTime = 10;
+
+	/* the session of a lost client is kept until it expires or the client connects */
+	Client* client = new Client();
+	client->keepSession(10);
+	assert(client->isSessionKept() && !client->isSessionExpired());
+	client->connackSended(MQTTSN_RC_ACCEPTED);
+	assert(client->isActive() && !client->isSessionKept());
+	client->keepSession(0);
+	assert(client->isSessionExpired());
+	client->updateStatus(Cstat_Lost);
+	assert(!client->isSessionKept());
+	delete client;
+
+	/* the kept session is resumed by the CONNACK of the gateway, and saved PUBLISHes are delivered */
+	Client* client1 = connect(_gateway, "resume", port);
+	MQTTGWPacket publish;
+	Publish pub = MQTTPacket_Publish_Initializer;
+	pub.header.bits.qos = 1;
+	pub.topic = (char*) "test/resume";
+	pub.topiclen = strlen(pub.topic);
+	pub.msgId = 1;
+	pub.payload = (char*) "payload";
+	pub.payloadlen = 7;
+	publish.setPUBLISH(&pub);
+	client1->keepSession(10);
+	assert(client1->setClientSleepPacket(&publish) == 1);
+
+	sendConnect(&handler, client1, false);
+	assert(client1->isActive() && !client1->isSessionKept());
+	assert(takeClientPackets(_gateway, MQTTSN_CONNACK) == 1);
+	assert(takeBrokerPackets(_gateway->getBrokerSendQue(), CONNECT) == 0);
+	assert(client1->getClientSleepPacket() == nullptr);
+	assert(takeBrokerPackets(_gateway->getPacketEventQue(), PUBLISH) == 1);
+
+	/* the will of a new CONNECT is requested to be sent to the broker */
+	client1->keepSession(10);
+	sendConnect(&handler, client1, true);
+	assert(!client1->isActive());
+	assert(takeClientPackets(_gateway, MQTTSN_WILLTOPICREQ) == 1);
+
+	/* the broker has the will of the previous CONNECT */
+	Client* client2 = connect(_gateway, "previous-will", port);
+	client2->getConnectData()->flags.bits.will = 1;
+	sendConnect(&handler, client2, false);
+	assert(!client2->isActive());
+	assert(takeClientPackets(_gateway, MQTTSN_CONNACK) == 0);
+	assert(takeBrokerPackets(_gateway->getBrokerSendQue(), CONNECT) == 1);
+
+	/* the connection of the broker was closed */
+	Client* client3 = connect(_gateway, "closed", port);
+	client3->keepSession(10);
+	client3->getNetwork()->close();
+	sendConnect(&handler, client3, false);
+	assert(!client3->isActive());
+	assert(takeClientPackets(_gateway, MQTTSN_CONNACK) == 0);
+	assert(takeBrokerPackets(_gateway->getBrokerSendQue(), CONNECT) == 1);
+
+	client1->disconnected();
+	client1->getNetwork()->close();
+	client2->getNetwork()->close();
+	close(sock);
+	_gateway->getGWParams()->sessionResumeTime = 0;
+	printf("[ OK ]\n");
+}
@@ -0,0 +1,249 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation
+ **************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <cassert>
+#include "TestConnectionHandler.h"
+#include "MQTTSNGWConnectionHandler.h"
+#include "MQTTGWPublishHandler.h"
+#include "MQTTSNGWAggregater.h"
+#include "MQTTSNGWClientList.h"
+#include "MQTTGWPacket.h"
+
+using namespace std;
+using namespace MQTTSNGW;
+
+#define KEEPALIVE_DURATION  (1)     // a client is lost 1.5 seconds after the CONNECT
+
+/*
+ *  The keep alive timer of the client starts again as when it sends a CONNECT.
+ */
+static void keepAlive(Client* client)
+{
+	MQTTSNPacket_connectData data = MQTTSNPacket_connectData_initializer;
+	data.clientID.cstring = (char*) client->getClientId();
+	data.duration = KEEPALIVE_DURATION;
+	MQTTSNPacket packet;
+	packet.setCONNECT(&data);
+	client->setKeepAlive(&packet);
+}
+
+static bool isLost(Client* client)
+{
+	return strcmp(client->getStatus(), "Lost") == 0;
+}
+
+/*
+ *  A client which has connected with the keep alive duration, with a will if willQoS >= 0.
+ */
+static Client* connect(Gateway* gw, const char* clientId, int willQoS)
+{
+	MQTTSNString id = MQTTSNString_initializer;
+	id.cstring = (char*) clientId;
+	Client* client = gw->getClientList()->createClient(nullptr, &id, TRANSPEARENT_TYPE);
+	keepAlive(client);
+	client->connackSended(MQTTSN_RC_ACCEPTED);
+
+	if (willQoS >= 0)
+	{
+		MQTTSNString topic = MQTTSNString_initializer;
+		MQTTSNString msg = MQTTSNString_initializer;
+		topic.cstring = (char*) "will/topic";
+		msg.cstring = (char*) "will message";
+		client->setWillTopic(topic);
+		client->setWillMsg(msg);
+		client->setWillFlg(true);
+		client->getConnectData()->flags.bits.will = 1;
+		client->getConnectData()->flags.bits.willQoS = willQoS;
+	}
+	return client;
+}
+
+/*
+ *  Take all packets posted to the broker.
+ *  @return the number of packets of the type
+ */
+static int takeBrokerPackets(Gateway* gw, int type)
+{
+	int cnt = 0;
+	while (gw->getBrokerSendQue()->size() > 0)
+	{
+		Event* ev = gw->getBrokerSendQue()->wait();
+		if (ev->getMQTTGWPacket()->getType() == type)
+		{
+			cnt++;
+		}
+		delete ev;
+	}
+	return cnt;
+}
+
+/*
+ *  Take all packets posted to clients.
+ *  @return the number of packets
+ */
+static int takeClientPackets(Gateway* gw)
+{
+	int cnt = 0;
+	while (gw->getClientSendQue()->size() > 0)
+	{
+		delete gw->getClientSendQue()->wait();
+		cnt++;
+	}
+	return cnt;
+}
+
+TestConnectionHandler::TestConnectionHandler(Gateway* gw)
+{
+	_gateway = gw;
+}
+
+TestConnectionHandler::~TestConnectionHandler()
+{
+
+}
+
+void TestConnectionHandler::test(void)
+{
+	char gwName[] = "TestGW";
+	MQTTSNConnectionHandler handler(_gateway);
+	MQTTGWPublishHandler publishHandler(_gateway);
+	_gateway->getGWParams()->msgIdTableSize = 10;
+	_gateway->getGWParams()->sessionResumeTime = 0;
+
+	/* transparent clients: the broker publishes the will, the gateway closes connections of others */
+	Client* client1 = connect(_gateway, "lost-will", 1);
+	Client* client2 = connect(_gateway, "lost", -1);
+	Client* client3 = connect(_gateway, "alive", -1);
+	sleep(2);
+	keepAlive(client3);
+	handler.checkKeepAlive();
+
+	assert(isLost(client1) && isLost(client2) && client3->isActive());
+	assert(takeBrokerPackets(_gateway, DISCONNECT) == 1);
+
+	/* DISCONNECT with duration 0 discards the will */
+	Client* client4 = connect(_gateway, "disconnect", 1);
+	assert(client4->hasWill());
+	MQTTSNPacket disconnect;
+	disconnect.setDISCONNECT(0);
+	handler.handleDisconnect(client4, &disconnect);
+	assert(!client4->hasWill());
+	assert(takeBrokerPackets(_gateway, DISCONNECT) == 1);
+	assert(takeClientPackets(_gateway) == 1);
+
+	/* aggregated clients: the gateway publishes the will with QoS1 at most and removes clean subscriptions */
+	_gateway->getAdapterManager()->initialize(gwName, true, false, false, false);
+	Aggregater* aggregater = _gateway->getAdapterManager()->getAggregater();
+	Client* client5 = connect(_gateway, "aggregated-will", 2);
+	client5->setSessionStatus(true);
+	Topic* topic = client5->getTopics()->add("test/aggregated", 0);
+	aggregater->addAggregateTopic(topic, client5);
+	Client* client7 = connect(_gateway, "aggregated-kept", -1);
+	client7->setSessionStatus(false);
+	Topic* keptTopic = client7->getTopics()->add("test/kept", 0);
+	aggregater->addAggregateTopic(keptTopic, client7);
+	Client* client6 = connect(_gateway, "aggregated-disconnect", 1);
+	handler.handleDisconnect(client6, &disconnect);
+	assert(takeBrokerPackets(_gateway, DISCONNECT) == 1);
+	takeClientPackets(_gateway);
+	sleep(2);
+	handler.checkKeepAlive();
+
+	assert(isLost(client5) && isLost(client6) && isLost(client7) && !client5->hasWill());
+	assert(aggregater->findTopic(topic) == nullptr);
+	assert(aggregater->findTopic(keptTopic) && aggregater->findTopic(keptTopic)->find(client7));
+	Publish pub = MQTTPacket_Publish_Initializer;
+	Event* ev = _gateway->getBrokerSendQue()->wait();
+	assert(ev->getMQTTGWPacket()->getType() == PUBLISH);
+	ev->getMQTTGWPacket()->getPUBLISH(&pub);
+	assert(pub.header.bits.qos == 1 && pub.msgId > 0);
+	delete ev;
+	assert(takeBrokerPackets(_gateway, UNSUBSCRIBE) == 1);
+
+	/* the PUBACK of the will is not forwarded to the client */
+	MQTTGWPacket puback;
+	puback.setAck(PUBACK, pub.msgId);
+	publishHandler.handleAggregatePuback(aggregater->getAdapterClient(client5), &puback);
+	assert(takeClientPackets(_gateway) == 0);
+
+	/* the client which connects again with CleanSession=false receives PUBLISHes of kept subscriptions */
+	MQTTSNPacket_connectData data = MQTTSNPacket_connectData_initializer;
+	data.clientID.cstring = (char*) client7->getClientId();
+	data.duration = KEEPALIVE_DURATION;
+	data.cleansession = 0;
+	MQTTSNPacket connectPacket;
+	connectPacket.setCONNECT(&data);
+	handler.handleConnect(client7, &connectPacket);
+	assert(takeBrokerPackets(_gateway, CONNECT) == 1);
+	client7->connackSended(MQTTSN_RC_ACCEPTED);
+	assert(aggregater->findTopic(keptTopic)->find(client7));
+
+	Publish keptPub = MQTTPacket_Publish_Initializer;
+	keptPub.topic = (char*) "test/kept";
+	keptPub.topiclen = strlen(keptPub.topic);
+	keptPub.payload = (char*) "payload";
+	keptPub.payloadlen = 7;
+	MQTTGWPacket publish;
+	publish.setPUBLISH(&keptPub);
+	publishHandler.handleAggregatePublish(aggregater->getAdapterClient(client7), &publish);
+	assert(takeClientPackets(_gateway) == 1);
+
+	/* a SUBSCRIBE waiting the SUBACK is shared, and only its clients receive the retained messages */
+	Client* client8 = connect(_gateway, "aggregated-retained", -1);
+	Topic* retainedTopic = client7->getTopics()->add("test/retained", 0);
+	aggregater->addAggregateTopic(retainedTopic, client7);
+	aggregater->addAggregateTopic(client8->getTopics()->add("test/retained", 0), client8);
+	aggregater->setSubscribing(101, retainedTopic, 0, client7);
+	assert(aggregater->joinSubscribing(retainedTopic, 0, client8, 5));
+	assert(aggregater->joinSubscribing(retainedTopic, 0, client8, 5));
+	assert(!aggregater->joinSubscribing(retainedTopic, 1, client8, 6));
+	vector<SubscribingClient> joined;
+	aggregater->subscribed(101, 0, &joined);
+	assert(joined.size() == 1 && joined[0].client == client8 && joined[0].msgId == 5);
+
+	Publish retainedPub = keptPub;
+	retainedPub.header.bits.retain = 1;
+	retainedPub.topic = (char*) "test/retained";
+	retainedPub.topiclen = strlen(retainedPub.topic);
+	MQTTGWPacket retained;
+	retained.setPUBLISH(&retainedPub);
+	publishHandler.handleAggregatePublish(aggregater->getAdapterClient(client7), &retained);
+	assert(takeClientPackets(_gateway) == 2);
+	aggregater->eraseSubscribing(client8);
+	publishHandler.handleAggregatePublish(aggregater->getAdapterClient(client7), &retained);
+	assert(takeClientPackets(_gateway) == 1);
+
+	aggregater->setSubscribing(102, keptTopic, 0, client7);
+	aggregater->subscribed(102, 0, &joined);
+	assert(joined.size() == 0);
+	publishHandler.handleAggregatePublish(aggregater->getAdapterClient(client7), &retained);
+	assert(takeClientPackets(_gateway) == 0);
+	retainedPub.header.bits.retain = 0;
+	retained.setPUBLISH(&retainedPub);
+	publishHandler.handleAggregatePublish(aggregater->getAdapterClient(client7), &retained);
+	assert(takeClientPackets(_gateway) == 2);
+
+	/* msgIds of a removed client are released, so late ACKs don't find it */
+	uint16_t clientMsgId = 0;
+	uint16_t msgId = aggregater->addMessageIdTable(client5, 7);
+	assert(msgId > 0);
+	aggregater->eraseMessageIdTable(client5);
+	assert(aggregater->convertClient(msgId, &clientMsgId) == nullptr && clientMsgId == 0);
+
+	printf("[ OK ]\n");
+}
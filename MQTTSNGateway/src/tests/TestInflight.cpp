@@ -0,0 +1,207 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation
+ **************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <cassert>
+#include "TestInflight.h"
+#include "MQTTSNGateway.h"
+#include "MQTTSNGWClient.h"
+
+using namespace std;
+using namespace MQTTSNGW;
+
+static void send(Client* client, EventQue* que, uint16_t msgId, int qos)
+{
+	MQTTSN_topicid topic;
+	topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+	topic.data.id = 1;
+	MQTTSNPacket* packet = new MQTTSNPacket();
+	packet->setPUBLISH(0, qos, 0, msgId, topic, (uint8_t*) "payload", 7);
+	client->getInflightWindow()->send(packet, que);
+}
+
+/* type and msgId of the next packet to the client */
+static int next(EventQue* que, uint16_t* msgId)
+{
+	if (que->size() == 0)
+	{
+		return -1;
+	}
+	Event* ev = que->timedwait(0);
+	MQTTSNPacket* packet = ev->getMQTTSNPacket();
+	int type = packet->getType();
+	*msgId = packet->getMsgId();
+	delete ev;
+	return type;
+}
+
+static bool sendUp(Client* client, EventQue* que, uint16_t msgId)
+{
+	Publish pub = MQTTPacket_Publish_Initializer;
+	pub.header.bits.qos = 1;
+	pub.topic = (char*) "a/b";
+	pub.topiclen = 3;
+	pub.msgId = msgId;
+	pub.payload = (char*) "payload";
+	pub.payloadlen = 7;
+	MQTTGWPacket* packet = new MQTTGWPacket();
+	packet->setPUBLISH(&pub);
+	return client->getUplinkWindow()->send(packet, msgId, que);
+}
+
+TestInflight::TestInflight()
+{
+
+}
+
+TestInflight::~TestInflight()
+{
+
+}
+
+void TestInflight::test(void)
+{
+	RetransmitStat stat0;
+	RetransmitStat stat1;
+	EventQue que;
+	Client* client = new Client();
+	InflightWindow* window = client->getInflightWindow();
+	uint16_t msgId = 0;
+
+	Retransmitter::getStat(&stat0);
+	Retransmitter::setWindowSize(2);
+
+	/* QoS0 is not kept */
+	send(client, &que, 0, 0);
+	assert(next(&que, &msgId) == MQTTSN_PUBLISH);
+	assert(window->getCount() == 0);
+
+	/* the third PUBLISH waits for a room */
+	send(client, &que, 1, 1);
+	send(client, &que, 2, 2);
+	send(client, &que, 3, 1);
+	assert(window->getCount() == 2);
+	assert(next(&que, &msgId) == MQTTSN_PUBLISH && msgId == 1);
+	assert(next(&que, &msgId) == MQTTSN_PUBLISH && msgId == 2);
+	assert(next(&que, &msgId) == -1);
+	assert(!Retransmitter::isEmpty());
+
+	/* an acknowledgement of a wrong type is ignored */
+	window->acknowledge(MQTTSN_PUBREC, 1, &que);
+	assert(window->getCount() == 2);
+
+	window->acknowledge(MQTTSN_PUBACK, 1, &que);
+	assert(next(&que, &msgId) == MQTTSN_PUBLISH && msgId == 3);
+	assert(window->getCount() == 2);
+
+	/* QoS2 keeps the slot until PUBCOMP */
+	window->acknowledge(MQTTSN_PUBREC, 2, &que);
+	assert(window->getCount() == 2);
+	assert(window->sendPubrel(2, &que));
+	assert(next(&que, &msgId) == MQTTSN_PUBREL && msgId == 2);
+	assert(!window->sendPubrel(4, &que));
+	window->acknowledge(MQTTSN_PUBCOMP, 2, &que);
+	window->acknowledge(MQTTSN_PUBACK, 3, &que);
+	assert(window->getCount() == 0);
+	assert(Retransmitter::isEmpty());
+
+	/* the round trip time shortens the timeout */
+	assert(window->getTimeout() == RETRANSMIT_RTO_MIN_STABLE);
+
+	/* a lost client keeps PUBLISHes, which are sent again when it connects or resumes the session */
+	send(client, &que, 5, 1);
+	assert(next(&que, &msgId) == MQTTSN_PUBLISH && msgId == 5);
+	client->keepSession(10);
+	window->resume(&que);
+	assert(next(&que, &msgId) == -1 && window->getCount() == 1);
+	client->updateStatus(Cstat_Lost);
+	window->resume(&que);
+	assert(next(&que, &msgId) == -1 && window->getCount() == 1);
+	client->connackSended(MQTTSN_RC_ACCEPTED);
+	window->resume(&que);
+	assert(next(&que, &msgId) == MQTTSN_PUBLISH && msgId == 5 && window->getCount() == 1);
+
+	window->clear();
+	assert(window->getCount() == 0);
+	assert(Retransmitter::isEmpty());
+
+	Retransmitter::getStat(&stat1);
+	assert(stat1.sent == stat0.sent + 5);
+	assert(stat1.acked == stat0.acked + 4);
+	assert(stat1.queued == stat0.queued + 1);
+	assert(stat1.expired == stat0.expired + 1);
+
+	while (next(&que, &msgId) != -1)
+	{
+	}
+
+	/* PUBLISHes to the broker wait for PUBACKs */
+	UplinkWindow* uplink = client->getUplinkWindow();
+	for (int i = 1; i <= 2 + MAX_SAVED_PUBLISH; i++)
+	{
+		assert(sendUp(client, &que, i));
+	}
+	assert(!sendUp(client, &que, 100));
+	assert(que.size() == 2);
+	assert(sendUp(client, &que, 1));
+	assert(que.size() == 3);
+	uplink->acknowledge(2, &que);
+	assert(que.size() == 4);
+	assert(uplink->getCount() == 2 + MAX_SAVED_PUBLISH - 1);
+	uplink->clear();
+	assert(uplink->getCount() == 0);
+
+	/* PUBLISHes wait for the REGACK of the topic. REGISTERs of topics are sent without waiting */
+	while (que.size() > 0)
+	{
+		delete que.timedwait(0);
+	}
+	WaitREGACKPacketList* regs = client->getWaitREGACKPacketList();
+	Topic* t1 = client->getTopics()->add("w/aa");
+	Topic* t2 = client->getTopics()->add("w/bb");
+	regs->send(t1, &que);
+	regs->send(t2, &que);
+	assert(regs->getCount() == 2 && regs->isRegistering(t1->getTopicId()));
+	uint16_t regId1 = 0;
+	uint16_t regId2 = 0;
+	assert(next(&que, &regId1) == MQTTSN_REGISTER);
+	assert(next(&que, &regId2) == MQTTSN_REGISTER && regId1 != regId2);
+	assert(!Retransmitter::isEmpty());
+
+	/* the oldest PUBLISH is discarded when MAX_SAVED_PUBLISH PUBLISHes wait */
+	MQTTSN_topicid topic;
+	topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+	topic.data.id = t1->getTopicId();
+	for (int i = 1; i <= MAX_SAVED_PUBLISH + 2; i++)
+	{
+		MQTTSNPacket* packet = new MQTTSNPacket();
+		packet->setPUBLISH(0, 0, 0, (uint16_t) i, topic, (uint8_t*) "payload", 7);
+		assert(regs->setPacket(packet, t1->getTopicId()));
+	}
+	assert(!regs->setPacket(nullptr, 100));
+	assert(que.size() == 0);
+	regs->acknowledge(regId1, &que);
+	assert(que.size() == MAX_SAVED_PUBLISH && regs->getCount() == 1 && !regs->isRegistering(t1->getTopicId()));
+	uint16_t pubId = 0;
+	assert(next(&que, &pubId) == MQTTSN_PUBLISH && pubId == 3);
+	regs->clear();
+	assert(regs->getCount() == 0 && Retransmitter::isEmpty());
+
+	que.clear();
+	delete client;
+	Retransmitter::setWindowSize(MAX_INFLIGHTMESSAGES);
+	printf("[ OK ]\n");
+}
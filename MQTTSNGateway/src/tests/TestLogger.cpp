@@ -0,0 +1,79 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation
+ **************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <cassert>
+#include "TestLogger.h"
+
+using namespace std;
+using namespace MQTTSNGW;
+
+TestLogger::TestLogger()
+{
+
+}
+
+TestLogger::~TestLogger()
+{
+
+}
+
+void TestLogger::test(void)
+{
+	LogRing* ring = new LogRing();
+	char* rec = new char[PROCESS_LOG_BUFFER_SIZE + 1];
+	char* buf = new char[PROCESS_LOG_BUFFER_SIZE + 1];
+
+	/* empty */
+	assert(ring->get(buf) == 0);
+
+	/* records are read in order */
+	ring->put("abc", 3);
+	ring->put("defgh", 5);
+	assert(ring->get(buf) == 3 && strcmp(buf, "abc") == 0);
+	assert(ring->get(buf) == 5 && strcmp(buf, "defgh") == 0);
+	assert(ring->get(buf) == 0);
+
+	/* records wrap around the end of the ring */
+	for ( int i = 0; i < PROCESS_LOG_RING_SIZE / 1000 * 3; i++ )
+	{
+		memset(rec, 'a' + i % 26, 999);
+		rec[999] = 0;
+		ring->put(rec, 999);
+		assert(ring->get(buf) == 999 && strcmp(buf, rec) == 0);
+	}
+
+	/* a record which doesn't fit is dropped */
+	memset(rec, 'x', PROCESS_LOG_BUFFER_SIZE);
+	rec[PROCESS_LOG_BUFFER_SIZE] = 0;
+	int cnt = 0;
+	while ( ring->getDropped() == 0 )
+	{
+		ring->put(rec, PROCESS_LOG_BUFFER_SIZE);
+		cnt++;
+	}
+	assert(cnt == PROCESS_LOG_RING_SIZE / (PROCESS_LOG_BUFFER_SIZE + 2) + 1);
+	for ( int i = 0; i < cnt - 1; i++ )
+	{
+		assert(ring->get(buf) == PROCESS_LOG_BUFFER_SIZE && strcmp(buf, rec) == 0);
+	}
+	assert(ring->get(buf) == 0);
+
+	delete[] rec;
+	delete[] buf;
+	delete ring;
+	printf("[ OK ]\n");
+}
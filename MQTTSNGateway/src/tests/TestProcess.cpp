@@ -21,6 +21,15 @@
 #include "TestQue.h"
 #include "TestTree23.h"
 #include "TestTopicIdMap.h"
+#include "TestAggregateTopicTable.h"
+#include "TestBufferPool.h"
+#include "TestLogger.h"
+#include "TestSleepStore.h"
+#include "TestInflight.h"
+#include "TestRetainedCache.h"
+#include "TestSessionStore.h"
+#include "TestConnectionHandler.h"
+#include "TestClientSession.h"
 #include "MQTTSNGWProcess.h"
 #include "MQTTSNGWClient.h"
 #include "MQTTSNGWPacket.h"
@@ -108,6 +117,62 @@ void TestProcess::run(void)
 	testMap->test();
 	delete testMap;
 
+	/* Test AggregateTopicTable */
+    printf("Test  AggregateTopic ");
+	TestAggregateTopicTable* testAggregate = new TestAggregateTopicTable();
+	testAggregate->test();
+	delete testAggregate;
+
+	/* Test BufferPool */
+    printf("Test  BufferPool     ");
+	TestBufferPool* testPool = new TestBufferPool();
+	testPool->test();
+	delete testPool;
+
+	/* Test Logger */
+    printf("Test  Logger         ");
+	TestLogger* testLogger = new TestLogger();
+	testLogger->test();
+	delete testLogger;
+
+	/* Test SleepStore */
+    printf("Test  SleepStore     ");
+	TestSleepStore* testSleep = new TestSleepStore();
+	testSleep->test();
+	delete testSleep;
+
+	/* Test Inflight */
+    printf("Test  Inflight       ");
+	TestInflight* testInflight = new TestInflight();
+	testInflight->test();
+	delete testInflight;
+
+	/* Test RetainedCache */
+    printf("Test  RetainedCache  ");
+	TestRetainedCache* testRetained = new TestRetainedCache();
+	testRetained->test();
+	delete testRetained;
+
+	/* Test SessionStore */
+    printf("Test  SessionStore   ");
+	TestSessionStore* testSession = new TestSessionStore(this);
+	testSession->test();
+	delete testSession;
+
+	/* Test ClientSession */
+	getGWParams()->maxClients = 20;
+	getClientList()->initialize(false);
+    printf("Test  ClientSession  ");
+	TestClientSession* testClientSession = new TestClientSession(this);
+	testClientSession->test();
+	delete testClientSession;
+
+	/* Test ConnectionHandler */
+    printf("Test  Connection     ");
+	TestConnectionHandler* testConnection = new TestConnectionHandler(this);
+	testConnection->test();
+	delete testConnection;
+
 	/* Test EventQue */
 	/*
 	printf("Test  EventQue       ");
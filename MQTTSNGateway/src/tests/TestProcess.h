@@ -21,7 +21,7 @@
 #define EVENT_CNT 10
 namespace MQTTSNGW
 {
-class TestProcess: public MultiTaskProcess{
+class TestProcess: public Gateway{
 public:
 	TestProcess();
 	~TestProcess();
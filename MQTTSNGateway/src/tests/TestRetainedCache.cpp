@@ -0,0 +1,127 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation
+ **************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <cassert>
+#include "TestRetainedCache.h"
+#include "MQTTSNGateway.h"
+#include "MQTTSNGWClient.h"
+
+using namespace std;
+using namespace MQTTSNGW;
+
+static void publish(RetainedCache* cache, const char* topic, const char* payload, int retain)
+{
+	Publish pub = MQTTPacket_Publish_Initializer;
+	pub.header.bits.retain = retain;
+	pub.topic = (char*) topic;
+	pub.topiclen = strlen(topic);
+	pub.payload = (char*) payload;
+	pub.payloadlen = strlen(payload);
+	cache->update(&pub);
+}
+
+static bool answer(RetainedCache* cache, Client* client, const char* topic, EventQue* que, bool duplicated = false)
+{
+	MQTTSN_topicid id;
+	id.type = MQTTSN_TOPIC_TYPE_NORMAL;
+	id.data.id = 1;
+	return cache->answer(client, topic, strlen(topic), &id, que, duplicated);
+}
+
+TestRetainedCache::TestRetainedCache()
+{
+
+}
+
+TestRetainedCache::~TestRetainedCache()
+{
+
+}
+
+void TestRetainedCache::test(void)
+{
+	RetainedCache cache;
+	RetainedCacheStat stat;
+	EventQue que;
+	Client* client = new Client();
+
+	cache.initialize(3 * (RETAINED_ENTRY_OVERHEAD + 8), 0);
+
+	/* retained messages are cached, others remove them */
+	publish(&cache, "cfg/a", "one", 1);
+	assert(answer(&cache, client, "cfg/a", &que));
+	assert(que.size() == 1);
+	Event* ev = que.timedwait(0);
+	assert(ev->getMQTTSNPacket()->getType() == MQTTSN_PUBLISH);
+	delete ev;
+	publish(&cache, "cfg/a", "two", 0);
+	assert(!answer(&cache, client, "cfg/a", &que));
+	publish(&cache, "cfg/b", "one", 1);
+	publish(&cache, "cfg/b", "", 1);
+	assert(!answer(&cache, client, "cfg/b", &que));
+	assert(!answer(&cache, client, "cfg/+", &que));
+
+	/* the copy of the broker is dropped once, only for the client which got the value on its SUBACK */
+	Publish pub = MQTTPacket_Publish_Initializer;
+	pub.header.bits.retain = 1;
+	pub.topic = (char*) "cfg/c";
+	pub.topiclen = 5;
+	pub.payload = (char*) "one";
+	pub.payloadlen = 3;
+	cache.update(&pub);
+	assert(!cache.isDelivered(client, &pub));
+	assert(!cache.isDelivered(client, &pub));
+	assert(answer(&cache, client, "cfg/c", &que));
+	assert(!cache.isDelivered(client, &pub));
+	cache.getStat(&stat);
+	uint32_t bytes = stat.bytes;
+	assert(answer(&cache, client, "cfg/c", &que, true));
+	cache.getStat(&stat);
+	assert(stat.bytes == bytes + RETAINED_CLIENT_OVERHEAD);
+	assert(cache.isDelivered(client, &pub));
+	assert(!cache.isDelivered(client, &pub));
+	cache.getStat(&stat);
+	assert(stat.bytes == bytes);
+	assert(answer(&cache, client, "cfg/c", &que, true));
+	cache.forget(client);
+	assert(!cache.isDelivered(client, &pub));
+	cache.getStat(&stat);
+	assert(stat.bytes == bytes);
+	pub.payload = (char*) "two";
+	cache.update(&pub);
+	assert(!cache.isDelivered(client, &pub));
+
+	/* the least recently used one is evicted */
+	publish(&cache, "cfg/d", "one", 1);
+	publish(&cache, "cfg/e", "one", 1);
+	assert(answer(&cache, client, "cfg/c", &que));
+	publish(&cache, "cfg/f", "one", 1);
+	assert(!answer(&cache, client, "cfg/d", &que));
+	assert(answer(&cache, client, "cfg/c", &que));
+
+	cache.getStat(&stat);
+	assert(stat.entries == 3);
+	assert(stat.evicted == 1);
+	assert(stat.invalidated == 2);
+	assert(stat.suppressed == 1);
+	assert(stat.hits == 6);
+	assert(stat.misses == 3);
+
+	que.clear();
+	delete client;
+	printf("[ OK ]\n");
+}
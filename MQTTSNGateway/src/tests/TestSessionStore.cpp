@@ -0,0 +1,181 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation
+ **************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <cassert>
+#include "TestSessionStore.h"
+#include "MQTTSNGWSessionStore.h"
+#include "MQTTSNGWClientList.h"
+#include "MQTTGWPacket.h"
+
+using namespace std;
+using namespace MQTTSNGW;
+
+#define SESSION_TEST_FILE  "./testSession.dat"
+#define SESSION_COPY_FILE  "./testSession.copy"
+#define SESSION_TEST_SIZE  (4096)
+
+static Client* create(ClientList* list, const char* clientId)
+{
+	MQTTSNString id = MQTTSNString_initializer;
+	id.cstring = (char*) clientId;
+	Client* client = list->createClient(nullptr, &id, TRANSPEARENT_TYPE);
+	client->setSessionStatus(false);
+	return client;
+}
+
+static Client* find(ClientList* list, const char* clientId)
+{
+	MQTTSNString id = MQTTSNString_initializer;
+	id.cstring = (char*) clientId;
+	return list->getClient(&id);
+}
+
+static void save(Client* client, const char* topic, int payloadlen)
+{
+	static char payload[SESSION_TEST_SIZE];
+	MQTTGWPacket packet;
+	Publish pub = MQTTPacket_Publish_Initializer;
+	pub.header.bits.qos = 1;
+	pub.topic = (char*) topic;
+	pub.topiclen = strlen(topic);
+	pub.msgId = 1;
+	pub.payload = payload;
+	pub.payloadlen = payloadlen;
+	packet.setPUBLISH(&pub);
+	assert(client->setClientSleepPacket(&packet) == 1);
+}
+
+static int payloadLength(Client* client)
+{
+	Publish pub = MQTTPacket_Publish_Initializer;
+	MQTTGWPacket* packet = client->getClientSleepPacket();
+	assert(packet);
+	packet->getPUBLISH(&pub);
+	return pub.payloadlen;
+}
+
+/*
+ *  Restore a copy of the file into a new ClientList as the gateway does when it restarts.
+ */
+static ClientList* reload(Gateway* gw, int expected)
+{
+	char buf[SESSION_TEST_SIZE];
+	size_t len;
+	FILE* src = fopen(SESSION_TEST_FILE, "rb");
+	FILE* dst = fopen(SESSION_COPY_FILE, "wb");
+	assert(src && dst);
+	while ((len = fread(buf, 1, sizeof(buf), src)) > 0)
+	{
+		assert(fwrite(buf, 1, len, dst) == len);
+	}
+	fclose(src);
+	fclose(dst);
+
+	SessionStore store;
+	ClientList* list = new ClientList(gw);
+	list->initialize(false);
+	store.open(SESSION_COPY_FILE, SESSION_TEST_SIZE);
+	assert(store.restore(list, false) == expected);
+	store.close();
+	unlink(SESSION_COPY_FILE);
+	return list;
+}
+
+TestSessionStore::TestSessionStore(Gateway* gw)
+{
+	_gateway = gw;
+}
+
+TestSessionStore::~TestSessionStore()
+{
+
+}
+
+void TestSessionStore::test(void)
+{
+	char name[32];
+	SessionStore store;
+
+	unlink(SESSION_TEST_FILE);
+	_gateway->getGWParams()->maxClients = 10;
+	ClientList* list = new ClientList(_gateway);
+	list->initialize(false);
+
+	/* a session which is not cleaned is appended and restored */
+	Client* client1 = create(list, "client1");
+	client1->getTopics()->add("test/a", 0);
+	save(client1, "test/a", 10);
+	Client* client2 = create(list, "client2");
+	client2->setSessionStatus(true);
+
+	store.open(SESSION_TEST_FILE, SESSION_TEST_SIZE);
+	assert(store.restore(list, false) == 0);
+	store.sync(list);
+
+	ClientList* list2 = reload(_gateway, 1);
+	Client* client = find(list2, "client1");
+	assert(client && !client->isCleanSession());
+	assert(client->getTopics()->getCount() == 1);
+	assert(payloadLength(client) == 10);
+	assert(find(list2, "client2") == nullptr);
+	delete list2;
+
+	/* records which fill the file are compacted. the latest record of each client survives */
+	client2->setSessionStatus(false);
+	save(client2, "test/b", 1000);
+	for (int i = 0; i < 20; i++)
+	{
+		snprintf(name, sizeof(name), "test/a/%d", i);
+		client1->getTopics()->add(name, 0);
+		store.sync(list);
+	}
+
+	list2 = reload(_gateway, 2);
+	client = find(list2, "client1");
+	assert(client && client->getTopics()->getCount() == 21);
+	assert(payloadLength(client) == 10);
+	client = find(list2, "client2");
+	assert(client && payloadLength(client) == 1000);
+	delete list2;
+
+	/* the file grows for a record which live records don't leave room for. other sessions are kept */
+	Client* client3 = create(list, "client3");
+	save(client3, "test/c", SESSION_TEST_SIZE);
+	client1->getTopics()->add("test/a/last", 0);
+	store.sync(list);
+
+	list2 = reload(_gateway, 3);
+	client = find(list2, "client1");
+	assert(client && client->getTopics()->getCount() == 22);
+	client = find(list2, "client3");
+	assert(client && payloadLength(client) == SESSION_TEST_SIZE);
+	delete list2;
+
+	/* a session which is cleaned is deleted */
+	client1->setSessionStatus(true);
+	store.sync(list);
+	list2 = reload(_gateway, 2);
+	assert(find(list2, "client1") == nullptr);
+	assert(find(list2, "client2") && find(list2, "client3"));
+	delete list2;
+
+	store.close();
+	delete list;
+	unlink(SESSION_TEST_FILE);
+	printf("[ OK ]\n");
+}
@@ -0,0 +1,114 @@
+/**************************************************************************************
+ * Copyright (c) 2016, Tomoaki Yamaguchi
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Tomoaki Yamaguchi - initial API and implementation
+ **************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <cassert>
+#include "TestSleepStore.h"
+#include "MQTTGWPacket.h"
+
+using namespace std;
+using namespace MQTTSNGW;
+
+static int post(SleepPacketQue* que, const char* topic, int qos)
+{
+	MQTTGWPacket packet;
+	Publish pub = MQTTPacket_Publish_Initializer;
+	pub.header.bits.qos = qos;
+	pub.topic = (char*) topic;
+	pub.topiclen = strlen(topic);
+	pub.msgId = 1;
+	pub.payload = (char*) "payload";
+	pub.payloadlen = 7;
+	packet.setPUBLISH(&pub);
+	return que->post(&packet);
+}
+
+static bool isTopic(MQTTGWPacket* packet, const char* topic)
+{
+	Publish pub = MQTTPacket_Publish_Initializer;
+	packet->getPUBLISH(&pub);
+	return pub.topiclen == (int) strlen(topic) && memcmp(pub.topic, topic, pub.topiclen) == 0;
+}
+
+TestSleepStore::TestSleepStore()
+{
+
+}
+
+TestSleepStore::~TestSleepStore()
+{
+
+}
+
+void TestSleepStore::test(void)
+{
+	SleepStoreStat stat0;
+	SleepStoreStat stat1;
+	SleepPacketQue que;
+	SleepPacketQue que2;
+
+	SleepStore::getStat(&stat0);
+
+	/* QoS0 keeps the latest value of a topic */
+	SleepStore::setBudget(0, 0);
+	assert(post(&que, "a", 0) == 1);
+	assert(post(&que, "b", 0) == 1);
+	assert(post(&que, "a", 0) == 1);
+	assert(que.getCount() == 2);
+	assert(isTopic(que.getPacket(), "b"));
+	SleepStore::getStat(&stat1);
+	assert(stat1.coalesced == stat0.coalesced + 1);
+	assert(stat1.bytes == stat0.bytes + que.getBytes());
+
+	/* the oldest QoS0 is discarded to make room within the quota */
+	uint32_t bytes = que.getBytes();
+	assert(post(&que, "x", 1) == 1);
+	uint32_t qos1Size = que.getBytes() - bytes;
+	SleepStore::setBudget(0, qos1Size * 3);
+	assert(post(&que, "y", 1) == 1);
+	assert(que.getCount() == 3);
+	assert(isTopic(que.getPacket(), "a"));
+	assert(post(&que, "z", 1) == 1);
+	assert(isTopic(que.getPacket(), "x"));
+
+	/* QoS1 is rejected when no QoS0 can be discarded */
+	assert(post(&que, "w", 1) == 0);
+	assert(que.getCount() == 3);
+	SleepStore::getStat(&stat1);
+	assert(stat1.dropped == stat0.dropped + 2);
+	assert(stat1.rejected == stat0.rejected + 1);
+
+	/* the global budget */
+	SleepStore::setBudget(stat1.bytes, 0);
+	assert(post(&que2, "a", 0) == 0);
+	assert(que2.getCount() == 0);
+
+	/* popped packets are owned by the caller */
+	MQTTGWPacket* packet = que.getPacket();
+	que.pop();
+	delete packet;
+	assert(que.getCount() == 2);
+	assert(post(&que2, "a", 0) == 1);
+
+	que.clear();
+	que2.clear();
+	SleepStore::getStat(&stat1);
+	assert(stat1.bytes == stat0.bytes);
+	assert(stat1.packets == stat0.packets);
+
+	SleepStore::setBudget(DEFAULT_SLEEPSTORE_SIZE, DEFAULT_SLEEPSTORE_QUOTA);
+	printf("[ OK ]\n");
+}
@@ -205,6 +205,34 @@ void TestTopicIdMap::test(void)
     {
         assert(!testGetElement(id[i], id[i], &topicId));
     }
+
+    /* msgIds which collide in the table */
+    topicId.type = MQTTSN_TOPIC_TYPE_NORMAL;
+    for ( int i = 0; i < MAX_INFLIGHTMESSAGES; i++ )
+    {
+        _map->add((uint16_t)(i * TOPICIDMAP_SIZE + 1), i + 1, &topicId);
+    }
+    assert(_map->getCount() == MAX_INFLIGHTMESSAGES);
+
+    _map->erase(TOPICIDMAP_SIZE + 1);
+    assert(!testGetElement(TOPICIDMAP_SIZE + 1, 2, &topicId));
+    for ( int i = 2; i < MAX_INFLIGHTMESSAGES; i++ )
+    {
+        assert(testGetElement((uint16_t)(i * TOPICIDMAP_SIZE + 1), i + 1, &topicId));
+    }
+
+    /* erase a msgId which is not in the map */
+    _map->erase(TOPICIDMAP_SIZE + 1);
+    _map->erase(0xfffe);
+    assert(_map->getCount() == MAX_INFLIGHTMESSAGES - 1);
+
+    /* add an existing msgId again */
+    _map->add(1, 100, &topicId);
+    assert(testGetElement(1, 100, &topicId));
+    assert(_map->getCount() == MAX_INFLIGHTMESSAGES - 1);
+
+    _map->clear();
+    assert(_map->getCount() == 0);
 	printf("[ OK ]\n");
 }
 